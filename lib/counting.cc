@@ -2,10 +2,12 @@
 #include "counting.hh"
 #include "hashbits.hh"
 #include "parsers.hh"
+#include "threads.hh"
 
 #include "zlib-1.2.3/zlib.h"
 #include <math.h>
 #include <algorithm>
+#include <sstream>
 
 using namespace std;
 using namespace khmer;
@@ -16,43 +18,18 @@ MinMaxTable * CountingHash::fasta_file_to_minmax(const std::string &inputfile,
 					      CallbackFn callback,
 					      void * callback_data)
 {
-   IParser* parser = IParser::get_parser(inputfile.c_str());
-   Read read;
-   string seq = "";
-   unsigned long long read_num = 0;
-
-   MinMaxTable * mmt = new MinMaxTable(total_reads);
-
-   while(!parser->is_complete()) {
-     read = parser->get_next_read();
-     seq = read.seq;
-
-     bool valid_read = true;
-     if (!readmask || readmask->get(read_num)) {
-       valid_read = check_read(seq);
-
-       if (valid_read) {
-         BoundedCounterType minval = get_min_count(seq);
-	 BoundedCounterType maxval = get_max_count(seq);
-
-	 mmt->add_min(read_num, minval);
-	 mmt->add_max(read_num, maxval);
-       }
-     }
+  MinMaxTable * mmt = new MinMaxTable(total_reads);
 
-     seq.clear();
-     read_num += 1;
+  ReadStatsScanner scanner(*this, SCAN_MINMAX);
+  scanner.minmax = mmt;
+  scanner.readmask = readmask;
 
-     // run callback, if specified
-     if (read_num % CALLBACK_PERIOD == 0 && callback) {
-       try {
-         callback("fasta_file_to_minmax", callback_data, read_num, 0);
-       } catch (...) {
-         delete mmt;
-	 throw;
-       }
-     }
-   }
+  try {
+    scanner.scan(inputfile, 1, callback, callback_data);
+  } catch (...) {
+    delete mmt;
+    throw;
+  }
 
   return mmt;
 }
@@ -113,51 +90,21 @@ ReadMaskTable * CountingHash::filter_fasta_file_limit_n(const std::string &reads
                                                      CallbackFn callback,
                                                      void * callback_data)
 {
-   IParser* parser = IParser::get_parser(readsfile.c_str());
-   string seq;
-   Read read;
-   unsigned long long read_num = 0;
-   const unsigned long long tablesize = minmax.get_tablesize();
-
-   ReadMaskTable * readmask = new ReadMaskTable(tablesize);
-
-   if (old_readmask) {
-     readmask->merge(*old_readmask);
+   ReadMaskTable * readmask = new ReadMaskTable(minmax.get_tablesize());
+
+   ReadFilter filter(*this);
+   filter.limit_threshold = threshold;
+   filter.limit_n = n;
+   filter.old_readmask = old_readmask;
+   filter.readmask = readmask;
+
+   try {
+      filter.filter(readsfile, "", 1, callback, callback_data);
+   } catch (...) {
+      delete readmask;
+      throw;
    }
 
-   while(!parser->is_complete()) {
-      read = parser->get_next_read();
-      seq = read.seq;
-     
-      if (readmask->get(read_num)) {
-         int numPos = seq.length() - _ksize + 1;
-         unsigned int n_met = 0;
- 
-         for (int i = 0; i < numPos; i++)  {
-            string kmer = seq.substr(i, _ksize);
-            if ((int)this->get_count(kmer.c_str()) >= threshold)  {
-               n_met++;
-            }
-         }
- 
-         if (n_met < n)  {
-            readmask->set(read_num, false);
-         }
- 
-         read_num++;
- 
-         // run callback, if specified
-         if (read_num % CALLBACK_PERIOD == 0 && callback) {
-            try {
-               callback("filter_fasta_file_limit_n", callback_data, read_num, 0);
-            } catch (...) {
-               delete readmask;
-               throw;
-            }
-         }
-      }
-   }
-         
    return readmask;
 }
 
@@ -218,59 +165,19 @@ ReadMaskTable * CountingHash::filter_fasta_file_run(const std::string &inputfile
 						 void * callback_data)
 
 {
-   IParser* parser = IParser::get_parser(inputfile.c_str());
-   string seq;
-   Read read;
-   unsigned long long read_num = 0;
-   unsigned long long n_kept = 0;
    ReadMaskTable * readmask = new ReadMaskTable(total_reads);
 
-   if (old_readmask) {
-     readmask->merge(*old_readmask);
-   }
-
-   while(parser->is_complete()) {
-      read = parser->get_next_read();
-      seq = read.seq;
-
-      if (readmask->get(read_num)) {
-         bool keep = false;
-	   
-         const unsigned int length = seq.length();
-         const char * s = seq.c_str();
-         unsigned int this_run = 0;
-
-         for (unsigned int i = 0; i < length - _ksize + 1; i++) {
-            HashIntoType count = this->get_count(s);
-	    this_run++;
-	    if (count < threshold) {
-	       this_run = 0;
-	    } else if (this_run >= runlength) {
-	       keep = true;
-	       break;
-	    }
-	    s++;
-         }
-
-         if (!keep) {
-            readmask->set(read_num, false);
-         } else {
-            n_kept++;
-         }
-      }
-
-      seq.clear();
-
-      read_num += 1;
-
-      // run callback, if specified
-      if (read_num % CALLBACK_PERIOD == 0 && callback) {
-         try {
-            callback("filter_fasta_file_run", callback_data, read_num,n_kept);
-         } catch (...) {
-            throw;
-         }
-      }
+   ReadFilter filter(*this);
+   filter.run_threshold = threshold;
+   filter.runlength = runlength;
+   filter.old_readmask = old_readmask;
+   filter.readmask = readmask;
+
+   try {
+      filter.filter(inputfile, "", 1, callback, callback_data);
+   } catch (...) {
+      delete readmask;
+      throw;
    }
 
    return readmask;
@@ -283,26 +190,10 @@ ReadMaskTable * CountingHash::filter_fasta_file_run(const std::string &inputfile
 void CountingHash::output_fasta_kmer_pos_freq(const std::string &inputfile,
                                            const std::string &outputfile)
 {
-   IParser* parser = IParser::get_parser(inputfile.c_str());
-   ofstream outfile;
-   outfile.open(outputfile.c_str());
-   string seq;
-   Read read;
+  ReadStatsScanner scanner(*this, SCAN_POSITION_FREQ);
+  scanner.pos_freq_filename = outputfile;
 
-   while(!parser->is_complete()) {
-      read = parser->get_next_read();
-      seq = read.seq;
-
-      int numPos = seq.length() - _ksize + 1;
-
-      for (int i = 0; i < numPos; i++)  {
-         string kmer = seq.substr(i, _ksize);
-         outfile << (int)get_count(kmer.c_str()) << " ";
-      }
-      outfile << endl;
-   }
-
-   outfile.close();
+  scanner.scan(inputfile);
 }
 
 
@@ -478,57 +369,19 @@ HashIntoType * CountingHash::fasta_count_kmers_by_position(const std::string &in
 					     CallbackFn callback,
 					     void * callback_data)
 {
-   unsigned long long *counts = new unsigned long long[max_read_len];
+  ReadStatsScanner scanner(*this, SCAN_POSITION_COUNTS);
+  scanner.readmask = readmask;
+  scanner.max_read_len = max_read_len;
+  scanner.limit_by_count = limit_by_count;
 
-   for (unsigned int i = 0; i < max_read_len; i++) {
-     counts[i] = 0;
-   }
+  scanner.scan(inputfile, 1, callback, callback_data);
 
-   Read read;
-   IParser* parser = IParser::get_parser(inputfile.c_str());
-   string name;
-   string seq;
-   unsigned long long read_num = 0;
-
-   while(!parser->is_complete()) {
-      read = parser->get_next_read();
-
-      seq = read.seq;
-      bool valid_read = true;
-	 
-      if (!readmask || readmask->get(read_num)) {
-	valid_read = check_read(seq);
-
-	if (valid_read) {
-	  for (unsigned int i = 0; i < seq.length() - _ksize + 1; i++) {
-	    string kmer = seq.substr(i, i + _ksize);
-	    BoundedCounterType n = get_count(kmer.c_str());
-	    
-	    if (limit_by_count == 0 || n == limit_by_count) {
-	      if (i < max_read_len) {
-		counts[i]++;
-	      }
-	    }
-	  }
-	}
- 
-	name.clear();
-	seq.clear();
-      }
-
-      read_num += 1;
-
-      // run callback, if specified
-      if (read_num % CALLBACK_PERIOD == 0 && callback) {
-         try {
-	    callback("fasta_file_count_kmers_by_position", callback_data, read_num, 0);
-         } catch (...) {
-	    throw;
-         }
-      }
-   }
+  HashIntoType * counts = new HashIntoType[max_read_len];
+  for (unsigned int i = 0; i < max_read_len; i++) {
+    counts[i] = scanner.position_counts[i];
+  }
 
-   return counts;
+  return counts;
 }
 
 void CountingHash::fasta_dump_kmers_by_abundance(const std::string &inputfile,
@@ -582,6 +435,438 @@ void CountingHash::fasta_dump_kmers_by_abundance(const std::string &inputfile,
   }
 }
 
+//
+// ReadStatsScanner
+//
+
+ReadStatsScanner::ReadStatsScanner(const CountingHash &ht,
+				   unsigned int stats) :
+  _ht(ht), _stats(stats), minmax(NULL), readmask(NULL), max_read_len(0),
+  limit_by_count(0), n_reads(0), abundance_hist(NULL), position_counts(NULL)
+{
+  ;
+}
+
+ReadStatsScanner::~ReadStatsScanner()
+{
+  _free_thread_results();
+
+  delete[] abundance_hist;
+  abundance_hist = NULL;
+  delete[] position_counts;
+  position_counts = NULL;
+}
+
+void ReadStatsScanner::_free_thread_results()
+{
+  for (unsigned int i = 0; i < _thread_hists.size(); i++) {
+    delete[] _thread_hists[i];
+  }
+  _thread_hists.clear();
+
+  for (unsigned int i = 0; i < _thread_positions.size(); i++) {
+    delete[] _thread_positions[i];
+  }
+  _thread_positions.clear();
+}
+
+// everything we need for one scan(), shared by all threads.
+struct _ScanState {
+  ReadStatsScanner * scanner;
+  ReadBatchSource * source;
+  OrderedWriter * writer;
+  CallbackFn callback;
+  void * callback_data;
+  unsigned long long n_done;
+};
+
+//
+// _scan_read: walk the k-mers of one read with the rolling hash, and
+// look each count up exactly once for all of the requested statistics.
+//
+
+void ReadStatsScanner::_scan_read(const std::string &seq,
+				  unsigned long long read_num,
+				  HashIntoType * hist,
+				  HashIntoType * positions,
+				  std::string * pos_freq) const
+{
+  bool is_valid = _ht.check_read(seq);
+
+  // only the per-read frequency output includes reads with non-ACGT.
+  if (!is_valid && !pos_freq) {
+    return;
+  }
+
+  BoundedCounterType min_count = MAX_COUNT, max_count = 0;
+  char buf[16];
+
+  KMerIterator kmers(seq.c_str(), _ht.ksize());
+  unsigned int pos = 0;
+
+  while(!kmers.done()) {
+    BoundedCounterType n = _ht.get_count(kmers.next());
+
+    if (pos_freq) {
+      sprintf(buf, "%d ", (int) n);
+      pos_freq->append(buf);
+    }
+
+    if (is_valid) {
+      if (n < min_count) { min_count = n; }
+      if (n > max_count) { max_count = n; }
+
+      if (hist) {
+	hist[n]++;
+      }
+      if (positions && pos < max_read_len &&
+	  (limit_by_count == 0 || n == limit_by_count)) {
+	positions[pos]++;
+      }
+    }
+    pos++;
+  }
+
+  if (is_valid && (_stats & SCAN_MINMAX)) {
+    minmax->add_min(read_num, min_count);
+    minmax->add_max(read_num, max_count);
+  }
+}
+
+void ReadStatsScanner::_scan_thread(unsigned int thread_id, void * data)
+{
+  _ScanState * state = (_ScanState *) data;
+  ReadStatsScanner * self = state->scanner;
+
+  HashIntoType * hist = NULL;
+  if (self->_stats & SCAN_ABUNDANCE) {
+    hist = self->_thread_hists[thread_id];
+  }
+  HashIntoType * positions = NULL;
+  if (self->_stats & SCAN_POSITION_COUNTS) {
+    positions = self->_thread_positions[thread_id];
+  }
+
+  ReadBatch batch;
+  std::string pos_freq;
+
+  while (state->source->next_batch(batch)) {
+    pos_freq.clear();
+
+    for (unsigned int i = 0; i < batch.reads.size(); i++) {
+      unsigned long long read_num = batch.first_read + i;
+
+      if (!self->readmask || self->readmask->get(read_num)) {
+	self->_scan_read(batch.reads[i].seq, read_num, hist, positions,
+			 state->writer ? &pos_freq : NULL);
+      }
+      if (state->writer) {
+	pos_freq += "\n";
+      }
+    }
+
+    if (state->writer) {
+      state->writer->write(batch.batch_num, pos_freq);
+    }
+
+    unsigned long long n_before = __sync_fetch_and_add(&state->n_done,
+						       batch.reads.size());
+    unsigned long long n_after = n_before + batch.reads.size();
+
+    // run callback, if specified -- from the calling thread only.
+    if (thread_id == 0 && state->callback &&
+	n_after / CALLBACK_PERIOD != n_before / CALLBACK_PERIOD) {
+      state->callback("scan_reads", state->callback_data, n_after, 0);
+    }
+  }
+}
+
+void ReadStatsScanner::scan(const std::string &filename,
+			    unsigned int n_threads,
+			    CallbackFn callback,
+			    void * callback_data)
+{
+  assert(!(_stats & SCAN_MINMAX) || minmax);
+  assert(!(_stats & SCAN_POSITION_FREQ) || pos_freq_filename.length());
+
+  if (n_threads < 1) { n_threads = 1; }
+
+  _free_thread_results();
+  for (unsigned int i = 0; i < n_threads; i++) {
+    if (_stats & SCAN_ABUNDANCE) {
+      HashIntoType * hist = new HashIntoType[MAX_BIGCOUNT + 1];
+      memset(hist, 0, sizeof(HashIntoType) * (MAX_BIGCOUNT + 1));
+      _thread_hists.push_back(hist);
+    }
+    if (_stats & SCAN_POSITION_COUNTS) {
+      HashIntoType * positions = new HashIntoType[max_read_len];
+      memset(positions, 0, sizeof(HashIntoType) * max_read_len);
+      _thread_positions.push_back(positions);
+    }
+  }
+
+  ReadBatchSource source(filename);
+
+  std::ofstream outfile;
+  OrderedWriter * writer = NULL;
+  if (_stats & SCAN_POSITION_FREQ) {
+    outfile.open(pos_freq_filename.c_str());
+    writer = new OrderedWriter(outfile);
+  }
+
+  _ScanState state;
+  state.scanner = this;
+  state.source = &source;
+  state.writer = writer;
+  state.callback = callback;
+  state.callback_data = callback_data;
+  state.n_done = 0;
+
+  try {
+    run_threads(n_threads, _scan_thread, &state, source.stop_flag());
+  } catch (...) {
+    delete writer;
+    throw;
+  }
+
+  delete writer;
+  n_reads = source.n_reads();
+
+  // reduce the per-thread results.
+  if (_stats & SCAN_ABUNDANCE) {
+    delete[] abundance_hist;
+    abundance_hist = _thread_hists[0];
+    _thread_hists[0] = NULL;
+
+    for (unsigned int t = 1; t < n_threads; t++) {
+      for (unsigned int i = 0; i <= MAX_BIGCOUNT; i++) {
+	abundance_hist[i] += _thread_hists[t][i];
+      }
+    }
+  }
+
+  if (_stats & SCAN_POSITION_COUNTS) {
+    delete[] position_counts;
+    position_counts = _thread_positions[0];
+    _thread_positions[0] = NULL;
+
+    for (unsigned int t = 1; t < n_threads; t++) {
+      for (unsigned int i = 0; i < max_read_len; i++) {
+	position_counts[i] += _thread_positions[t][i];
+      }
+    }
+  }
+
+  _free_thread_results();
+}
+
+unsigned long long ReadStatsScanner::n_kmers() const
+{
+  assert(abundance_hist);
+
+  unsigned long long n = 0;
+  for (unsigned int i = 0; i <= MAX_BIGCOUNT; i++) {
+    n += abundance_hist[i];
+  }
+  return n;
+}
+
+unsigned long long ReadStatsScanner::total_count() const
+{
+  assert(abundance_hist);
+
+  unsigned long long total = 0;
+  for (unsigned int i = 0; i <= MAX_BIGCOUNT; i++) {
+    total += abundance_hist[i] * i;
+  }
+  return total;
+}
+
+float ReadStatsScanner::mean() const
+{
+  return float(total_count()) / float(n_kmers());
+}
+
+float ReadStatsScanner::abs_deviation(float mean) const
+{
+  assert(abundance_hist);
+
+  double total = 0.0;
+  for (unsigned int i = 0; i <= MAX_BIGCOUNT; i++) {
+    if (abundance_hist[i]) {
+      total += fabs(mean - (double) i) * abundance_hist[i];
+    }
+  }
+  return total / float(n_kmers());
+}
+
+//
+// ReadFilter
+//
+
+ReadFilter::ReadFilter(const CountingHash &ht) :
+  _ht(ht), min_threshold(0), max_threshold(0), run_threshold(0),
+  runlength(0), limit_threshold(0), limit_n(0), old_readmask(NULL),
+  readmask(NULL), n_reads(0), n_kept(0)
+{
+  ;
+}
+
+//
+// keep_read: look each k-mer count up once, and stop as soon as the
+// answer is known.  Reads that are too short or contain non-ACGT are
+// dropped, as they have no min/max under fasta_file_to_minmax.
+//
+
+bool ReadFilter::keep_read(const std::string &seq) const
+{
+  bool need_max = max_threshold != 0;
+  bool need_run = run_threshold != 0;
+  bool need_limit = limit_threshold != 0 && limit_n != 0;
+
+  if (!_ht.check_read(seq)) {
+    return !(min_threshold || need_max || need_run || need_limit);
+  }
+
+  unsigned int this_run = 0, n_met = 0;
+
+  KMerIterator kmers(seq.c_str(), _ht.ksize());
+
+  while(!kmers.done()) {
+    BoundedCounterType n = _ht.get_count(kmers.next());
+
+    if (min_threshold && n < min_threshold) {
+      return false;
+    }
+    if (need_max && n >= max_threshold) {
+      need_max = false;
+    }
+    if (need_run) {
+      if (n < run_threshold) {
+	this_run = 0;
+      } else if (++this_run >= runlength) {
+	need_run = false;
+      }
+    }
+    if (need_limit && n >= limit_threshold && ++n_met >= limit_n) {
+      need_limit = false;
+    }
+
+    if (!min_threshold && !need_max && !need_run && !need_limit) {
+      return true;
+    }
+  }
+
+  return !need_max && !need_run && !need_limit;
+}
+
+struct _FilterState {
+  ReadFilter * filter;
+  ReadBatchSource * source;
+  OrderedWriter * writer;
+  CallbackFn callback;
+  void * callback_data;
+  unsigned long long n_done;
+  unsigned long long n_kept;
+};
+
+void ReadFilter::_filter_thread(unsigned int thread_id, void * data)
+{
+  _FilterState * state = (_FilterState *) data;
+  ReadFilter * self = state->filter;
+
+  ReadBatch batch;
+  std::string out;
+
+  while (state->source->next_batch(batch)) {
+    unsigned long long n_kept = 0;
+    out.clear();
+
+    for (unsigned int i = 0; i < batch.reads.size(); i++) {
+      unsigned long long read_num = batch.first_read + i;
+      const Read &read = batch.reads[i];
+
+      bool keep = true;
+      if (self->old_readmask && !self->old_readmask->get(read_num)) {
+	keep = false;
+      } else {
+	keep = self->keep_read(read.seq);
+      }
+
+      if (self->readmask) {
+	self->readmask->set_atomic(read_num, keep);
+      }
+
+      if (keep) {
+	n_kept++;
+	if (state->writer) {
+	  out += ">";
+	  out += read.name;
+	  out += "\n";
+	  out += read.seq;
+	  out += "\n";
+	}
+      }
+    }
+
+    if (state->writer) {
+      state->writer->write(batch.batch_num, out);
+    }
+
+    unsigned long long kept = __sync_add_and_fetch(&state->n_kept, n_kept);
+    unsigned long long n_before = __sync_fetch_and_add(&state->n_done,
+						       batch.reads.size());
+    unsigned long long n_after = n_before + batch.reads.size();
+
+    // run callback, if specified -- from the calling thread only.
+    if (thread_id == 0 && state->callback &&
+	n_after / CALLBACK_PERIOD != n_before / CALLBACK_PERIOD) {
+      state->callback("filter_reads", state->callback_data, n_after, kept);
+    }
+  }
+}
+
+unsigned long long ReadFilter::filter(const std::string &inputfile,
+				      const std::string &outputfile,
+				      unsigned int n_threads,
+				      CallbackFn callback,
+				      void * callback_data)
+{
+  if (n_threads < 1) { n_threads = 1; }
+
+  ReadBatchSource source(inputfile);
+
+  std::ofstream outfile;
+  OrderedWriter * writer = NULL;
+  if (outputfile.length()) {
+    outfile.open(outputfile.c_str());
+    writer = new OrderedWriter(outfile);
+  }
+
+  _FilterState state;
+  state.filter = this;
+  state.source = &source;
+  state.writer = writer;
+  state.callback = callback;
+  state.callback_data = callback_data;
+  state.n_done = 0;
+  state.n_kept = 0;
+
+  try {
+    run_threads(n_threads, _filter_thread, &state, source.stop_flag());
+  } catch (...) {
+    delete writer;
+    throw;
+  }
+
+  delete writer;
+
+  n_reads = source.n_reads();
+  n_kept = state.n_kept;
+
+  return n_kept;
+}
+
 void CountingHash::save(std::string outfilename)
 {
   CountingHashFile::save(outfilename, *this);
@@ -633,97 +918,22 @@ void CountingHash::get_kmer_abund_mean(const std::string &filename,
 				       unsigned long long &count,
 				       float &mean) const
 {
-  total = 0;
-  count = 0;
-  mean = 0.0;
-
-  Read read;
-  IParser* parser = IParser::get_parser(filename.c_str());
-  string name;
-  string seq;
-  unsigned long long read_num = 0;
-
-  while(!parser->is_complete()) {
-    read = parser->get_next_read();
-    seq = read.seq;
-
-    if (check_read(seq)) {
-      for (unsigned int i = 0; i < seq.length() - _ksize + 1; i++) {
-	string kmer = seq.substr(i, i + _ksize);
-	BoundedCounterType n = get_count(kmer.c_str());
-
-	total += n;
-	count ++;
-      }
-
-      name.clear();
-      seq.clear();
-    }
-
-    read_num += 1;
-
-#if 0
-    // run callback, if specified
-    if (read_num % CALLBACK_PERIOD == 0 && callback) {
-      try {
-        callback("abundance_distribution", callback_data, read_num, 0);
-      } catch (...) {
-        throw;
-      }
-    }
-#endif // 0
-  }
+  ReadStatsScanner scanner(*this, SCAN_ABUNDANCE);
+  scanner.scan(filename);
 
-  mean = float(total) / float(count);
+  total = scanner.total_count();
+  count = scanner.n_kmers();
+  mean = scanner.mean();
 }
 
 void CountingHash::get_kmer_abund_abs_deviation(const std::string &filename,
 						float mean,
 						float &abs_deviation) const
 {
-  float total = 0.0;
-  unsigned long long count = 0;
-
-  Read read;
-  IParser* parser = IParser::get_parser(filename.c_str());
-  string name;
-  string seq;
-  unsigned long long read_num = 0;
-
-  while(!parser->is_complete()) {
-    read = parser->get_next_read();
-    seq = read.seq;
-
-    if (check_read(seq)) {
-      for (unsigned int i = 0; i < seq.length() - _ksize + 1; i++) {
-	string kmer = seq.substr(i, i + _ksize);
-	BoundedCounterType n = get_count(kmer.c_str());
-
-	float diff = mean - (unsigned int)n;
-	if (diff < 0) { diff = -diff; }
-	total += diff;
-	count ++;
-      }
-
-      name.clear();
-      seq.clear();
-    }
-
-    read_num += 1;
-
-#if 0
-    // run callback, if specified
-    if (read_num % CALLBACK_PERIOD == 0 && callback) {
-      try {
-        callback("abundance_distribution", callback_data, read_num, 0);
-      } catch (...) {
-        throw;
-      }
-    }
-#endif // 0
-  }
+  ReadStatsScanner scanner(*this, SCAN_ABUNDANCE);
+  scanner.scan(filename);
 
-  abs_deviation = total / float(count);
+  abs_deviation = scanner.abs_deviation(mean);
 }
 
 unsigned int CountingHash::max_hamming1_count(const std::string kmer_s)
@@ -55,6 +55,17 @@ namespace khmer {
       _allocate_counters();
     }
 
+    // "auto" sizing; see choose_table_sizes.
+    CountingHash(WordLength ksize, const HLLCounter &estimate,
+		 HashIntoType max_memory = 0,
+		 double target_fp = DEFAULT_TARGET_FP) :
+      khmer::Hashtable(ksize), _use_bigcount(false) {
+      choose_table_sizes(estimate.estimate_cardinality(), max_memory,
+			 target_fp, 8, _tablesizes);
+
+      _allocate_counters();
+    }
+
     virtual ~CountingHash() {
       if (_counts) {
 	for (unsigned int i = 0; i < _n_tables; i++) {
@@ -238,6 +249,106 @@ namespace khmer {
   };
 
 
+  //
+  // ReadStatsScanner: computes any combination of the per-read and
+  // per-file k-mer abundance statistics below, in one pass over the reads
+  // (optionally on several threads).  OR together the SCAN_* flags.
+  //
+
+#define SCAN_MINMAX 1		// min & max k-mer count per read => minmax
+#define SCAN_ABUNDANCE 2	// histogram of k-mer counts => mean, deviation
+#define SCAN_POSITION_COUNTS 4	// # of k-mers at each position in the reads
+#define SCAN_POSITION_FREQ 8	// every k-mer count in every read => file
+
+  class ReadStatsScanner {
+  protected:
+    const CountingHash &_ht;
+    unsigned int _stats;
+
+    // per-thread partial results, reduced at the end of scan().
+    std::vector<HashIntoType *> _thread_hists;
+    std::vector<HashIntoType *> _thread_positions;
+
+    void _free_thread_results();
+    void _scan_read(const std::string &seq,
+		    unsigned long long read_num,
+		    HashIntoType * hist,
+		    HashIntoType * positions,
+		    std::string * pos_freq) const;
+
+    static void _scan_thread(unsigned int thread_id, void * data);
+
+  public:
+    // options
+    MinMaxTable * minmax;	// SCAN_MINMAX results; owned by the caller.
+    ReadMaskTable * readmask;	// if set, skip reads that are masked out.
+    unsigned int max_read_len;	// SCAN_POSITION_COUNTS
+    BoundedCounterType limit_by_count; // ...only count k-mers w/this count
+    std::string pos_freq_filename; // SCAN_POSITION_FREQ
+
+    // results
+    unsigned long long n_reads;
+    HashIntoType * abundance_hist; // MAX_BIGCOUNT + 1 entries
+    HashIntoType * position_counts; // max_read_len entries
+
+    ReadStatsScanner(const CountingHash &ht, unsigned int stats);
+    ~ReadStatsScanner();
+
+    void scan(const std::string &filename,
+	      unsigned int n_threads = 1,
+	      CallbackFn callback = NULL,
+	      void * callback_data = NULL);
+
+    // from the abundance histogram
+    unsigned long long n_kmers() const;
+    unsigned long long total_count() const;
+    float mean() const;
+    float abs_deviation(float mean) const;
+  };
+
+  //
+  // ReadFilter: applies any combination of the filter_fasta_file_*
+  // predicates to each read as it streams past, and writes the kept reads
+  // straight out, so that filtering takes one pass over the file and no
+  // per-read tables.  A read is kept only if it passes every predicate
+  // that is switched on (threshold != 0).  Mask output is optional.
+  //
+
+  class ReadFilter {
+  protected:
+    const CountingHash &_ht;
+
+    static void _filter_thread(unsigned int thread_id, void * data);
+
+  public:
+    // predicates
+    BoundedCounterType min_threshold; // all k-mers have at least this count
+    BoundedCounterType max_threshold; // some k-mer has at least this count
+    BoundedCounterType run_threshold; // 'runlength' k-mers in a row do
+    unsigned int runlength;
+    BoundedCounterType limit_threshold; // 'limit_n' k-mers do
+    unsigned int limit_n;
+
+    // options
+    ReadMaskTable * old_readmask; // if set, drop reads masked out here.
+    ReadMaskTable * readmask;	// if set, record which reads were kept.
+
+    // results
+    unsigned long long n_reads;
+    unsigned long long n_kept;
+
+    ReadFilter(const CountingHash &ht);
+
+    bool keep_read(const std::string &seq) const;
+
+    // an empty outputfile means "don't write the reads out".
+    unsigned long long filter(const std::string &inputfile,
+			      const std::string &outputfile,
+			      unsigned int n_threads = 1,
+			      CallbackFn callback = NULL,
+			      void * callback_data = NULL);
+  };
+
   class CountingHashFile {
   public:
     static void load(const std::string &infilename, CountingHash &ht);
@@ -1,7 +1,16 @@
 #include "hashtable.hh"
 #include "hashbits.hh"
 #include "parsers.hh"
+#include "threads.hh"
 #include <iostream>
+#include <math.h>
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #define MAX_KEEPER_SIZE int(1e6)
 
 using namespace std;
@@ -17,7 +26,7 @@ void Hashbits::save(std::string outfilename)
 
   ofstream outfile(outfilename.c_str(), ios::binary);
 
-  unsigned char version = SAVED_FORMAT_VERSION;
+  unsigned char version = SAVED_HASHBITS_VERSION;
   outfile.write((const char *) &version, 1);
 
   unsigned char ht_type = SAVED_HASHBITS;
@@ -25,6 +34,7 @@ void Hashbits::save(std::string outfilename)
 
   outfile.write((const char *) &save_ksize, sizeof(save_ksize));
   outfile.write((const char *) &save_n_tables, sizeof(save_n_tables));
+  _save_occupancy(outfile);
 
   for (unsigned int i = 0; i < _n_tables; i++) {
     save_tablesize = _tablesizes[i];
@@ -57,16 +67,20 @@ void Hashbits::load(std::string infilename)
 
   infile.read((char *) &version, 1);
   infile.read((char *) &ht_type, 1);
-  assert(version == SAVED_FORMAT_VERSION);
+  assert(version == SAVED_FORMAT_VERSION || version == SAVED_HASHBITS_VERSION);
   assert(ht_type == SAVED_HASHBITS);
 
   infile.read((char *) &save_ksize, sizeof(save_ksize));
   infile.read((char *) &save_n_tables, sizeof(save_n_tables));
+  _load_occupancy(infile, version);
 
   _ksize = (WordLength) save_ksize;
   _n_tables = (unsigned int) save_n_tables;
   _init_bitstuff();
 
+  if (_adjacency_cache) { _adjacency_cache->clear(); }
+  clear_unitig_index();
+
   _counts = new Byte*[_n_tables];
   for (unsigned int i = 0; i < _n_tables; i++) {
     HashIntoType tablesize;
@@ -87,6 +101,503 @@ void Hashbits::load(std::string infilename)
     }
   }
   infile.close();
+
+  if (version == SAVED_FORMAT_VERSION) {
+    recount_occupancy();
+  }
+}
+
+// version 4 files have the occupied bin and k-mer counts after the
+// table sizes; version 3 files don't, and the occupied bins are counted
+// from the bits after loading.
+
+void Hashbits::_save_occupancy(std::ofstream &outfile) const
+{
+  unsigned long long save_occupied = _occupied_bins;
+  unsigned long long save_n_unique = _n_unique_kmers;
+  unsigned long long save_n_overlap = _n_overlap_kmers;
+
+  outfile.write((const char *) &save_occupied, sizeof(save_occupied));
+  outfile.write((const char *) &save_n_unique, sizeof(save_n_unique));
+  outfile.write((const char *) &save_n_overlap, sizeof(save_n_overlap));
+}
+
+void Hashbits::_load_occupancy(std::ifstream &infile, unsigned char version)
+{
+  unsigned long long save_occupied = 0;
+  unsigned long long save_n_unique = 0;
+  unsigned long long save_n_overlap = 0;
+
+  if (version == SAVED_HASHBITS_VERSION) {
+    infile.read((char *) &save_occupied, sizeof(save_occupied));
+    infile.read((char *) &save_n_unique, sizeof(save_n_unique));
+    infile.read((char *) &save_n_overlap, sizeof(save_n_overlap));
+  }
+
+  _occupied_bins = save_occupied;
+  _n_unique_kmers = save_n_unique;
+  _n_overlap_kmers = save_n_overlap;
+}
+
+//
+// sweep_bits: run through the arrays in chunks, handed out to the
+// threads one at a time.
+//
+
+#define SWEEP_CHUNK_BYTES (1 << 20)
+
+struct _SweepState {
+  unsigned int op;
+  const BitArrays * a;
+  const BitArrays * b;
+  std::vector<Byte *> * out;
+  std::vector<HashIntoType> n_set;
+
+  std::vector<std::pair<unsigned int, HashIntoType> > chunks;
+  unsigned long long next_chunk;
+};
+
+static HashIntoType _sweep_chunk(unsigned int op, const Byte * a,
+				 const Byte * b, Byte * out, HashIntoType n)
+{
+  if (op == BITS_COUNT) {
+    return _popcount_bytes(a, n);
+  }
+
+  HashIntoType n_set = 0;
+  HashIntoType i = 0;
+
+#ifdef __SSE2__
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+
+    if (op == BITS_UNION) {
+      x = _mm_or_si128(x, y);
+    } else if (op == BITS_INTERSECTION) {
+      x = _mm_and_si128(x, y);
+    } else {
+      x = _mm_andnot_si128(y, x);
+    }
+
+    unsigned long long w[2];
+    _mm_storeu_si128((__m128i *) w, x);
+    n_set += _popcount64(w[0]) + _popcount64(w[1]);
+
+    if (out) {
+      _mm_storeu_si128((__m128i *) (out + i), x);
+    }
+  }
+#endif // __SSE2__
+
+  for (; i < n; i++) {
+    Byte x;
+    if (op == BITS_UNION) {
+      x = a[i] | b[i];
+    } else if (op == BITS_INTERSECTION) {
+      x = a[i] & b[i];
+    } else {
+      x = a[i] & ~b[i];
+    }
+
+    n_set += _popcount64(x);
+    if (out) {
+      out[i] = x;
+    }
+  }
+
+  return n_set;
+}
+
+static void _sweep_thread(unsigned int thread_id, void * data)
+{
+  _SweepState * state = (_SweepState *) data;
+  const unsigned long long n_chunks = state->chunks.size();
+
+  while (1) {
+    unsigned long long i = __sync_fetch_and_add(&state->next_chunk, 1);
+    if (i >= n_chunks) {
+      break;
+    }
+
+    unsigned int array = state->chunks[i].first;
+    HashIntoType start = state->chunks[i].second;
+    HashIntoType n = state->a->n_bytes[array] - start;
+    if (n > SWEEP_CHUNK_BYTES) {
+      n = SWEEP_CHUNK_BYTES;
+    }
+
+    const Byte * b = NULL;
+    if (state->b) {
+      b = state->b->arrays[array] + start;
+    }
+    Byte * out = NULL;
+    if (!state->out->empty()) {
+      out = (*state->out)[array] + start;
+    }
+
+    HashIntoType n_set = _sweep_chunk(state->op,
+				      state->a->arrays[array] + start,
+				      b, out, n);
+    __sync_fetch_and_add(&state->n_set[array], n_set);
+  }
+}
+
+void khmer::sweep_bits(unsigned int op, const BitArrays &a,
+		       const BitArrays * b, std::vector<Byte *> &out,
+		       std::vector<HashIntoType> &n_set,
+		       unsigned int n_threads)
+{
+  assert(op == BITS_COUNT || (b && a.same_layout(*b)));
+  assert(out.empty() || out.size() == a.arrays.size());
+
+  _SweepState state;
+  state.op = op;
+  state.a = &a;
+  state.b = b;
+  state.out = &out;
+  state.n_set.assign(a.arrays.size(), 0);
+  state.next_chunk = 0;
+
+  for (unsigned int i = 0; i < a.arrays.size(); i++) {
+    for (HashIntoType j = 0; j < a.n_bytes[i]; j += SWEEP_CHUNK_BYTES) {
+      state.chunks.push_back(std::make_pair(i, j));
+    }
+  }
+
+  if (n_threads > state.chunks.size()) {
+    n_threads = state.chunks.size();
+  }
+  if (n_threads == 0) {
+    n_threads = 1;
+  }
+  run_threads(n_threads, _sweep_thread, &state);
+
+  n_set = state.n_set;
+}
+
+BitArrays Hashbits::bit_arrays() const
+{
+  BitArrays bits;
+  bits.ht_type = SAVED_HASHBITS;
+  bits.ksize = _ksize;
+
+  for (unsigned int i = 0; i < _n_tables; i++) {
+    bits.arrays.push_back(_counts[i]);
+    bits.n_bytes.push_back(_tablesizes[i] / 8 + 1);
+    bits.n_bits.push_back(_tablesizes[i]);
+    bits.bits_per_kmer.push_back(1);
+  }
+  return bits;
+}
+
+void Hashbits::combine_tables(unsigned int op, const BitArrays &a,
+			      const BitArrays &b, unsigned int n_threads)
+{
+  BitArrays mine = bit_arrays();
+  assert(op != BITS_COUNT);
+  assert(mine.same_layout(a) && mine.same_layout(b));
+
+  // our own arrays, to write to.
+  std::vector<Byte *> out;
+  for (unsigned int i = 0; i < mine.arrays.size(); i++) {
+    out.push_back((Byte *) mine.arrays[i]);
+  }
+
+  std::vector<HashIntoType> n_set;
+  sweep_bits(op, a, &b, out, n_set, n_threads);
+
+  _occupied_bins = 0;
+  for (unsigned int i = 0; i < n_set.size(); i++) {
+    _occupied_bins += n_set[i];
+  }
+  _n_unique_kmers = 0;
+  _n_overlap_kmers = 0;
+
+  if (_adjacency_cache) { _adjacency_cache->clear(); }
+  clear_unitig_index();
+}
+
+//
+// HashbitsFile
+//
+
+HashbitsFile::HashbitsFile(const std::string &filename) :
+  _map(NULL), _map_size(0)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return;
+  }
+
+  void * map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    return;
+  }
+
+  if (_parse((const Byte *) map, (const Byte *) map + st.st_size)) {
+    _map = map;
+    _map_size = st.st_size;
+  } else {
+    munmap(map, st.st_size);
+    _bits.arrays.clear();
+  }
+}
+
+static bool _take(const Byte * &p, const Byte * end, void * dest, size_t n)
+{
+  if (n > (size_t) (end - p)) {
+    return false;
+  }
+  memcpy(dest, p, n);
+  p += n;
+  return true;
+}
+
+// walk the header (see Hashbits::save and BlockedHashbits::save); false
+// if it isn't a table, or the file is too short.
+
+bool HashbitsFile::_parse(const Byte * p, const Byte * end)
+{
+  unsigned char version, ht_type, n_tables;
+  unsigned int save_ksize;
+  unsigned long long n_blocks = 0;
+
+  if (!_take(p, end, &version, 1) || !_take(p, end, &ht_type, 1)) {
+    return false;
+  }
+  if (version != SAVED_FORMAT_VERSION && version != SAVED_HASHBITS_VERSION) {
+    return false;
+  }
+  if (ht_type != SAVED_HASHBITS && ht_type != SAVED_BLOCKED_HASHBITS) {
+    return false;
+  }
+
+  if (!_take(p, end, &save_ksize, sizeof(save_ksize)) ||
+      !_take(p, end, &n_tables, sizeof(n_tables))) {
+    return false;
+  }
+  if (ht_type == SAVED_BLOCKED_HASHBITS &&
+      !_take(p, end, &n_blocks, sizeof(n_blocks))) {
+    return false;
+  }
+  if (version == SAVED_HASHBITS_VERSION) {
+    unsigned long long occupancy[3];	// not needed here
+    if (!_take(p, end, occupancy, sizeof(occupancy))) {
+      return false;
+    }
+  }
+
+  _bits.ht_type = ht_type;
+  _bits.ksize = save_ksize;
+
+  if (ht_type == SAVED_BLOCKED_HASHBITS) {
+    const HashIntoType block_bytes = BLOCK_WORDS * sizeof(unsigned long long);
+    if (n_blocks > (HashIntoType) (end - p) / block_bytes) {
+      return false;
+    }
+    HashIntoType nbytes = n_blocks * block_bytes;
+
+    _bits.arrays.push_back(p);
+    _bits.n_bytes.push_back(nbytes);
+    _bits.n_bits.push_back(n_blocks * BLOCK_BITS);
+    _bits.bits_per_kmer.push_back(n_tables);
+    return true;
+  }
+
+  for (unsigned int i = 0; i < n_tables; i++) {
+    unsigned long long tablesize;
+    if (!_take(p, end, &tablesize, sizeof(tablesize))) {
+      return false;
+    }
+
+    HashIntoType tablebytes = tablesize / 8 + 1;
+    if (tablebytes > (HashIntoType) (end - p)) {
+      return false;
+    }
+
+    _bits.arrays.push_back(p);
+    _bits.n_bytes.push_back(tablebytes);
+    _bits.n_bits.push_back(tablesize);
+    _bits.bits_per_kmer.push_back(1);
+    p += tablebytes;
+  }
+  return true;
+}
+
+HashbitsFile::~HashbitsFile()
+{
+  if (_map) {
+    munmap(_map, _map_size);
+    _map = NULL;
+  }
+}
+
+double Hashbits::estimated_fp_rate() const
+{
+  double fp = 1.0;
+
+  std::vector<HashIntoType> n_set;
+  table_occupancy(n_set);
+
+  for (unsigned int i = 0; i < _n_tables; i++) {
+    fp *= (double) n_set[i] / (double) _tablesizes[i];
+  }
+  return fp;
+}
+
+//
+// BlockedHashbits
+//
+
+BlockedHashbits::BlockedHashbits(WordLength ksize, HashIntoType n_bits,
+				 unsigned int n_hashes) :
+  Hashbits(ksize, n_hashes), _blocks(NULL)
+{
+  assert(n_hashes >= 1 && n_hashes <= MAX_BLOCK_HASHES);
+
+  _n_blocks = (n_bits + BLOCK_BITS - 1) / BLOCK_BITS;
+  if (_n_blocks == 0) { _n_blocks = 1; }
+
+  _allocate_blocks();
+}
+
+BlockedHashbits::~BlockedHashbits()
+{
+  _free_blocks();
+}
+
+void BlockedHashbits::_allocate_blocks()
+{
+  void * p = NULL;
+  if (posix_memalign(&p, BLOCK_BITS / 8,
+		     _n_blocks * BLOCK_WORDS * sizeof(unsigned long long))) {
+    throw std::bad_alloc();
+  }
+
+  _blocks = (unsigned long long *) p;
+  memset(_blocks, 0, _n_blocks * BLOCK_WORDS * sizeof(unsigned long long));
+
+  // n_hashes equal "tables" sharing the bits; see hashbits.hh.
+  _tablesizes.assign(_n_tables, _n_blocks * BLOCK_BITS / _n_tables);
+}
+
+void BlockedHashbits::_free_blocks()
+{
+  free(_blocks);
+  _blocks = NULL;
+}
+
+void BlockedHashbits::save(std::string outfilename)
+{
+  assert(_blocks);
+
+  unsigned int save_ksize = _ksize;
+  unsigned char save_n_hashes = _n_tables;
+  unsigned long long save_n_blocks = _n_blocks;
+
+  ofstream outfile(outfilename.c_str(), ios::binary);
+
+  unsigned char version = SAVED_HASHBITS_VERSION;
+  outfile.write((const char *) &version, 1);
+
+  unsigned char ht_type = SAVED_BLOCKED_HASHBITS;
+  outfile.write((const char *) &ht_type, 1);
+
+  outfile.write((const char *) &save_ksize, sizeof(save_ksize));
+  outfile.write((const char *) &save_n_hashes, sizeof(save_n_hashes));
+  outfile.write((const char *) &save_n_blocks, sizeof(save_n_blocks));
+  _save_occupancy(outfile);
+
+  outfile.write((const char *) _blocks,
+		_n_blocks * BLOCK_WORDS * sizeof(unsigned long long));
+  outfile.close();
+}
+
+void BlockedHashbits::load(std::string infilename)
+{
+  _free_blocks();
+
+  unsigned int save_ksize = 0;
+  unsigned char save_n_hashes = 0;
+  unsigned long long save_n_blocks = 0;
+  unsigned char version, ht_type;
+
+  ifstream infile(infilename.c_str(), ios::binary);
+  assert(infile.is_open());
+
+  infile.read((char *) &version, 1);
+  infile.read((char *) &ht_type, 1);
+  assert(version == SAVED_FORMAT_VERSION || version == SAVED_HASHBITS_VERSION);
+  assert(ht_type == SAVED_BLOCKED_HASHBITS);
+
+  infile.read((char *) &save_ksize, sizeof(save_ksize));
+  infile.read((char *) &save_n_hashes, sizeof(save_n_hashes));
+  infile.read((char *) &save_n_blocks, sizeof(save_n_blocks));
+  _load_occupancy(infile, version);
+
+  _ksize = (WordLength) save_ksize;
+  _n_tables = (unsigned int) save_n_hashes;
+  _n_blocks = save_n_blocks;
+  _init_bitstuff();
+
+  if (_adjacency_cache) { _adjacency_cache->clear(); }
+  clear_unitig_index();
+
+  _allocate_blocks();
+
+  infile.read((char *) _blocks,
+	      _n_blocks * BLOCK_WORDS * sizeof(unsigned long long));
+  assert(!infile.fail());
+
+  infile.close();
+
+  if (version == SAVED_FORMAT_VERSION) {
+    recount_occupancy();
+  }
+}
+
+BitArrays BlockedHashbits::bit_arrays() const
+{
+  BitArrays bits;
+  bits.ht_type = SAVED_BLOCKED_HASHBITS;
+  bits.ksize = _ksize;
+
+  bits.arrays.push_back((const Byte *) _blocks);
+  bits.n_bytes.push_back(_n_blocks * BLOCK_WORDS * sizeof(unsigned long long));
+  bits.n_bits.push_back(_n_blocks * BLOCK_BITS);
+  bits.bits_per_kmer.push_back(_n_tables);
+  return bits;
+}
+
+// a k-mer not in the filter hits a random block, and is a false positive
+// if all of its n_hashes bits happen to be set there.
+
+double BlockedHashbits::estimated_fp_rate() const
+{
+  double total = 0.0;
+
+  for (HashIntoType i = 0; i < _n_blocks; i++) {
+    const unsigned long long * b = _blocks + i * BLOCK_WORDS;
+
+    unsigned int n_set = 0;
+    for (unsigned int j = 0; j < BLOCK_WORDS; j++) {
+      n_set += _popcount64(b[j]);
+    }
+
+    if (n_set) {
+      total += pow((double) n_set / BLOCK_BITS, (double) _n_tables);
+    }
+  }
+
+  return total / _n_blocks;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -120,9 +631,11 @@ const
   // keep track of both seen kmers, and counts.
   keeper.insert(kmer);
 
+  HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+  unsigned int present = get_neighbors(kmer_f, kmer_r, f, r);
+
   // is this a high-circumference k-mer? if so, don't count it; get outta here!
-  if (break_on_circum && \
-      kmer_degree(kmer_f, kmer_r) > 4) {
+  if (break_on_circum && _popcount64(present) > 4) {
     return;
   }
 
@@ -134,50 +647,22 @@ const
   }
 
   // otherwise, explore in all directions.
-
-  // NEXT.
-
-  HashIntoType f, r;
-  const unsigned int rc_left_shift = _ksize*2 - 2;
-
-  f = next_f(kmer_f, 'A');
-  r = next_r(kmer_r, 'A');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  f = next_f(kmer_f, 'C');
-  r = next_r(kmer_r, 'C');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  f = next_f(kmer_f, 'G');
-  r = next_r(kmer_r, 'G');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  f = next_f(kmer_f, 'T');
-  r = next_r(kmer_r, 'T');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  // PREVIOUS.
-
-  
-  r = prev_r(kmer_r, 'A');
-  f = prev_f(kmer_f, 'A');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  r = prev_r(kmer_r, 'C');
-  f = prev_f(kmer_f, 'C');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  r = prev_r(kmer_r, 'G');
-  f = prev_f(kmer_f, 'G');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  r = prev_r(kmer_r, 'T');
-  f = prev_f(kmer_f, 'T');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
+  for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+    if (present & (1 << i)) {
+      calc_connected_graph_size(f[i], r[i], count, keeper, threshold,
+				break_on_circum);
+    }
+  }
 }
 
-void Hashbits::save_tagset(std::string outfilename)
+void Hashbits::save_tagset(std::string outfilename, bool packed)
 {
+  if (packed) {
+    save_packed_tags(outfilename, SAVED_TAGS, _ksize, _tag_density,
+		     all_tags);
+    return;
+  }
+
   ofstream outfile(outfilename.c_str(), ios::binary);
   const unsigned int tagset_size = all_tags.size();
   unsigned int save_ksize = _ksize;
@@ -195,7 +680,7 @@ void Hashbits::save_tagset(std::string outfilename)
   outfile.write((const char *) &_tag_density, sizeof(_tag_density));
 
   unsigned int i = 0;
-  for (SeenSet::iterator pi = all_tags.begin(); pi != all_tags.end();
+  for (TagSet::const_iterator pi = all_tags.begin(); pi != all_tags.end();
 	 pi++, i++) {
     buf[i] = *pi;
   }
@@ -222,6 +707,21 @@ void Hashbits::load_tagset(std::string infilename, bool clear_tags)
 
   infile.read((char *) &version, 1);
   infile.read((char *) &ht_type, 1);
+
+  if (version == SAVED_PACKED_TAGS_VERSION) {
+    infile.close();
+
+    TagFile tagfile(infilename);
+    if (!tagfile.is_open() || tagfile.ht_type() != SAVED_TAGS ||
+	tagfile.ksize() != _ksize) {
+      throw std::runtime_error("bad packed tag file " + infilename);
+    }
+
+    _tag_density = tagfile.tag_density();
+    tagfile.load_into(all_tags);
+    return;
+  }
+
   assert(version == SAVED_FORMAT_VERSION);
   assert(ht_type == SAVED_TAGS);
   
@@ -235,6 +735,7 @@ void Hashbits::load_tagset(std::string infilename, bool clear_tags)
 
   infile.read((char *) buf, sizeof(HashIntoType) * tagset_size);
 
+  all_tags.reserve(all_tags.size() + tagset_size);
   for (unsigned int i = 0; i < tagset_size; i++) {
     all_tags.insert(buf[i]);
   }
@@ -242,50 +743,166 @@ void Hashbits::load_tagset(std::string infilename, bool clear_tags)
   delete buf;
 }
 
-unsigned int Hashbits::kmer_degree(HashIntoType kmer_f, HashIntoType kmer_r)
-const
+// two-bit codes for A, C, G, T (see twobit_repr); the complement of
+// each is code ^ 1.
+static const HashIntoType _neighbor_bases[4] = { 0, 2, 3, 1 };
+
+// the get_neighbors() mask for the reverse complement of a k-mer: next
+// neighbor i is previous neighbor 3-i of the other strand and vice versa,
+// which reverses the order of the 8 bits.
+static inline unsigned int _flip_neighbors(unsigned int mask)
 {
-  unsigned int neighbors = 0;
+  mask = ((mask & 0xf0) >> 4) | ((mask & 0x0f) << 4);
+  mask = ((mask & 0xcc) >> 2) | ((mask & 0x33) << 2);
+  mask = ((mask & 0xaa) >> 1) | ((mask & 0x55) << 1);
+  return mask;
+}
 
+unsigned int Hashbits::get_neighbors(HashIntoType kmer_f, HashIntoType kmer_r,
+				     HashIntoType * f, HashIntoType * r)
+const
+{
   const unsigned int rc_left_shift = _ksize*2 - 2;
+  HashIntoType kmers[N_NEIGHBORS];
 
-  HashIntoType f, r;
+  for (unsigned int i = 0; i < 4; i++) {
+    const HashIntoType b = _neighbor_bases[i];
 
-  // NEXT.
-  f = next_f(kmer_f, 'A');
-  r = next_r(kmer_r, 'A');
-  if (get_count(uniqify_rc(f, r))) { neighbors++; }
-	  
-  f = next_f(kmer_f, 'C');
-  r = next_r(kmer_r, 'C');
-  if (get_count(uniqify_rc(f, r))) { neighbors++; }
-
-  f = next_f(kmer_f, 'G');
-  r = next_r(kmer_r, 'G');
-  if (get_count(uniqify_rc(f, r))) { neighbors++; }
-
-  f = next_f(kmer_f, 'T');
-  r = next_r(kmer_r, 'T');
-  if (get_count(uniqify_rc(f, r))) { neighbors++; }
-
-  // PREVIOUS.
-  r = prev_r(kmer_r, 'A');
-  f = prev_f(kmer_f, 'A');
-  if (get_count(uniqify_rc(f, r))) { neighbors++; }
-
-  r = prev_r(kmer_r, 'C');
-  f = prev_f(kmer_f, 'C');
-  if (get_count(uniqify_rc(f, r))) { neighbors++; }
-    
-  r = prev_r(kmer_r, 'G');
-  f = prev_f(kmer_f, 'G');
-  if (get_count(uniqify_rc(f, r))) { neighbors++; }
+    f[i] = ((kmer_f << 2) & bitmask) | b;
+    r[i] = (kmer_r >> 2) | ((b ^ 1) << rc_left_shift);
 
-  r = prev_r(kmer_r, 'T');
-  f = prev_f(kmer_f, 'T');
-  if (get_count(uniqify_rc(f, r))) { neighbors++; }
+    f[i + 4] = (kmer_f >> 2) | (b << rc_left_shift);
+    r[i + 4] = ((kmer_r << 2) & bitmask) | (b ^ 1);
+  }
+
+  const HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
+  unsigned int present = 0;
+
+  if (_adjacency_cache) {
+    if (_adjacency_cache->stamp() != _occupied_bins) {
+      _adjacency_cache->set_stamp(_occupied_bins); // table has changed.
+    }
+    if (_adjacency_cache->get(kmer, present)) {
+      return kmer == kmer_f ? present : _flip_neighbors(present);
+    }
+  }
 
-  return neighbors;
+  // issue all the loads before waiting on any of them.
+  for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+    kmers[i] = uniqify_rc(f[i], r[i]);
+    prefetch(kmers[i]);
+  }
+
+  for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+    if (get_count(kmers[i])) {
+      present |= 1 << i;
+    }
+  }
+
+  if (_adjacency_cache) {
+    _adjacency_cache->set(kmer,
+			  kmer == kmer_f ? present : _flip_neighbors(present));
+  }
+
+  return present;
+}
+
+//
+// AdjacencyCache
+//
+
+__thread unsigned int khmer::_adjacency_stripe = 0;
+
+// threads take stripes in turn; past ADJACENCY_STAT_STRIPES threads they
+// share, and the counts may come out a little low.
+unsigned int khmer::_assign_adjacency_stripe()
+{
+  static unsigned int next_stripe = 0;
+
+  unsigned int stripe = __sync_fetch_and_add(&next_stripe, 1) %
+    ADJACENCY_STAT_STRIPES;
+  _adjacency_stripe = stripe + 1;
+  return stripe;
+}
+
+AdjacencyCache::AdjacencyCache(HashIntoType max_bytes) :
+  _generation(1), _stamp(0)
+{
+  reset_stats();
+
+  // largest power of two that fits, but no smaller than 1024 slots.
+  _n_slots = 1024;
+  while (_n_slots * 2 * sizeof(Slot) <= max_bytes) {
+    _n_slots *= 2;
+  }
+
+  // all-zero slots never match: generation 0 is never used.
+  _slots = new Slot[_n_slots];
+  memset((void *) _slots, 0, _n_slots * sizeof(Slot));
+}
+
+void Hashbits::enable_adjacency_cache(HashIntoType max_bytes)
+{
+  disable_adjacency_cache();
+  _adjacency_cache = new AdjacencyCache(max_bytes);
+  _adjacency_cache->set_stamp(_occupied_bins);
+}
+
+struct _AdjacencyFillState {
+  const Hashbits * ht;
+  std::vector<HashIntoType> tags;
+  unsigned int radius;
+  unsigned long long next_tag;
+  unsigned long long n_visited;
+};
+
+static void _fill_adjacency_thread(unsigned int thread_id, void * data)
+{
+  _AdjacencyFillState * state = (_AdjacencyFillState *) data;
+  const Hashbits * ht = state->ht;
+  const unsigned long long n_tags = state->tags.size();
+  unsigned long long n_visited = 0;
+  TraversalWorkspace ws;
+
+  while (1) {
+    unsigned long long i = __sync_fetch_and_add(&state->next_tag, 1);
+    if (i >= n_tags) {
+      break;
+    }
+
+    // walk the k-mers themselves: count_kmers_within_radius would cross
+    // unitigs in one step, and leave the k-mers along them uncached.
+    n_visited += ht->traverse_from_kmer(state->tags[i], state->radius, ws);
+  }
+
+  __sync_fetch_and_add(&state->n_visited, n_visited);
+}
+
+unsigned long long Hashbits::fill_adjacency_cache(unsigned int radius,
+						  unsigned int n_threads)
+{
+  if (!_adjacency_cache) {
+    enable_adjacency_cache();
+  }
+
+  _AdjacencyFillState state;
+  state.ht = this;
+  state.tags.assign(all_tags.begin(), all_tags.end());
+  state.radius = radius;
+  state.next_tag = 0;
+  state.n_visited = 0;
+
+  run_threads(n_threads, _fill_adjacency_thread, &state);
+
+  return state.n_visited;
+}
+
+unsigned int Hashbits::kmer_degree(HashIntoType kmer_f, HashIntoType kmer_r)
+const
+{
+  HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+
+  return _popcount64(get_neighbors(kmer_f, kmer_r, f, r));
 }
 
 
@@ -294,15 +911,102 @@ const
 //     so often.
 //
 
+struct _TagLoadState {
+  Hashbits * ht;
+  ReadBatchSource * source;
+  TagShards * new_tags;
+  CallbackFn callback;
+  void * callback_data;
+  unsigned long long n_done;
+  unsigned long long n_consumed;
+  HashIntoType n_new_bins;
+  HashIntoType n_new_kmers;
+};
+
+static void _consume_and_tag_thread(unsigned int thread_id, void * data)
+{
+  _TagLoadState * state = (_TagLoadState *) data;
+  Hashbits * ht = state->ht;
+
+  // per-thread counters, added into the shared ones once per batch.
+  unsigned long long n_consumed = 0;
+  HashIntoType n_new_bins = 0, n_new_kmers = 0;
+
+  ReadBatch batch;
+
+  while (state->source->next_batch(batch)) {
+    for (unsigned int i = 0; i < batch.reads.size(); i++) {
+      const std::string &seq = batch.reads[i].seq;
+      if (ht->check_read(seq)) {
+	ht->consume_sequence_and_tag_atomic(seq, n_consumed, n_new_bins,
+					    n_new_kmers, *state->new_tags);
+      }
+    }
+
+    unsigned long long consumed = __sync_add_and_fetch(&state->n_consumed,
+						       n_consumed);
+    __sync_fetch_and_add(&state->n_new_bins, n_new_bins);
+    __sync_fetch_and_add(&state->n_new_kmers, n_new_kmers);
+    n_consumed = n_new_bins = n_new_kmers = 0;
+
+    unsigned long long n_before = __sync_fetch_and_add(&state->n_done,
+						       batch.reads.size());
+    unsigned long long n_after = n_before + batch.reads.size();
+
+    // run callback, if specified -- from the calling thread only.
+    if (thread_id == 0 && state->callback &&
+	n_after / CALLBACK_PERIOD != n_before / CALLBACK_PERIOD) {
+      state->callback("consume_fasta_and_tag", state->callback_data,
+		      n_after, consumed);
+    }
+  }
+}
+
 void Hashbits::consume_fasta_and_tag(const std::string &filename,
 				      unsigned int &total_reads,
 				      unsigned long long &n_consumed,
+				      unsigned int n_threads,
 				      CallbackFn callback,
 				      void * callback_data)
 {
   total_reads = 0;
   n_consumed = 0;
 
+  if (n_threads > 1) {
+    ReadBatchSource source(filename);
+    TagShards new_tags;
+
+    _TagLoadState state;
+    state.ht = this;
+    state.source = &source;
+    state.new_tags = &new_tags;
+    state.callback = callback;
+    state.callback_data = callback_data;
+    state.n_done = 0;
+    state.n_consumed = 0;
+    state.n_new_bins = 0;
+    state.n_new_kmers = 0;
+
+    try {
+      run_threads(n_threads, _consume_and_tag_thread, &state,
+		  source.stop_flag());
+    } catch (...) {
+      // keep what was loaded before the callback stopped us.
+      new_tags.merge_into(all_tags);
+      _occupied_bins += state.n_new_bins;
+      _n_unique_kmers += state.n_new_kmers;
+      throw;
+    }
+
+    new_tags.merge_into(all_tags);
+    _occupied_bins += state.n_new_bins;
+    _n_unique_kmers += state.n_new_kmers;
+
+    total_reads = source.n_reads();
+    n_consumed = state.n_consumed;
+    return;
+  }
+
   IParser* parser = IParser::get_parser(filename.c_str());
   Read read;
 
@@ -362,22 +1066,191 @@ void Hashbits::consume_sequence_and_tag(const std::string& seq,
 
     if (!is_new_kmer && set_contains(all_tags, kmer)) {
       since = 1;
-      if (found_tags) { found_tags->insert(kmer); }
+      if (found_tags) { found_tags->insert(kmer); }
+    } else {
+      since++;
+    }
+
+    if (since >= _tag_density) {
+      all_tags.insert(kmer);
+      if (found_tags) { found_tags->insert(kmer); }
+      since = 1;
+    }
+  }
+
+  if (since >= _tag_density/2 - 1) {
+    all_tags.insert(kmer);	// insert the last k-mer, too.
+    if (found_tags) { found_tags->insert(kmer); }
+  }
+}
+
+void Hashbits::consume_sequence_and_tag_atomic(const std::string& seq,
+					       unsigned long long& n_consumed,
+					       HashIntoType& n_new_bins,
+					       HashIntoType& n_new_kmers,
+					       TagShards& new_tags)
+{
+  bool is_new_kmer;
+
+  KMerIterator kmers(seq.c_str(), _ksize);
+  HashIntoType kmer = 0;
+  bool seen_kmer = false;
+
+  unsigned int since = _tag_density / 2 + 1;
+
+  while(!kmers.done()) {
+    kmer = kmers.next();
+    seen_kmer = true;
+
+    is_new_kmer = test_and_set_bits(kmer, n_new_bins);
+    if (is_new_kmer) {
+      n_new_kmers++;
+      n_consumed++;
+    }
+
+    // a tag seen here may come from another thread, but it is a real
+    // tag either way; racing threads can only add extra tags.
+    if (!is_new_kmer && (set_contains(all_tags, kmer) ||
+			 new_tags.contains(kmer))) {
+      since = 1;
+    } else {
+      since++;
+    }
+
+    if (since >= _tag_density) {
+      new_tags.insert(kmer);
+      since = 1;
+    }
+  }
+
+  if (seen_kmer && since >= _tag_density/2 - 1) {
+    new_tags.insert(kmer);	// insert the last k-mer, too.
+  }
+}
+
+//
+// consume_fasta_and_partition: consume_fasta_and_tag, joining the tags on
+//     each read into one partition as it goes.  The tags along a read are
+//     connected by the read itself, so that is all the partitioning a read
+//     needs, unless it touches the graph that was there before it: shares
+//     a k-mer with it, or has a k-mer next to one of its k-mers (other
+//     than along the read).  Then it may be connected to tags that are not
+//     on it, and its tags go in partition_todo_tags; a search from each of
+//     those, once everything is loaded, finishes the job (see
+//     SubsetPartition::refine_streaming_partition).  Stop tags are not
+//     looked at.
+//
+
+void Hashbits::consume_fasta_and_partition(const std::string &filename,
+					   unsigned int &total_reads,
+					   unsigned long long &n_consumed,
+					   CallbackFn callback,
+					   void * callback_data)
+{
+  total_reads = 0;
+  n_consumed = 0;
+
+  IParser* parser = IParser::get_parser(filename.c_str());
+  Read read;
+  std::vector<HashIntoType> read_tags;
+
+  while(!parser->is_complete())  {
+    read = parser->get_next_read();
+
+    if (check_read(read.seq)) {
+      read_tags.clear();
+      bool touched = consume_sequence_and_partition(read.seq, n_consumed,
+						    read_tags);
+
+      if (read_tags.size() > 1) {
+	partition->assign_partition_id(read_tags[0], read_tags);
+      }
+      if (touched) {
+	partition_todo_tags.insert(read_tags.begin(), read_tags.end());
+      }
+    }
+
+    total_reads++;
+
+    // run callback, if specified
+    if (total_reads % CALLBACK_PERIOD == 0 && callback) {
+      try {
+        callback("consume_fasta_and_partition", callback_data, total_reads,
+		 n_consumed);
+      } catch (...) {
+	delete parser;
+        throw;
+      }
+    }
+  }
+  delete parser;
+}
+
+bool Hashbits::consume_sequence_and_partition(const std::string& seq,
+					      unsigned long long& n_consumed,
+					      std::vector<HashIntoType>& read_tags)
+{
+  bool touched = false;
+
+  KMerIterator kmers(seq.c_str(), _ksize);
+  HashIntoType kmer = 0, kmer_f, kmer_r;
+  HashIntoType prev = 0;
+  bool is_first_kmer = true;
+
+  unsigned int since = _tag_density / 2 + 1;
+
+  while(!kmers.done()) {
+    kmer = kmers.next(kmer_f, kmer_r);
+
+    bool is_new_kmer = (bool) !get_count(kmer);
+    if (is_new_kmer) {
+      // anything next to it, other than the k-mer before it on the read?
+      if (!touched) {
+	HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+	unsigned int present = get_neighbors(kmer_f, kmer_r, f, r);
+
+	for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+	  if (present & (1 << i)) {
+	    HashIntoType n = uniqify_rc(f[i], r[i]);
+	    if (is_first_kmer || n != prev) {
+	      touched = true;
+	      break;
+	    }
+	  }
+	}
+      }
+
+      count(kmer);
+      n_consumed++;
+    } else {
+      touched = true;
+    }
+
+    if (!is_new_kmer && set_contains(all_tags, kmer)) {
+      read_tags.push_back(kmer);
+      since = 1;
     } else {
       since++;
     }
 
     if (since >= _tag_density) {
       all_tags.insert(kmer);
-      if (found_tags) { found_tags->insert(kmer); }
+      read_tags.push_back(kmer);
       since = 1;
     }
+
+    prev = kmer;
+    is_first_kmer = false;
   }
 
   if (since >= _tag_density/2 - 1) {
     all_tags.insert(kmer);	// insert the last k-mer, too.
-    if (found_tags) { found_tags->insert(kmer); }
+    if (read_tags.empty() || read_tags.back() != kmer) {
+      read_tags.push_back(kmer);
+    }
   }
+
+  return touched;
 }
 
 //
@@ -418,7 +1291,7 @@ void Hashbits::consume_fasta_and_tag_with_stoptags(const std::string &filename,
       bool is_new_kmer;
       KMerIterator kmers(seq.c_str(), _ksize);
 
-      HashIntoType kmer, last_kmer;
+      HashIntoType kmer = 0, last_kmer = 0;
       bool is_first_kmer = true;
 
       unsigned int since = _tag_density / 2 + 1;
@@ -458,7 +1331,7 @@ void Hashbits::consume_fasta_and_tag_with_stoptags(const std::string &filename,
 	is_first_kmer = false;
       }
 
-      if (!set_contains(stop_tags, kmer)) { // NOT a stop tag... ok.
+      if (!is_first_kmer && !set_contains(stop_tags, kmer)) {
 	is_new_kmer = (bool) !get_count(kmer);
 	if (is_new_kmer) {
 	  count(kmer);
@@ -504,10 +1377,10 @@ void Hashbits::divide_tags_into_subsets(unsigned int subset_size,
 {
   unsigned int i = 0;
 
-  for (SeenSet::const_iterator si = all_tags.begin(); si != all_tags.end();
-       si++) {
+  const std::vector<HashIntoType> &tags = all_tags.sorted();
+  for (unsigned int j = 0; j < tags.size(); j++) {
     if (i % subset_size == 0) {
-      divvy.insert(*si);
+      divvy.insert(tags[j]);
       i = 0;
     }
     i++;
@@ -661,46 +1534,54 @@ unsigned int Hashbits::count_kmers_within_radius(HashIntoType kmer_f,
 						 HashIntoType kmer_r,
 						 unsigned int radius,
 						 unsigned int max_count,
-						 const SeenSet * seen)
+						 const SeenSet * seen,
+						 TraversalWorkspace * ws)
 const
 {
-  HashIntoType f, r;
-  NodeQueue node_q;
-  std::queue<unsigned int> breadth_q;
   unsigned int cur_breadth = 0;
   unsigned int breadth = 0;
 
-  const unsigned int rc_left_shift = _ksize*2 - 2;
   unsigned int total = 0;
 
-  SeenSet keeper;		// keep track of traversed kmers
-  if (seen) { keeper = *seen; }
+  if ((!seen || seen->empty()) && unitig_index && unitig_index->is_current()) {
+    unsigned long long n_visited;
+    if (unitig_index->traverse(kmer_f, kmer_r, radius, false, false, NULL,
+			       max_count, n_visited)) {
+      if (max_count && n_visited > max_count) {
+	return max_count + 1;	// as below.
+      }
+      return n_visited;
+    }
+  }
+
+  TraversalWorkspace own_ws;
+  TraversalWorkspace &w = ws ? *ws : own_ws;
+
+  w.start();			// keep track of traversed kmers
+  if (seen) {
+    for (SeenSet::const_iterator si = seen->begin(); si != seen->end(); si++) {
+      w.visit(*si);
+    }
+  }
 
   // start breadth-first search.
 
-  node_q.push(kmer_f);
-  node_q.push(kmer_r);
-  breadth_q.push(0);
+  w.push(kmer_f, kmer_r, 0);
 
-  while(!node_q.empty()) {
-    kmer_f = node_q.front();
-    node_q.pop();
-    kmer_r = node_q.front();
-    node_q.pop();
-    breadth = breadth_q.front();
-    breadth_q.pop();
+  while(!w.queue_empty()) {
+    TraversalNode node = w.pop();
+    kmer_f = node.kmer_f;
+    kmer_r = node.kmer_r;
+    breadth = node.breadth;
 
     if (breadth > radius) {
       break;
     }
 
-    HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
-    if (set_contains(keeper, kmer)) {
+    // keep track of seen kmers
+    if (!w.visit(uniqify_rc(kmer_f, kmer_r))) {
       continue;
     }
-
-    // keep track of seen kmers
-    keeper.insert(kmer);
     total++;
 
     if (max_count && total > max_count) {
@@ -714,62 +1595,13 @@ const
     // Enqueue next set of nodes.
     //
 
-    // NEXT.
-    f = next_f(kmer_f, 'A');
-    r = next_r(kmer_r, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'C');
-    r = next_r(kmer_r, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'G');
-    r = next_r(kmer_r, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'T');
-    r = next_r(kmer_r, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    // PREVIOUS.
-    r = prev_r(kmer_r, 'A');
-    f = prev_f(kmer_f, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    r = prev_r(kmer_r, 'C');
-    f = prev_f(kmer_f, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-    
-    r = prev_r(kmer_r, 'G');
-    f = prev_f(kmer_f, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+    HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+    unsigned int present = get_neighbors(kmer_f, kmer_r, f, r);
 
-    r = prev_r(kmer_r, 'T');
-    f = prev_f(kmer_f, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
+    for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+      if ((present & (1 << i)) && !w.is_visited(uniqify_rc(f[i], r[i]))) {
+	w.push(f[i], r[i], breadth + 1);
+      }
     }
   }
 
@@ -783,86 +1615,22 @@ unsigned int Hashbits::count_kmers_within_depth(HashIntoType kmer_f,
 						SeenSet * seen)
 const
 {
-  HashIntoType f, r;
   unsigned int count = 1;
 
   if (depth == 0) { return 0; }
 
-  const unsigned int rc_left_shift = _ksize*2 - 2;
-
   seen->insert(uniqify_rc(kmer_f, kmer_r));
 
-  // NEXT.
-  f = next_f(kmer_f, 'A');
-  r = next_r(kmer_r, 'A');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth - 1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-  }
-
-  f = next_f(kmer_f, 'C');
-  r = next_r(kmer_r, 'C');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
-  }
-
-  f = next_f(kmer_f, 'G');
-  r = next_r(kmer_r, 'G');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
-  }
-
-  f = next_f(kmer_f, 'T');
-  r = next_r(kmer_r, 'T');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
-  }
-
-  // PREVIOUS.
-  r = prev_r(kmer_r, 'A');
-  f = prev_f(kmer_f, 'A');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
-  }
-
-  r = prev_r(kmer_r, 'C');
-  f = prev_f(kmer_f, 'C');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
-  }
-    
-  r = prev_r(kmer_r, 'G');
-  f = prev_f(kmer_f, 'G');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
-  }
+  HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+  unsigned int present = get_neighbors(kmer_f, kmer_r, f, r);
 
-  r = prev_r(kmer_r, 'T');
-  f = prev_f(kmer_f, 'T');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
+  for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+    if ((present & (1 << i)) &&
+	!set_contains(*seen, uniqify_rc(f[i], r[i]))) {
+      count += count_kmers_within_depth(f[i], r[i], depth - 1,
+					max_count - count, seen);
+      if (count >= max_count) { return count; }
+    }
   }
 
   return count;
@@ -871,40 +1639,32 @@ const
 unsigned int Hashbits::find_radius_for_volume(HashIntoType kmer_f,
 					      HashIntoType kmer_r,
 					      unsigned int max_count,
-					      unsigned int max_radius)
+					      unsigned int max_radius,
+					      TraversalWorkspace * ws)
 const
 {
-  HashIntoType f, r;
-  NodeQueue node_q;
-  std::queue<unsigned int> breadth_q;
   unsigned int breadth = 0;
 
-  const unsigned int rc_left_shift = _ksize*2 - 2;
   unsigned int total = 0;
 
-  SeenSet keeper;		// keep track of traversed kmers
+  TraversalWorkspace own_ws;
+  TraversalWorkspace &w = ws ? *ws : own_ws;
+  w.start();			// keep track of traversed kmers
 
   // start breadth-first search.
 
-  node_q.push(kmer_f);
-  node_q.push(kmer_r);
-  breadth_q.push(0);
+  w.push(kmer_f, kmer_r, 0);
 
-  while(!node_q.empty()) {
-    kmer_f = node_q.front();
-    node_q.pop();
-    kmer_r = node_q.front();
-    node_q.pop();
-    breadth = breadth_q.front();
-    breadth_q.pop();
+  while(!w.queue_empty()) {
+    TraversalNode node = w.pop();
+    kmer_f = node.kmer_f;
+    kmer_r = node.kmer_r;
+    breadth = node.breadth;
 
-    HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
-    if (set_contains(keeper, kmer)) {
+    // keep track of seen kmers
+    if (!w.visit(uniqify_rc(kmer_f, kmer_r))) {
       continue;
     }
-
-    // keep track of seen kmers
-    keeper.insert(kmer);
     total++;
 
     if (total >= max_count || breadth >= max_radius) {
@@ -915,65 +1675,16 @@ const
     // Enqueue next set of nodes.
     //
 
-    // NEXT.
-    f = next_f(kmer_f, 'A');
-    r = next_r(kmer_r, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'C');
-    r = next_r(kmer_r, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'G');
-    r = next_r(kmer_r, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'T');
-    r = next_r(kmer_r, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    // PREVIOUS.
-    r = prev_r(kmer_r, 'A');
-    f = prev_f(kmer_f, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    r = prev_r(kmer_r, 'C');
-    f = prev_f(kmer_f, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-    
-    r = prev_r(kmer_r, 'G');
-    f = prev_f(kmer_f, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+    HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+    unsigned int present = get_neighbors(kmer_f, kmer_r, f, r);
 
-    r = prev_r(kmer_r, 'T');
-    f = prev_f(kmer_f, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
+    for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+      if ((present & (1 << i)) && !w.is_visited(uniqify_rc(f[i], r[i]))) {
+	w.push(f[i], r[i], breadth + 1);
+      }
     }
 
-    if (node_q.empty()) {
+    if (w.queue_empty()) {
       breadth = max_radius;
       break;
     }
@@ -985,41 +1696,36 @@ const
 unsigned int Hashbits::count_kmers_on_radius(HashIntoType kmer_f,
 					     HashIntoType kmer_r,
 					     unsigned int radius,
-					     unsigned int max_volume)
+					     unsigned int max_volume,
+					     TraversalWorkspace * ws)
 const
 {
-  HashIntoType f, r;
-  NodeQueue node_q;
-  std::queue<unsigned int> breadth_q;
   unsigned int cur_breadth = 0;
   unsigned int breadth = 0;
   unsigned int count = 0;
 
-  const unsigned int rc_left_shift = _ksize*2 - 2;
   unsigned int total = 0;
 
-  SeenSet keeper;		// keep track of traversed kmers
+  TraversalWorkspace own_ws;
+  TraversalWorkspace &w = ws ? *ws : own_ws;
+  w.start();			// keep track of traversed kmers
 
   // start breadth-first search.
 
-  node_q.push(kmer_f);
-  node_q.push(kmer_r);
-  breadth_q.push(0);
+  w.push(kmer_f, kmer_r, 0);
 
-  while(!node_q.empty()) {
-    kmer_f = node_q.front();
-    node_q.pop();
-    kmer_r = node_q.front();
-    node_q.pop();
-    breadth = breadth_q.front();
-    breadth_q.pop();
+  while(!w.queue_empty()) {
+    TraversalNode node = w.pop();
+    kmer_f = node.kmer_f;
+    kmer_r = node.kmer_r;
+    breadth = node.breadth;
 
     if (breadth > radius) {
       break;
     }
 
-    HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
-    if (set_contains(keeper, kmer)) {
+    // keep track of seen kmers
+    if (!w.visit(uniqify_rc(kmer_f, kmer_r))) {
       continue;
     }
 
@@ -1027,8 +1733,6 @@ const
       count++;
     }
 
-    // keep track of seen kmers
-    keeper.insert(kmer);
     total++;
 
     if (max_volume && total > max_volume) {
@@ -1042,62 +1746,13 @@ const
     // Enqueue next set of nodes.
     //
 
-    // NEXT.
-    f = next_f(kmer_f, 'A');
-    r = next_r(kmer_r, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'C');
-    r = next_r(kmer_r, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'G');
-    r = next_r(kmer_r, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'T');
-    r = next_r(kmer_r, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    // PREVIOUS.
-    r = prev_r(kmer_r, 'A');
-    f = prev_f(kmer_f, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    r = prev_r(kmer_r, 'C');
-    f = prev_f(kmer_f, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-    
-    r = prev_r(kmer_r, 'G');
-    f = prev_f(kmer_f, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+    HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+    unsigned int present = get_neighbors(kmer_f, kmer_r, f, r);
 
-    r = prev_r(kmer_r, 'T');
-    f = prev_f(kmer_f, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
+    for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+      if ((present & (1 << i)) && !w.is_visited(uniqify_rc(f[i], r[i]))) {
+	w.push(f[i], r[i], breadth + 1);
+      }
     }
   }
 
@@ -1138,23 +1793,24 @@ const
   const unsigned int RADIUS = 2;
   const unsigned int INCR = 2*RADIUS;
   const char * first_kmer = seq.c_str();
+  TraversalWorkspace ws;
 
   HashIntoType kmer_f, kmer_r;
   _hash(first_kmer, _ksize, kmer_f, kmer_r);
-  if (count_kmers_on_radius(kmer_f, kmer_r, RADIUS, 20) > max_degree) {
+  if (count_kmers_on_radius(kmer_f, kmer_r, RADIUS, 20, &ws) > max_degree) {
     return _ksize - 1;
   }
 
   for (unsigned int i = INCR; i < seq.length() - _ksize + 1; i += INCR) {
     _hash(first_kmer + i, _ksize, kmer_f, kmer_r);
-    if (count_kmers_on_radius(kmer_f, kmer_r, RADIUS, 20) > max_degree) {
+    if (count_kmers_on_radius(kmer_f, kmer_r, RADIUS, 20, &ws) > max_degree) {
 
       i -= INCR;
       unsigned int pos = 1;
 
       for (; pos < INCR; pos++) {
 	_hash(first_kmer + i + pos, _ksize, kmer_f, kmer_r);
-	if (count_kmers_on_radius(kmer_f, kmer_r, RADIUS, 20) > max_degree) {
+	if (count_kmers_on_radius(kmer_f, kmer_r, RADIUS, 20, &ws) > max_degree) {
 	  break;
 	}
       }
@@ -1225,82 +1881,200 @@ unsigned int Hashbits::trim_on_stoptags(std::string seq) const
 void Hashbits::traverse_from_tags(unsigned int distance,
 				  unsigned int threshold,
 				  unsigned int frequency,
-				  CountingHash &counting)
+				  CountingHash &counting,
+				  unsigned int n_threads)
 {
-  unsigned int i = 0;
-  unsigned int n = 0;
-  unsigned int count;
-  unsigned int n_big = 0;
-  SeenSet keeper;
-
 #if VERBOSE_REPARTITION
   std::cout << all_tags.size() << " tags...\n";
 #endif // 0
-  SeenSet::const_iterator si = all_tags.begin();
-
-  for (; si != all_tags.end(); si++, i++) {
-    n++;
-    count = traverse_from_kmer(*si, distance, keeper);
-
-    if (count >= threshold) {
-      n_big++;
-	
-      SeenSet::const_iterator ti;
-      for (ti = keeper.begin(); ti != keeper.end(); ti++) {
-	if (counting.get_count(*ti) > frequency) {
-	  stop_tags.insert(*ti);
-	} else {
-	  counting.count(*ti);
+  // in order: which k-mers become stop tags depends on it.
+  const std::vector<HashIntoType> &tags = all_tags.sorted();
+
+  find_knots(tags, distance, threshold, frequency, counting, NULL, n_threads);
+}
+
+//
+// find_knots: for each tag in turn, traverse_from_kmer out to 'distance';
+// if that reaches at least 'threshold' k-mers, each k-mer reached is
+// counted, or, if it has already been counted more than 'frequency'
+// times, made a stop tag.  Tags whose traversals come up short are put
+// in small_tags, if it is given, and tags already there are skipped.
+//
+// Each traversal is blocked by the stop tags made for the tags before it,
+// so the tags are taken in rounds.  The threads traverse a round's tags
+// at once, against the stop tags as they were at the start of the round,
+// and the calling thread then applies the results in tag order.  A
+// traversal that visited none of the k-mers made stop tags since the
+// start of the round would have come out the same had it waited for
+// them, so it stands; otherwise it is done again, on the calling thread.
+// The stop tags and counts are therefore the same as from one thread,
+// whatever the number of threads.
+//
+// Starting the threads costs something each round, so the rounds double
+// in size while few of their traversals have to be redone, and halve
+// again when many do (as they will, around a knot).
+//
+
+#define KNOT_ROUND_TAGS 8		// per thread, at the smallest
+#define KNOT_MAX_ROUND_TAGS 128		// per thread
+
+struct _KnotState {
+  const Hashbits * ht;
+  const std::vector<HashIntoType> * tags;
+  const TagSet * small_tags;
+  unsigned int distance;
+  unsigned long long first, last; // this round's tags
+  unsigned long long next_tag;
+  std::vector<TraversalWorkspace> * workspaces; // one for each thread
+  std::vector<unsigned char> * skipped;		  // for each tag in the round
+  std::vector<unsigned int> * counts;
+  std::vector<std::vector<HashIntoType> > * visited;
+};
+
+static void _knot_thread(unsigned int thread_id, void * data)
+{
+  _KnotState * state = (_KnotState *) data;
+  TraversalWorkspace &ws = (*state->workspaces)[thread_id];
+
+  while (1) {
+    unsigned long long i = __sync_fetch_and_add(&state->next_tag, 1);
+    if (i >= state->last) {
+      break;
+    }
+
+    HashIntoType tag = (*state->tags)[i];
+    unsigned int j = i - state->first;
+
+    if (state->small_tags && set_contains(*state->small_tags, tag)) {
+      (*state->skipped)[j] = true;
+      continue;
+    }
+
+    (*state->skipped)[j] = false;
+    (*state->counts)[j] = state->ht->traverse_from_kmer(tag, state->distance,
+							ws);
+    ws.swap_visited((*state->visited)[j]);
+  }
+}
+
+void Hashbits::find_knots(const std::vector<HashIntoType>& tags,
+			  unsigned int distance,
+			  unsigned int threshold,
+			  unsigned int frequency,
+			  CountingHash &counting,
+			  TagSet * small_tags,
+			  unsigned int n_threads)
+{
+  if (n_threads < 1) { n_threads = 1; }
+  const unsigned int min_round_tags = n_threads == 1 ? 1 :
+    n_threads * KNOT_ROUND_TAGS;
+  const unsigned int max_round_tags = n_threads == 1 ? 1 :
+    n_threads * KNOT_MAX_ROUND_TAGS;
+  unsigned int round_tags = min_round_tags;
+
+  std::vector<TraversalWorkspace> workspaces(n_threads);
+  std::vector<unsigned char> skipped(max_round_tags);
+  std::vector<unsigned int> counts(max_round_tags);
+  std::vector<std::vector<HashIntoType> > visited(max_round_tags);
+
+  _KnotState state;
+  state.ht = this;
+  state.tags = &tags;
+  state.small_tags = small_tags;
+  state.distance = distance;
+  state.workspaces = &workspaces;
+  state.skipped = &skipped;
+  state.counts = &counts;
+  state.visited = &visited;
+
+  TagSet new_stop_tags;		// made this round
+
+  for (unsigned long long first = 0; first < tags.size();
+       first = state.last) {
+    state.first = first;
+    state.last = std::min(first + round_tags, (unsigned long long) tags.size());
+    state.next_tag = first;
+
+    run_threads(n_threads, _knot_thread, &state);
+
+    new_stop_tags.clear();
+    unsigned int n_redone = 0;
+    for (unsigned long long i = first; i < state.last; i++) {
+      unsigned int j = i - first;
+      if (skipped[j]) {
+	continue;
+      }
+
+      std::vector<HashIntoType> &keeper = visited[j];
+      unsigned int count = counts[j];
+
+      if (!new_stop_tags.empty()) {
+	for (unsigned int k = 0; k < keeper.size(); k++) {
+	  if (set_contains(new_stop_tags, keeper[k])) {
+	    count = traverse_from_kmer(tags[i], distance, workspaces[0]);
+	    workspaces[0].swap_visited(keeper);
+	    n_redone++;
+	    break;
+	  }
 	}
       }
+
+      if (count >= threshold) {
+	for (unsigned int k = 0; k < keeper.size(); k++) {
+	  if (counting.get_count(keeper[k]) > frequency) {
+	    if (stop_tags.insert(keeper[k])) {
+	      new_stop_tags.insert(keeper[k]);
+	    }
+	  } else {
+	    counting.count(keeper[k]);
+	  }
+	}
 #if VERBOSE_REPARTITION
-      std::cout << "traversed from " << n << " tags total; "
-		<< n_big << " big; " << keeper.size() << "\n";
+	std::cout << "traversed from " << i + 1 << " tags total, of "
+		  << tags.size() << "; big, size is " << keeper.size()
+		  << "; " << stop_tags.size() << " stop tags\n";
 #endif // 0
+      } else if (small_tags) {
+	small_tags->insert(tags[i]);
+      }
     }
-    keeper.clear();
 
-    if (n % 100 == 0) {
-#if VERBOSE_REPARTITION
-      std::cout << "traversed " << n << " " << n_big << " " <<
-	all_tags.size() << " " << stop_tags.size() << "\n";
-#endif // 0
+    if (n_redone * 8 <= round_tags) {
+      round_tags = std::min(round_tags * 2, max_round_tags);
+    } else {
+      round_tags = std::max(round_tags / 2, min_round_tags);
     }
   }
 }
 
+// traverse_from_kmer: breadth-first search out to 'radius', not through
+//    stop tags; the k-mers visited are left in ws.visited().
+
 unsigned int Hashbits::traverse_from_kmer(HashIntoType start,
 					  unsigned int radius,
-					  SeenSet &keeper)
+					  TraversalWorkspace &ws)
 const
 {
   std::string kmer_s = _revhash(start, _ksize);
   HashIntoType kmer, kmer_f, kmer_r;
   kmer = _hash(kmer_s.c_str(), _ksize, kmer_f, kmer_r);
 
-  HashIntoType f, r;
-  NodeQueue node_q;
-  std::queue<unsigned int> breadth_q;
   unsigned int cur_breadth = 0;
   unsigned int breadth = 0;
-  bool is_first_kmer = true;
 
-  const unsigned int rc_left_shift = _ksize*2 - 2;
   unsigned int total = 0;
 
+  ws.start();
+
   // start breadth-first search.
 
-  node_q.push(kmer_f);
-  node_q.push(kmer_r);
-  breadth_q.push(0);
+  ws.push(kmer_f, kmer_r, 0);
 
-  while(!node_q.empty()) {
-    kmer_f = node_q.front();
-    node_q.pop();
-    kmer_r = node_q.front();
-    node_q.pop();
-    breadth = breadth_q.front();
-    breadth_q.pop();
+  while(!ws.queue_empty()) {
+    TraversalNode node = ws.pop();
+    kmer_f = node.kmer_f;
+    kmer_r = node.kmer_r;
+    breadth = node.breadth;
 
     if (breadth > radius) {
       break;
@@ -1311,7 +2085,7 @@ const
     }
 
     HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
-    if (set_contains(keeper, kmer)) {
+    if (ws.is_visited(kmer)) {
       continue;
     }
 
@@ -1320,13 +2094,9 @@ const
     }
 
     // keep track of seen kmers
-    keeper.insert(kmer);
+    ws.visit(kmer);
     total++;
 
-    if (false && !is_first_kmer && set_contains(all_tags, kmer)) {
-      continue;
-    }
-
     assert(breadth >= cur_breadth); // keep track of watermark, for debugging.
     if (breadth > cur_breadth) { cur_breadth = breadth; }
 
@@ -1334,68 +2104,14 @@ const
     // Enqueue next set of nodes.
     //
 
-    // NEXT.
-    f = next_f(kmer_f, 'A');
-    r = next_r(kmer_r, 'A');
-      
-    // f = ((kmer_f << 2) & bitmask) | twobit_repr('A');
-    r = next_r(kmer_r, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'C');
-    r = next_r(kmer_r, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'G');
-    r = next_r(kmer_r, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'T');
-    r = next_r(kmer_r, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    // PREVIOUS.
-    r = prev_r(kmer_r, 'A');
-    f = prev_f(kmer_f, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    r = prev_r(kmer_r, 'C');
-    f = prev_f(kmer_f, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-    
-    r = prev_r(kmer_r, 'G');
-    f = prev_f(kmer_f, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+    HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+    unsigned int present = get_neighbors(kmer_f, kmer_r, f, r);
 
-    r = prev_r(kmer_r, 'T');
-    f = prev_f(kmer_f, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
+    for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+      if ((present & (1 << i)) && !ws.is_visited(uniqify_rc(f[i], r[i]))) {
+	ws.push(f[i], r[i], breadth + 1);
+      }
     }
-
-    is_first_kmer = false;
   }
 
   return total;
@@ -1454,6 +2170,20 @@ void Hashbits::load_stop_tags(std::string infilename, bool clear_tags)
 
   infile.read((char *) &version, 1);
   infile.read((char *) &ht_type, 1);
+
+  if (version == SAVED_PACKED_TAGS_VERSION) {
+    infile.close();
+
+    TagFile tagfile(infilename);
+    if (!tagfile.is_open() || tagfile.ht_type() != SAVED_STOPTAGS ||
+	tagfile.ksize() != _ksize) {
+      throw std::runtime_error("bad packed tag file " + infilename);
+    }
+
+    tagfile.load_into(stop_tags);
+    return;
+  }
+
   assert(version == SAVED_FORMAT_VERSION);
   assert(ht_type == SAVED_STOPTAGS);
   
@@ -1465,6 +2195,7 @@ void Hashbits::load_stop_tags(std::string infilename, bool clear_tags)
 
   infile.read((char *) buf, sizeof(HashIntoType) * tagset_size);
 
+  stop_tags.reserve(stop_tags.size() + tagset_size);
   for (unsigned int i = 0; i < tagset_size; i++) {
     stop_tags.insert(buf[i]);
   }
@@ -1472,8 +2203,14 @@ void Hashbits::load_stop_tags(std::string infilename, bool clear_tags)
   delete buf;
 }
 
-void Hashbits::save_stop_tags(std::string outfilename)
+void Hashbits::save_stop_tags(std::string outfilename, bool packed)
 {
+  if (packed) {
+    save_packed_tags(outfilename, SAVED_STOPTAGS, _ksize, _tag_density,
+		     stop_tags);
+    return;
+  }
+
   ofstream outfile(outfilename.c_str(), ios::binary);
   const unsigned int tagset_size = stop_tags.size();
 
@@ -1490,7 +2227,7 @@ void Hashbits::save_stop_tags(std::string outfilename)
   outfile.write((const char *) &tagset_size, sizeof(tagset_size));
 
   unsigned int i = 0;
-  for (SeenSet::iterator pi = stop_tags.begin(); pi != stop_tags.end();
+  for (TagSet::const_iterator pi = stop_tags.begin(); pi != stop_tags.end();
 	 pi++, i++) {
     buf[i] = *pi;
   }
@@ -1505,10 +2242,10 @@ void Hashbits::print_stop_tags(std::string infilename)
 {
   ofstream printfile(infilename.c_str());
 
-  unsigned int i = 0;
-  for (SeenSet::iterator pi = stop_tags.begin(); pi != stop_tags.end();
-	 pi++, i++) {
-    std::string kmer = _revhash(*pi, _ksize);
+  // in order, as they used to come out of a std::set.
+  const std::vector<HashIntoType> &tags = stop_tags.sorted();
+  for (unsigned int i = 0; i < tags.size(); i++) {
+    std::string kmer = _revhash(tags[i], _ksize);
     printfile << kmer << "\n";
   }
   
@@ -1519,29 +2256,29 @@ void Hashbits::print_tagset(std::string infilename)
 {
   ofstream printfile(infilename.c_str());
 
-  unsigned int i = 0;
-  for (SeenSet::iterator pi = all_tags.begin(); pi != all_tags.end();
-	 pi++, i++) {
-    std::string kmer = _revhash(*pi, _ksize);
+  // in order, as they used to come out of a std::set.
+  const std::vector<HashIntoType> &tags = all_tags.sorted();
+  for (unsigned int i = 0; i < tags.size(); i++) {
+    std::string kmer = _revhash(tags[i], _ksize);
     printfile << kmer << "\n";
   }
   
   printfile.close();
 }
 
-unsigned int Hashbits::count_and_transfer_to_stoptags(SeenSet &keeper,
-						      unsigned int threshold,
-						      CountingHash &counting)
+unsigned int Hashbits::count_and_transfer_to_stoptags(
+				const std::vector<HashIntoType> &keeper,
+				unsigned int threshold,
+				CountingHash &counting)
 {
   unsigned int n_inserted = 0;
 
-  SeenSet::const_iterator ti;
-  for (ti = keeper.begin(); ti != keeper.end(); ti++) {
-    if (counting.get_count(*ti) >= threshold) {
-      stop_tags.insert(*ti);
+  for (unsigned int i = 0; i < keeper.size(); i++) {
+    if (counting.get_count(keeper[i]) >= threshold) {
+      stop_tags.insert(keeper[i]);
       n_inserted++;
     } else {
-      counting.count(*ti);
+      counting.count(keeper[i]);
     }
   }
 
@@ -1559,7 +2296,7 @@ void Hashbits::traverse_from_reads(std::string filename,
 
   IParser* parser = IParser::get_parser(filename.c_str());
   Read read;
-  SeenSet keeper;
+  TraversalWorkspace ws;
 
   string seq = "";
 
@@ -1575,18 +2312,16 @@ void Hashbits::traverse_from_reads(std::string filename,
       const char * last_kmer = seq.c_str() + seq.length() - _ksize;
       HashIntoType kmer = _hash(last_kmer, _ksize);
 
-      unsigned int n = traverse_from_kmer(kmer, radius, keeper);
+      unsigned int n = traverse_from_kmer(kmer, radius, ws);
 
       if (n >= big_threshold) {
 #if VERBOSE_REPARTITION
 	std::cout << "lump: " << n << "; added: " << total_stop << "\n";
 #endif
-	total_stop += count_and_transfer_to_stoptags(keeper,
+	total_stop += count_and_transfer_to_stoptags(ws.visited(),
 						     transfer_threshold,
 						     counting);
       }
-
-      keeper.clear();
     }
 	       
     // reset the sequence info, increment read number
@@ -1614,6 +2349,7 @@ void Hashbits::consume_fasta_and_traverse(const std::string &filename,
 
   IParser* parser = IParser::get_parser(filename.c_str());
   Read read;
+  TraversalWorkspace ws;
 
   string seq = "";
 
@@ -1641,14 +2377,13 @@ void Hashbits::consume_fasta_and_traverse(const std::string &filename,
       }
 
       if (!is_first_kmer) {	// traverse
-	SeenSet keeper;
-
-	unsigned int n = traverse_from_kmer(kmer, radius, keeper);
+	unsigned int n = traverse_from_kmer(kmer, radius, ws);
 	if (n >= big_threshold) {
 #if VERBOSE_REPARTITION
 	  std::cout << "lmp: " << n << "; added: " << stop_tags.size() << "\n";
 #endif // VERBOSE_REPARTITION
-	  count_and_transfer_to_stoptags(keeper, transfer_threshold, counting);
+	  count_and_transfer_to_stoptags(ws.visited(), transfer_threshold,
+					 counting);
 	}
       }
     }
@@ -1806,8 +2541,260 @@ unsigned int Hashbits::check_and_process_read_overlap(const std::string &read,
 }
 
 //
-// consume_fasta: consume a FASTA file of reads
+// consume_fasta_overlap: consume a file of reads, comparing the new k-mers
+// against a panel of tables.
+//
+// The curve is kept as segments of 'resolution' reads, each holding the
+// new k-mers and overlaps for its reads; each thread works out the
+// segments for a batch and adds them in under the lock.  When there are
+// more than 2*n_points segments, neighbouring pairs are merged and the
+// resolution doubles, so the file never has to be read twice.
 //
+// Given the read counts to put the points at instead (at_reads), segment
+// i holds the reads from at_reads[i - 1] up to at_reads[i], and the last
+// one the rest of the file; the resolution stays at 1.
+//
+
+struct _OverlapState {
+  Hashbits * ht;
+  const std::vector<const Hashbits *> * panel;
+  ReadBatchSource * source;
+  HashIntoType lower_bound, upper_bound;
+  const ReadMaskTable * readmask;
+  const std::vector<unsigned long long> * at_reads;
+  unsigned int max_segments;
+
+  pthread_mutex_t mutex;
+  volatile unsigned long long resolution; // a power of two
+  std::vector<std::vector<HashIntoType> > segments; // new k-mers, overlaps
+  std::vector<unsigned long long> invalid_reads;
+
+  CallbackFn callback;
+  void * callback_data;
+  unsigned long long n_done;
+  unsigned long long n_consumed;
+  HashIntoType n_new_bins;
+};
+
+static void _add_overlap_segments(_OverlapState * state,
+				  const std::vector<std::pair<unsigned long long, std::vector<HashIntoType> > > &local)
+{
+  unsigned long long resolution = state->resolution;
+
+  for (unsigned int i = 0; i < local.size(); i++) {
+    unsigned long long seg = local[i].first / resolution;
+    if (seg >= state->segments.size()) {
+      state->segments.resize(seg + 1,
+			     std::vector<HashIntoType>(local[i].second.size(),
+						       0));
+    }
+
+    std::vector<HashIntoType> &counts = state->segments[seg];
+    for (unsigned int j = 0; j < counts.size(); j++) {
+      counts[j] += local[i].second[j];
+    }
+  }
+
+  while (state->segments.size() > state->max_segments) {
+    std::vector<std::vector<HashIntoType> > merged;
+    for (unsigned int i = 0; i < state->segments.size(); i += 2) {
+      merged.push_back(state->segments[i]);
+      if (i + 1 < state->segments.size()) {
+	for (unsigned int j = 0; j < merged.back().size(); j++) {
+	  merged.back()[j] += state->segments[i + 1][j];
+	}
+      }
+    }
+    state->segments.swap(merged);
+    state->resolution = resolution = resolution * 2;
+  }
+}
+
+static void _consume_overlap_thread(unsigned int thread_id, void * data)
+{
+  _OverlapState * state = (_OverlapState *) data;
+  Hashbits * ht = state->ht;
+  const std::vector<const Hashbits *> &panel = *state->panel;
+  const bool bounded = state->lower_bound || state->upper_bound;
+
+  // per-batch segments: (first read, counts).
+  std::vector<std::pair<unsigned long long, std::vector<HashIntoType> > > local;
+  std::vector<unsigned long long> invalid;
+  std::vector<HashIntoType> kmers;
+  unsigned long long n_consumed = 0;
+  HashIntoType n_new_bins = 0;
+
+  ReadBatch batch;
+
+  while (state->source->next_batch(batch)) {
+    // segments only get wider, so ones this narrow still fit later.
+    unsigned long long resolution = state->resolution;
+
+    local.clear();
+    invalid.clear();
+
+    for (unsigned int i = 0; i < batch.reads.size(); i++) {
+      unsigned long long read_num = batch.first_read + i;
+      unsigned long long seg_start = read_num - read_num % resolution;
+      if (state->at_reads) {
+	seg_start = std::upper_bound(state->at_reads->begin(),
+				     state->at_reads->end(), read_num) -
+	  state->at_reads->begin();
+      }
+
+      if (local.empty() || local.back().first != seg_start) {
+	local.push_back(std::make_pair(seg_start,
+			     std::vector<HashIntoType>(panel.size() + 1, 0)));
+      }
+      std::vector<HashIntoType> &counts = local.back().second;
+
+      if (state->readmask && !state->readmask->get(read_num)) {
+	continue;
+      }
+
+      const std::string &seq = batch.reads[i].seq;
+      if (!ht->check_read(seq)) {
+	invalid.push_back(read_num);
+	continue;
+      }
+
+      // hash the read, and start loading its bins.
+      kmers.clear();
+      KMerIterator ki(seq.c_str(), ht->ksize());
+      while (!ki.done()) {
+	HashIntoType kmer = ki.next();
+	if (!bounded ||
+	    (kmer >= state->lower_bound && kmer < state->upper_bound)) {
+	  kmers.push_back(kmer);
+	  ht->prefetch(kmer);
+	}
+      }
+      n_consumed += kmers.size();
+
+      for (unsigned int j = 0; j < kmers.size(); j++) {
+	if (ht->test_and_set_bits(kmers[j], n_new_bins)) {
+	  counts[0]++;
+	  for (unsigned int p = 0; p < panel.size(); p++) {
+	    if (panel[p]->get_count(kmers[j])) {
+	      counts[p + 1]++;
+	    }
+	  }
+	}
+      }
+    }
+
+    pthread_mutex_lock(&state->mutex);
+    _add_overlap_segments(state, local);
+    state->invalid_reads.insert(state->invalid_reads.end(),
+				invalid.begin(), invalid.end());
+    pthread_mutex_unlock(&state->mutex);
+
+    unsigned long long consumed = __sync_add_and_fetch(&state->n_consumed,
+						       n_consumed);
+    __sync_fetch_and_add(&state->n_new_bins, n_new_bins);
+    n_consumed = n_new_bins = 0;
+
+    unsigned long long n_before = __sync_fetch_and_add(&state->n_done,
+						       batch.reads.size());
+    unsigned long long n_after = n_before + batch.reads.size();
+
+    // run callback, if specified -- from the calling thread only.
+    if (thread_id == 0 && state->callback &&
+	n_after / CALLBACK_PERIOD != n_before / CALLBACK_PERIOD) {
+      state->callback("consume_fasta_overlap", state->callback_data,
+		      n_after, consumed);
+    }
+  }
+}
+
+void Hashbits::consume_fasta_overlap(const std::string &filename,
+				     const std::vector<const Hashbits *> &panel,
+				     unsigned int n_points,
+				     OverlapCurve &curve,
+				     unsigned int &total_reads,
+				     unsigned long long &n_consumed,
+				     unsigned int n_threads,
+				     CallbackFn callback,
+				     void * callback_data,
+				     HashIntoType lower_bound,
+				     HashIntoType upper_bound,
+				     const ReadMaskTable * readmask,
+				     std::vector<unsigned long long> * invalid_reads,
+				     const std::vector<unsigned long long> * at_reads)
+{
+  ReadBatchSource source(filename);
+
+  _OverlapState state;
+  state.ht = this;
+  state.panel = &panel;
+  state.source = &source;
+  state.lower_bound = lower_bound;
+  state.upper_bound = upper_bound;
+  state.readmask = readmask;
+  state.at_reads = at_reads;
+  state.max_segments = at_reads ? at_reads->size() + 1 :
+    2 * (n_points ? n_points : 1);
+  pthread_mutex_init(&state.mutex, NULL);
+  state.resolution = 1;
+  state.callback = callback;
+  state.callback_data = callback_data;
+  state.n_done = 0;
+  state.n_consumed = 0;
+  state.n_new_bins = 0;
+
+  try {
+    run_threads(n_threads, _consume_overlap_thread, &state,
+		source.stop_flag());
+  } catch (...) {
+    // keep the k-mers that were loaded before the callback stopped us.
+    _occupied_bins += state.n_new_bins;
+    pthread_mutex_destroy(&state.mutex);
+    throw;
+  }
+  pthread_mutex_destroy(&state.mutex);
+
+  _occupied_bins += state.n_new_bins;
+  total_reads = source.n_reads();
+  n_consumed = state.n_consumed;
+
+  // add up the segments.
+  curve.n_reads.clear();
+  curve.n_unique.clear();
+  curve.n_overlap.clear();
+
+  unsigned int n_segments = state.segments.size();
+  if (at_reads && total_reads) {
+    n_segments = at_reads->size() + 1;	// a point for each, even if empty
+    state.segments.resize(n_segments,
+			  std::vector<HashIntoType>(panel.size() + 1, 0));
+  }
+
+  std::vector<HashIntoType> sum(panel.size() + 1, 0);
+  for (unsigned int i = 0; i < n_segments; i++) {
+    for (unsigned int j = 0; j < sum.size(); j++) {
+      sum[j] += state.segments[i][j];
+    }
+
+    unsigned long long n_reads = (i + 1) * state.resolution;
+    if (at_reads) {
+      n_reads = i < at_reads->size() ? (*at_reads)[i] : total_reads;
+    }
+    if (n_reads > total_reads) {
+      n_reads = total_reads;
+    }
+
+    curve.n_reads.push_back(n_reads);
+    curve.n_unique.push_back(sum[0]);
+    curve.n_overlap.push_back(std::vector<HashIntoType>(sum.begin() + 1,
+							 sum.end()));
+  }
+  _n_unique_kmers += sum[0];
+
+  if (invalid_reads) {
+    invalid_reads->swap(state.invalid_reads);
+    std::sort(invalid_reads->begin(), invalid_reads->end());
+  }
+}
 
 void Hashbits::consume_fasta_overlap(const std::string &filename,
                                         HashIntoType curve[2][100],Hashbits &ht2,
@@ -1820,109 +2807,67 @@ void Hashbits::consume_fasta_overlap(const std::string &filename,
 			      CallbackFn callback,
 			      void * callback_data)
 {
-  total_reads = 0;
-  n_consumed = 0;
-  Read read;
-
-//get total number of reads in dataset
-
-  IParser* parser = IParser::get_parser(filename.c_str());
-  while(!parser->is_complete())  {
-    read = parser->get_next_read();
-    total_reads++;
-  }
-//block size for curve
-  int block_size = total_reads/100;
-  
-  total_reads = 0;
-  khmer::HashIntoType start = 0, stop = 0;
-  parser = IParser::get_parser(filename.c_str());
-
-
-
-  string currName = "";
-  string currSeq = "";
-
-  //
-  // readmask stuff: were we given one? do we want to update it?
-  // 
-
   ReadMaskTable * readmask = NULL;
-  std::list<unsigned int> masklist;
-
   if (orig_readmask && *orig_readmask) {
     readmask = *orig_readmask;
   }
 
-  //
-  // iterate through the FASTA file & consume the reads.
-  //
+  // count the reads first, for the points: every block_size reads, with
+  // block_size the whole number of reads in 1% of them.
+  unsigned long long n_reads = 0;
+  IParser * parser = IParser::get_parser(filename.c_str());
+  while (!parser->is_complete()) {
+    parser->get_next_read();
+    n_reads++;
+  }
+  delete parser;
 
-  while(!parser->is_complete())  {
-    read = parser->get_next_read();
-    currSeq = read.seq;
-    currName = read.name; 
-
-    // do we want to process it?
-    if (!readmask || readmask->get(total_reads)) {
-
-      // yep! process.
-      unsigned int this_n_consumed;
-      bool is_valid;
-
-      this_n_consumed = check_and_process_read_overlap(currSeq,
-					       is_valid,
-					       lower_bound,
-					       upper_bound,ht2);
-
-      // was this an invalid sequence -> mark as bad?
-      if (!is_valid && update_readmask) {
-        if (readmask) {
-	  readmask->set(total_reads, false);
-	} else {
-	  masklist.push_back(total_reads);
-	}
-      } else {		// nope -- count it!
-        n_consumed += this_n_consumed;
-      }
-    }
-	       
-    // reset the sequence info, increment read number
+  const unsigned long long block_size = n_reads / 100;
+  std::vector<unsigned long long> at_reads(100);
+  for (unsigned int i = 0; i < 100; i++) {
+    at_reads[i] = block_size ? block_size * (i + 1) : n_reads * (i + 1) / 100;
+  }
 
-    total_reads++;
+  std::vector<const Hashbits *> panel(1, &ht2);
+  OverlapCurve points;
+  std::vector<unsigned long long> invalid;
+  HashIntoType n_unique_before = _n_unique_kmers;
+  HashIntoType n_overlap_before = _n_overlap_kmers;
 
-    if (total_reads%block_size == 0) {
-        curve[0][total_reads/block_size-1] = n_overlap_kmers(start,stop);
-        curve[1][total_reads/block_size-1] = n_kmers(start,stop);
-    }
-    // run callback, if specified
-    if (total_reads % CALLBACK_PERIOD == 0 && callback) {
-      try {
-        callback("consume_fasta", callback_data, total_reads, n_consumed);
-      } catch (...) {
-        throw;
-      }
-    }
-//   count<<curve[0][0]<<" ";
-//   count<< curve[0][1]<<" ";
+  consume_fasta_overlap(filename, panel, 100, points, total_reads,
+			n_consumed, 1, callback, callback_data,
+			lower_bound, upper_bound, readmask, &invalid,
+			&at_reads);
 
+  if (!points.n_overlap.empty()) {
+    _n_overlap_kmers += points.n_overlap.back()[0];
   }
 
+  for (unsigned int i = 0; i < 100; i++) {
+    curve[0][i] = n_overlap_before;
+    curve[1][i] = n_unique_before;
+    if (i < points.n_reads.size()) {
+      curve[0][i] += points.n_overlap[i][0];
+      curve[1][i] += points.n_unique[i];
+    }
+  }
 
   //
-  // We've either updated the readmask in place, OR we need to create a
-  // new one.
+  // Either update the readmask in place, OR create a new one.
   //
 
-  if (orig_readmask && update_readmask && readmask == NULL) {
-    // allocate, fill in from masklist
-    readmask = new ReadMaskTable(total_reads);
-
-    list<unsigned int>::const_iterator it;
-    for(it = masklist.begin(); it != masklist.end(); ++it) {
-      readmask->set(*it, false);
+  if (update_readmask) {
+    if (readmask) {
+      for (unsigned int i = 0; i < invalid.size(); i++) {
+	readmask->set(invalid[i], false);
+      }
+    } else if (orig_readmask) {
+      readmask = new ReadMaskTable(total_reads);
+      for (unsigned int i = 0; i < invalid.size(); i++) {
+	readmask->set(invalid[i], false);
+      }
+      *orig_readmask = readmask;
     }
-    *orig_readmask = readmask;
   }
 }
 
@@ -2,8 +2,14 @@
 #define HASHBITS_HH
 
 #include <vector>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "hashtable.hh"
+#include "hllcounter.hh"
 #include "subset.hh"
+#include "unitigs.hh"
 
 #define next_f(kmer_f, ch) ((((kmer_f) << 2) & bitmask) | (twobit_repr(ch)))
 #define next_r(kmer_r, ch) (((kmer_r) >> 2) | (twobit_comp(ch) << rc_left_shift))
@@ -13,11 +19,250 @@
 
 #define set_contains(s, e) ((s).find(e) != (s).end())
 
+// get_neighbors: neighbors 0-3 are the next k-mers (A, C, G, T added on
+// the right), 4-7 the previous ones (A, C, G, T added on the left).
+#define N_NEIGHBORS 8
+#define NEIGHBORS_NEXT 0x0f
+#define NEIGHBORS_PREV 0xf0
+
+#define DEFAULT_TAG_SHARDS 64
+#define DEFAULT_ADJACENCY_CACHE_BYTES (64*1024*1024)
+
 namespace khmer {
   class CountingHash;
 
+  //
+  // TagShards: a set of tags that several threads can add to at once,
+  // split by hash into shards that each have their own lock.
+  //
+
+  class TagShards {
+  protected:
+    std::vector<SeenSet> _shards;
+    std::vector<pthread_mutex_t> _locks;
+
+    unsigned int _shard(HashIntoType tag) const {
+      return _mix_hash(tag) % _shards.size();
+    }
+
+  public:
+    TagShards(unsigned int n_shards = DEFAULT_TAG_SHARDS) :
+      _shards(n_shards), _locks(n_shards) {
+      for (unsigned int i = 0; i < n_shards; i++) {
+	pthread_mutex_init(&_locks[i], NULL);
+      }
+    }
+
+    ~TagShards() {
+      for (unsigned int i = 0; i < _locks.size(); i++) {
+	pthread_mutex_destroy(&_locks[i]);
+      }
+    }
+
+    void insert(HashIntoType tag) {
+      unsigned int i = _shard(tag);
+      pthread_mutex_lock(&_locks[i]);
+      _shards[i].insert(tag);
+      pthread_mutex_unlock(&_locks[i]);
+    }
+
+    bool contains(HashIntoType tag) {
+      unsigned int i = _shard(tag);
+      pthread_mutex_lock(&_locks[i]);
+      bool found = set_contains(_shards[i], tag);
+      pthread_mutex_unlock(&_locks[i]);
+      return found;
+    }
+
+    // move everything into 'tags'; only once the threads are done.
+    void merge_into(TagSet &tags) {
+      for (unsigned int i = 0; i < _shards.size(); i++) {
+	tags.insert(_shards[i].begin(), _shards[i].end());
+	_shards[i].clear();
+      }
+    }
+  };
+
+  //
+  // AdjacencyCache: a bounded, direct-mapped cache of get_neighbors()
+  // masks, keyed by the canonical k-mer (uniqify_rc) and stored for that
+  // orientation.  A colliding k-mer simply replaces the old entry.
+  //
+  // Each slot holds key^data and data, so that several traversal threads
+  // can share the cache without locks: a torn write just reads as a miss.
+  // data also holds a generation number, so clear() is O(1).  The hit &
+  // lookup counts are kept per thread, each on its own cache line, and
+  // summed when asked for (see _adjacency_stats_stripe).
+  //
+
+#define ADJACENCY_STAT_STRIPES 64
+
+  // this thread's stripe of the AdjacencyCache statistics.
+  extern __thread unsigned int _adjacency_stripe; // stripe + 1; 0 = unset
+  unsigned int _assign_adjacency_stripe();
+
+  inline unsigned int _adjacency_stats_stripe() {
+    return _adjacency_stripe ? _adjacency_stripe - 1 :
+      _assign_adjacency_stripe();
+  }
+
+  class AdjacencyCache {
+  protected:
+    struct Slot {
+      volatile HashIntoType check;
+      volatile HashIntoType data;
+    };
+
+    struct StatStripe {
+      HashIntoType n_lookups;
+      HashIntoType n_hits;
+      HashIntoType pad[6];	// a cache line each
+    };
+
+    Slot * _slots;
+    HashIntoType _n_slots;	// a power of two
+    volatile HashIntoType _generation;
+    volatile HashIntoType _stamp;
+    StatStripe _stats[ADJACENCY_STAT_STRIPES];
+
+    Slot& _slot(HashIntoType kmer) const {
+      return _slots[_mix_hash(kmer) & (_n_slots - 1)];
+    }
+
+  public:
+    AdjacencyCache(HashIntoType max_bytes);
+    ~AdjacencyCache() { delete[] _slots; }
+
+    bool get(HashIntoType kmer, unsigned int &mask) {
+      const Slot &s = _slot(kmer);
+      HashIntoType data = s.data;
+      HashIntoType check = s.check;
+
+      StatStripe &stats = _stats[_adjacency_stats_stripe()];
+      stats.n_lookups++;
+      if ((check ^ data) != kmer || (data >> 8) != _generation) {
+	return false;
+      }
+      stats.n_hits++;
+
+      mask = data & 0xff;
+      return true;
+    }
+
+    void set(HashIntoType kmer, unsigned int mask) {
+      Slot &s = _slot(kmer);
+      HashIntoType data = (_generation << 8) | (mask & 0xff);
+
+      s.data = data;
+      s.check = kmer ^ data;
+    }
+
+    void clear() { __sync_add_and_fetch(&_generation, 1); }
+
+    // the entries are only good for one state of the owning table;
+    // 'stamp' identifies that state, and changing it clears the cache.
+    HashIntoType stamp() const { return _stamp; }
+    void set_stamp(HashIntoType stamp) { _stamp = stamp; clear(); }
+
+    HashIntoType n_slots() const { return _n_slots; }
+    HashIntoType n_lookups() const {
+      HashIntoType n = 0;
+      for (unsigned int i = 0; i < ADJACENCY_STAT_STRIPES; i++) {
+	n += _stats[i].n_lookups;
+      }
+      return n;
+    }
+    HashIntoType n_hits() const {
+      HashIntoType n = 0;
+      for (unsigned int i = 0; i < ADJACENCY_STAT_STRIPES; i++) {
+	n += _stats[i].n_hits;
+      }
+      return n;
+    }
+    double hit_rate() const {
+      HashIntoType n = n_lookups();
+      return n ? (double) n_hits() / (double) n : 0.0;
+    }
+    void reset_stats() { memset(_stats, 0, sizeof(_stats)); }
+  };
+
+  //
+  // BitArrays: the bits of a Hashbits-style table, as one array per table
+  // (or a single array for BlockedHashbits), for bitwise operations
+  // between tables and saved files.  Two tables can be combined only if
+  // they have the same layout: same type, sizes and bits per k-mer.
+  //
+
+#define BITS_COUNT 0		// just count the bits set
+#define BITS_UNION 1
+#define BITS_INTERSECTION 2
+#define BITS_DIFFERENCE 3	// a & ~b
+
+  struct BitArrays {
+    unsigned char ht_type;		// SAVED_HASHBITS or SAVED_BLOCKED_HASHBITS
+    WordLength ksize;
+    std::vector<const Byte *> arrays;
+    std::vector<HashIntoType> n_bytes;
+    std::vector<HashIntoType> n_bits;
+    std::vector<unsigned int> bits_per_kmer;
+
+    bool same_layout(const BitArrays &other) const {
+      return ht_type == other.ht_type && ksize == other.ksize &&
+	n_bits == other.n_bits && bits_per_kmer == other.bits_per_kmer;
+    }
+  };
+
+  // a op b, on n_threads threads: the bits set in the result, for each
+  // array, and the result itself in 'out' unless that is empty.
+  void sweep_bits(unsigned int op, const BitArrays &a, const BitArrays * b,
+		  std::vector<Byte *> &out, std::vector<HashIntoType> &n_set,
+		  unsigned int n_threads = 1);
+
+  //
+  // HashbitsFile: a saved Hashbits or BlockedHashbits file, mmapped
+  // read-only, so that it can be used in bitwise operations without
+  // loading it.
+  //
+
+  class HashbitsFile {
+  protected:
+    void * _map;
+    size_t _map_size;
+    BitArrays _bits;
+
+    bool _parse(const Byte * p, const Byte * end);
+
+  public:
+    HashbitsFile(const std::string &filename);
+    ~HashbitsFile();
+
+    // false if the file could not be mapped, or is not a table.
+    bool is_open() const { return _map != NULL; }
+
+    const BitArrays& bit_arrays() const { return _bits; }
+  };
+
+  //
+  // OverlapCurve: the saturation curve from Hashbits::consume_fasta_overlap.
+  // After n_reads[i] reads, n_unique[i] new k-mers had been seen, and
+  // n_overlap[i][j] of them were in panel table j.  The points are evenly
+  // spaced in reads (a power of two apart), and the last one is the whole
+  // file; there are between n_points and 2*n_points of them, or one per
+  // read for short files.  Or they can be put at given read counts, with
+  // one more for the whole file.  With several threads, a k-mer seen in
+  // two batches that are being loaded at once may be counted against
+  // either.
+  //
+
+  struct OverlapCurve {
+    std::vector<unsigned long long> n_reads;
+    std::vector<HashIntoType> n_unique;
+    std::vector<std::vector<HashIntoType> > n_overlap;
+  };
+
   class Hashbits : public khmer::Hashtable {
     friend class SubsetPartition;
+    friend class UnitigIndex;
   protected:
     std::vector<HashIntoType> _tablesizes;
     unsigned int _n_tables;
@@ -26,6 +271,7 @@ namespace khmer {
     HashIntoType _n_unique_kmers;
 	HashIntoType _n_overlap_kmers;
     Byte ** _counts;
+    AdjacencyCache * _adjacency_cache;
 
     virtual void _allocate_counters() {
       _n_tables = _tablesizes.size();
@@ -44,27 +290,67 @@ namespace khmer {
       }
     }
             
+    void _save_occupancy(std::ofstream &outfile) const;
+    void _load_occupancy(std::ifstream &infile, unsigned char version);
+
     void _clear_all_partitions() {
       if (partition != NULL) {
 	partition->_clear_all_partitions();
       }
     }
 
+    // for subclasses that keep the bits in their own layout.
+    Hashbits(WordLength ksize, unsigned int n_tables) :
+      khmer::Hashtable(ksize), _n_tables(n_tables), _counts(NULL),
+      _adjacency_cache(NULL) {
+      _tag_density = DEFAULT_TAG_DENSITY;
+      assert(_tag_density % 2 == 0);
+      partition = new SubsetPartition(this);
+      unitig_index = NULL;
+      _occupied_bins = 0;
+      _n_unique_kmers = 0;
+	  _n_overlap_kmers = 0;
+    }
+
   public:
     SubsetPartition * partition;
-    SeenSet all_tags;
-    SeenSet stop_tags;
-    SeenSet repart_small_tags;
+    UnitigIndex * unitig_index;	// NULL unless built
+    TagSet all_tags;
+    TagSet stop_tags;
+    TagSet repart_small_tags;
+    TagSet partition_todo_tags;	// see consume_fasta_and_partition
 
     void _validate_pmap() {
       if (partition) { partition->_validate_pmap(); }
     }
 
     Hashbits(WordLength ksize, std::vector<HashIntoType>& tablesizes) :
-      khmer::Hashtable(ksize), _tablesizes(tablesizes) {
+      khmer::Hashtable(ksize), _tablesizes(tablesizes),
+      _adjacency_cache(NULL) {
+      _tag_density = DEFAULT_TAG_DENSITY;
+      assert(_tag_density % 2 == 0);
+      partition = new SubsetPartition(this);
+      unitig_index = NULL;
+      _occupied_bins = 0;
+      _n_unique_kmers = 0;
+	  _n_overlap_kmers = 0;
+
+      _allocate_counters();
+    }
+
+    // "auto" sizing: pick table sizes for the estimated number of
+    // distinct k-mers, a target false positive rate & a memory budget.
+    Hashbits(WordLength ksize, const HLLCounter &estimate,
+	     HashIntoType max_memory = 0,
+	     double target_fp = DEFAULT_TARGET_FP) :
+      khmer::Hashtable(ksize), _adjacency_cache(NULL) {
+      choose_table_sizes(estimate.estimate_cardinality(), max_memory,
+			 target_fp, 1, _tablesizes);
+
       _tag_density = DEFAULT_TAG_DENSITY;
       assert(_tag_density % 2 == 0);
       partition = new SubsetPartition(this);
+      unitig_index = NULL;
       _occupied_bins = 0;
       _n_unique_kmers = 0;
 	  _n_overlap_kmers = 0;
@@ -73,6 +359,9 @@ namespace khmer {
     }
 
     ~Hashbits() {
+      disable_adjacency_cache();
+      clear_unitig_index();
+
       if (_counts) {
 	for (unsigned int i = 0; i < _n_tables; i++) {
 	  delete _counts[i];
@@ -93,7 +382,9 @@ namespace khmer {
 
     virtual void save(std::string);
     virtual void load(std::string);
-    virtual void save_tagset(std::string);
+    // packed = true writes a sorted, gap-coded file (see TagFile); either
+    // kind can be loaded.
+    virtual void save_tagset(std::string, bool packed=false);
     virtual void load_tagset(std::string, bool clear_tags=true);
 
     // for debugging/testing purposes only!
@@ -145,12 +436,49 @@ namespace khmer {
 			       unsigned int &total_reads,
 			       unsigned long long &n_consumed,
 			       CallbackFn callback = 0,
+			       void * callback_data = 0)
+    {
+      consume_fasta_and_tag(filename, total_reads, n_consumed, 1,
+			    callback, callback_data);
+    }
+
+    // with n_threads > 1, reads are loaded and tagged on several threads;
+    // each read still gets a tag at least every _tag_density k-mers.
+    void consume_fasta_and_tag(const std::string &filename,
+			       unsigned int &total_reads,
+			       unsigned long long &n_consumed,
+			       unsigned int n_threads,
+			       CallbackFn callback = 0,
 			       void * callback_data = 0);
 
     void consume_sequence_and_tag(const std::string& seq,
 				  unsigned long long& n_consumed,
 				  SeenSet * new_tags = 0);
 
+    // thread-safe version of the above, for use while other threads are
+    // loading too: all_tags is only read, and new tags go in 'new_tags'.
+    // The counters are the caller's own, and are added in afterwards.
+    void consume_sequence_and_tag_atomic(const std::string& seq,
+					 unsigned long long& n_consumed,
+					 HashIntoType& n_new_bins,
+					 HashIntoType& n_new_kmers,
+					 TagShards& new_tags);
+
+
+    // consume_fasta_and_tag, partitioning as it goes; the partitions are
+    // finished off by SubsetPartition::refine_streaming_partition.  See
+    // hashbits.cc.
+    void consume_fasta_and_partition(const std::string &filename,
+				     unsigned int &total_reads,
+				     unsigned long long &n_consumed,
+				     CallbackFn callback = 0,
+				     void * callback_data = 0);
+
+    // consume and tag one read, with its tags in read_tags; true if it
+    // touched k-mers that were already in the graph.
+    bool consume_sequence_and_partition(const std::string& seq,
+					unsigned long long& n_consumed,
+					std::vector<HashIntoType>& read_tags);
 
     void consume_fasta_and_tag_with_stoptags(const std::string &filename,
 					     unsigned int &total_reads,
@@ -170,7 +498,33 @@ namespace khmer {
 				   CallbackFn callback = 0,
 				   void * callback_data = 0);
 
-    // for overlap k-mer counting
+    // consume a file of reads in one pass on n_threads threads, counting
+    // the new k-mers and how many of them are in each of the 'panel'
+    // tables; see OverlapCurve.  k-mers outside [lower_bound,
+    // upper_bound) are skipped, if those are not both 0, as are reads
+    // masked off in readmask; invalid reads are listed in invalid_reads.
+    // If at_reads (sorted) is given, the points are after exactly those
+    // numbers of reads, and n_points is ignored.
+    void consume_fasta_overlap(const std::string &filename,
+			       const std::vector<const Hashbits *> &panel,
+			       unsigned int n_points,
+			       OverlapCurve &curve,
+			       unsigned int &total_reads,
+			       unsigned long long &n_consumed,
+			       unsigned int n_threads = 1,
+			       CallbackFn callback = 0,
+			       void * callback_data = 0,
+			       HashIntoType lower_bound = 0,
+			       HashIntoType upper_bound = 0,
+			       const ReadMaskTable * readmask = NULL,
+			       std::vector<unsigned long long> * invalid_reads
+			       = NULL,
+			       const std::vector<unsigned long long> * at_reads
+			       = NULL);
+
+    // for overlap k-mer counting against one table: the curve has 100
+    // points, every total_reads/100 reads (or at each 1% of the reads, in
+    // files of fewer than 100), as ever; the reads are counted first.
     void consume_fasta_overlap(const std::string &filename,HashIntoType curve[2][100],
                                       khmer::Hashbits &ht2,
 			      unsigned int &total_reads,
@@ -197,6 +551,45 @@ namespace khmer {
 
 
 
+    // compute all 8 neighbors of kmer_f/kmer_r into f[]/r[] (see
+    // N_NEIGHBORS) and look them all up at once; bit i of the return
+    // value is set if neighbor i is present.
+    unsigned int get_neighbors(HashIntoType kmer_f, HashIntoType kmer_r,
+			       HashIntoType * f, HashIntoType * r) const;
+
+    // compact the graph around the tags into unitigs, so that the
+    // traversals can cross linear stretches in one step; see UnitigIndex.
+    // The index covers everything within 'radius' of a tag; the default
+    // is as far as partitioning looks.
+    void build_unitig_index(unsigned int radius = 0,
+			    unsigned int max_unitigs = 0) {
+      if (!unitig_index) {
+	unitig_index = new UnitigIndex(this);
+      }
+      unitig_index->build(radius ? radius : 2 * _tag_density + 1,
+			  max_unitigs);
+    }
+    void clear_unitig_index() {
+      delete unitig_index;
+      unitig_index = NULL;
+    }
+
+    // optionally remember get_neighbors() results; see AdjacencyCache.
+    void enable_adjacency_cache(HashIntoType max_bytes =
+				DEFAULT_ADJACENCY_CACHE_BYTES);
+    void disable_adjacency_cache() {
+      delete _adjacency_cache;
+      _adjacency_cache = NULL;
+    }
+    const AdjacencyCache * adjacency_cache() const {
+      return _adjacency_cache;
+    }
+
+    // fill the cache in one sweep, by traversing out to 'radius' from
+    // every tag on n_threads threads; returns the number of k-mers visited.
+    unsigned long long fill_adjacency_cache(unsigned int radius,
+					    unsigned int n_threads = 1);
+
     unsigned int kmer_degree(HashIntoType kmer_f, HashIntoType kmer_r) const;
     unsigned int kmer_degree(const char * kmer_s) const {
       HashIntoType kmer_f, kmer_r;
@@ -205,21 +598,57 @@ namespace khmer {
       return kmer_degree(kmer_f, kmer_r);
     }
 
-    // count number of occupied bins
+    // count number of occupied bins (averaged over the tables)
     virtual const HashIntoType n_occupied(HashIntoType start=0,
 				  HashIntoType stop=0) const {
-      // @@ CTB need to be able to *save* this...
       return _occupied_bins/_n_tables;
     }
       
     virtual const HashIntoType n_kmers(HashIntoType start=0,
                   HashIntoType stop=0) const {
-      return _n_unique_kmers;	// @@ CTB need to be able to *save* this...
+      return _n_unique_kmers;	// 0 if not known; see load, combine_tables
     }
 
     virtual const HashIntoType n_overlap_kmers(HashIntoType start=0,
                   HashIntoType stop=0) const {
-      return _n_overlap_kmers;	// @@ CTB need to be able to *save* this...
+      return _n_overlap_kmers;
+    }
+
+    // the tables' bits; see BitArrays.
+    virtual BitArrays bit_arrays() const;
+
+    // a new, empty table with the same layout, e.g. for combine_tables.
+    virtual Hashbits * empty_copy() const {
+      std::vector<HashIntoType> sizes = _tablesizes;
+      return new Hashbits(_ksize, sizes);
+    }
+
+    // count the bits set in each table, on n_threads threads.
+    void table_occupancy(std::vector<HashIntoType> &n_set,
+			 unsigned int n_threads = 1) const {
+      std::vector<Byte *> no_out;
+      sweep_bits(BITS_COUNT, bit_arrays(), NULL, no_out, n_set, n_threads);
+    }
+
+    // set this table to a op b (BITS_UNION etc.); either may be this
+    // table's own bits.  a and b must have the same layout as this table.
+    // The occupancy is recounted; n_kmers() is 0 afterwards, as the
+    // number of k-mers isn't known.
+    void combine_tables(unsigned int op, const BitArrays &a,
+			const BitArrays &b, unsigned int n_threads = 1);
+
+    // reset the occupied bin count from the tables themselves, for files
+    // that don't store it and after loading on several threads; returns
+    // the total over all tables.
+    HashIntoType recount_occupancy(unsigned int n_threads = 1) {
+      std::vector<HashIntoType> n_set;
+      table_occupancy(n_set, n_threads);
+
+      _occupied_bins = 0;
+      for (unsigned int i = 0; i < n_set.size(); i++) {
+	_occupied_bins += n_set[i];
+      }
+      return _occupied_bins;
     }
 
     virtual void count(const char * kmer) {
@@ -246,17 +675,8 @@ namespace khmer {
     }
 
 	virtual bool check_overlap(HashIntoType khash, Hashbits &ht2) {
-
-	  for (unsigned int i = 0; i < ht2._n_tables; i++) {
-		HashIntoType bin = khash % ht2._tablesizes[i];
-		HashIntoType byte = bin / 8;
-		unsigned char bit = bin % 8;
-		if (!( ht2._counts[i][byte] & (1<<bit))) {
-		  return false;
+	  return ht2.get_count(khash) != 0;
 	}
-      }
-	  return true;
-	  }
 
     virtual void count_overlap(const char * kmer, Hashbits &ht2) {
       HashIntoType hash = _hash(kmer, _ksize);
@@ -284,12 +704,39 @@ namespace khmer {
     }
 	}
 
+    // set the k-mer's bits with atomic fetch-or, so that several threads
+    // can load at once; returns true if the k-mer was not there before.
+    // Newly set bins are added to n_new_bins.
+    virtual bool test_and_set_bits(HashIntoType khash,
+				   HashIntoType &n_new_bins) {
+      bool is_new_kmer = false;
+
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	HashIntoType bin = khash % _tablesizes[i];
+	Byte mask = 1 << (bin % 8);
+
+	Byte old = __sync_fetch_and_or(&_counts[i][bin / 8], mask);
+	if (!(old & mask)) {
+	  n_new_bins++;
+	  is_new_kmer = true;
+	}
+      }
+      return is_new_kmer;
+    }
+
     // get the count for the given k-mer.
     virtual const BoundedCounterType get_count(const char * kmer) const {
       HashIntoType hash = _hash(kmer, _ksize);
       return get_count(hash);
     }
 
+    // start loading the bins for this k-mer, ahead of a get_count.
+    virtual void prefetch(HashIntoType khash) const {
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	__builtin_prefetch(_counts[i] + (khash % _tablesizes[i]) / 8);
+      }
+    }
+
     // get the count for the given k-mer hash.
     virtual const BoundedCounterType get_count(HashIntoType khash) const {
       for (unsigned int i = 0; i < _n_tables; i++) {
@@ -304,16 +751,23 @@ namespace khmer {
       return 1;
     }
 
+    // false positive rate, from how full the tables actually are.
+    virtual double estimated_fp_rate() const;
+
     void filter_if_present(const std::string infilename,
 			   const std::string outputfilename,
 			   CallbackFn callback=0,
 			   void * callback_data=0);
 
+    // the breadth-first searches take an optional TraversalWorkspace,
+    // which a caller doing many of them should keep and pass in.
+
     unsigned int count_kmers_within_radius(HashIntoType kmer_f,
 					   HashIntoType kmer_r,
 					   unsigned int radius,
 					   unsigned int max_count,
-					   const SeenSet * seen=0) const;
+					   const SeenSet * seen=0,
+					   TraversalWorkspace * ws=0) const;
     unsigned int count_kmers_within_depth(HashIntoType kmer_f,
 					  HashIntoType kmer_r,
 					  unsigned int depth,
@@ -323,12 +777,14 @@ namespace khmer {
     unsigned int find_radius_for_volume(HashIntoType kmer_f,
 					HashIntoType kmer_r,
 					unsigned int max_count,
-					unsigned int max_radius) const;
+					unsigned int max_radius,
+					TraversalWorkspace * ws=0) const;
 
     unsigned int count_kmers_on_radius(HashIntoType kmer_f,
 				       HashIntoType kmer_r,
 				       unsigned int radius,
-				       unsigned int max_volume) const;
+				       unsigned int max_volume,
+				       TraversalWorkspace * ws=0) const;
 
     unsigned int trim_on_degree(std::string sequence, unsigned int max_degree)
       const;
@@ -343,15 +799,29 @@ namespace khmer {
     void traverse_from_tags(unsigned int distance,
 			    unsigned int threshold,
 			    unsigned int num_high_todo,
-			    CountingHash &counting);
+			    CountingHash &counting,
+			    unsigned int n_threads=1);
+
+    // traverse_from_kmer from each tag in turn, as in traverse_from_tags,
+    // skipping (and adding to) small_tags if it is given; on n_threads
+    // threads, with the same stop tags and counts as on one.  See
+    // hashbits.cc.
+    void find_knots(const std::vector<HashIntoType>& tags,
+		    unsigned int distance,
+		    unsigned int threshold,
+		    unsigned int frequency,
+		    CountingHash &counting,
+		    TagSet * small_tags,
+		    unsigned int n_threads);
 
     unsigned int traverse_from_kmer(HashIntoType start,
 				    unsigned int radius,
-				    SeenSet &keeper) const;
+				    TraversalWorkspace &ws) const;
 
-    unsigned int count_and_transfer_to_stoptags(SeenSet &keeper,
-						unsigned int threshold,
-						CountingHash &counting);
+    unsigned int count_and_transfer_to_stoptags(
+				const std::vector<HashIntoType> &keeper,
+				unsigned int threshold,
+				CountingHash &counting);
 
     void traverse_from_reads(std::string filename,
 			     unsigned int radius,
@@ -365,7 +835,7 @@ namespace khmer {
 
     virtual void print_tagset(std::string);
     virtual void print_stop_tags(std::string);
-    virtual void save_stop_tags(std::string);
+    virtual void save_stop_tags(std::string, bool packed=false);
     void load_stop_tags(std::string filename, bool clear_tags=true);
 
     void identify_stop_tags_by_position(std::string sequence,
@@ -377,6 +847,162 @@ namespace khmer {
 			      float min_unique_f,
 			      std::vector<std::string> &results);
   };
+
+  //
+  // BlockedHashbits: a blocked Bloom filter.  One hash picks a 512-bit
+  // (cache line) block, and all n_hashes bits for the k-mer are in that
+  // block, so a lookup costs one cache miss rather than one per table.
+  // The price is a slightly higher false positive rate for the same
+  // memory, since blocks fill unevenly; see estimated_fp_rate().
+  //
+  // get_tablesizes() reports n_hashes "tables" that split the bits
+  // evenly, so that occupancy/size is the fraction of bits set, as for
+  // Hashbits.
+  //
+
+#define BLOCK_BITS 512
+#define BLOCK_WORDS (BLOCK_BITS / 64)
+#define MAX_BLOCK_HASHES 16
+
+  class BlockedHashbits : public Hashbits {
+  protected:
+    HashIntoType _n_blocks;
+    unsigned long long * _blocks; // BLOCK_WORDS per block, 64-byte aligned
+
+    void _allocate_blocks();
+    void _free_blocks();
+
+    // which block, and which bits within it, for this k-mer.
+    void _block_and_mask(HashIntoType khash, HashIntoType &block,
+			 unsigned long long * mask) const {
+      HashIntoType h = _mix_hash(khash);
+      block = h % _n_blocks;
+
+      memset(mask, 0, BLOCK_WORDS * sizeof(unsigned long long));
+
+      HashIntoType g = _mix_hash(h + 0x9e3779b97f4a7c15ULL);
+      unsigned int bits_left = 64;
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	if (bits_left < 9) {
+	  g = _mix_hash(g);
+	  bits_left = 64;
+	}
+	unsigned int pos = g & (BLOCK_BITS - 1);
+	g >>= 9;
+	bits_left -= 9;
+
+	mask[pos / 64] |= 1ULL << (pos % 64);
+      }
+    }
+
+  public:
+    // n_bits is rounded up to a whole number of blocks.
+    BlockedHashbits(WordLength ksize, HashIntoType n_bits,
+		    unsigned int n_hashes);
+    ~BlockedHashbits();
+
+    HashIntoType n_blocks() const { return _n_blocks; }
+
+    virtual void save(std::string);
+    virtual void load(std::string);
+
+    virtual void count(const char * kmer) {
+      count(_hash(kmer, _ksize));
+    }
+
+    virtual void count(HashIntoType khash) {
+      HashIntoType block;
+      unsigned long long mask[BLOCK_WORDS];
+      _block_and_mask(khash, block, mask);
+
+      unsigned long long * b = _blocks + block * BLOCK_WORDS;
+      unsigned int n_new_bits = 0;
+      for (unsigned int i = 0; i < BLOCK_WORDS; i++) {
+	n_new_bits += _popcount64(mask[i] & ~b[i]);
+	b[i] |= mask[i];
+      }
+
+      if (n_new_bits) {
+	_occupied_bins += n_new_bits;
+	_n_unique_kmers++;
+      }
+    }
+
+    virtual void count_overlap(const char * kmer, Hashbits &ht2) {
+      count_overlap(_hash(kmer, _ksize), ht2);
+    }
+
+    virtual void count_overlap(HashIntoType khash, Hashbits &ht2) {
+      HashIntoType n_before = _n_unique_kmers;
+      count(khash);
+      if (_n_unique_kmers != n_before && check_overlap(khash, ht2)) {
+	_n_overlap_kmers++;
+      }
+    }
+
+    virtual bool test_and_set_bits(HashIntoType khash,
+				   HashIntoType &n_new_bins) {
+      HashIntoType block;
+      unsigned long long mask[BLOCK_WORDS];
+      _block_and_mask(khash, block, mask);
+
+      unsigned long long * b = _blocks + block * BLOCK_WORDS;
+      bool is_new_kmer = false;
+      for (unsigned int i = 0; i < BLOCK_WORDS; i++) {
+	if (mask[i]) {
+	  unsigned long long old = __sync_fetch_and_or(&b[i], mask[i]);
+	  if (mask[i] & ~old) {
+	    n_new_bins += _popcount64(mask[i] & ~old);
+	    is_new_kmer = true;
+	  }
+	}
+      }
+      return is_new_kmer;
+    }
+
+    virtual const BoundedCounterType get_count(const char * kmer) const {
+      return get_count(_hash(kmer, _ksize));
+    }
+
+    virtual void prefetch(HashIntoType khash) const {
+      __builtin_prefetch(_blocks + (_mix_hash(khash) % _n_blocks) * BLOCK_WORDS);
+    }
+
+    virtual const BoundedCounterType get_count(HashIntoType khash) const {
+      HashIntoType block;
+      unsigned long long mask[BLOCK_WORDS] __attribute__((aligned(16)));
+      _block_and_mask(khash, block, mask);
+
+      const unsigned long long * b = _blocks + block * BLOCK_WORDS;
+
+#ifdef __SSE2__
+      // (block & mask) == mask, 16 bytes at a time.
+      __m128i all = _mm_set1_epi8(-1);
+      for (unsigned int i = 0; i < BLOCK_WORDS; i += 2) {
+	__m128i m = _mm_load_si128((const __m128i *) (mask + i));
+	__m128i x = _mm_load_si128((const __m128i *) (b + i));
+	all = _mm_and_si128(all, _mm_cmpeq_epi8(_mm_and_si128(x, m), m));
+      }
+      return _mm_movemask_epi8(all) == 0xffff;
+#else
+      for (unsigned int i = 0; i < BLOCK_WORDS; i++) {
+	if ((b[i] & mask[i]) != mask[i]) {
+	  return 0;
+	}
+      }
+      return 1;
+#endif // __SSE2__
+    }
+
+    // the blocks are one array of bits, so there is just one "table".
+    virtual BitArrays bit_arrays() const;
+
+    virtual Hashbits * empty_copy() const {
+      return new BlockedHashbits(_ksize, _n_blocks * BLOCK_BITS, _n_tables);
+    }
+
+    virtual double estimated_fp_rate() const;
+  };
 };
 
 #include "counting.hh"
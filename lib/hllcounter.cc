@@ -0,0 +1,237 @@
+#include "khmer.hh"
+#include "hashtable.hh"
+#include "hllcounter.hh"
+#include "parsers.hh"
+
+#include <math.h>
+
+using namespace khmer;
+using namespace std;
+
+HLLCounter::HLLCounter(WordLength ksize, unsigned int p) : _ksize(ksize), _p(p)
+{
+  assert(p >= 4 && p <= 18);
+
+  _m = 1 << _p;
+  _registers.assign(_m, 0);
+}
+
+double HLLCounter::error_rate() const
+{
+  return 1.04 / sqrt((double) _m);
+}
+
+unsigned int HLLCounter::consume_string(const std::string &s)
+{
+  unsigned int n_consumed = 0;
+
+  KMerIterator kmers(s.c_str(), _ksize);
+
+  while(!kmers.done()) {
+    add(kmers.next());
+    n_consumed++;
+  }
+
+  return n_consumed;
+}
+
+void HLLCounter::consume_fasta(const std::string &filename,
+			       unsigned int &total_reads,
+			       unsigned long long &n_consumed,
+			       unsigned int max_reads,
+			       CallbackFn callback,
+			       void * callback_data)
+{
+  total_reads = 0;
+  n_consumed = 0;
+
+  IParser* parser = IParser::get_parser(filename.c_str());
+  Read read;
+
+  while(!parser->is_complete())  {
+    if (max_reads && total_reads >= max_reads) {
+      break;
+    }
+
+    read = parser->get_next_read();
+
+    bool is_valid = read.seq.length() >= _ksize;
+    for (unsigned int i = 0; is_valid && i < read.seq.length(); i++) {
+      if (!is_valid_dna(read.seq[i])) {
+	is_valid = false;
+      }
+    }
+
+    if (is_valid) {
+      n_consumed += consume_string(read.seq);
+    }
+    total_reads++;
+
+    // run callback, if specified
+    if (total_reads % CALLBACK_PERIOD == 0 && callback) {
+      try {
+	callback("consume_fasta", callback_data, total_reads, n_consumed);
+      } catch (...) {
+	delete parser;
+	throw;
+      }
+    }
+  }
+
+  delete parser;
+}
+
+void HLLCounter::merge(const HLLCounter &other)
+{
+  assert(_ksize == other._ksize);
+  assert(_p == other._p);
+
+  for (unsigned int i = 0; i < _m; i++) {
+    if (other._registers[i] > _registers[i]) {
+      _registers[i] = other._registers[i];
+    }
+  }
+}
+
+HashIntoType HLLCounter::estimate_cardinality() const
+{
+  double alpha;
+  switch (_p) {
+  case 4: alpha = 0.673; break;
+  case 5: alpha = 0.697; break;
+  case 6: alpha = 0.709; break;
+  default: alpha = 0.7213 / (1.0 + 1.079 / _m); break;
+  }
+
+  double sum = 0.0;
+  unsigned int n_zero = 0;
+  for (unsigned int i = 0; i < _m; i++) {
+    sum += ldexp(1.0, -_registers[i]);
+    if (_registers[i] == 0) {
+      n_zero++;
+    }
+  }
+
+  double estimate = alpha * _m * _m / sum;
+
+  // small range correction: fall back on linear counting.  With a 64-bit
+  // hash there is no need for the large range correction.
+  if (estimate <= 2.5 * _m && n_zero) {
+    estimate = _m * log((double) _m / n_zero);
+  }
+
+  return (HashIntoType) (estimate + 0.5);
+}
+
+//
+// table sizing
+//
+
+bool khmer::is_prime(HashIntoType n)
+{
+  if (n < 2) { return false; }
+  if (n == 2) { return true; }
+  if (n % 2 == 0) { return false; }
+
+  for (HashIntoType x = 3; x * x <= n; x += 2) {
+    if (n % x == 0) { return false; }
+  }
+  return true;
+}
+
+void khmer::get_n_primes_above_x(unsigned int n, HashIntoType x,
+				 std::vector<HashIntoType> &primes)
+{
+  primes.clear();
+
+  HashIntoType i = x + 1;
+  if (i % 2 == 0) { i++; }
+
+  while (primes.size() != n) {
+    if (is_prime(i)) {
+      primes.push_back(i);
+    }
+    i += 2;
+  }
+}
+
+void khmer::get_n_primes_near_x(unsigned int n, HashIntoType x,
+				std::vector<HashIntoType> &primes)
+{
+  primes.clear();
+
+  HashIntoType i = x - 1;
+  if (i % 2 == 0) { i--; }
+
+  while (primes.size() != n && i > 1) {
+    if (is_prime(i)) {
+      primes.push_back(i);
+    }
+    i -= 2;
+  }
+}
+
+double khmer::expected_fp_rate(HashIntoType n_unique_kmers,
+			       const std::vector<HashIntoType> &tablesizes)
+{
+  double fp = 1.0;
+  for (unsigned int i = 0; i < tablesizes.size(); i++) {
+    fp *= 1.0 - exp(-(double) n_unique_kmers / (double) tablesizes[i]);
+  }
+  return fp;
+}
+
+// fp for N tables of x bins is (1 - e^(-n/x))^N; for a given N the
+// smallest x that meets the target is -n / ln(1 - fp^(1/N)).
+
+double khmer::choose_table_sizes(HashIntoType n_unique_kmers,
+				 HashIntoType max_memory,
+				 double target_fp,
+				 unsigned int bits_per_bin,
+				 std::vector<HashIntoType> &tablesizes)
+{
+  assert(target_fp > 0 && target_fp < 1);
+  assert(bits_per_bin > 0);
+
+  tablesizes.clear();
+
+  double n = n_unique_kmers ? (double) n_unique_kmers : 1.0;
+  double max_bits = (double) max_memory * 8.0;
+
+  unsigned int best_n = 0;
+  double best_x = 0, best_bits = 0;
+
+  for (unsigned int n_tables = 1; n_tables <= MAX_AUTO_TABLES; n_tables++) {
+    double x = -n / log(1.0 - pow(target_fp, 1.0 / n_tables));
+    double bits = x * n_tables * bits_per_bin;
+
+    if (best_n == 0 || bits < best_bits) {
+      best_n = n_tables;
+      best_x = x;
+      best_bits = bits;
+    }
+  }
+
+  if (max_memory && best_bits > max_bits) {
+    // won't fit: spend the whole budget, with the best number of tables.
+    double best_fp = 1.0;
+    for (unsigned int n_tables = 1; n_tables <= MAX_AUTO_TABLES; n_tables++) {
+      double x = max_bits / (n_tables * bits_per_bin);
+      double fp = pow(1.0 - exp(-n / x), (double) n_tables);
+
+      if (fp < best_fp) {
+	best_n = n_tables;
+	best_x = x;
+	best_fp = fp;
+      }
+    }
+    get_n_primes_near_x(best_n, (HashIntoType) best_x, tablesizes);
+  }
+
+  if (tablesizes.size() != best_n) {
+    get_n_primes_above_x(best_n, (HashIntoType) best_x, tablesizes);
+  }
+
+  assert(tablesizes.size() == best_n);
+  return expected_fp_rate(n_unique_kmers, tablesizes);
+}
@@ -0,0 +1,105 @@
+#ifndef HLLCOUNTER_HH
+#define HLLCOUNTER_HH
+
+#include <vector>
+#include <string>
+
+#include "khmer.hh"
+#include "ktable.hh"
+
+#define DEFAULT_HLL_PRECISION 14	// 2**14 registers => ~0.8% error
+#define DEFAULT_TARGET_FP 0.01
+#define MAX_AUTO_TABLES 16
+
+namespace khmer {
+  //
+  // HLLCounter: HyperLogLog estimate of the number of distinct k-mers
+  // in a stream, in 2**p bytes of memory.  Cheap enough to run alongside
+  // a parser pass, or as a quick pre-pass to size the real tables.
+  //
+
+  class HLLCounter {
+  protected:
+    WordLength _ksize;
+    unsigned int _p;		// precision; there are 2**_p registers.
+    unsigned int _m;
+    std::vector<unsigned char> _registers;
+
+  public:
+    HLLCounter(WordLength ksize, unsigned int p = DEFAULT_HLL_PRECISION);
+
+    // accessor to get 'k'
+    const WordLength ksize() const { return _ksize; }
+    const unsigned int precision() const { return _p; }
+
+    // expected relative standard error of the estimate.
+    double error_rate() const;
+
+    // add a single (canonical) k-mer hash.
+    void add(HashIntoType kmer) {
+      HashIntoType h = _mix_hash(kmer);
+      unsigned int index = (unsigned int) (h >> (64 - _p));
+      HashIntoType w = h << _p;
+
+      unsigned char rank;
+      if (w == 0) {
+	rank = 64 - _p + 1;
+      } else {
+	rank = __builtin_clzll(w) + 1;
+      }
+
+      if (_registers[index] < rank) {
+	_registers[index] = rank;
+      }
+    }
+
+    // add every k-mer in the string.
+    unsigned int consume_string(const std::string &s);
+
+    // add every k-mer in the FASTA/FASTQ file; stop after max_reads reads
+    // if max_reads is nonzero (a sampling pre-pass: the estimate is then a
+    // lower bound for the whole file).
+    void consume_fasta(const std::string &filename,
+		       unsigned int &total_reads,
+		       unsigned long long &n_consumed,
+		       unsigned int max_reads = 0,
+		       CallbackFn callback = NULL,
+		       void * callback_data = NULL);
+
+    // fold another counter (same k, same precision) into this one.
+    void merge(const HLLCounter &other);
+
+    HashIntoType estimate_cardinality() const;
+  };
+
+  //
+  // Table sizing.
+  //
+  // Pick the number and size of tables so that a Bloom filter with
+  // 'bits_per_bin' bits per bin (1 for Hashbits, 8 for CountingHash)
+  // holding n_unique_kmers has a false positive rate of at most target_fp,
+  // using as little memory as possible.  If that won't fit in max_memory
+  // bytes (0 => no limit), use all of max_memory and minimize the false
+  // positive rate instead.  Returns the expected false positive rate.
+  //
+
+  double choose_table_sizes(HashIntoType n_unique_kmers,
+			    HashIntoType max_memory,
+			    double target_fp,
+			    unsigned int bits_per_bin,
+			    std::vector<HashIntoType> &tablesizes);
+
+  // expected false positive rate for n_unique_kmers in the given tables.
+  double expected_fp_rate(HashIntoType n_unique_kmers,
+			  const std::vector<HashIntoType> &tablesizes);
+
+  bool is_prime(HashIntoType n);
+
+  // the first n primes above/below x, as used for table sizes.
+  void get_n_primes_above_x(unsigned int n, HashIntoType x,
+			    std::vector<HashIntoType> &primes);
+  void get_n_primes_near_x(unsigned int n, HashIntoType x,
+			   std::vector<HashIntoType> &primes);
+};
+
+#endif // HLLCOUNTER_HH
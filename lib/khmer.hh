@@ -1,3 +1,8 @@
+#ifndef KHMER_HH
+#define KHMER_HH
+
+#include <string.h>
+
 #define VERSION "0.4"
 
 #define MAX_COUNT 255
@@ -9,11 +14,15 @@
 #define CIRCUM_MAX_VOL 200	// @CTB remove
 
 #define SAVED_FORMAT_VERSION 3
+#define SAVED_HASHBITS_VERSION 4	// Hashbits files also keep occupancy
+#define SAVED_PACKED_TAGS_VERSION 5	// sorted, gap-coded tag files
+#define SAVED_PACKED_PMAP_VERSION 6	// sorted, block-coded partition maps
 #define SAVED_COUNTING_HT 1
 #define SAVED_HASHBITS 2
 #define SAVED_TAGS 3
 #define SAVED_STOPTAGS 4
 #define SAVED_SUBSET 5
+#define SAVED_BLOCKED_HASHBITS 6
 
 #define VERBOSE_REPARTITION 0
 
@@ -32,8 +41,42 @@ namespace khmer {
   // A single-byte type.
   typedef unsigned char Byte;
 
+  // count the bits set in a 64-bit word.
+  inline unsigned int _popcount64(unsigned long long x) {
+#ifdef __POPCNT__
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (unsigned int) ((x * 0x0101010101010101ULL) >> 56);
+#endif
+  }
+
+  // count the bits set in n bytes.  Four independent sums, so that
+  // several popcounts can be in flight at once.
+  inline unsigned long long _popcount_bytes(const Byte * p,
+					    unsigned long long n) {
+    unsigned long long c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    unsigned long long i = 0, w[4];
+
+    for (; i + sizeof(w) <= n; i += sizeof(w)) {
+      memcpy(w, p + i, sizeof(w));
+      c0 += _popcount64(w[0]);
+      c1 += _popcount64(w[1]);
+      c2 += _popcount64(w[2]);
+      c3 += _popcount64(w[3]);
+    }
+    for (; i < n; i++) {
+      c0 += _popcount64(p[i]);
+    }
+    return c0 + c1 + c2 + c3;
+  }
+
   typedef void (*CallbackFn)(const char * info, void * callback_data,
 			     unsigned long long n_reads,
 			     unsigned long long other);
 
 };
+
+#endif // KHMER_HH
@@ -6,6 +6,8 @@
 
 #include "khmer.hh"
 #include "ktable.hh"
+#include "hashtable.hh"
+#include "threads.hh"
 
 using namespace std;
 using namespace khmer;
@@ -111,7 +113,7 @@ void KTable::consume_string(const std::string &s)
 
   _hash(sp, _ksize, h, r);
   
-  _counts[uniqify_rc(h, r)]++;
+  _increment(uniqify_rc(h, r));
 
   for (unsigned int i = _ksize; i < length; i++) {
     // left-shift the previous hash over
@@ -127,18 +129,72 @@ void KTable::consume_string(const std::string &s)
     r = r >> 2;
     r |= (twobit_comp(sp[i]) << (_ksize*2 - 2));
 
-    _counts[uniqify_rc(h, r)]++;
+    _increment(uniqify_rc(h, r));
   }
 
 #endif // 0
 }
 
+//
+// sparse tables: double the number of slots and reinsert everything.
+//
+
+void KTable::_grow()
+{
+  HashIntoType * old_keys = _keys;
+  ExactCounterType * old_counts = _counts;
+  HashIntoType old_n_slots = _n_slots;
+
+  _allocate_slots(_n_slots * 2);
+
+  for (HashIntoType i = 0; i < old_n_slots; i++) {
+    if (old_keys[i] != KTABLE_EMPTY_KEY) {
+      HashIntoType j = _find_slot(old_keys[i]);
+      _keys[j] = old_keys[i];
+      _counts[j] = old_counts[i];
+      _n_occupied++;
+    }
+  }
+
+  delete[] old_keys;
+  delete[] old_counts;
+}
+
+const HashIntoType KTable::n_occupied() const
+{
+  if (_sparse) {
+    return _n_occupied;
+  }
+
+  HashIntoType n = 0;
+  for (HashIntoType i = 0; i < n_entries(); i++) {
+    if (_counts[i]) {
+      n++;
+    }
+  }
+  return n;
+}
+
 void KTable::update(const KTable &other)
 {
   assert(_ksize == other._ksize);
 
-  for (unsigned int i = 0; i < n_entries(); i++) {
-    _counts[i] += other._counts[i];
+  if (!_sparse && !other._sparse) {
+    for (HashIntoType i = 0; i < n_entries(); i++) {
+      _counts[i] += other._counts[i];
+    }
+  } else if (other._sparse) {
+    for (HashIntoType i = 0; i < other._n_slots; i++) {
+      if (other._keys[i] != KTABLE_EMPTY_KEY) {
+	_increment(other._keys[i], other._counts[i]);
+      }
+    }
+  } else {
+    for (HashIntoType i = 0; i < other.n_entries(); i++) {
+      if (other._counts[i]) {
+	_increment(i, other._counts[i]);
+      }
+    }
   }
 }
 
@@ -146,12 +202,120 @@ KTable * KTable::intersect(const KTable &other) const
 {
   assert(_ksize == other._ksize);
 
-  KTable * intersection = new KTable(_ksize);
+  KTable * intersection = new KTable(_ksize, _sparse);
 
-  for (unsigned int i = 0; i < n_entries(); i++) {
-    if (_counts[i] > 0 && other._counts[i] > 0) {
-      intersection->_counts[i] = _counts[i] + other._counts[i];
+  HashIntoType n = _sparse ? _n_slots : n_entries();
+  for (HashIntoType i = 0; i < n; i++) {
+    HashIntoType kmer = i;
+    if (_sparse) {
+      if (_keys[i] == KTABLE_EMPTY_KEY) {
+	continue;
+      }
+      kmer = _keys[i];
+    }
+
+    ExactCounterType other_count = other.get_count(kmer);
+    if (_counts[i] > 0 && other_count > 0) {
+      intersection->set_count(kmer, _counts[i] + other_count);
     }
   }
   return intersection;
 }
+
+//
+// consume_fasta: thread 0 counts into this table, and the others into
+// tables of their own, which are folded in once all the reads are done.
+//
+
+struct _KTableConsumeState {
+  std::vector<KTable *> tables;
+  ReadBatchSource * source;
+  CallbackFn callback;
+  void * callback_data;
+  unsigned long long n_done;
+  unsigned long long n_consumed;
+};
+
+static void _ktable_consume_thread(unsigned int thread_id, void * data)
+{
+  _KTableConsumeState * state = (_KTableConsumeState *) data;
+  KTable * ktable = state->tables[thread_id];
+  const WordLength k = ktable->ksize();
+
+  ReadBatch batch;
+
+  while (state->source->next_batch(batch)) {
+    unsigned long long n_consumed = 0;
+
+    for (unsigned int i = 0; i < batch.reads.size(); i++) {
+      const std::string &seq = batch.reads[i].seq;
+
+      bool is_valid = seq.length() >= k;
+      for (unsigned int j = 0; is_valid && j < seq.length(); j++) {
+	if (!is_valid_dna(seq[j])) {
+	  is_valid = false;
+	}
+      }
+
+      if (is_valid) {
+	ktable->consume_string(seq);
+	n_consumed += seq.length() - k + 1;
+      }
+    }
+
+    unsigned long long consumed = __sync_add_and_fetch(&state->n_consumed,
+						       n_consumed);
+    unsigned long long n_before = __sync_fetch_and_add(&state->n_done,
+						       batch.reads.size());
+    unsigned long long n_after = n_before + batch.reads.size();
+
+    // run callback, if specified -- from the calling thread only.
+    if (thread_id == 0 && state->callback &&
+	n_after / CALLBACK_PERIOD != n_before / CALLBACK_PERIOD) {
+      state->callback("consume_fasta", state->callback_data, n_after,
+		      consumed);
+    }
+  }
+}
+
+void KTable::consume_fasta(const std::string &filename,
+			   unsigned int &total_reads,
+			   unsigned long long &n_consumed,
+			   unsigned int n_threads,
+			   CallbackFn callback,
+			   void * callback_data)
+{
+  if (n_threads < 1) { n_threads = 1; }
+
+  ReadBatchSource source(filename);
+
+  _KTableConsumeState state;
+  state.source = &source;
+  state.callback = callback;
+  state.callback_data = callback_data;
+  state.n_done = 0;
+  state.n_consumed = 0;
+
+  state.tables.push_back(this);
+  for (unsigned int i = 1; i < n_threads; i++) {
+    state.tables.push_back(new KTable(_ksize, _sparse));
+  }
+
+  try {
+    run_threads(n_threads, _ktable_consume_thread, &state,
+		source.stop_flag());
+  } catch (...) {
+    for (unsigned int i = 1; i < n_threads; i++) {
+      delete state.tables[i];
+    }
+    throw;
+  }
+
+  for (unsigned int i = 1; i < n_threads; i++) {
+    update(*state.tables[i]);
+    delete state.tables[i];
+  }
+
+  total_reads = source.n_reads();
+  n_consumed = state.n_consumed;
+}
@@ -44,36 +44,119 @@ namespace khmer {
 
   std::string _revhash(HashIntoType hash, WordLength k);
 
+  // scramble a k-mer hash (which is just the packed sequence) so that
+  // all 64 bits are usable; this is the MurmurHash3 64-bit finalizer.
+  inline HashIntoType _mix_hash(HashIntoType h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
   //
   // KTable class: keep track of k-mer prevalences.
   //
   // the main (so far only...) class in khmer.
   //
+  // A dense KTable is an array of 4**k counters, which is only feasible
+  // for small k.  A sparse KTable only stores the k-mers that occur, in
+  // an open-addressing hash table, and works for k up to 31.  Anything
+  // above MAX_DENSE_KTABLE_K is always sparse.
+  //
+
+#define MAX_DENSE_KTABLE_K 12
+#define MAX_SPARSE_KTABLE_K 31
+#define KTABLE_EMPTY_KEY ((HashIntoType) -1) // never a k-mer for k <= 31
+#define KTABLE_INITIAL_SLOTS 1024
 
   class KTable {
   protected:
     WordLength _ksize;	// 'k'
-    HashIntoType _max_hash;	// 4**k
+    HashIntoType _max_hash;	// 4**k - 1
 
-    ExactCounterType * _counts;	// counts table.
+    ExactCounterType * _counts;	// counts table (dense), or values (sparse).
+
+    // sparse only: keys, and how many slots (a power of 2) are in use.
+    bool _sparse;
+    HashIntoType * _keys;
+    HashIntoType _n_slots;
+    HashIntoType _n_occupied;
 
     // allocate the counts table.
     void _allocate_counters() {
+      if (_sparse) {
+	_allocate_slots(KTABLE_INITIAL_SLOTS);
+	return;
+      }
       // allocate.
       _counts = new ExactCounterType[n_entries()];
       memset(_counts, 0, n_entries() * sizeof(ExactCounterType));
     }
+
+    void _allocate_slots(HashIntoType n_slots) {
+      _n_slots = n_slots;
+      _n_occupied = 0;
+      _keys = new HashIntoType[_n_slots];
+      _counts = new ExactCounterType[_n_slots];
+      memset(_keys, 0xff, _n_slots * sizeof(HashIntoType));
+      memset(_counts, 0, _n_slots * sizeof(ExactCounterType));
+    }
+
+    void _free_counters() {
+      delete[] _counts; _counts = NULL;
+      delete[] _keys; _keys = NULL;
+    }
+
+    // sparse: find the slot for this k-mer (linear probing); if it is
+    // not present, this is the empty slot where it would go.
+    HashIntoType _find_slot(HashIntoType kmer) const {
+      HashIntoType mask = _n_slots - 1;
+      HashIntoType i = _mix_hash(kmer) & mask;
+      while (_keys[i] != kmer && _keys[i] != KTABLE_EMPTY_KEY) {
+	i = (i + 1) & mask;
+      }
+      return i;
+    }
+
+    // sparse: the slot for this k-mer, inserting it if need be.
+    HashIntoType _insert_slot(HashIntoType kmer) {
+      HashIntoType i = _find_slot(kmer);
+      if (_keys[i] == KTABLE_EMPTY_KEY) {
+	if ((_n_occupied + 1) * 2 > _n_slots) { // keep load below 1/2
+	  _grow();
+	  i = _find_slot(kmer);
+	}
+	_keys[i] = kmer;
+	_n_occupied++;
+      }
+      return i;
+    }
+
+    void _grow();
+
+    void _increment(HashIntoType kmer, ExactCounterType n = 1) {
+      if (_sparse) {
+	_counts[_insert_slot(kmer)] += n;
+      } else {
+	_counts[kmer] += n;
+      }
+    }
   public:
 
     // Constructor: initialize stuff.
-    KTable(WordLength ksize) : _ksize(ksize) {
-      _max_hash = (unsigned int) pow(4, _ksize) - 1;
+    KTable(WordLength ksize, bool sparse = false) : _ksize(ksize),
+      _counts(NULL), _sparse(sparse || ksize > MAX_DENSE_KTABLE_K),
+      _keys(NULL), _n_slots(0), _n_occupied(0) {
+      assert(ksize <= MAX_SPARSE_KTABLE_K);
+      _max_hash = (1ULL << (2 * _ksize)) - 1;
       _allocate_counters();
     }
 
     // destructor: free.
     ~KTable() {
-      delete _counts; _counts = NULL;
+      _free_counters();
     }
 
     // accessor to get 'k'
@@ -82,39 +165,63 @@ namespace khmer {
     // accessors to get table info
     const HashIntoType max_hash() const { return _max_hash; }
     const HashIntoType n_entries() const { return _max_hash + 1; }
+    const bool is_sparse() const { return _sparse; }
+
+    // number of distinct k-mers stored (sparse), or with a count (dense).
+    const HashIntoType n_occupied() const;
 
     // add the given k-mer into the counts table.
     void count(const char * kmer) {
-      _counts[_hash(kmer, _ksize)]++;
+      _increment(_hash(kmer, _ksize));
     }
 
     // get the count for the given k-mer.
     const ExactCounterType get_count(const char * kmer) const {
-      return _counts[_hash(kmer, _ksize)];
+      return get_count(_hash(kmer, _ksize));
     }
 
     // get the count for the given k-mer hash.
     const ExactCounterType get_count(HashIntoType i) const {
+      if (_sparse) {
+	return _counts[_find_slot(i)];	// empty slots have count 0.
+      }
       return _counts[i];
     }
 
     // set the count for the given k-mer.
     void set_count(const char * kmer, ExactCounterType c) {
-      _counts[_hash(kmer, _ksize)] = c;
+      set_count(_hash(kmer, _ksize), c);
     }
 
     // set the count for the given k-mer hash.
     void set_count(HashIntoType i, ExactCounterType c) {
       assert(i <= max_hash());
-      _counts[i] = c;
+      if (_sparse) {
+	if (c == 0 && _keys[_find_slot(i)] == KTABLE_EMPTY_KEY) {
+	  return;
+	}
+	_counts[_insert_slot(i)] = c;
+      } else {
+	_counts[i] = c;
+      }
     }
 
     // count every k-mer in the string.
     void consume_string(const std::string &s);
 
+    // count every k-mer in the valid reads in a FASTA/FASTQ file; with
+    // n_threads > 1, each thread counts into its own table, and the
+    // tables are merged at the end.
+    void consume_fasta(const std::string &filename,
+		       unsigned int &total_reads,
+		       unsigned long long &n_consumed,
+		       unsigned int n_threads = 1,
+		       CallbackFn callback = NULL,
+		       void * callback_data = NULL);
+
     // reset the table.
     void clear() {
-      delete _counts;
+      _free_counters();
       _allocate_counters();
     }
 
@@ -2,6 +2,13 @@
 #define STORAGE_HH
 
 #include <fstream>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "khmer.hh"
 #include "ktable.hh"
 #include "hashtable.hh"
@@ -14,28 +21,60 @@ namespace khmer {
 					  CallbackFn callback = NULL,
 					  void * callback_data = NULL);
 
+  //
+  // ReadMaskTable: one bit per read, packed 64 to a word.  The bits past
+  // _tablesize in the last word are always kept clear, so that counting
+  // and merging can work a whole word at a time.
+  //
+  // Saved as READMASK_MAGIC, the table size, and then the words, so that
+  // load() can just mmap the file (copy-on-write).  Old one-byte-per-read
+  // files are still readable.
+  //
+
+#define READMASK_MAGIC 0xffffffffffff4d52ULL
+
   class ReadMaskTable {
   protected:
-    const unsigned long long _tablesize;
-    unsigned char * _mask;
+    unsigned long long _tablesize;
+    unsigned long long _n_words;
+    unsigned long long * _mask;
+
+    void * _mmapped;		// the whole file, if load() mapped it.
+    size_t _mmapped_size;
 
     void _allocate(bool initialize=true) {
-      _mask = new unsigned char[_tablesize];
+      _n_words = (_tablesize + 63) / 64;
+      _mask = new unsigned long long[_n_words ? _n_words : 1];
       if (initialize) {
-	for (unsigned long long i = 0; i < _tablesize; i++) {
-	  _mask[i] = 1;
-	}
+	memset(_mask, 0xff, _n_words * sizeof(unsigned long long));
+	_clear_tail();
+      }
+    }
+
+    void _free() {
+      if (_mmapped) {
+	munmap(_mmapped, _mmapped_size);
+	_mmapped = NULL;
+      } else if (_mask) {
+	delete[] _mask;
+      }
+      _mask = NULL;
+    }
+
+    void _clear_tail() {
+      if (_tablesize % 64) {
+	_mask[_n_words - 1] &= (1ULL << (_tablesize % 64)) - 1;
       }
     }
 
   public:
     ReadMaskTable(unsigned long long tablesize) :
-      _tablesize(tablesize), _mask(NULL) {
+      _tablesize(tablesize), _mask(NULL), _mmapped(NULL), _mmapped_size(0) {
       _allocate();
     }
 
     ~ReadMaskTable() {
-      if (_mask) { delete _mask; _mask = NULL; }
+      _free();
     }
 
     const unsigned long long get_tablesize() const {
@@ -44,8 +83,8 @@ namespace khmer {
 
     const unsigned long long n_kept() const {
       unsigned long long n = 0;
-      for (unsigned long long i = 0; i < _tablesize; i++) {
-	if (_mask[i]) { n++; }
+      for (unsigned long long i = 0; i < _n_words; i++) {
+	n += _popcount64(_mask[i]);
       }
       return n;
     }
@@ -53,47 +92,128 @@ namespace khmer {
     const bool get(unsigned long long index) const {
       if (index >= _tablesize) { return false; } // @CTB throw?
 
-      return _mask[index];
+      return (_mask[index / 64] >> (index % 64)) & 1;
     }
 
     void set(unsigned long long index, bool keep) {
       if (index >= _tablesize) { return; } // @CTB throw?
 
-      _mask[index] = keep ? 1 : 0;
+      if (keep) {
+	_mask[index / 64] |= 1ULL << (index % 64);
+      } else {
+	_mask[index / 64] &= ~(1ULL << (index % 64));
+      }
+    }
+
+    // thread-safe version of set(), for masks shared between threads.
+    void set_atomic(unsigned long long index, bool keep) {
+      if (index >= _tablesize) { return; }
+
+      if (keep) {
+	__sync_fetch_and_or(&_mask[index / 64], 1ULL << (index % 64));
+      } else {
+	__sync_fetch_and_and(&_mask[index / 64], ~(1ULL << (index % 64)));
+      }
     }
 
     void merge(ReadMaskTable &other) {
       if (this ->_tablesize != other._tablesize) { return; } // @CTB throw?
 
-      for (unsigned long long i = 0; i < _tablesize; i++) {
-	_mask[i] = _mask[i] && other._mask[i] ? 1 : 0;
+      for (unsigned long long i = 0; i < _n_words; i++) {
+	_mask[i] &= other._mask[i];
       }
     }
 
     void invert() {
-      for (unsigned long long i = 0; i < _tablesize; i++) {
-	_mask[i] = !_mask[i];
+      for (unsigned long long i = 0; i < _n_words; i++) {
+	_mask[i] = ~_mask[i];
       }
+      _clear_tail();
     }
 
     void save(const std::string &outputfile) {
       std::ofstream outfile;
       outfile.open(outputfile.c_str(), std::ofstream::binary);
 
+      unsigned long long magic = READMASK_MAGIC;
+      outfile.write((const char *) &magic, sizeof(magic));
       outfile.write((const char *) &_tablesize, sizeof(_tablesize));
-      outfile.write((const char *) _mask, _tablesize);
+      outfile.write((const char *) _mask,
+		    _n_words * sizeof(unsigned long long));
       outfile.close();
     }
 
+    // throws std::runtime_error if the file can't be read, or is the
+    // wrong size for the table it says it holds.
     void load(const std::string &inputfile) {
-      std::ifstream infile;
-      infile.open(inputfile.c_str(), std::ifstream::binary);
+      int fd = open(inputfile.c_str(), O_RDONLY);
+      if (fd < 0) {
+	throw std::runtime_error("cannot open read mask file " + inputfile);
+      }
 
-      infile.read((char *) &_tablesize, sizeof(_tablesize));
-      _allocate(false);
-      infile.read((char *) _mask, _tablesize);
+      struct stat st;
+      unsigned long long header[2] = { 0, 0 };
+      ssize_t n_read = 0;
+      if (fstat(fd, &st) == 0) {
+	n_read = read(fd, header, sizeof(header));
+      }
+      if (n_read < (ssize_t) sizeof(unsigned long long)) {
+	close(fd);
+	throw std::runtime_error("cannot read read mask file " + inputfile);
+      }
 
-      infile.close();
+      if (header[0] == READMASK_MAGIC) {
+	unsigned long long tablesize = header[1];
+	unsigned long long n_words = (tablesize + 63) / 64;
+	size_t size = st.st_size;
+	if (n_read != (ssize_t) sizeof(header) ||
+	    size != sizeof(header) + n_words * sizeof(unsigned long long)) {
+	  close(fd);
+	  throw std::runtime_error("truncated read mask file " + inputfile);
+	}
+
+	void * map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			  fd, 0);
+	if (map == MAP_FAILED) {
+	  close(fd);
+	  throw std::runtime_error("cannot map read mask file " + inputfile);
+	}
+
+	_free();
+	_tablesize = tablesize;
+	_n_words = n_words;
+	_mmapped = map;
+	_mmapped_size = size;
+	_mask = (unsigned long long *) ((char *) _mmapped + sizeof(header));
+      } else {
+	// old format: the table size, then one byte per read.
+	if ((unsigned long long) st.st_size !=
+	    sizeof(unsigned long long) + header[0]) {
+	  close(fd);
+	  throw std::runtime_error("truncated read mask file " + inputfile);
+	}
+
+	_free();
+	_tablesize = header[0];
+	_allocate(false);
+	memset(_mask, 0, _n_words * sizeof(unsigned long long));
+
+	lseek(fd, sizeof(unsigned long long), SEEK_SET);
+
+	unsigned char buf[64 * 1024];
+	unsigned long long index = 0;
+	while (index < _tablesize) {
+	  ssize_t n = read(fd, buf, sizeof(buf));
+	  if (n <= 0) { break; }
+	  for (ssize_t i = 0; i < n && index < _tablesize; i++, index++) {
+	    if (buf[i]) {
+	      _mask[index / 64] |= 1ULL << (index % 64);
+	    }
+	  }
+	}
+      }
+
+      close(fd);
     }
 
     unsigned long long filter_fasta_file(const std::string &inputfile,
@@ -131,7 +251,7 @@ namespace khmer {
     }
 
     ~MinMaxTable() {
-      if (_table) { delete _table; _table = NULL; }
+      if (_table) { delete[] _table; _table = NULL; }
     }
 
     const unsigned long long get_tablesize() const {
@@ -1,11 +1,19 @@
 #include "hashbits.hh"
 #include "subset.hh"
 #include "parsers.hh"
+#include "threads.hh"
+
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define IO_BUF_SIZE 1000*1000*20
 
 #define BIG_TRAVERSALS_ARE 200
 
+#define PARTITION_CHUNK_TAGS 32
+#define PARTITION_ROUND_TAGS (64*1024)
+
 // #define VALIDATE_PARTITIONS
 
 using namespace khmer;
@@ -45,110 +53,495 @@ void SubsetPartition::count_partitions(unsigned int& n_partitions,
   // go through all the tagged kmers and count partitions/orphan.
   //
 
-  for (PartitionMap::const_iterator pi = partition_map.begin();
-       pi != partition_map.end(); pi++) {
-    PartitionID * partition_p = pi->second;
-    if (partition_p) {
-      partitions.insert(*partition_p);
-    }
-    else {
-      n_unassigned++;
+  for (TagMap::const_iterator ti = _tag_nodes.begin();
+       ti != _tag_nodes.end(); ++ti) {
+    if (ti.value() != NO_PARTITION_NODE) {
+      partitions.insert(_node_partition(ti.value()));
     }
   }
   n_partitions = partitions.size();
 }
 
 
+//
+// output_partitioned_file/output_partition_buckets: the threads take
+// batches of reads from one parser, roll a canonical hash along each read
+// and look the k-mers up in _tag_nodes until one is a tag; the read goes
+// out with that tag's partition, through an OrderedWriter per file so
+// that each file is in input order.
+//
+// The forest is not read by the threads, since _find shortens paths as
+// it goes; each node's partition is worked out beforehand, into a flat
+// table.
+//
+
+struct _OutputPartitionsState {
+  SubsetPartition * subset;
+  const Hashbits * ht;
+  const TagMap * tag_nodes;
+  const std::vector<PartitionID> * node_partition;
+  ReadBatchSource * source;
+  std::vector<OrderedWriter *> writers;
+  unsigned int n_buckets;
+  bool output_unassigned;
+  std::vector<PartitionSet> partitions; // one for each thread
+  CallbackFn callback;
+  void * callback_data;
+  unsigned long long n_done;
+  unsigned long long n_kept;
+};
+
+static void _output_partitions_thread(unsigned int thread_id, void * data)
+{
+  _OutputPartitionsState * state = (_OutputPartitionsState *) data;
+  const unsigned int ksize = state->ht->ksize();
+  const unsigned int n_outs = state->writers.size();
+  const std::vector<PartitionID> &node_partition = *state->node_partition;
+  PartitionSet &partitions = state->partitions[thread_id];
+
+  ReadBatch batch;
+  std::vector<std::string> out(n_outs);
+  char pid_s[16];
+
+  while (state->source->next_batch(batch)) {
+    unsigned long long n_done = 0;
+    unsigned long long n_kept = 0;
+    for (unsigned int o = 0; o < n_outs; o++) {
+      out[o].clear();
+    }
+
+    for (unsigned int i = 0; i < batch.reads.size(); i++) {
+      const Read &read = batch.reads[i];
+      if (!state->ht->check_read(read.seq)) {
+	continue;
+      }
+      n_done++;
+
+      // all sequences should have at least one tag in them.
+      // assert(found_tag);  @CTB currently breaks tests.  give fn flag to
+      // disable.
+
+      PartitionID partition_id = 0;
+      KMerIterator kmers(read.seq.c_str(), ksize);
+      while (!kmers.done()) {
+	unsigned int node = state->tag_nodes->get(kmers.next(),
+						  NO_PARTITION_NODE);
+	if (node != NO_PARTITION_NODE) {
+	  partition_id = node_partition[node];
+	  partitions.insert(partition_id);
+	  break;
+	}
+      }
+
+#ifdef VALIDATE_PARTITIONS
+      std::cout << "checking: " << read.name << "\n";
+      assert(state->subset->is_single_partition(read.seq));
+#endif // VALIDATE_PARTITIONS
+
+      if (partition_id > 0 || state->output_unassigned) {
+	// unassigned reads go in the last file.
+	std::string &o = partition_id ?
+	  out[partition_id % state->n_buckets] : out[n_outs - 1];
+
+	sprintf(pid_s, "%u", partition_id);
+	o += ">";
+	o += read.name;
+	o += "\t";
+	o += pid_s;
+	o += "\n";
+	o += read.seq;
+	o += "\n";
+	n_kept++;
+      }
+    }
+
+    for (unsigned int o = 0; o < n_outs; o++) {
+      state->writers[o]->write(batch.batch_num, out[o]);
+    }
+
+    unsigned long long kept = __sync_add_and_fetch(&state->n_kept, n_kept);
+    unsigned long long n_before = __sync_fetch_and_add(&state->n_done,
+						       n_done);
+    unsigned long long n_after = n_before + n_done;
+
+    // run callback, if specified -- from the calling thread only.
+    if (thread_id == 0 && state->callback &&
+	n_after / CALLBACK_PERIOD != n_before / CALLBACK_PERIOD) {
+      state->callback("output_partitions", state->callback_data,
+		      n_after, kept);
+    }
+  }
+}
+
+// reads in partition p go to outs[p % n_buckets], and unassigned reads
+// (if output_unassigned) to the last of outs, which may be the same file.
+
+unsigned int SubsetPartition::_output_partitions(const std::string infilename,
+					std::vector<std::ostream *> &outs,
+					unsigned int n_buckets,
+					bool output_unassigned,
+					CallbackFn callback,
+					void * callback_data,
+					unsigned int n_threads)
+{
+  assert(n_buckets > 0 && n_buckets <= outs.size());
+  if (n_threads < 1) { n_threads = 1; }
+#ifdef VALIDATE_PARTITIONS
+  n_threads = 1;		// is_single_partition uses the forest.
+#endif // VALIDATE_PARTITIONS
+
+  std::vector<PartitionID> node_partition(_parent.size());
+  for (unsigned int i = 0; i < _parent.size(); i++) {
+    node_partition[i] = _root_partition[_find(i)];
+  }
+
+  ReadBatchSource source(infilename);
+
+  _OutputPartitionsState state;
+  state.subset = this;
+  state.ht = _ht;
+  state.tag_nodes = &_tag_nodes;
+  state.node_partition = &node_partition;
+  state.source = &source;
+  state.n_buckets = n_buckets;
+  state.output_unassigned = output_unassigned;
+  state.partitions.resize(n_threads);
+  state.callback = callback;
+  state.callback_data = callback_data;
+  state.n_done = 0;
+  state.n_kept = 0;
+
+  for (unsigned int o = 0; o < outs.size(); o++) {
+    state.writers.push_back(new OrderedWriter(*outs[o]));
+  }
+
+  try {
+    run_threads(n_threads, _output_partitions_thread, &state,
+		source.stop_flag());
+  } catch (...) {
+    for (unsigned int o = 0; o < state.writers.size(); o++) {
+      delete state.writers[o];
+    }
+    throw;
+  }
+
+  for (unsigned int o = 0; o < state.writers.size(); o++) {
+    delete state.writers[o];
+  }
+
+  PartitionSet partitions;
+  for (unsigned int t = 0; t < n_threads; t++) {
+    partitions.insert(state.partitions[t].begin(), state.partitions[t].end());
+  }
+  return partitions.size();
+}
+
 unsigned int SubsetPartition::output_partitioned_file(const std::string infilename,
 						      const std::string outputfile,
 						      bool output_unassigned,
 						      CallbackFn callback,
-						      void * callback_data)
+						      void * callback_data,
+						      unsigned int n_threads)
 {
-  IParser* parser = IParser::get_parser(infilename);
   ofstream outfile(outputfile.c_str());
 
-  unsigned int total_reads = 0;
-  unsigned int reads_kept = 0;
-  unsigned int n_singletons = 0;
-
-  PartitionSet partitions;
+  std::vector<std::ostream *> outs;
+  outs.push_back(&outfile);
 
-  Read read;
-  string seq;
+  return _output_partitions(infilename, outs, 1, output_unassigned,
+			    callback, callback_data, n_threads);
+}
 
-  std::string first_kmer;
-  HashIntoType kmer = 0;
+unsigned int SubsetPartition::output_partition_buckets(const std::string infilename,
+						       const std::string prefix,
+						       unsigned int n_buckets,
+						       bool output_unassigned,
+						       CallbackFn callback,
+						       void * callback_data,
+						       unsigned int n_threads)
+{
+  assert(n_buckets > 0);
 
-  const unsigned int ksize = _ht->ksize();
+  std::vector<std::ostream *> outs;
+  char name[32];
 
-  //
-  // go through all the reads, and take those with assigned partitions
-  // and output them.
-  //
+  for (unsigned int i = 0; i < n_buckets; i++) {
+    sprintf(name, ".bucket%u.part", i);
+    outs.push_back(new ofstream((prefix + name).c_str()));
+  }
+  if (output_unassigned) {
+    outs.push_back(new ofstream((prefix + ".unassigned.part").c_str()));
+  }
 
-  while(!parser->is_complete()) {
-    read = parser->get_next_read();
-    seq = read.seq;
+  unsigned int n_partitions;
+  try {
+    n_partitions = _output_partitions(infilename, outs, n_buckets,
+				      output_unassigned,
+				      callback, callback_data, n_threads);
+  } catch (...) {
+    for (unsigned int o = 0; o < outs.size(); o++) {
+      delete outs[o];
+    }
+    throw;
+  }
 
-    if (_ht->check_read(seq)) {
-      const char * kmer_s = seq.c_str();
+  for (unsigned int o = 0; o < outs.size(); o++) {
+    delete outs[o];
+  }
+  return n_partitions;
+}
 
-      bool found_tag = false;
-      for (unsigned int i = 0; i < seq.length() - ksize + 1; i++) {
-	kmer = _hash(kmer_s + i, ksize);
+//
+// extract_partitions: the reads in partition-annotated files, grouped
+// into files by the size of their partitions.  One pass over the files
+// counts the reads in each partition (and writes out the unassigned
+// ones); the partitions with more than min_part_size reads are then
+// dealt out, smallest first, into groups of at most max_size reads --
+// a partition bigger than that gets a group to itself -- and a second
+// pass writes each group's reads to <prefix>.groupNNNN.fa.  The counts
+// and groups are kept in flat tables keyed by partition ID.
+//
 
-	// is this a known tag?
-	if (set_contains(partition_map, kmer)) {
-	  found_tag = true;
-	  break;
-	}
+#define EXTRACT_BUF_SIZE (64*1024)
+
+class _GroupWriter {
+protected:
+  FILE * _fp;
+  gzFile _gz;
+  std::string _buf;
+
+public:
+  _GroupWriter(const std::string &filename, bool gzip) : _fp(NULL), _gz(NULL)
+  {
+    if (gzip) {
+      _gz = gzopen((filename + ".gz").c_str(), "wb");
+      if (_gz == NULL) {
+	throw std::runtime_error("cannot open " + filename + ".gz");
       }
+    } else {
+      _fp = fopen(filename.c_str(), "w");
+      if (_fp == NULL) {
+	throw std::runtime_error("cannot open " + filename);
+      }
+    }
+    _buf.reserve(EXTRACT_BUF_SIZE);
+  }
 
-      // all sequences should have at least one tag in them.
-      // assert(found_tag);  @CTB currently breaks tests.  give fn flag to
-      // disable.
+  ~_GroupWriter() {
+    flush();
+    if (_gz) { gzclose(_gz); }
+    if (_fp) { fclose(_fp); }
+  }
 
-      PartitionID partition_id = 0;
-      if (found_tag) {
-	PartitionID * partition_p = partition_map[kmer];
-	if (partition_p == NULL ){
-	  partition_id = 0;
-	  n_singletons++;
-	} else {
-	  partition_id = *partition_p;
-	  partitions.insert(partition_id);
-	}
-      }
+  void flush() {
+    if (_buf.empty()) {
+      return;
+    }
+    if (_gz) {
+      gzwrite(_gz, _buf.data(), _buf.size());
+    } else {
+      fwrite(_buf.data(), 1, _buf.size(), _fp);
+    }
+    _buf.clear();
+  }
+
+  // a FASTA record; the partition ID goes on the name line, if it is not 0.
+  void write(const std::string &name, PartitionID partition_id,
+	     const std::string &seq) {
+    _buf += ">";
+    _buf += name;
+    if (partition_id) {
+      char partition_s[16];
+      sprintf(partition_s, "\t%u", partition_id);
+      _buf += partition_s;
+    }
+    _buf += "\n";
+    _buf += seq;
+    _buf += "\n";
+
+    if (_buf.size() >= EXTRACT_BUF_SIZE) {
+      flush();
+    }
+  }
+};
+
+// split "name\tpartition" in place; reads without a partition are
+// taken as unassigned.
+
+static PartitionID _split_partition_name(std::string &name)
+{
+  size_t tab = name.rfind('\t');
+  if (tab == std::string::npos) {
+    return 0;
+  }
+
+  PartitionID partition_id = strtoul(name.c_str() + tab + 1, NULL, 10);
+  name.resize(tab);
+  return partition_id;
+}
+
+static bool _is_empty_file(const std::string &filename)
+{
+  struct stat st;
+  return stat(filename.c_str(), &st) == 0 && st.st_size == 0;
+}
+
+unsigned int khmer::extract_partitions(const std::vector<std::string>& part_filenames,
+				       const std::string& prefix,
+				       unsigned long long max_size,
+				       unsigned int min_part_size,
+				       bool output_groups,
+				       bool output_unassigned,
+				       bool gzip,
+				       CallbackFn callback,
+				       void * callback_data)
+{
+  TagMap counts;			// partition ID -> n reads
+  unsigned long long n_reads = 0;
+
+  _GroupWriter * unassigned = NULL;
+  if (output_unassigned) {
+    unassigned = new _GroupWriter(prefix + ".unassigned.fa", gzip);
+  }
 
-      if (partition_id > 0 || output_unassigned) {
-	outfile << ">" << read.name << "\t" << partition_id;
-	outfile << "\n" << seq << "\n";
+  for (unsigned int f = 0; f < part_filenames.size(); f++) {
+    if (_is_empty_file(part_filenames[f])) {
+      continue;
+    }
+    IParser * parser = IParser::get_parser(part_filenames[f]);
+
+    while (!parser->is_complete()) {
+      Read read = parser->get_next_read();
+      PartitionID partition_id = _split_partition_name(read.name);
+
+      if (partition_id) {
+	counts.set(partition_id, counts.get(partition_id, 0) + 1);
+      } else if (unassigned) {
+	unassigned->write(read.name, 0, read.seq);
       }
-#ifdef VALIDATE_PARTITIONS
-      std::cout << "checking: " << read.name << "\n";
-      assert(is_single_partition(seq));
-#endif // VALIDATE_PARTITIONS
-	       
-      total_reads++;
 
-      // run callback, if specified
-      if (total_reads % CALLBACK_PERIOD == 0 && callback) {
+      n_reads++;
+      if (n_reads % CALLBACK_PERIOD == 0 && callback) {
 	try {
-	  callback("output_partitions", callback_data,
-		   total_reads, reads_kept);
+	  callback("extract_partitions", callback_data, n_reads,
+		   counts.size());
 	} catch (...) {
-	  delete parser; parser = NULL;
-	  outfile.close();
+	  delete parser;
+	  delete unassigned;
 	  throw;
 	}
       }
     }
+    delete parser;
   }
+  delete unassigned;
 
-  delete parser; parser = NULL;
+  // the distribution of partition sizes:
+  // size, n partitions, cumulative n partitions, cumulative n reads.
+  std::map<unsigned int, unsigned long long> dist;
+  for (TagMap::const_iterator ci = counts.begin(); ci != counts.end(); ++ci) {
+    dist[ci.value()]++;
+  }
+
+  ofstream distfile((prefix + ".dist").c_str());
+  if (!distfile.is_open()) {
+    throw std::runtime_error("cannot open " + prefix + ".dist");
+  }
+  unsigned long long total = 0, wtotal = 0;
+  for (std::map<unsigned int, unsigned long long>::const_iterator di =
+	 dist.begin(); di != dist.end(); di++) {
+    total += di->second;
+    wtotal += di->first * di->second;
+    distfile << di->first << " " << di->second << " " << total << " "
+	     << wtotal << "\n";
+  }
+  distfile.close();
+
+  if (!output_groups) {
+    return 0;
+  }
+
+  // deal the partitions out into groups, smallest first.
+  std::vector<std::pair<unsigned int, PartitionID> > divvy;
+  for (TagMap::const_iterator ci = counts.begin(); ci != counts.end(); ++ci) {
+    if (ci.value() > min_part_size) {
+      divvy.push_back(std::make_pair(ci.value(), (PartitionID) ci.key()));
+    }
+  }
+  std::sort(divvy.begin(), divvy.end());
+  counts.clear();
+
+  TagMap groups;			// partition ID -> group
+  groups.reserve(divvy.size());
+
+  unsigned int n_groups = 0;
+  unsigned long long group_size = 0;
+  for (unsigned int i = 0; i < divvy.size(); i++) {
+    if (group_size && group_size + divvy[i].first > max_size) {
+      n_groups++;
+      group_size = 0;
+    }
+    groups.set(divvy[i].second, n_groups);
+    group_size += divvy[i].first;
+  }
+  if (group_size) {
+    n_groups++;
+  }
+
+  if (n_groups == 0) {
+    return 0;
+  }
+
+  std::vector<_GroupWriter *> writers;
+  char name[32];
+
+  n_reads = 0;
+  try {
+    for (unsigned int g = 0; g < n_groups; g++) {
+      sprintf(name, ".group%04u.fa", g);
+      writers.push_back(new _GroupWriter(prefix + name, gzip));
+    }
+
+    for (unsigned int f = 0; f < part_filenames.size(); f++) {
+      if (_is_empty_file(part_filenames[f])) {
+	continue;
+      }
+      IParser * parser = IParser::get_parser(part_filenames[f]);
+
+      while (!parser->is_complete()) {
+	Read read = parser->get_next_read();
+	PartitionID partition_id = _split_partition_name(read.name);
+
+	unsigned int g = groups.get(partition_id, n_groups);
+	if (partition_id && g < n_groups) {
+	  writers[g]->write(read.name, partition_id, read.seq);
+	}
+
+	n_reads++;
+	if (n_reads % CALLBACK_PERIOD == 0 && callback) {
+	  try {
+	    callback("extract_partitions/write", callback_data, n_reads,
+		     n_groups);
+	  } catch (...) {
+	    delete parser;
+	    throw;
+	  }
+	}
+      }
+      delete parser;
+    }
+  } catch (...) {
+    for (unsigned int g = 0; g < writers.size(); g++) {
+      delete writers[g];
+    }
+    throw;
+  }
+
+  for (unsigned int g = 0; g < n_groups; g++) {
+    delete writers[g];
+  }
 
-  return partitions.size() + n_singletons;
+  return n_groups;
 }
 
 unsigned int SubsetPartition::find_unpart(const std::string infilename,
@@ -197,11 +590,7 @@ unsigned int SubsetPartition::find_unpart(const std::string infilename,
 
       for (SeenSet::iterator si = found_tags.begin(); si != found_tags.end();
 	   si++) {
-	PartitionMap::iterator pi = partition_map.find(*si);
-	PartitionID partition_id = 0;
-	if (pi != partition_map.end() && pi->second != NULL) {
-	  partition_id = *(pi->second);
-	}
+	PartitionID partition_id = get_partition_id(*si);
 	if (partition_id == 0) {
 	  found_zero = true;
 	} else {
@@ -260,7 +649,7 @@ unsigned int SubsetPartition::find_unpart(const std::string infilename,
     unsigned int n = 0;
     std::string kmer_s;
     HashIntoType kmer_f, kmer_r;
-    SeenSet tagged_kmers;
+    TraversalWorkspace ws;
     for (SeenSet::iterator si = tags_todo.begin(); si != tags_todo.end(); si++) {
       n += 1;
 
@@ -268,15 +657,14 @@ unsigned int SubsetPartition::find_unpart(const std::string infilename,
       kmer = _hash(kmer_s.c_str(), ksize, kmer_f, kmer_r);
 
       // find all tagged kmers within range.
-      tagged_kmers.clear();
-      find_all_tags(kmer_f, kmer_r, tagged_kmers, _ht->all_tags,
+      find_all_tags(kmer_f, kmer_r, ws, _ht->all_tags,
 		    true, stop_big_traversals);
 
-      // std::cout << "found " << tagged_kmers.size() << "\n";
+      // std::cout << "found " << ws.tagged.size() << "\n";
 
       // assign the partition ID
       // std::cout << next_partition_id << "\n";
-      assign_partition_id(kmer, tagged_kmers);
+      assign_partition_id(kmer, ws.tagged);
 
       // print out
       if (n % 1000 == 0) {
@@ -293,53 +681,61 @@ unsigned int SubsetPartition::find_unpart(const std::string infilename,
 ///
 
 // find_all_tags: the core of the partitioning code.  finds all tagged k-mers
-//    connected to kmer_f/kmer_r in the graph.
+//    connected to kmer_f/kmer_r in the graph, and leaves them in ws.tagged,
+//    in order.  Returns false (with no tags) if stop_big_traversals cut
+//    the search short.
 
-void SubsetPartition::find_all_tags(HashIntoType kmer_f,
+bool SubsetPartition::find_all_tags(HashIntoType kmer_f,
 				    HashIntoType kmer_r,
-				    SeenSet& tagged_kmers,
-				    const SeenSet& all_tags,
+				    TraversalWorkspace& ws,
+				    const TagSet& all_tags,
 				    bool break_on_stop_tags,
 				    bool stop_big_traversals)
 {
-  const HashIntoType bitmask = _ht->bitmask;
-
-  HashIntoType f, r;
   bool first = true;
-  NodeQueue node_q;
-  std::queue<unsigned int> breadth_q;
   unsigned int cur_breadth = 0;
   unsigned int breadth = 0;
   const unsigned int max_breadth = (2 * _ht->_tag_density) + 1;
 
-  const unsigned int rc_left_shift = _ht->ksize()*2 - 2;
-  unsigned int total = 0;
+  ws.start();
+
+  // cross whole unitigs at once, if we can.
+  if (_ht->unitig_index && &all_tags == &_ht->all_tags &&
+      _ht->unitig_index->is_current()) {
+    SeenSet found;
+    unsigned long long n_visited;
 
-  SeenSet keeper;		// keep track of traversed kmers
+    if (_ht->unitig_index->traverse(kmer_f, kmer_r, max_breadth, true,
+				    break_on_stop_tags, &found,
+				    stop_big_traversals ? BIG_TRAVERSALS_ARE : 0,
+				    n_visited)) {
+      if (stop_big_traversals && n_visited > BIG_TRAVERSALS_ARE) {
+	return false;
+      }
+      ws.tagged.assign(found.begin(), found.end());
+      return true;
+    }
+  }
 
   // start breadth-first search.
 
-  node_q.push(kmer_f);
-  node_q.push(kmer_r);
-  breadth_q.push(0);
+  ws.push(kmer_f, kmer_r, 0);
 
-  while(!node_q.empty()) {
-    if (stop_big_traversals && keeper.size() > BIG_TRAVERSALS_ARE) {
-      tagged_kmers.clear();
-      break;
+  while(!ws.queue_empty()) {
+    if (stop_big_traversals && ws.n_visited() > BIG_TRAVERSALS_ARE) {
+      ws.tagged.clear();
+      return false;
     }
 
-    kmer_f = node_q.front();
-    node_q.pop();
-    kmer_r = node_q.front();
-    node_q.pop();
-    breadth = breadth_q.front();
-    breadth_q.pop();
+    TraversalNode node = ws.pop();
+    kmer_f = node.kmer_f;
+    kmer_r = node.kmer_r;
+    breadth = node.breadth;
 
     HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
 
     // Have we already seen this k-mer?  If so, skip.
-    if (set_contains(keeper, kmer)) {
+    if (ws.is_visited(kmer)) {
       continue;
     }
 
@@ -350,14 +746,13 @@ void SubsetPartition::find_all_tags(HashIntoType kmer_f,
     }
 
     // keep track of seen kmers
-    keeper.insert(kmer);
-    total++;
+    ws.visit(kmer);
 
     // Is this a kmer-to-tag, and have we put this tag in a partition already?
     // Search no further in this direction.  (This is where we connect
     // partitions.)
     if (!first && set_contains(all_tags, kmer)) {
-      tagged_kmers.insert(kmer);
+      ws.tagged.push_back(kmer);
       continue;
     }
 
@@ -370,73 +765,37 @@ void SubsetPartition::find_all_tags(HashIntoType kmer_f,
     // Enqueue next set of nodes.
     //
 
-    // NEXT
-    f = next_f(kmer_f, 'A');
-    r = next_r(kmer_r, 'A');
-    if (_ht->get_count(uniqify_rc(f,r)) &&
-	!set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'C');
-    r = next_r(kmer_r, 'C');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'G');
-    r = next_r(kmer_r, 'G');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+    HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+    unsigned int present = _ht->get_neighbors(kmer_f, kmer_r, f, r);
 
-    f = next_f(kmer_f, 'T');
-    r = next_r(kmer_r, 'T');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
+    for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+      if ((present & (1 << i)) && !ws.is_visited(uniqify_rc(f[i], r[i]))) {
+	ws.push(f[i], r[i], breadth + 1);
+      }
     }
 
-    // PREVIOUS.
-    r = prev_r(kmer_r, 'A');
-    f = prev_f(kmer_f, 'A');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+    first = false;
+  }
 
-    r = prev_r(kmer_r, 'C');
-    f = prev_f(kmer_f, 'C');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-    
-    r = prev_r(kmer_r, 'G');
-    f = prev_f(kmer_f, 'G');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+  // each tag is visited once, so only the order needs fixing.
+  std::sort(ws.tagged.begin(), ws.tagged.end());
+  return true;
+}
 
-    r = prev_r(kmer_r, 'T');
-    f = prev_f(kmer_f, 'T');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+void SubsetPartition::find_all_tags(HashIntoType kmer_f,
+				    HashIntoType kmer_r,
+				    SeenSet& tagged_kmers,
+				    const TagSet& all_tags,
+				    bool break_on_stop_tags,
+				    bool stop_big_traversals)
+{
+  TraversalWorkspace ws;
 
-    first = false;
+  if (find_all_tags(kmer_f, kmer_r, ws, all_tags, break_on_stop_tags,
+		    stop_big_traversals)) {
+    tagged_kmers.insert(ws.tagged.begin(), ws.tagged.end());
+  } else {
+    tagged_kmers.clear();
   }
 }
 
@@ -453,35 +812,36 @@ void SubsetPartition::do_partition(HashIntoType first_kmer,
 
   std::string kmer_s;
   HashIntoType kmer_f, kmer_r, kmer;
-  SeenSet tagged_kmers;
+  TraversalWorkspace ws;
   const unsigned char ksize = _ht->ksize();
 
-  SeenSet::const_iterator si, end;
+  // the tags from first_kmer up to (not including) last_kmer, in order.
+  const std::vector<HashIntoType> &tags = _ht->all_tags.sorted();
+  std::vector<HashIntoType>::const_iterator si, end;
 
   if (first_kmer) {
-    si = _ht->all_tags.find(first_kmer);
+    si = std::lower_bound(tags.begin(), tags.end(), first_kmer);
   } else {
-    si = _ht->all_tags.begin();
+    si = tags.begin();
   }
   if (last_kmer) {
-    end = _ht->all_tags.find(last_kmer);
+    end = std::lower_bound(tags.begin(), tags.end(), last_kmer);
   } else {
-    end = _ht->all_tags.end();
+    end = tags.end();
   }
 
-  for (; si != end; si++) {
+  for (; si < end; si++) {
     total_reads++;
 
     kmer_s = _revhash(*si, ksize); // @CTB hackity hack hack!
     kmer = _hash(kmer_s.c_str(), ksize, kmer_f, kmer_r);
 
     // find all tagged kmers within range.
-    tagged_kmers.clear();
-    find_all_tags(kmer_f, kmer_r, tagged_kmers, _ht->all_tags,
+    find_all_tags(kmer_f, kmer_r, ws, _ht->all_tags,
 		  break_on_stop_tags, stop_big_traversals);
 
     // assign the partition ID
-    assign_partition_id(kmer, tagged_kmers);
+    assign_partition_id(kmer, ws.tagged);
 
     // run callback, if specified
     if (total_reads % CALLBACK_PERIOD == 0 && callback) {
@@ -499,143 +859,421 @@ void SubsetPartition::do_partition(HashIntoType first_kmer,
   }
 }
 
+//
+// do_parallel_partition: do_partition over all the tags, on n_threads
+// threads, with no subsets to save and merge.  The threads take small
+// chunks of tags from a shared counter as they go, since the cost of a
+// chunk varies a great deal; each searches from its tags with its own
+// workspace, and unions the tags it finds into one ConcurrentUnionFind
+// over the sorted tags.  The forest then goes into this partition map on
+// the calling thread.
+//
+// A tag ends up in a partition if any search found it, or if its own
+// search found another tag -- the same tags as in do_partition, except
+// that there a tag whose own search is cut short (stop_big_traversals)
+// can lose a partition it was given by an earlier search.
 //
 
-void SubsetPartition::set_partition_id(std::string kmer_s, PartitionID p)
+struct _PartitionState {
+  SubsetPartition * subset;
+  const std::vector<HashIntoType> * tags;
+  const TagSet * all_tags;
+  ConcurrentUnionFind * forest;
+  WordLength ksize;
+  bool break_on_stop_tags;
+  bool stop_big_traversals;
+  CallbackFn callback;
+  void * callback_data;
+  unsigned long long next_tag;
+  unsigned long long n_done;
+  volatile bool stop;
+};
+
+static void _partition_thread(unsigned int thread_id, void * data)
 {
-  HashIntoType kmer;
-  assert(kmer_s.length() >= _ht->ksize());
-  kmer = _hash(kmer_s.c_str(), _ht->ksize());
+  _PartitionState * state = (_PartitionState *) data;
+  const std::vector<HashIntoType> &tags = *state->tags;
+  const unsigned long long n_tags = tags.size();
+  ConcurrentUnionFind &forest = *state->forest;
+  TraversalWorkspace ws;
+
+  while (!state->stop) {
+    unsigned long long first = __sync_fetch_and_add(&state->next_tag,
+						    PARTITION_CHUNK_TAGS);
+    if (first >= n_tags) {
+      break;
+    }
+    unsigned long long last = std::min(first + PARTITION_CHUNK_TAGS, n_tags);
+
+    for (unsigned long long i = first; i < last; i++) {
+      HashIntoType kmer_f, kmer_r;
+      std::string kmer_s = _revhash(tags[i], state->ksize);
+      _hash(kmer_s.c_str(), state->ksize, kmer_f, kmer_r);
+
+      state->subset->find_all_tags(kmer_f, kmer_r, ws, *state->all_tags,
+				   state->break_on_stop_tags,
+				   state->stop_big_traversals);
+      if (ws.tagged.empty()) {
+	continue;
+      }
 
-  set_partition_id(kmer, p);
-}
+      forest.mark(i);
+      for (unsigned int j = 0; j < ws.tagged.size(); j++) {
+	std::vector<HashIntoType>::const_iterator ti =
+	  std::lower_bound(tags.begin(), tags.end(), ws.tagged[j]);
+	assert(ti != tags.end() && *ti == ws.tagged[j]);
 
-void SubsetPartition::set_partition_id(HashIntoType kmer, PartitionID p)
-{
-  PartitionPtrSet * s = reverse_pmap[p];
-  PartitionID * pp = NULL;
-  if (s == NULL) {
-    s = new PartitionPtrSet();
-    pp = new unsigned int(p);
-    s->insert(pp);
-    reverse_pmap[p] = s;
-  } else {
-    pp = *(s->begin());
-  }
-  partition_map[kmer] = pp;
+	unsigned int k = ti - tags.begin();
+	forest.mark(k);
+	forest.unite(i, k);
+      }
+    }
 
-  if (next_partition_id <= p) {
-    next_partition_id = p + 1;
+    unsigned long long n_before = __sync_fetch_and_add(&state->n_done,
+						       last - first);
+    unsigned long long n_after = n_before + (last - first);
+
+    // run callback, if specified -- from the calling thread only.
+    if (thread_id == 0 && state->callback &&
+	n_after / CALLBACK_PERIOD != n_before / CALLBACK_PERIOD) {
+      state->callback("do_parallel_partition", state->callback_data,
+		      n_after, n_tags);
+    }
   }
 }
 
-PartitionID SubsetPartition::assign_partition_id(HashIntoType kmer,
-						 SeenSet& tagged_kmers)
-
+void SubsetPartition::do_parallel_partition(unsigned int n_threads,
+					    bool break_on_stop_tags,
+					    bool stop_big_traversals,
+					    CallbackFn callback,
+					    void * callback_data)
 {
-  PartitionID return_val = 0; 
-  PartitionID * pp = NULL;
+  const std::vector<HashIntoType> &tags = _ht->all_tags.sorted();
+  if (tags.empty()) {
+    return;
+  }
+  assert(tags.size() < NO_PARTITION_NODE);
+
+  ConcurrentUnionFind forest(tags.size());
+
+  _PartitionState state;
+  state.subset = this;
+  state.tags = &tags;
+  state.all_tags = &_ht->all_tags;
+  state.forest = &forest;
+  state.ksize = _ht->ksize();
+  state.break_on_stop_tags = break_on_stop_tags;
+  state.stop_big_traversals = stop_big_traversals;
+  state.callback = callback;
+  state.callback_data = callback_data;
+  state.next_tag = 0;
+  state.n_done = 0;
+  state.stop = false;
+
+  run_threads(n_threads, _partition_thread, &state, &state.stop);
+
+  // one partition per tree, joined to whatever partitions its tags
+  // were already in.  Those can span trees, so the partition a tree went
+  // into may since have been joined into another; go by the tree's first
+  // tag rather than remembering the ID.
+  std::vector<unsigned int> tree_first(tags.size(), NO_PARTITION_NODE);
+
+  for (unsigned int i = 0; i < tags.size(); i++) {
+    if (!forest.is_marked(i)) {
+      continue;
+    }
 
-  // did we find a tagged kmer?
-  if (tagged_kmers.size() >= 1) {
-    pp = _join_partitions_by_tags(tagged_kmers, kmer);
-    return_val = *pp;
-  } else {
-    PartitionMap::iterator pi = partition_map.find(kmer);
+    PartitionID p;
+    unsigned int &first = tree_first[forest.find(i)];
+    if (first == NO_PARTITION_NODE) {
+      first = i;
+      p = get_partition_id(tags[i]);
+      if (!p) {
+	p = get_new_partition();
+      }
+    } else {
+      p = get_partition_id(tags[first]);
+    }
 
-    partition_map.erase(kmer);
-    return_val = 0;
+    unsigned int node = _tag_node(tags[i]);
+    if (node == NO_PARTITION_NODE) {
+      _set_tag_partition(tags[i], p);
+    } else {
+      _join_two_partitions(p, _node_partition(node));
+    }
   }
-
-  return return_val;
 }
 
-// _join_partitions_by_tags combines the tags in 'tagged_kmers' into a single
-// partition, creating or reassigning partitions as necessary.  Low level
-// function!
+//
+// partition_from_tags: do_parallel_partition from just the given tags,
+// joining each to the tags its search finds and to whatever partitions
+// they are already in.  Nothing here is sized by the whole tag set, so
+// when only some tags need searching from -- those on reads that touched
+// the graph loaded before them -- the cost goes with those.
+//
+// The threads search from a round of tags at a time and keep what each
+// search found; the calling thread then joins them, in tag order, before
+// the next round.
+//
 
-PartitionID * SubsetPartition::_join_partitions_by_tags(
-                   const SeenSet& tagged_kmers,
-		   const HashIntoType kmer)
+struct _PartitionFromState {
+  SubsetPartition * subset;
+  const std::vector<HashIntoType> * starts;
+  std::vector<std::vector<HashIntoType> > * found; // one per tag in round
+  const TagSet * all_tags;
+  WordLength ksize;
+  bool break_on_stop_tags;
+  bool stop_big_traversals;
+  CallbackFn callback;
+  void * callback_data;
+  unsigned long long round_start, round_end;
+  unsigned long long next_tag;
+  volatile bool stop;
+};
+
+static void _partition_from_thread(unsigned int thread_id, void * data)
 {
-  SeenSet::const_iterator it = tagged_kmers.begin();
-  unsigned int * this_partition_p = NULL;
-
-  // find first assigned partition ID in tagged set
-  while (it != tagged_kmers.end()) {
-    this_partition_p = partition_map[*it];
-    if (this_partition_p != NULL) {
+  _PartitionFromState * state = (_PartitionFromState *) data;
+  const std::vector<HashIntoType> &starts = *state->starts;
+  TraversalWorkspace ws;
+
+  while (!state->stop) {
+    unsigned long long first = __sync_fetch_and_add(&state->next_tag,
+						    PARTITION_CHUNK_TAGS);
+    if (first >= state->round_end) {
       break;
     }
-    it++;
-  }
-
-  // no partition ID? allocate new!
-  if (this_partition_p == NULL) {
-    this_partition_p = new PartitionID(next_partition_id);
-    next_partition_id++;
+    unsigned long long last = std::min(first + PARTITION_CHUNK_TAGS,
+				       state->round_end);
+
+    for (unsigned long long i = first; i < last; i++) {
+      HashIntoType kmer_f, kmer_r;
+      std::string kmer_s = _revhash(starts[i], state->ksize);
+      _hash(kmer_s.c_str(), state->ksize, kmer_f, kmer_r);
+
+      state->subset->find_all_tags(kmer_f, kmer_r, ws, *state->all_tags,
+				   state->break_on_stop_tags,
+				   state->stop_big_traversals);
+      (*state->found)[i - state->round_start] = ws.tagged;
+    }
 
-    PartitionPtrSet * s = new PartitionPtrSet();
-    s->insert(this_partition_p);
-    reverse_pmap[*this_partition_p] = s;
+    // run callback, if specified -- from the calling thread only.
+    if (thread_id == 0 && state->callback &&
+	last / CALLBACK_PERIOD != first / CALLBACK_PERIOD) {
+      state->callback("partition_from_tags", state->callback_data,
+		      last, starts.size());
+    }
   }
-  
-  // reassign all partitions individually.
-  it = tagged_kmers.begin();
-  for (; it != tagged_kmers.end(); ++it) {
-    PartitionMap::iterator pi = partition_map.find(*it);
+}
 
-    if (pi == partition_map.end()) { // no entry? insert.
-      partition_map[*it] = this_partition_p;
-    } else {
-      PartitionID * pp_id = pi->second;
-
-      if (pp_id == NULL) {	// entry is null? set;
-	pi->second = this_partition_p;
-      } else if (*pp_id != *this_partition_p) { // != entry? join partitions.
-	_merge_two_partitions(this_partition_p, pp_id);
+void SubsetPartition::partition_from_tags(const TagSet &start_tags,
+					  unsigned int n_threads,
+					  bool break_on_stop_tags,
+					  bool stop_big_traversals,
+					  CallbackFn callback,
+					  void * callback_data)
+{
+  std::vector<HashIntoType> starts(start_tags.begin(), start_tags.end());
+  std::sort(starts.begin(), starts.end());
+
+  std::vector<std::vector<HashIntoType> > found;
+
+  _PartitionFromState state;
+  state.subset = this;
+  state.starts = &starts;
+  state.found = &found;
+  state.all_tags = &_ht->all_tags;
+  state.ksize = _ht->ksize();
+  state.break_on_stop_tags = break_on_stop_tags;
+  state.stop_big_traversals = stop_big_traversals;
+  state.callback = callback;
+  state.callback_data = callback_data;
+  state.stop = false;
+
+  for (unsigned long long round_start = 0; round_start < starts.size();
+       round_start += PARTITION_ROUND_TAGS) {
+    unsigned long long round_end = std::min(round_start + PARTITION_ROUND_TAGS,
+					    (unsigned long long) starts.size());
+
+    found.assign(round_end - round_start, std::vector<HashIntoType>());
+    state.round_start = round_start;
+    state.round_end = round_end;
+    state.next_tag = round_start;
+
+    run_threads(n_threads, _partition_from_thread, &state, &state.stop);
+
+    for (unsigned long long i = round_start; i < round_end; i++) {
+      const std::vector<HashIntoType> &tagged = found[i - round_start];
+      if (!tagged.empty()) {
+	_join_partitions_by_tags(tagged, starts[i]);
       }
     }
   }
+}
+
+//
+// refine_streaming_partition: finish off the partitions made by
+// Hashbits::consume_fasta_and_partition, by searching from the tags it
+// left in partition_todo_tags.  Those are all the tags that can be
+// connected to tags other than the ones on their own reads, so the
+// partitions come out as if do_parallel_partition had been run over
+// everything -- unless stop tags (which the loading ignores) break up
+// reads.  The same goes for reads added to a graph that was partitioned
+// before, so this is also how a partition map is brought up to date.
+// Returns the number of tags searched from.
+//
+
+unsigned int SubsetPartition::refine_streaming_partition(unsigned int n_threads,
+						bool break_on_stop_tags,
+						bool stop_big_traversals,
+						CallbackFn callback,
+						void * callback_data)
+{
+  unsigned int n_todo = _ht->partition_todo_tags.size();
+
+  partition_from_tags(_ht->partition_todo_tags, n_threads,
+		      break_on_stop_tags, stop_big_traversals,
+		      callback, callback_data);
+  _ht->partition_todo_tags.clear();
+
+  return n_todo;
+}
+
+//
+
+void SubsetPartition::set_partition_id(std::string kmer_s, PartitionID p)
+{
+  HashIntoType kmer;
+  assert(kmer_s.length() >= _ht->ksize());
+  kmer = _hash(kmer_s.c_str(), _ht->ksize());
+
+  set_partition_id(kmer, p);
+}
+
+void SubsetPartition::set_partition_id(HashIntoType kmer, PartitionID p)
+{
+  _set_tag_partition(kmer, p);
+
+  if (next_partition_id <= p) {
+    next_partition_id = p + 1;
+  }
+}
+
+// _set_tag_partition puts the tag in partition p, taking it out of any
+// other partition it was in.  p is created if it doesn't exist yet.
+
+void SubsetPartition::_set_tag_partition(HashIntoType tag, PartitionID p)
+{
+  unsigned int node = _tag_node(tag);
+  if (node != NO_PARTITION_NODE && _node_partition(node) == p) {
+    return;
+  }
+
+  node = _parent.size();
+  PartitionNodeMap::const_iterator ri = _partition_roots.find(p);
+
+  if (ri == _partition_roots.end()) { // a new partition; this is its root.
+    _parent.push_back(node);
+    _partition_roots[p] = node;
+  } else {
+    unsigned int root = ri->second;
+    _parent.push_back(root);
+    if (_rank[root] == 0) {
+      _rank[root] = 1;
+    }
+  }
+  _rank.push_back(0);
+  _root_partition.push_back(p);
+
+  _tag_nodes.set(tag, node);
+}
+
+// _join_two_partitions merges partition 'other' into partition 'keep':
+// the root of lower rank goes under the other, and the merged tree takes
+// the ID 'keep'.  Both must exist.
+
+void SubsetPartition::_join_two_partitions(PartitionID keep,
+					   PartitionID other)
+{
+  if (keep == other) {
+    return;
+  }
+
+  PartitionNodeMap::iterator ki = _partition_roots.find(keep);
+  PartitionNodeMap::iterator oi = _partition_roots.find(other);
+  assert(ki != _partition_roots.end());
+  assert(oi != _partition_roots.end());
+
+  unsigned int root = ki->second, child = oi->second;
+  if (_rank[root] < _rank[child]) {
+    std::swap(root, child);
+  }
+  _parent[child] = root;
+  if (_rank[root] == _rank[child]) {
+    _rank[root]++;
+  }
 
-  assert(this_partition_p != NULL);
-  partition_map[kmer] = this_partition_p;
+  _root_partition[root] = keep;
+  ki->second = root;
+  _partition_roots.erase(oi);
+}
 
-  return this_partition_p;
+PartitionID SubsetPartition::assign_partition_id(HashIntoType kmer,
+						 SeenSet& tagged_kmers)
+{
+  std::vector<HashIntoType> tags(tagged_kmers.begin(), tagged_kmers.end());
+  return assign_partition_id(kmer, tags);
 }
 
-// _merge_two_partitions merges the 'merge_pp' partition into the
-// 'the_pp' partition.  It does this by joining the reverse pointer
-// map structures for two partitions and resetting each partition
-// pointer individually.
+PartitionID SubsetPartition::assign_partition_id(HashIntoType kmer,
+				const std::vector<HashIntoType>& tagged_kmers)
+{
+  // did we find a tagged kmer?
+  if (tagged_kmers.size() >= 1) {
+    return _join_partitions_by_tags(tagged_kmers, kmer);
+  }
+
+  if (_tag_node(kmer) != NO_PARTITION_NODE) {
+    _tag_nodes.set(kmer, NO_PARTITION_NODE);
+  }
+  return 0;
+}
+
+// _join_partitions_by_tags combines the tags in 'tagged_kmers' into a single
+// partition, creating or reassigning partitions as necessary.  Low level
+// function!
 
-PartitionID * SubsetPartition::_merge_two_partitions(PartitionID *the_pp,
-						     PartitionID *merge_pp)
+PartitionID SubsetPartition::_join_partitions_by_tags(
+                   const std::vector<HashIntoType>& tagged_kmers,
+		   const HashIntoType kmer)
 {
-  PartitionPtrSet * s = reverse_pmap[*the_pp];
-  PartitionPtrSet * t = reverse_pmap[*merge_pp];
+  std::vector<HashIntoType>::const_iterator it = tagged_kmers.begin();
+  PartitionID this_partition = 0;
 
-  // Choose the smaller of two sets to loop over.
-  if (s->size() < t->size()) {
-    PartitionPtrSet * tmp = s;  s = t; t = tmp;
-    PartitionID * tmp2 = the_pp; the_pp = merge_pp; merge_pp = tmp2;
+  // find first assigned partition ID in tagged set
+  for (; it != tagged_kmers.end() && !this_partition; ++it) {
+    this_partition = get_partition_id(*it);
   }
 
-  // Get rid of the reverse pointer for the old partition.
-  reverse_pmap.erase(*merge_pp);
+  // no partition ID? allocate new!
+  if (!this_partition) {
+    this_partition = get_new_partition();
+  }
 
-  // Merge all of the elements in the to-be-replaced PartitionPtrSet
-  // into the merged partition.
-  for (PartitionPtrSet::iterator pi = t->begin(); pi != t->end(); pi++) {
-    PartitionID * iter_pp;
-    iter_pp = *pi;
+  // reassign all partitions individually.
+  for (it = tagged_kmers.begin(); it != tagged_kmers.end(); ++it) {
+    unsigned int node = _tag_node(*it);
 
-    *iter_pp = *the_pp;	// reset the partition ID to the new one.
-    s->insert(iter_pp);
+    if (node == NO_PARTITION_NODE) { // no entry? insert.
+      _set_tag_partition(*it, this_partition);
+    } else {			// != entry? join partitions.
+      _join_two_partitions(this_partition, _node_partition(node));
+    }
   }
-  delete t;
 
-  return the_pp;
+  _set_tag_partition(kmer, this_partition);
+
+  return this_partition;
 }
 
 PartitionID SubsetPartition::join_partitions(PartitionID orig, PartitionID join)
@@ -643,17 +1281,12 @@ PartitionID SubsetPartition::join_partitions(PartitionID orig, PartitionID join)
   if (orig == join) { return orig; }
   if (orig == 0 || join == 0) { return 0; }
 
-  if (reverse_pmap.find(orig) == reverse_pmap.end() ||
-      reverse_pmap.find(join) == reverse_pmap.end() ||
-      reverse_pmap[orig] == NULL ||
-      reverse_pmap[join] == NULL) {
+  if (_partition_roots.find(orig) == _partition_roots.end() ||
+      _partition_roots.find(join) == _partition_roots.end()) {
     return 0;
   }
 
-  PartitionID * orig_pp = *(reverse_pmap[orig]->begin());
-  PartitionID * join_pp = *(reverse_pmap[join]->begin());
-
-  _merge_two_partitions(orig_pp, join_pp);
+  _join_two_partitions(orig, join);
 
   return orig;
 }
@@ -669,28 +1302,34 @@ PartitionID SubsetPartition::get_partition_id(std::string kmer_s)
 
 PartitionID SubsetPartition::get_partition_id(HashIntoType kmer)
 {
-  if (partition_map.find(kmer) != partition_map.end()) {
-    PartitionID * pp = partition_map[kmer];
-    if (pp == NULL) {
-      return 0;
-    }
-    return *pp;
+  unsigned int node = _tag_node(kmer);
+  if (node == NO_PARTITION_NODE) {
+    return 0;
   }
-  return 0;
+  return _node_partition(node);
 }
 
 void SubsetPartition::merge(SubsetPartition * other)
 {
   if (this == other) { return; }
 
-  PartitionPtrMap other_to_this;
+  // in tag order, as merge_from_disk would see them.
+  std::vector<std::pair<HashIntoType, PartitionID> > tags;
+  tags.reserve(other->_tag_nodes.size());
 
-  PartitionMap::const_iterator pi = other->partition_map.begin();
-  for (; pi != other->partition_map.end(); pi++) {
-    if (pi->second) {
-      _merge_other(pi->first, *(pi->second), other_to_this);
+  TagMap::const_iterator ti = other->_tag_nodes.begin();
+  for (; ti != other->_tag_nodes.end(); ++ti) {
+    if (ti.value() != NO_PARTITION_NODE) {
+      tags.push_back(std::make_pair(ti.key(),
+				    other->_node_partition(ti.value())));
     }
   }
+  std::sort(tags.begin(), tags.end());
+
+  PartitionNodeMap other_to_this;
+  for (unsigned int i = 0; i < tags.size(); i++) {
+    _merge_other(tags[i].first, tags[i].second, other_to_this);
+  }
 }
 
 // Merge PartitionIDs from another SubsetPartition, based on overlapping
@@ -698,52 +1337,36 @@ void SubsetPartition::merge(SubsetPartition * other)
 
 void SubsetPartition::_merge_other(HashIntoType tag,
 				   PartitionID other_partition,
-				   PartitionPtrMap& diskp_to_pp)
+				   PartitionNodeMap& diskp_to_node)
 {
   if (set_contains(_ht->stop_tags, tag)) { // don't merge if it's a stop_tag
     return;
   }
 
   // OK.  Does our current partitionmap have this?
-  PartitionID * pp_0;
-  pp_0 = partition_map[tag];
+  unsigned int node = _tag_node(tag);
+  PartitionNodeMap::iterator di = diskp_to_node.find(other_partition);
 
-  if (pp_0 == NULL) {	// No!  OK, map to new 'un.
-    PartitionID * existing_pp_0 = diskp_to_pp[other_partition];
-
-    if (existing_pp_0) {	// already seen this other_partition
-      partition_map[tag] = existing_pp_0;
+  if (node == NO_PARTITION_NODE) { // No!  OK, map to new 'un.
+    if (di != diskp_to_node.end()) { // already seen this other_partition
+      _set_tag_partition(tag, _node_partition(di->second));
     }
     else {			// new other_partition! create a new partition.
-      pp_0 = get_new_partition();
-
-      PartitionPtrSet * pp_set = new PartitionPtrSet();
-      pp_set->insert(pp_0);
-      reverse_pmap[*pp_0] = pp_set;
-      partition_map[tag] = pp_0;
-
-      diskp_to_pp[other_partition] = pp_0;
+      _set_tag_partition(tag, get_new_partition());
+      diskp_to_node[other_partition] = _tag_node(tag);
     }
   }
   else {			// yes, we've seen this tag before...
-    PartitionID * existing_pp_0 = diskp_to_pp[other_partition];
-
-    if (existing_pp_0) {	// mapping exists.  copacetic?
-      if (*pp_0 == *existing_pp_0) {
-	;			// yep! nothing to do, yay!
-      } else {
-	// remapping must be done... we need to merge!
-	// the two partitions to merge are *pp_0 and *existing_pp_0.
-	// we also need to reset existing_pp_0 in diskp_to_pp to pp_0.
-
-	pp_0 = _merge_two_partitions(pp_0, existing_pp_0);
-	diskp_to_pp[other_partition] = pp_0;
-      }
+    if (di != diskp_to_node.end()) { // mapping exists.  copacetic?
+      // if not, merge.  diskp_to_node holds a node, not an ID, so it
+      // follows the merged partition without being reset.
+      _join_two_partitions(_node_partition(node),
+			   _node_partition(di->second));
     }
     else {
       // no, does not exist in our mapping yet.  but that's ok,
       // we can fix that.
-      diskp_to_pp[other_partition] = pp_0;
+      diskp_to_node[other_partition] = node;
     }
   }
 }
@@ -760,6 +1383,34 @@ void SubsetPartition::merge_from_disk(string other_filename)
 
   infile.read((char *) &version, 1);
   infile.read((char *) &ht_type, 1);
+
+  if (version == SAVED_PACKED_PMAP_VERSION) {
+    infile.close();
+
+    PartitionMapFile pmapfile(other_filename);
+    if (!pmapfile.is_open() || pmapfile.ksize() != _ht->ksize()) {
+      throw std::runtime_error("bad packed partition map " +
+			       other_filename);
+    }
+
+    PartitionNodeMap diskp_to_node;
+    std::vector<HashIntoType> tags;
+    std::vector<unsigned int> partitions;
+
+    for (HashIntoType i = 0; i < pmapfile.n_blocks(); i++) {
+      if (!pmapfile.get_block(i, tags, partitions)) {
+	throw std::runtime_error("corrupt packed partition map " +
+				 other_filename);
+      }
+
+      for (unsigned int j = 0; j < tags.size(); j++) {
+	_merge_other(tags[j], pmapfile.partition_id(partitions[j]),
+		     diskp_to_node);
+      }
+    }
+    return;
+  }
+
   assert(version == SAVED_FORMAT_VERSION);
   assert(ht_type == SAVED_SUBSET);
 
@@ -775,7 +1426,7 @@ void SubsetPartition::merge_from_disk(string other_filename)
 
   assert(infile.is_open());
 
-  PartitionPtrMap diskp_to_pp;
+  PartitionNodeMap diskp_to_node;
 
   HashIntoType * kmer_p = NULL;
   PartitionID * diskp = NULL;
@@ -805,21 +1456,336 @@ void SubsetPartition::merge_from_disk(string other_filename)
 
       assert(*diskp != 0);		// sanity check.
 
-      _merge_other(*kmer_p, *diskp, diskp_to_pp);
+      _merge_other(*kmer_p, *diskp, diskp_to_node);
 
       loaded++;
     }
     assert(i == n_bytes);
     memcpy(buf, buf + n_bytes, remainder);
 
-    // _merge_from_disk_consolidate(diskp_to_pp);
+    // _merge_from_disk_consolidate(diskp_to_node);
+  }
+}
+
+//
+// merge_partitionmap_files: merge any number of saved partition maps into
+// one, on disk, without loading their tags.
+//
+// save_partitionmap writes the tags in sorted order, so the files can be
+// read side by side, a tag at a time, as in the merge step of a merge
+// sort.  A partition in one file is a node in a small union-find forest;
+// a tag in several files joins their partitions, just as _merge_other
+// would.  That is the first pass.  The second pass reads the files again
+// and writes each tag with the ID of its partition's tree.  Memory is one
+// buffer per file and the forest, which grows with the number of
+// partitions in the files rather than the number of tags.
+//
+
+#define PMAP_RECORD_BYTES (sizeof(HashIntoType) + sizeof(PartitionID))
+#define PMAP_MERGE_BUF_RECORDS (64*1024)
+
+// _PmapReader: the records of one partition map file, in order.  Throws
+// std::runtime_error on a file that can't be merged.
+
+class _PmapReader {
+protected:
+  ifstream _infile;
+  char * _buf;
+  unsigned int _pos, _end;
+  bool _started;
+
+public:
+  HashIntoType tag;
+  PartitionID partition;
+
+  _PmapReader(const std::string &filename, WordLength ksize) :
+    _infile(filename.c_str(), ios::binary), _pos(0), _end(0),
+    _started(false), tag(0), partition(0)
+  {
+    unsigned int save_ksize = 0;
+    unsigned char version = 0, ht_type = 0;
+
+    if (!_infile.is_open()) {
+      throw std::runtime_error("cannot open partition map " + filename);
+    }
+    _infile.read((char *) &version, 1);
+    _infile.read((char *) &ht_type, 1);
+    _infile.read((char *) &save_ksize, sizeof(save_ksize));
+
+    if (!_infile.good() || version != SAVED_FORMAT_VERSION ||
+	ht_type != SAVED_SUBSET) {
+      throw std::runtime_error("not an unpacked partition map: " + filename);
+    }
+    if (save_ksize != ksize) {
+      throw std::runtime_error("partition map k-size mismatch: " + filename);
+    }
+
+    _buf = new char[PMAP_MERGE_BUF_RECORDS * PMAP_RECORD_BYTES];
+  }
+
+  ~_PmapReader() { delete[] _buf; }
+
+  bool next() {
+    if (_pos == _end) {
+      _infile.read(_buf, PMAP_MERGE_BUF_RECORDS * PMAP_RECORD_BYTES);
+      _pos = 0;
+      _end = _infile.gcount();
+      if (_end % PMAP_RECORD_BYTES) {
+	throw std::runtime_error("truncated partition map");
+      }
+      if (_end == 0) {
+	return false;
+      }
+    }
+
+    HashIntoType last = tag;
+
+    memcpy(&tag, _buf + _pos, sizeof(HashIntoType));
+    memcpy(&partition, _buf + _pos + sizeof(HashIntoType),
+	   sizeof(PartitionID));
+    _pos += PMAP_RECORD_BYTES;
+
+    if (partition == 0) {
+      throw std::runtime_error("partition map has a tag with no partition");
+    }
+    if (_started && tag <= last) { // saved in tag order.
+      throw std::runtime_error("partition map is not sorted by tag");
+    }
+    _started = true;
+    return true;
+  }
+};
+
+// _PmapMerger: the records of several partition map files, grouped by tag
+// in tag order.  Each group is a list of (file, partition).
+
+typedef std::pair<unsigned int, PartitionID> _PmapRecord;
+
+class _PmapMerger {
+protected:
+  std::vector<_PmapReader *> _readers;
+  std::priority_queue<std::pair<HashIntoType, unsigned int>,
+		      std::vector<std::pair<HashIntoType, unsigned int> >,
+		      std::greater<std::pair<HashIntoType, unsigned int> > >
+  _heap;
+
+  void _advance(unsigned int i) {
+    if (_readers[i]->next()) {
+      _heap.push(std::make_pair(_readers[i]->tag, i));
+    }
+  }
+
+  void _delete_readers() {
+    for (unsigned int i = 0; i < _readers.size(); i++) {
+      delete _readers[i];
+    }
+    _readers.clear();
+  }
+
+public:
+  _PmapMerger(const std::vector<std::string> &filenames, WordLength ksize) {
+    try {
+      for (unsigned int i = 0; i < filenames.size(); i++) {
+	_readers.push_back(NULL);
+	_readers[i] = new _PmapReader(filenames[i], ksize);
+	_advance(i);
+      }
+    } catch (...) {
+      _delete_readers();
+      throw;
+    }
+  }
+
+  ~_PmapMerger() { _delete_readers(); }
+
+  bool next_group(HashIntoType &tag, std::vector<_PmapRecord> &group) {
+    group.clear();
+    if (_heap.empty()) {
+      return false;
+    }
+
+    tag = _heap.top().first;
+    while (!_heap.empty() && _heap.top().first == tag) {
+      unsigned int i = _heap.top().second;
+      _heap.pop();
+
+      group.push_back(std::make_pair(i, _readers[i]->partition));
+      _advance(i);
+    }
+    return true;
+  }
+};
+
+static unsigned int _pmap_find(std::vector<unsigned int> &parent,
+			       unsigned int x)
+{
+  while (parent[x] != x) {
+    parent[x] = parent[parent[x]];
+    x = parent[x];
+  }
+  return x;
+}
+
+void SubsetPartition::merge_partitionmap_files(
+			const std::vector<std::string> &infiles,
+			const std::string &outfile,
+			bool packed)
+{
+  const WordLength ksize = _ht->ksize();
+
+  // each file's partitions -> nodes in the forest.
+  std::vector<std::map<PartitionID, unsigned int> > nodes(infiles.size());
+  std::vector<unsigned int> parent;
+  std::vector<unsigned char> rank;
+
+  HashIntoType tag;
+  std::vector<_PmapRecord> group;
+  unsigned long long n_tags = 0;
+
+  {
+    _PmapMerger merger(infiles, ksize);
+
+    while (merger.next_group(tag, group)) {
+      if (set_contains(_ht->stop_tags, tag)) { // don't merge on stop tags
+	continue;
+      }
+      n_tags++;
+
+      unsigned int first_root = 0;
+      for (unsigned int i = 0; i < group.size(); i++) {
+	std::map<PartitionID, unsigned int> &file_nodes =
+	  nodes[group[i].first];
+	std::map<PartitionID, unsigned int>::iterator ni =
+	  file_nodes.find(group[i].second);
+
+	unsigned int node;
+	if (ni == file_nodes.end()) {
+	  node = parent.size();
+	  parent.push_back(node);
+	  rank.push_back(0);
+	  file_nodes[group[i].second] = node;
+	} else {
+	  node = ni->second;
+	}
+
+	unsigned int root = _pmap_find(parent, node);
+	if (i == 0) {
+	  first_root = root;
+	} else if (root != first_root) {	// join them, by rank.
+	  if (rank[root] > rank[first_root]) {
+	    std::swap(root, first_root);
+	  }
+	  parent[root] = first_root;
+	  if (rank[root] == rank[first_root]) {
+	    rank[first_root]++;
+	  }
+	}
+      }
+    }
+  }
+
+  // one partition per tree.
+  std::vector<unsigned int> tree_index(parent.size(), NO_PARTITION_NODE);
+  std::vector<PartitionID> partitions;
+
+  for (unsigned int i = 0; i < parent.size(); i++) {
+    unsigned int root = _pmap_find(parent, i);
+    if (tree_index[root] == NO_PARTITION_NODE) {
+      tree_index[root] = partitions.size();
+      partitions.push_back(get_new_partition());
+    }
+  }
+
+  // now write each tag out with its tree's partition.
+  _PmapMerger merger(infiles, ksize);
+
+  PartitionMapWriter * writer = NULL;
+  ofstream out;
+  char * buf = NULL;
+  unsigned int n_bytes = 0;
+
+  if (packed) {
+    writer = new PartitionMapWriter(outfile, ksize, n_tags, partitions);
+  } else {
+    out.open(outfile.c_str(), ios::binary);
+
+    unsigned char version = SAVED_FORMAT_VERSION;
+    unsigned char ht_type = SAVED_SUBSET;
+    unsigned int save_ksize = ksize;
+    out.write((const char *) &version, 1);
+    out.write((const char *) &ht_type, 1);
+    out.write((const char *) &save_ksize, sizeof(save_ksize));
+
+    buf = new char[PMAP_MERGE_BUF_RECORDS * PMAP_RECORD_BYTES];
+  }
+
+  // the files were checked on the first pass; if one has changed since,
+  // its tags or partitions may not match what that pass saw.
+  unsigned long long n_written = 0;
+  try {
+    while (merger.next_group(tag, group)) {
+      if (set_contains(_ht->stop_tags, tag)) {
+	continue;
+      }
+
+      const std::map<PartitionID, unsigned int> &file_nodes =
+	nodes[group[0].first];
+      std::map<PartitionID, unsigned int>::const_iterator ni =
+	file_nodes.find(group[0].second);
+      if (ni == file_nodes.end() || n_written == n_tags) {
+	throw std::runtime_error("partition map " + infiles[group[0].first] +
+				 " changed while being merged");
+      }
+      n_written++;
+
+      unsigned int i = tree_index[_pmap_find(parent, ni->second)];
+
+      if (writer) {
+	writer->add(tag, i);
+	continue;
+      }
+
+      memcpy(buf + n_bytes, &tag, sizeof(HashIntoType));
+      memcpy(buf + n_bytes + sizeof(HashIntoType), &partitions[i],
+	     sizeof(PartitionID));
+      n_bytes += PMAP_RECORD_BYTES;
+
+      if (n_bytes == PMAP_MERGE_BUF_RECORDS * PMAP_RECORD_BYTES) {
+	out.write(buf, n_bytes);
+	n_bytes = 0;
+      }
+    }
+
+    if (n_written != n_tags) {
+      throw std::runtime_error("partition maps changed while being merged");
+    }
+  } catch (...) {
+    delete writer;
+    delete[] buf;
+    throw;
+  }
+
+  if (writer) {
+    writer->close();
+    delete writer;
+  } else {
+    if (n_bytes) {
+      out.write(buf, n_bytes);
+    }
+    out.close();
+    delete[] buf;
   }
 }
 
 // Save a partition map to disk.
 
-void SubsetPartition::save_partitionmap(string pmap_filename)
+void SubsetPartition::save_partitionmap(string pmap_filename, bool packed)
 {
+  if (packed) {
+    _save_packed_partitionmap(pmap_filename);
+    return;
+  }
+
   ofstream outfile(pmap_filename.c_str(), ios::binary);
 
   unsigned char version = SAVED_FORMAT_VERSION;
@@ -840,31 +1806,34 @@ void SubsetPartition::save_partitionmap(string pmap_filename)
   HashIntoType * kmer_p = NULL;
   PartitionID * pp;
 
-  // For each tag in the partition map, save the tag and the associated
-  // partition ID.
-
-  PartitionMap::const_iterator pi = partition_map.begin();
-  for (; pi != partition_map.end(); pi++) {
-    PartitionID p_id;
-
-    HashIntoType kmer = pi->first;
-    if (pi->second != NULL) {	// if a partition ID has been assigned... save.
-      p_id = *(pi->second);
+  // For each tag with a partition, save the tag and the associated
+  // partition ID, in tag order.
 
-      // each record consists of one tag followed by one PartitionID.
-      kmer_p = (HashIntoType *) (buf + n_bytes);
-      *kmer_p = kmer;
-      n_bytes += sizeof(HashIntoType);
+  std::vector<HashIntoType> tags;
+  tags.reserve(_tag_nodes.size());
 
-      pp = (PartitionID *) (buf + n_bytes);
-      *pp = p_id;
-      n_bytes += sizeof(PartitionID);
-
-      // flush to disk
-      if (n_bytes >= IO_BUF_SIZE - sizeof(HashIntoType) - sizeof(PartitionID)) {
-	outfile.write(buf, n_bytes);
-	n_bytes = 0;
-      }
+  TagMap::const_iterator ti = _tag_nodes.begin();
+  for (; ti != _tag_nodes.end(); ++ti) {
+    if (ti.value() != NO_PARTITION_NODE) {
+      tags.push_back(ti.key());
+    }
+  }
+  std::sort(tags.begin(), tags.end());
+
+  for (unsigned int i = 0; i < tags.size(); i++) {
+    // each record consists of one tag followed by one PartitionID.
+    kmer_p = (HashIntoType *) (buf + n_bytes);
+    *kmer_p = tags[i];
+    n_bytes += sizeof(HashIntoType);
+
+    pp = (PartitionID *) (buf + n_bytes);
+    *pp = _node_partition(_tag_node(tags[i]));
+    n_bytes += sizeof(PartitionID);
+
+    // flush to disk
+    if (n_bytes >= IO_BUF_SIZE - sizeof(HashIntoType) - sizeof(PartitionID)) {
+      outfile.write(buf, n_bytes);
+      n_bytes = 0;
     }
   }
   // save remainder.
@@ -878,58 +1847,429 @@ void SubsetPartition::save_partitionmap(string pmap_filename)
 
 // Load a partition map from disk.
 					 
-void SubsetPartition::load_partitionmap(string infilename)
+void SubsetPartition::load_partitionmap(string infilename,
+					unsigned int n_threads)
 {
+  // into an empty partition map, a packed file can go straight in.
+  if (_tag_nodes.size() == 0 && _parent.empty()) {
+    PartitionMapFile pmapfile(infilename);
+    if (pmapfile.is_open()) {
+      if (pmapfile.ksize() != _ht->ksize()) {
+	throw std::runtime_error("partition map k-size mismatch: " +
+				 infilename);
+      }
+      _load_packed_partitionmap(pmapfile, n_threads);
+      return;
+    }
+  }
+
   // @CTB make sure this is an empty partition...?
   merge_from_disk(infilename);
 }
 
 
-void SubsetPartition::_validate_pmap()
+// Save a partition map as a packed file, with the partitions in ID order.
+
+void SubsetPartition::_save_packed_partitionmap(string pmap_filename)
 {
-  for (PartitionMap::const_iterator pi = partition_map.begin();
-       pi != partition_map.end(); pi++) {
-    //HashIntoType kmer = (*pi).first;
-    PartitionID * pp_id = (*pi).second;
+  std::vector<HashIntoType> tags;
+  std::vector<PartitionID> partitions;
+  tags.reserve(_tag_nodes.size());
+
+  TagMap::const_iterator ti = _tag_nodes.begin();
+  for (; ti != _tag_nodes.end(); ++ti) {
+    if (ti.value() != NO_PARTITION_NODE) {
+      tags.push_back(ti.key());
+      partitions.push_back(_node_partition(ti.value()));
+    }
+  }
+  std::sort(tags.begin(), tags.end());
+  std::sort(partitions.begin(), partitions.end());
+  partitions.erase(std::unique(partitions.begin(), partitions.end()),
+		   partitions.end());
+
+  PartitionMapWriter writer(pmap_filename, _ht->ksize(), tags.size(),
+			    partitions);
+
+  for (unsigned int i = 0; i < tags.size(); i++) {
+    PartitionID p = _node_partition(_tag_node(tags[i]));
+    writer.add(tags[i], std::lower_bound(partitions.begin(),
+					 partitions.end(), p) -
+	       partitions.begin());
+  }
+  writer.close();
+}
+
+//
+// _load_packed_partitionmap: load a packed file into this (empty)
+// partition map, on n_threads threads, keeping its partition IDs.
+//
+// Partition i of the file is node i, a root, and the tags are the nodes
+// after that, in file order; so every block knows its nodes without
+// asking, and the threads can take blocks as they go and fill in their
+// nodes and tags with no locking.  Each tag hangs directly off its root.
+// Stop tags are left out, as in merge_from_disk; their nodes go unused.
+// On a corrupt file, the map is left empty and std::runtime_error thrown.
+//
+
+struct _PmapLoadState {
+  const PartitionMapFile * pmapfile;
+  const TagSet * stop_tags;
+  std::vector<unsigned int> * parent;
+  TagMap * tag_nodes;
+  unsigned long long next_block;
+  volatile bool failed;
+};
+
+static void _load_pmap_thread(unsigned int thread_id, void * data)
+{
+  _PmapLoadState * state = (_PmapLoadState *) data;
+  const PartitionMapFile &pmapfile = *state->pmapfile;
+  const HashIntoType n_partitions = pmapfile.n_partitions();
+  std::vector<unsigned int> &parent = *state->parent;
+
+  std::vector<HashIntoType> tags;
+  std::vector<unsigned int> partitions;
+
+  while (!state->failed) {
+    HashIntoType i = __sync_fetch_and_add(&state->next_block, 1);
+    if (i >= pmapfile.n_blocks()) {
+      break;
+    }
+
+    if (!pmapfile.get_block(i, tags, partitions)) {
+      state->failed = true;
+      break;
+    }
 
-    if (pp_id != NULL) {
-      assert(*pp_id >= 1);
-      assert(*pp_id < next_partition_id);
+    unsigned int node = n_partitions + i * pmapfile.block_tags();
+    for (unsigned int j = 0; j < tags.size(); j++, node++) {
+      parent[node] = partitions[j];
+      if (!set_contains(*state->stop_tags, tags[j])) {
+	state->tag_nodes->set_new_concurrent(tags[j], node);
+      }
     }
   }
+}
 
-  for (ReversePartitionMap::const_iterator ri = reverse_pmap.begin();
-       ri != reverse_pmap.end(); ri++) {
-    PartitionID p = (*ri).first;
-    PartitionPtrSet *s = (*ri).second;
+void SubsetPartition::_load_packed_partitionmap(
+				const PartitionMapFile &pmapfile,
+				unsigned int n_threads)
+{
+  const HashIntoType n_partitions = pmapfile.n_partitions();
+  const HashIntoType n_nodes = n_partitions + pmapfile.size();
+  assert(n_nodes < NO_PARTITION_NODE);
+
+  _parent.assign(n_nodes, 0);
+  _rank.assign(n_nodes, 0);
+  _root_partition.assign(n_nodes, 0);
+
+  const unsigned int first_partition_id = next_partition_id;
+  bool failed = false;
 
-    assert(s != NULL);
+  for (unsigned int i = 0; i < n_partitions; i++) {
+    PartitionID p = pmapfile.partition_id(i);
+    if (p == 0 || _partition_roots.count(p)) {
+      failed = true;
+      break;
+    }
 
-    for (PartitionPtrSet::const_iterator si = s->begin(); si != s->end();
-	 si++) {
-      PartitionID * pp;
-      pp = *si;
+    _parent[i] = i;
+    _rank[i] = 1;
+    _root_partition[i] = p;
+    _partition_roots[p] = i;
 
-      assert (p == *pp);
+    if (next_partition_id <= p) {
+      next_partition_id = p + 1;
     }
   }
+
+  if (!failed) {
+    _tag_nodes.reserve(pmapfile.size());
+
+    _PmapLoadState state;
+    state.pmapfile = &pmapfile;
+    state.stop_tags = &_ht->stop_tags;
+    state.parent = &_parent;
+    state.tag_nodes = &_tag_nodes;
+    state.next_block = 0;
+    state.failed = false;
+
+    run_threads(n_threads, _load_pmap_thread, &state);
+    failed = state.failed;
+  }
+
+  if (failed) {
+    _clear_all_partitions();
+    next_partition_id = first_partition_id;
+    throw std::runtime_error("corrupt packed partition map");
+  }
 }
 
-// Get rid of all partitions & partition information.
+//
+// PartitionMapWriter
+//
 
-void SubsetPartition::_clear_all_partitions()
+#define PMAPFILE_HEADER_BYTES 48
+
+PartitionMapWriter::PartitionMapWriter(const std::string &filename,
+				       WordLength ksize,
+				       unsigned long long n_tags,
+				       const std::vector<PartitionID> &partitions)
+  : _outfile(filename.c_str(), ios::binary), _ksize(ksize), _n_tags(n_tags),
+    _n_added(0), _n_data_bytes(0), _partitions(partitions)
+{
+  // the index and partition IDs go before the blocks, so leave room for
+  // them and come back.
+  unsigned long long n_blocks = (n_tags + PMAPFILE_BLOCK_TAGS - 1) /
+    PMAPFILE_BLOCK_TAGS;
+
+  _outfile.seekp(PMAPFILE_HEADER_BYTES +
+		 n_blocks * 2 * sizeof(HashIntoType) +
+		 partitions.size() * sizeof(PartitionID));
+}
+
+void PartitionMapWriter::_write_block()
+{
+  _index.push_back(_block_tags[0]);
+  _index.push_back(_n_data_bytes);
+
+  _buf.clear();
+  for (unsigned int j = 1; j < _block_tags.size(); j++) {
+    _put_varint(_buf, _block_tags[j] - _block_tags[j - 1]);
+  }
+  for (unsigned int j = 0; j < _block_partitions.size(); j++) {
+    _put_varint(_buf, _block_partitions[j]);
+  }
+
+  _outfile.write((const char *) &_buf[0], _buf.size());
+  _n_data_bytes += _buf.size();
+
+  _block_tags.clear();
+  _block_partitions.clear();
+}
+
+void PartitionMapWriter::add(HashIntoType tag, unsigned int partition)
+{
+  assert(_n_added < _n_tags);
+  assert(_block_tags.empty() || tag > _block_tags.back());
+  assert(partition < _partitions.size());
+
+  _block_tags.push_back(tag);
+  _block_partitions.push_back(partition);
+  _n_added++;
+
+  if (_block_tags.size() == PMAPFILE_BLOCK_TAGS) {
+    _write_block();
+  }
+}
+
+void PartitionMapWriter::close()
+{
+  assert(_n_added == _n_tags);
+  if (_block_tags.size()) {
+    _write_block();
+  }
+
+  unsigned char version = SAVED_PACKED_PMAP_VERSION;
+  unsigned char ht_type = SAVED_SUBSET;
+  unsigned char pad[4] = { 0, 0, 0, 0 };
+  unsigned int save_ksize = _ksize;
+  unsigned int block_tags = PMAPFILE_BLOCK_TAGS;
+  unsigned long long n_blocks = _index.size() / 2;
+  unsigned long long n_partitions = _partitions.size();
+
+  _outfile.seekp(0);
+  _outfile.write((const char *) &version, 1);
+  _outfile.write((const char *) &ht_type, 1);
+  _outfile.write((const char *) pad, 2);
+  _outfile.write((const char *) &save_ksize, sizeof(save_ksize));
+  _outfile.write((const char *) &block_tags, sizeof(block_tags));
+  _outfile.write((const char *) pad, 4);
+  _outfile.write((const char *) &_n_tags, sizeof(_n_tags));
+  _outfile.write((const char *) &n_blocks, sizeof(n_blocks));
+  _outfile.write((const char *) &n_partitions, sizeof(n_partitions));
+  _outfile.write((const char *) &_n_data_bytes, sizeof(_n_data_bytes));
+  if (_index.size()) {
+    _outfile.write((const char *) &_index[0],
+		   _index.size() * sizeof(HashIntoType));
+  }
+  if (_partitions.size()) {
+    _outfile.write((const char *) &_partitions[0],
+		   _partitions.size() * sizeof(PartitionID));
+  }
+  _outfile.close();
+}
+
+//
+// PartitionMapFile
+//
+
+PartitionMapFile::PartitionMapFile(const std::string &filename) :
+  _map(NULL), _map_size(0), _ksize(0), _block_tags(0), _n_tags(0),
+  _n_blocks(0), _n_partitions(0), _index(NULL), _partitions(NULL),
+  _data(NULL), _data_end(NULL)
+{
+  size_t size;
+  void * map = map_file(filename, size);
+  if (!map) {
+    return;
+  }
+
+  if (size >= PMAPFILE_HEADER_BYTES &&
+      _parse((const Byte *) map, (const Byte *) map + size)) {
+    _map = map;
+    _map_size = size;
+  } else {
+    munmap(map, size);
+  }
+}
+
+PartitionMapFile::~PartitionMapFile()
+{
+  if (_map) {
+    munmap(_map, _map_size);
+    _map = NULL;
+  }
+}
+
+// check the header, that the index, IDs and blocks fit in the file, and
+// that the blocks are in tag order.  Every tag has at least a byte for
+// its partition, so the tag count is bounded by the file too.
+
+bool PartitionMapFile::_parse(const Byte * p, const Byte * end)
+{
+  unsigned long long n_data_bytes;
+
+  if (p[0] != SAVED_PACKED_PMAP_VERSION || p[1] != SAVED_SUBSET) {
+    return false;
+  }
+
+  memcpy(&_ksize, p + 4, sizeof(_ksize));
+  memcpy(&_block_tags, p + 8, sizeof(_block_tags));
+  memcpy(&_n_tags, p + 16, sizeof(_n_tags));
+  memcpy(&_n_blocks, p + 24, sizeof(_n_blocks));
+  memcpy(&_n_partitions, p + 32, sizeof(_n_partitions));
+  memcpy(&n_data_bytes, p + 40, sizeof(n_data_bytes));
+
+  if (_block_tags == 0 || _n_tags > n_data_bytes ||
+      _n_blocks != (_n_tags + _block_tags - 1) / _block_tags) {
+    return false;
+  }
+
+  // the header is a multiple of 8 bytes, so the index is aligned, and
+  // the IDs after it are too.
+  unsigned long long room = (end - p) - PMAPFILE_HEADER_BYTES;
+  if (_n_blocks > room / (2 * sizeof(HashIntoType))) {
+    return false;
+  }
+  unsigned long long index_bytes = _n_blocks * 2 * sizeof(HashIntoType);
+  room -= index_bytes;
+
+  if (_n_partitions > room / sizeof(PartitionID)) {
+    return false;
+  }
+  unsigned long long id_bytes = _n_partitions * sizeof(PartitionID);
+  room -= id_bytes;
+
+  if (n_data_bytes > room) {
+    return false;
+  }
+
+  // a node for each partition and each tag; see _load_packed_partitionmap.
+  if (_n_partitions + _n_tags >= NO_PARTITION_NODE) {
+    return false;
+  }
+
+  _index = (const unsigned long long *) (p + PMAPFILE_HEADER_BYTES);
+  for (unsigned long long i = 1; i < _n_blocks; i++) {
+    if (_index[2 * i] <= _index[2 * (i - 1)]) {
+      return false;
+    }
+  }
+
+  _partitions = (const PartitionID *) (p + PMAPFILE_HEADER_BYTES +
+				       index_bytes);
+  _data = p + PMAPFILE_HEADER_BYTES + index_bytes + id_bytes;
+  _data_end = _data + n_data_bytes;
+  return true;
+}
+
+bool PartitionMapFile::get_block(HashIntoType i,
+				 std::vector<HashIntoType> &tags,
+				 std::vector<unsigned int> &partitions) const
 {
-  for (ReversePartitionMap::iterator ri = reverse_pmap.begin();
-       ri != reverse_pmap.end(); ri++) {
-    PartitionPtrSet * s = (*ri).second;
+  assert(i < _n_blocks);
+
+  tags.clear();
+  partitions.clear();
+
+  HashIntoType tag = _index[2 * i];
+  HashIntoType offset = _index[2 * i + 1];
+  if (offset > (HashIntoType) (_data_end - _data)) {
+    return false;
+  }
+
+  const Byte * p = _data + offset;
+  unsigned long long n = std::min((unsigned long long) _block_tags,
+				  _n_tags - i * _block_tags);
+
+  // strictly increasing, and short of the next block's first tag.
+  HashIntoType last = i + 1 < _n_blocks ? _index[2 * (i + 1)] - 1 :
+    (HashIntoType) -1;
+
+  tags.push_back(tag);
+  for (unsigned long long j = 1; j < n; j++) {
+    HashIntoType gap;
+    if (!_get_varint(p, _data_end, gap) || gap == 0 || gap > last - tag) {
+      return false;
+    }
+    tag += gap;
+    tags.push_back(tag);
+  }
 
-    for (PartitionPtrSet::iterator pi = s->begin(); pi != s->end(); pi++) {
-      PartitionID * pp = (*pi);
-      delete pp;
+  for (unsigned long long j = 0; j < n; j++) {
+    HashIntoType partition;
+    if (!_get_varint(p, _data_end, partition) ||
+	partition >= _n_partitions) {
+      return false;
     }
-    delete s;
+    partitions.push_back(partition);
   }
-  partition_map.clear();
+  return true;
+}
+
+void SubsetPartition::_validate_pmap()
+{
+  for (TagMap::const_iterator ti = _tag_nodes.begin();
+       ti != _tag_nodes.end(); ++ti) {
+    if (ti.value() != NO_PARTITION_NODE) {
+      assert(ti.value() < _parent.size());
+
+      PartitionID p = _node_partition(ti.value());
+      assert(p >= 1);
+      assert(p < next_partition_id);
+    }
+  }
+
+  for (PartitionNodeMap::const_iterator ri = _partition_roots.begin();
+       ri != _partition_roots.end(); ri++) {
+    unsigned int root = ri->second;
+
+    assert(_parent[root] == root);
+    assert(_root_partition[root] == ri->first);
+  }
+}
+
+// Get rid of all partitions & partition information.
+
+void SubsetPartition::_clear_all_partitions()
+{
+  _tag_nodes.clear();
+  std::vector<unsigned int>().swap(_parent);
+  std::vector<unsigned char>().swap(_rank);
+  std::vector<PartitionID>().swap(_root_partition);
+  _partition_roots.clear();
   next_partition_id = 1;
 }
 
@@ -943,17 +2283,15 @@ bool SubsetPartition::is_single_partition(std::string seq)
   HashIntoType kmer;
 
   PartitionSet partitions;
-  PartitionID *pp;
+  PartitionID p;
 
   KMerIterator kmers(seq.c_str(), _ht->ksize());
   while (!kmers.done()) {
     kmer = kmers.next();
 
-    if (partition_map.find(kmer) != partition_map.end()) {
-      pp = partition_map[kmer];
-      if (pp) {
-	partitions.insert(*pp);
-      }
+    p = get_partition_id(kmer);
+    if (p) {
+      partitions.insert(p);
     }
   }
 
@@ -987,12 +2325,10 @@ const
   PartitionCountMap cm;
   n_unassigned = 0;
 
-  for (PartitionMap::const_iterator pi = partition_map.begin();
-       pi != partition_map.end(); pi++) {
-    if (pi->second) {
-      cm[*(pi->second)]++;
-    } else {
-      n_unassigned++;
+  for (TagMap::const_iterator ti = _tag_nodes.begin();
+       ti != _tag_nodes.end(); ++ti) {
+    if (ti.value() != NO_PARTITION_NODE) {
+      cm[_node_partition(ti.value())]++;
     }
   }
 
@@ -1005,10 +2341,10 @@ const
 unsigned int SubsetPartition::repartition_largest_partition(unsigned int distance,
 						    unsigned int threshold,
 						    unsigned int frequency,
-						    CountingHash &counting)
+						    CountingHash &counting,
+						    unsigned int n_threads)
 {
   PartitionCountMap cm;
-  unsigned int n_unassigned = 0;
   PartitionID biggest_p = 0;
   unsigned int next_largest = 0;
 
@@ -1017,12 +2353,10 @@ unsigned int SubsetPartition::repartition_largest_partition(unsigned int distanc
 #endif // 0
 
   // first, count the number of members in each partition.
-  for (PartitionMap::const_iterator pi = partition_map.begin();
-       pi != partition_map.end(); pi++) {
-    if (pi->second) {
-      cm[*(pi->second)]++;
-    } else {
-      n_unassigned++;
+  for (TagMap::const_iterator ti = _tag_nodes.begin();
+       ti != _tag_nodes.end(); ++ti) {
+    if (ti.value() != NO_PARTITION_NODE) {
+      cm[_node_partition(ti.value())]++;
     }
   }
 
@@ -1074,57 +2408,9 @@ unsigned int SubsetPartition::repartition_largest_partition(unsigned int distanc
   /// Now, go through and traverse from all the bigtags, tracking
   // those that lead to well-connected sets.
 
-  unsigned int i = 0;
-  unsigned int n = 0;
-  unsigned int count;
-  unsigned int n_big = 0;
-  SeenSet keeper;
-
-  SeenSet::const_iterator si = bigtags.begin();
-
-  for (; si != bigtags.end(); si++, i++) {
-    n++;
-
-#if 1
-    if (set_contains(_ht->repart_small_tags, *si)) {
-      continue;
-    }
-#endif //0
-
-    count = _ht->traverse_from_kmer(*si, distance, keeper);
-
-    if (count >= threshold) {
-      n_big++;
-	
-      SeenSet::const_iterator ti;
-      for (ti = keeper.begin(); ti != keeper.end(); ti++) {
-	if (counting.get_count(*ti) > frequency) {
-	  _ht->stop_tags.insert(*ti);
-	} else {
-	  counting.count(*ti);
-	}
-      }
-#if VERBOSE_REPARTITION
-      std::cout << "traversed from " << n << " tags total, of " 
-	        << bigtags.size() << "; "
-		<< n_big << " big; size is " << keeper.size()
-		<< "; " << _ht->repart_small_tags.size() << " small\n";
-#endif // 0
-    } else {
-#if 1
-      _ht->repart_small_tags.insert(*si);
-#endif //0
-    }
-    keeper.clear();
-
-    if (n % 1000 == 0) {
-#if VERBOSE_REPARTITION
-      std::cout << "found big 'un!  traversed " << n << " tags, " << n_big << " big; " <<
-	bigtags.size() << " total tags; " << _ht->stop_tags.size() 
-		<< " stop tags\n";
-#endif // 0
-    }
-  }
+  std::vector<HashIntoType> tags(bigtags.begin(), bigtags.end());
+  _ht->find_knots(tags, distance, threshold, frequency, counting,
+		  &_ht->repart_small_tags, n_threads);
 
   // return next_largest;
 #if VERBOSE_REPARTITION
@@ -1139,7 +2425,7 @@ unsigned int SubsetPartition::repartition_largest_partition(unsigned int distanc
 
 void SubsetPartition::repartition_a_partition(const SeenSet& partition_tags)
 {
-  SeenSet tagged_kmers;
+  TraversalWorkspace ws;
   std::string kmer_s;
   HashIntoType kmer_f, kmer_r, kmer;
   unsigned int ksize = _ht->ksize();
@@ -1157,18 +2443,19 @@ void SubsetPartition::repartition_a_partition(const SeenSet& partition_tags)
     kmer_s = _revhash(*si, ksize); // @CTB hackity hack hack!
     kmer = _hash(kmer_s.c_str(), ksize, kmer_f, kmer_r);
 
-    tagged_kmers.clear();
-    find_all_tags(kmer_f, kmer_r, tagged_kmers, _ht->all_tags, true, false);
+    find_all_tags(kmer_f, kmer_r, ws, _ht->all_tags, true, false);
 
     // only join things already in bigtags.
-    for (SeenSet::iterator ssi = tagged_kmers.begin();
-	 ssi != tagged_kmers.end(); ssi++) {
-      if (!set_contains(partition_tags, *ssi)) {
-	tagged_kmers.erase(ssi);
+    std::vector<HashIntoType>::iterator keep = ws.tagged.begin();
+    for (unsigned int j = 0; j < ws.tagged.size(); j++) {
+      if (set_contains(partition_tags, ws.tagged[j])) {
+	*keep++ = ws.tagged[j];
       }
     }
-    // std::cout << "joining: " << tagged_kmers.size() << "\n";
-    assign_partition_id(kmer, tagged_kmers);
+    ws.tagged.erase(keep, ws.tagged.end());
+
+    // std::cout << "joining: " << ws.tagged.size() << "\n";
+    assign_partition_id(kmer, ws.tagged);
   }
 }
 
@@ -1181,24 +2468,19 @@ void SubsetPartition::_clear_partition(PartitionID the_partition,
 {
   partition_tags.clear();
 
-  for (PartitionMap::iterator pi = partition_map.begin();
-       pi != partition_map.end(); pi++) {
-    if (pi->second && *(pi->second) == the_partition) {
-      partition_tags.insert(pi->first);
+  for (TagMap::const_iterator ti = _tag_nodes.begin();
+       ti != _tag_nodes.end(); ++ti) {
+    if (ti.value() != NO_PARTITION_NODE &&
+	_node_partition(ti.value()) == the_partition) {
+      partition_tags.insert(ti.key());
     }
   }
 
   for (SeenSet::const_iterator si = partition_tags.begin();
        si != partition_tags.end(); si++) {
-    partition_map.erase(*si);
-  }
-
-  // clear out the reverse partition mapping, too.
-  PartitionPtrSet * ps = reverse_pmap[the_partition];
-  for (PartitionPtrSet::iterator psi = ps->begin(); psi != ps->end(); psi++) {
-    delete *psi;
+    _tag_nodes.set(*si, NO_PARTITION_NODE);
   }
-  delete ps;
 
-  reverse_pmap.erase(the_partition);
+  // the partition's nodes stay in the forest, but nothing reaches them.
+  _partition_roots.erase(the_partition);
 }
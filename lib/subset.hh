@@ -2,25 +2,214 @@
 #define SUBSET_HH
 
 #include "hashtable.hh"
+#include "tagset.hh"
+#include "traversal.hh"
 
 namespace khmer {
   class CountingHash;
   class Hashbits;
 
+  //
+  // ConcurrentUnionFind: a disjoint-set forest over 0..n-1 that any number
+  // of threads can union into at once, without locks.  Roots are linked by
+  // index, the higher under the lower, with a compare-and-swap; a parent
+  // is therefore always lower than its child, so no cycle can form, and
+  // find() halves paths the same way.  A failed swap just means another
+  // thread moved first, and the union is retried from the new roots.
+  // Used over the tags in sorted (hash) order, linking by index is as good
+  // as linking at random.
+  //
+
+  class ConcurrentUnionFind {
+  protected:
+    std::vector<unsigned int> _parent;
+    std::vector<unsigned char> _marked;
+
+  public:
+    ConcurrentUnionFind(unsigned int n) : _parent(n), _marked(n, 0) {
+      for (unsigned int i = 0; i < n; i++) {
+	_parent[i] = i;
+      }
+    }
+
+    unsigned int find(unsigned int x) {
+      volatile unsigned int * parent = &_parent[0];
+
+      while (1) {
+	unsigned int p = parent[x];
+	if (p == x) {
+	  return x;
+	}
+	unsigned int gp = parent[p];
+	if (gp != p) {
+	  __sync_bool_compare_and_swap(&parent[x], p, gp);
+	}
+	x = gp;
+      }
+    }
+
+    void unite(unsigned int a, unsigned int b) {
+      while (1) {
+	a = find(a);
+	b = find(b);
+	if (a == b) {
+	  return;
+	}
+	if (a > b) {
+	  std::swap(a, b);
+	}
+	if (__sync_bool_compare_and_swap(&_parent[b], b, a)) {
+	  return;
+	}
+      }
+    }
+
+    // a mark per element, for the caller; every thread only ever sets it.
+    void mark(unsigned int x) {
+      if (!_marked[x]) {
+	_marked[x] = 1;
+      }
+    }
+    bool is_marked(unsigned int x) const { return _marked[x]; }
+  };
+
+  //
+  // Packed partition map files (SAVED_PACKED_PMAP_VERSION).  As in packed
+  // tag files, the tags are sorted and cut into blocks of PMAPFILE_BLOCK_TAGS
+  // with an index of where each block starts.  A block is the gaps between
+  // its tags and then each tag's partition, as an index into the table of
+  // partition IDs, all as varints.  The header gives the number of tags
+  // and partitions, so a loader can size everything before it decodes a
+  // block, and then decode the blocks in any order.
+  //
+  //   version, ht_type (1 byte each), 2 bytes padding
+  //   ksize, block_tags (unsigned int), 4 bytes padding
+  //   n_tags, n_blocks, n_partitions, n_data_bytes (unsigned long long)
+  //   n_blocks x (first tag, offset of its block) (unsigned long long)
+  //   n_partitions x PartitionID
+  //   the blocks
+  //
+
+#define PMAPFILE_BLOCK_TAGS 128
+
+  // PartitionMapWriter: write a packed partition map, a tag at a time, in
+  // tag order.  The number of tags and the partition IDs go in first.
+
+  class PartitionMapWriter {
+  protected:
+    std::ofstream _outfile;
+    WordLength _ksize;
+    unsigned long long _n_tags, _n_added, _n_data_bytes;
+    std::vector<PartitionID> _partitions;
+    std::vector<HashIntoType> _index;
+    std::vector<HashIntoType> _block_tags;
+    std::vector<unsigned int> _block_partitions;
+    std::vector<Byte> _buf;
+
+    void _write_block();
+
+  public:
+    PartitionMapWriter(const std::string &filename, WordLength ksize,
+		       unsigned long long n_tags,
+		       const std::vector<PartitionID> &partitions);
+
+    // 'partition' is an index into 'partitions'.
+    void add(HashIntoType tag, unsigned int partition);
+    void close();
+  };
+
+  // PartitionMapFile: a packed partition map, mmapped.
+
+  class PartitionMapFile {
+  protected:
+    void * _map;
+    size_t _map_size;
+
+    unsigned int _ksize;
+    unsigned int _block_tags;
+    unsigned long long _n_tags;
+    unsigned long long _n_blocks;
+    unsigned long long _n_partitions;
+
+    const unsigned long long * _index;
+    const PartitionID * _partitions;
+    const Byte * _data;
+    const Byte * _data_end;
+
+    bool _parse(const Byte * p, const Byte * end);
+
+  public:
+    PartitionMapFile(const std::string &filename);
+    ~PartitionMapFile();
+
+    // false if the file could not be mapped, or is not a packed pmap.
+    bool is_open() const { return _map != NULL; }
+
+    WordLength ksize() const { return _ksize; }
+    unsigned int block_tags() const { return _block_tags; }
+    HashIntoType size() const { return _n_tags; }
+    HashIntoType n_blocks() const { return _n_blocks; }
+    HashIntoType n_partitions() const { return _n_partitions; }
+    PartitionID partition_id(unsigned int i) const { return _partitions[i]; }
+
+    // the tags in block i, and their partitions as indices into the
+    // partition IDs; false if the block is corrupt.
+    bool get_block(HashIntoType i, std::vector<HashIntoType> &tags,
+		   std::vector<unsigned int> &partitions) const;
+  };
+
+  //
+  // SubsetPartition: which partition each tag is in.  The partitions are a
+  // disjoint-set forest, with union by rank and path halving, so joining
+  // two of them is one pointer change however big they are.
+  //
+  // A tag's node is found through _tag_nodes, which is indexed densely as
+  // the tags are put in; the partition ID lives at the root of the node's
+  // tree, and _partition_roots goes the other way.  A tag that moves to
+  // another partition (or is cleared) gets a new node (or NO_PARTITION_NODE)
+  // and its old node stays where it was, unused, so the other nodes that
+  // point through it are not disturbed.
+  //
+
+#define NO_PARTITION_NODE ((unsigned int) -1)
+
+  typedef std::map<PartitionID, unsigned int> PartitionNodeMap;
+
   class SubsetPartition {
     friend class Hashbits;
   protected:
     unsigned int next_partition_id;
     Hashbits * _ht;
-    PartitionMap partition_map;
-    ReversePartitionMap reverse_pmap;
+
+    TagMap _tag_nodes;		// tag -> node, or NO_PARTITION_NODE
+    mutable std::vector<unsigned int> _parent;
+    std::vector<unsigned char> _rank;
+    std::vector<PartitionID> _root_partition; // only good at roots
+    PartitionNodeMap _partition_roots;
 
     void _clear_all_partitions();
 
-    PartitionID * _merge_two_partitions(PartitionID *orig_pp,
-					PartitionID *new_pp);
-    PartitionID * _join_partitions_by_tags(const SeenSet& tagged_kmers,
-					   const HashIntoType kmer);
+    unsigned int _find(unsigned int node) const {
+      while (_parent[node] != node) {
+	_parent[node] = _parent[_parent[node]];
+	node = _parent[node];
+      }
+      return node;
+    }
+
+    unsigned int _tag_node(HashIntoType tag) const {
+      return _tag_nodes.get(tag, NO_PARTITION_NODE);
+    }
+
+    PartitionID _node_partition(unsigned int node) const {
+      return _root_partition[_find(node)];
+    }
+
+    void _set_tag_partition(HashIntoType tag, PartitionID p);
+    void _join_two_partitions(PartitionID keep, PartitionID other);
+    PartitionID _join_partitions_by_tags(
+			const std::vector<HashIntoType>& tagged_kmers,
+			const HashIntoType kmer);
 
   public:
     SubsetPartition(Hashbits * ht) : next_partition_id(2), _ht(ht) {
@@ -30,6 +219,8 @@ namespace khmer {
     ~SubsetPartition() { _clear_all_partitions(); }
 
     PartitionID assign_partition_id(HashIntoType kmer, SeenSet& tagged_kmers);
+    PartitionID assign_partition_id(HashIntoType kmer,
+			    const std::vector<HashIntoType>& tagged_kmers);
 
     void set_partition_id(HashIntoType kmer, PartitionID p);
     void set_partition_id(std::string kmer_s, PartitionID p);
@@ -37,23 +228,38 @@ namespace khmer {
     PartitionID get_partition_id(std::string kmer_s);
     PartitionID get_partition_id(HashIntoType kmer);
 
-    PartitionID * get_new_partition() {
-      PartitionID* pp = new PartitionID(next_partition_id);
-      next_partition_id++;
-      return pp;
+    PartitionID get_new_partition() {
+      return next_partition_id++;
     }
 
     void merge(SubsetPartition *);
     void merge_from_disk(std::string);
-    void _merge_from_disk_consolidate(PartitionPtrMap&);
+    void _merge_from_disk_consolidate(PartitionNodeMap&);
 
-    void save_partitionmap(std::string outfile);
-    void load_partitionmap(std::string infile);
+    // merge saved partition maps into one new one on disk, streaming;
+    // see subset.cc.  Stop tags in this table are left out, as in merge.
+    void merge_partitionmap_files(const std::vector<std::string>& infiles,
+				  const std::string& outfile,
+				  bool packed=false);
+
+    // packed files are loaded on n_threads threads, straight into an
+    // empty partition map (keeping their IDs); see subset.cc.
+    void save_partitionmap(std::string outfile, bool packed=false);
+    void load_partitionmap(std::string infile, unsigned int n_threads=1);
+    void _save_packed_partitionmap(std::string outfile);
+    void _load_packed_partitionmap(const PartitionMapFile &pmapfile,
+				   unsigned int n_threads);
     void _validate_pmap();
 
+    // the tags are left in ws.tagged; see subset.cc.
+    bool find_all_tags(HashIntoType kmer_f, HashIntoType kmer_r,
+		       TraversalWorkspace& ws,
+		       const TagSet& all_tags,
+		       bool break_on_stop_tags=false,
+		       bool stop_big_traversals=false);
     void find_all_tags(HashIntoType kmer_f, HashIntoType kmer_r,
 		       SeenSet& tagged_kmers,
-		       const SeenSet& all_tags,
+		       const TagSet& all_tags,
 		       bool break_on_stop_tags=false,
 		       bool stop_big_traversals=false);
 
@@ -64,14 +270,59 @@ namespace khmer {
 		      CallbackFn callback=0,
 		      void * callback_data=0);
 
+    // partition all the tags at once on n_threads threads, into this
+    // partition map; see subset.cc.
+    void do_parallel_partition(unsigned int n_threads,
+			       bool break_on_stop_tags=false,
+			       bool stop_big_traversals=false,
+			       CallbackFn callback=0,
+			       void * callback_data=0);
+
+    // do_parallel_partition from just these tags; see subset.cc.
+    void partition_from_tags(const TagSet &start_tags,
+			     unsigned int n_threads,
+			     bool break_on_stop_tags=false,
+			     bool stop_big_traversals=false,
+			     CallbackFn callback=0,
+			     void * callback_data=0);
+
+    // search from the tags left by Hashbits::consume_fasta_and_partition,
+    // to finish its partitions; see subset.cc.
+    unsigned int refine_streaming_partition(unsigned int n_threads,
+					    bool break_on_stop_tags=false,
+					    bool stop_big_traversals=false,
+					    CallbackFn callback=0,
+					    void * callback_data=0);
+
     void count_partitions(unsigned int& n_partitions,
 			  unsigned int& n_unassigned);
 
+    // write each read with the partition of its first tag, on n_threads
+    // threads; see subset.cc.
     unsigned int output_partitioned_file(const std::string infilename,
 					 const std::string outputfilename,
 					 bool output_unassigned=false,
 					 CallbackFn callback=0,
-					 void * callback_data=0);
+					 void * callback_data=0,
+					 unsigned int n_threads=1);
+
+    // the same, but split by partition ID mod n_buckets into the files
+    // <prefix>.bucketN.part, with unassigned reads (if they are wanted)
+    // in <prefix>.unassigned.part.  A partition is all in one file.
+    unsigned int output_partition_buckets(const std::string infilename,
+					  const std::string prefix,
+					  unsigned int n_buckets,
+					  bool output_unassigned=false,
+					  CallbackFn callback=0,
+					  void * callback_data=0,
+					  unsigned int n_threads=1);
+    unsigned int _output_partitions(const std::string infilename,
+				    std::vector<std::ostream *> &outs,
+				    unsigned int n_buckets,
+				    bool output_unassigned,
+				    CallbackFn callback,
+				    void * callback_data,
+				    unsigned int n_threads);
 
     unsigned int find_unpart(const std::string infilename,
 			     bool traverse,
@@ -86,16 +337,32 @@ namespace khmer {
     void partition_size_distribution(PartitionCountDistribution &d,
 				    unsigned int& n_unassigned) const;
 
+    // the knot finding runs on n_threads threads; see
+    // Hashbits::find_knots.
     unsigned int repartition_largest_partition(unsigned int, unsigned int,
-					       unsigned int, CountingHash&);
+					       unsigned int, CountingHash&,
+					       unsigned int n_threads=1);
 
     void repartition_a_partition(const SeenSet& partition_tags);
     void _clear_partition(PartitionID, SeenSet& partition_tags);
 
     void _merge_other(HashIntoType tag,
 		      PartitionID other_partition,
-		      PartitionPtrMap& diskp_to_pp);
+		      PartitionNodeMap& diskp_to_node);
   };
+
+  // group the reads in partition-annotated files into files of at most
+  // max_size reads by partition size, as extract-partitions.py does;
+  // returns the number of groups.  See subset.cc.
+  unsigned int extract_partitions(const std::vector<std::string>& part_filenames,
+				  const std::string& prefix,
+				  unsigned long long max_size,
+				  unsigned int min_part_size,
+				  bool output_groups=true,
+				  bool output_unassigned=false,
+				  bool gzip=false,
+				  CallbackFn callback=0,
+				  void * callback_data=0);
 }
 
 #endif // SUBSET_HH
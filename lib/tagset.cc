@@ -0,0 +1,248 @@
+#include "tagset.hh"
+#include <fstream>
+#include <stdexcept>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace khmer;
+
+#define TAGFILE_HEADER_BYTES 40
+
+void khmer::save_packed_tags(const std::string &filename,
+			     unsigned char ht_type,
+			     WordLength ksize,
+			     unsigned int tag_density,
+			     const TagSet &tags)
+{
+  std::vector<HashIntoType> sorted(tags.begin(), tags.end());
+  std::sort(sorted.begin(), sorted.end());
+
+  unsigned char version = SAVED_PACKED_TAGS_VERSION;
+  unsigned char pad[2] = { 0, 0 };
+  unsigned int save_ksize = ksize;
+  unsigned int block_tags = TAGFILE_BLOCK_TAGS;
+  unsigned long long n_tags = sorted.size();
+  unsigned long long n_blocks = (n_tags + block_tags - 1) / block_tags;
+
+  // the index goes before the gaps, so leave room for it and come back.
+  ofstream outfile(filename.c_str(), ios::binary);
+  outfile.seekp(TAGFILE_HEADER_BYTES + n_blocks * 2 * sizeof(HashIntoType));
+
+  std::vector<HashIntoType> index;
+  std::vector<Byte> buf;
+  unsigned long long n_data_bytes = 0;
+
+  for (unsigned long long i = 0; i < n_tags; i += block_tags) {
+    unsigned long long last = std::min(i + block_tags, n_tags);
+
+    index.push_back(sorted[i]);
+    index.push_back(n_data_bytes);
+
+    buf.clear();
+    for (unsigned long long j = i + 1; j < last; j++) {
+      _put_varint(buf, sorted[j] - sorted[j - 1]);
+    }
+    if (buf.size()) {
+      outfile.write((const char *) &buf[0], buf.size());
+    }
+    n_data_bytes += buf.size();
+  }
+
+  outfile.seekp(0);
+  outfile.write((const char *) &version, 1);
+  outfile.write((const char *) &ht_type, 1);
+  outfile.write((const char *) pad, 2);
+  outfile.write((const char *) &save_ksize, sizeof(save_ksize));
+  outfile.write((const char *) &tag_density, sizeof(tag_density));
+  outfile.write((const char *) &block_tags, sizeof(block_tags));
+  outfile.write((const char *) &n_tags, sizeof(n_tags));
+  outfile.write((const char *) &n_blocks, sizeof(n_blocks));
+  outfile.write((const char *) &n_data_bytes, sizeof(n_data_bytes));
+  if (index.size()) {
+    outfile.write((const char *) &index[0],
+		  index.size() * sizeof(HashIntoType));
+  }
+  outfile.close();
+}
+
+void * khmer::map_file(const std::string &filename, size_t &size)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return NULL;
+  }
+
+  void * map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  size = st.st_size;
+  return map;
+}
+
+//
+// TagFile
+//
+
+TagFile::TagFile(const std::string &filename) :
+  _map(NULL), _map_size(0), _ht_type(0), _ksize(0), _tag_density(0),
+  _block_tags(0), _n_tags(0), _n_blocks(0), _index(NULL), _data(NULL),
+  _data_end(NULL)
+{
+  size_t size;
+  void * map = map_file(filename, size);
+  if (!map) {
+    return;
+  }
+
+  if (size >= TAGFILE_HEADER_BYTES &&
+      _parse((const Byte *) map, (const Byte *) map + size)) {
+    _map = map;
+    _map_size = size;
+  } else {
+    munmap(map, size);
+  }
+}
+
+TagFile::~TagFile()
+{
+  if (_map) {
+    munmap(_map, _map_size);
+    _map = NULL;
+  }
+}
+
+// check the header and that the index and gaps fit in the file.
+
+bool TagFile::_parse(const Byte * p, const Byte * end)
+{
+  unsigned long long n_data_bytes;
+
+  if (p[0] != SAVED_PACKED_TAGS_VERSION) {
+    return false;
+  }
+  _ht_type = p[1];
+  if (_ht_type != SAVED_TAGS && _ht_type != SAVED_STOPTAGS) {
+    return false;
+  }
+
+  memcpy(&_ksize, p + 4, sizeof(_ksize));
+  memcpy(&_tag_density, p + 8, sizeof(_tag_density));
+  memcpy(&_block_tags, p + 12, sizeof(_block_tags));
+  memcpy(&_n_tags, p + 16, sizeof(_n_tags));
+  memcpy(&_n_blocks, p + 24, sizeof(_n_blocks));
+  memcpy(&n_data_bytes, p + 32, sizeof(n_data_bytes));
+
+  if (_block_tags == 0 ||
+      _n_blocks != (_n_tags + _block_tags - 1) / _block_tags) {
+    return false;
+  }
+
+  // the header is a multiple of 8 bytes, so the index is aligned.
+  unsigned long long room = (end - p) - TAGFILE_HEADER_BYTES;
+  if (_n_blocks > room / (2 * sizeof(HashIntoType))) {
+    return false;
+  }
+  unsigned long long index_bytes = _n_blocks * 2 * sizeof(HashIntoType);
+  if (n_data_bytes > room - index_bytes) {
+    return false;
+  }
+
+  _index = (const unsigned long long *) (p + TAGFILE_HEADER_BYTES);
+  _data = p + TAGFILE_HEADER_BYTES + index_bytes;
+  _data_end = _data + n_data_bytes;
+  return true;
+}
+
+bool TagFile::get_block(HashIntoType i, std::vector<HashIntoType> &tags) const
+{
+  assert(i < _n_blocks);
+
+  HashIntoType tag = _index[2 * i];
+  HashIntoType offset = _index[2 * i + 1];
+  if (offset > (HashIntoType) (_data_end - _data)) {
+    return false;
+  }
+
+  const Byte * p = _data + offset;
+  unsigned long long n = std::min((unsigned long long) _block_tags,
+				  _n_tags - i * _block_tags);
+
+  // the tags in a block are strictly increasing, so no gap is 0.
+  tags.push_back(tag);
+  for (unsigned long long j = 1; j < n; j++) {
+    HashIntoType gap;
+    if (!_get_varint(p, _data_end, gap) || gap == 0) {
+      return false;
+    }
+    tag += gap;
+    tags.push_back(tag);
+  }
+  return true;
+}
+
+bool TagFile::contains(HashIntoType tag) const
+{
+  if (_n_blocks == 0 || tag < _index[0]) {
+    return false;
+  }
+
+  // the last block starting at or before the tag.
+  HashIntoType lo = 0, hi = _n_blocks;
+  while (hi - lo > 1) {
+    HashIntoType mid = lo + (hi - lo) / 2;
+    if (_index[2 * mid] <= tag) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  HashIntoType x = _index[2 * lo];
+  HashIntoType offset = _index[2 * lo + 1];
+  if (offset > (HashIntoType) (_data_end - _data)) {
+    return false;
+  }
+
+  const Byte * p = _data + offset;
+  unsigned long long n = std::min((unsigned long long) _block_tags,
+				  _n_tags - lo * _block_tags);
+
+  for (unsigned long long j = 1; j < n && x < tag; j++) {
+    HashIntoType gap;
+    if (!_get_varint(p, _data_end, gap) || gap == 0) {
+      return false;
+    }
+    x += gap;
+  }
+  return x == tag;
+}
+
+void TagFile::load_into(TagSet &tags) const
+{
+  tags.reserve(tags.size() + _n_tags);
+
+  std::vector<HashIntoType> block;
+  for (HashIntoType i = 0; i < _n_blocks; i++) {
+    block.clear();
+    if (!get_block(i, block)) {
+      throw std::runtime_error("corrupt packed tag file");
+    }
+
+    for (unsigned int j = 0; j < block.size(); j++) {
+      tags.insert(block[j]);
+    }
+  }
+}
@@ -0,0 +1,557 @@
+#ifndef TAGSET_HH
+#define TAGSET_HH
+
+#include <vector>
+#include <string>
+#include <iterator>
+#include <algorithm>
+#include <pthread.h>
+#include <assert.h>
+
+#include "khmer.hh"
+#include "ktable.hh"
+
+#define TAGSET_EMPTY_KEY ((HashIntoType) -1)
+#define TAGSET_MIN_SLOTS 16
+#define TAGFILE_BLOCK_TAGS 128
+
+namespace khmer {
+  //
+  // TagSet: a set of k-mers in one flat, open-addressed table (linear
+  // probing, at most 3/4 full), for the tag sets of a Hashbits.  That is
+  // 8-16 bytes a tag, against ~40 for a std::set node, and a lookup is
+  // usually one cache miss.
+  //
+  // It looks enough like a SeenSet for find/end (and set_contains),
+  // insert, erase and iteration, but iterates in no particular order.
+  // Code that needs the tags in order (dividing them into subsets,
+  // partitioning a range of them) uses sorted(), which is built when
+  // asked for and kept until the set changes.
+  //
+  // TAGSET_EMPTY_KEY marks empty slots, so if it is ever added as a tag it
+  // is kept to one side.
+  //
+  // generation() goes up whenever the keys change, so anything built from
+  // the set (a UnitigIndex) can tell whether it still matches.
+  //
+
+  class TagSet {
+  protected:
+    std::vector<HashIntoType> _slots;	// a power of two of them, or none
+    HashIntoType _size;
+    bool _has_empty_key;
+    unsigned long long _generation;
+
+    mutable std::vector<HashIntoType> _sorted;
+    mutable bool _sorted_ok;
+    mutable pthread_mutex_t _sorted_lock;
+
+    // the slot holding this key, or the empty slot where it would go.
+    HashIntoType _find_slot(HashIntoType key) const {
+      HashIntoType mask = _slots.size() - 1;
+      HashIntoType i = _mix_hash(key) & mask;
+      while (_slots[i] != key && _slots[i] != TAGSET_EMPTY_KEY) {
+	i = (i + 1) & mask;
+      }
+      return i;
+    }
+
+    void _rehash(HashIntoType n_slots) {
+      std::vector<HashIntoType> old(n_slots, TAGSET_EMPTY_KEY);
+      old.swap(_slots);
+
+      for (HashIntoType i = 0; i < old.size(); i++) {
+	if (old[i] != TAGSET_EMPTY_KEY) {
+	  _slots[_find_slot(old[i])] = old[i];
+	}
+      }
+    }
+
+  public:
+    class const_iterator {
+      friend class TagSet;
+    protected:
+      const TagSet * _set;
+      HashIntoType _i;		// slot; _slots.size() is the empty key.
+
+      void _skip() {
+	const HashIntoType n_slots = _set->_slots.size();
+	while (_i < n_slots && _set->_slots[_i] == TAGSET_EMPTY_KEY) {
+	  _i++;
+	}
+	if (_i == n_slots && !_set->_has_empty_key) {
+	  _i++;
+	}
+      }
+
+      const_iterator(const TagSet * set, HashIntoType i) : _set(set), _i(i) {
+	;
+      }
+
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef HashIntoType value_type;
+      typedef long long difference_type;
+      typedef const HashIntoType * pointer;
+      typedef const HashIntoType & reference;
+
+      const_iterator() : _set(NULL), _i(0) { ; }
+
+      const HashIntoType& operator*() const {
+	static const HashIntoType empty_key = TAGSET_EMPTY_KEY;
+	if (_i == _set->_slots.size()) {
+	  return empty_key;
+	}
+	return _set->_slots[_i];
+      }
+
+      const_iterator& operator++() { _i++; _skip(); return *this; }
+      const_iterator operator++(int) {
+	const_iterator old = *this;
+	++(*this);
+	return old;
+      }
+
+      bool operator==(const const_iterator &o) const { return _i == o._i; }
+      bool operator!=(const const_iterator &o) const { return _i != o._i; }
+    };
+    typedef const_iterator iterator;
+
+    TagSet() : _size(0), _has_empty_key(false), _generation(0),
+      _sorted_ok(false) {
+      pthread_mutex_init(&_sorted_lock, NULL);
+    }
+
+    TagSet(const TagSet &other) : _slots(other._slots), _size(other._size),
+      _has_empty_key(other._has_empty_key), _generation(0),
+      _sorted_ok(false) {
+      pthread_mutex_init(&_sorted_lock, NULL);
+    }
+
+    ~TagSet() {
+      pthread_mutex_destroy(&_sorted_lock);
+    }
+
+    TagSet& operator=(const TagSet &other) {
+      if (this != &other) {
+	_slots = other._slots;
+	_size = other._size;
+	_has_empty_key = other._has_empty_key;
+	_generation++;
+	_sorted.clear();
+	_sorted_ok = false;
+      }
+      return *this;
+    }
+
+    HashIntoType size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    unsigned long long generation() const { return _generation; }
+
+    const_iterator begin() const {
+      const_iterator it(this, 0);
+      it._skip();
+      return it;
+    }
+    const_iterator end() const { return const_iterator(this, _slots.size() + 1); }
+
+    const_iterator find(HashIntoType key) const {
+      if (key == TAGSET_EMPTY_KEY) {
+	return _has_empty_key ? const_iterator(this, _slots.size()) : end();
+      }
+      if (_slots.empty()) {
+	return end();
+      }
+
+      HashIntoType i = _find_slot(key);
+      return _slots[i] == key ? const_iterator(this, i) : end();
+    }
+
+    // start loading the slot for this key, ahead of a find.
+    void prefetch(HashIntoType key) const {
+      if (!_slots.empty()) {
+	__builtin_prefetch(&_slots[_mix_hash(key) & (_slots.size() - 1)]);
+      }
+    }
+
+    // make room for n keys in all, without rehashing.
+    void reserve(HashIntoType n) {
+      HashIntoType n_slots = _slots.empty() ? TAGSET_MIN_SLOTS : _slots.size();
+      while (n * 4 > n_slots * 3) {
+	n_slots *= 2;
+      }
+      if (n_slots != _slots.size()) {
+	_rehash(n_slots);
+      }
+    }
+
+    // returns true if the key was not there before.
+    bool insert(HashIntoType key) {
+      if (key == TAGSET_EMPTY_KEY) {
+	if (_has_empty_key) {
+	  return false;
+	}
+	_has_empty_key = true;
+      } else {
+	reserve(_size + 1);
+
+	HashIntoType i = _find_slot(key);
+	if (_slots[i] == key) {
+	  return false;
+	}
+	_slots[i] = key;
+      }
+
+      _size++;
+      _generation++;
+      _sorted_ok = false;
+      return true;
+    }
+
+    template <typename Iter>
+    void insert(Iter first, Iter last) {
+      for (; first != last; first++) {
+	insert(*first);
+      }
+    }
+
+    // returns the number of keys removed (0 or 1), as std::set does.
+    HashIntoType erase(HashIntoType key) {
+      if (key == TAGSET_EMPTY_KEY) {
+	if (!_has_empty_key) {
+	  return 0;
+	}
+	_has_empty_key = false;
+      } else {
+	if (_slots.empty()) {
+	  return 0;
+	}
+
+	HashIntoType mask = _slots.size() - 1;
+	HashIntoType i = _find_slot(key);
+	if (_slots[i] != key) {
+	  return 0;
+	}
+
+	// shift back any later keys in the run that could live here.
+	HashIntoType j = i;
+	while (1) {
+	  j = (j + 1) & mask;
+	  if (_slots[j] == TAGSET_EMPTY_KEY) {
+	    break;
+	  }
+
+	  HashIntoType home = _mix_hash(_slots[j]) & mask;
+	  bool movable = (i <= j) ? (home <= i || home > j)
+	                          : (home <= i && home > j);
+	  if (movable) {
+	    _slots[i] = _slots[j];
+	    i = j;
+	  }
+	}
+	_slots[i] = TAGSET_EMPTY_KEY;
+      }
+
+      _size--;
+      _generation++;
+      _sorted_ok = false;
+      return 1;
+    }
+
+    void clear() {
+      std::vector<HashIntoType>().swap(_slots);
+      _size = 0;
+      _has_empty_key = false;
+      _generation++;
+      drop_sorted();
+    }
+
+    void swap(TagSet &other) {
+      _slots.swap(other._slots);
+      std::swap(_size, other._size);
+      std::swap(_has_empty_key, other._has_empty_key);
+      _generation++;
+      other._generation++;
+      drop_sorted();
+      other.drop_sorted();
+    }
+
+    // the keys in order.  Safe to call from several threads at once, as
+    // long as nobody is changing the set.
+    const std::vector<HashIntoType>& sorted() const {
+      pthread_mutex_lock(&_sorted_lock);
+      if (!_sorted_ok) {
+	_sorted.assign(begin(), end());
+	std::sort(_sorted.begin(), _sorted.end());
+	_sorted_ok = true;
+      }
+      pthread_mutex_unlock(&_sorted_lock);
+
+      return _sorted;
+    }
+
+    // free the memory used by sorted().
+    void drop_sorted() {
+      std::vector<HashIntoType>().swap(_sorted);
+      _sorted_ok = false;
+    }
+  };
+
+  //
+  // TagMap: tag -> unsigned int, in the same kind of flat table as TagSet.
+  // There is no erase; callers that need one store a value meaning "none".
+  //
+
+  class TagMap {
+  protected:
+    std::vector<HashIntoType> _keys;	// a power of two of them, or none
+    std::vector<unsigned int> _values;
+    HashIntoType _size;
+    bool _has_empty_key;
+    unsigned int _empty_key_value;
+
+    HashIntoType _find_slot(HashIntoType key) const {
+      HashIntoType mask = _keys.size() - 1;
+      HashIntoType i = _mix_hash(key) & mask;
+      while (_keys[i] != key && _keys[i] != TAGSET_EMPTY_KEY) {
+	i = (i + 1) & mask;
+      }
+      return i;
+    }
+
+    void _rehash(HashIntoType n_slots) {
+      std::vector<HashIntoType> old_keys(n_slots, TAGSET_EMPTY_KEY);
+      std::vector<unsigned int> old_values(n_slots, 0);
+      old_keys.swap(_keys);
+      old_values.swap(_values);
+
+      for (HashIntoType i = 0; i < old_keys.size(); i++) {
+	if (old_keys[i] != TAGSET_EMPTY_KEY) {
+	  HashIntoType j = _find_slot(old_keys[i]);
+	  _keys[j] = old_keys[i];
+	  _values[j] = old_values[i];
+	}
+      }
+    }
+
+  public:
+    class const_iterator {
+      friend class TagMap;
+    protected:
+      const TagMap * _map;
+      HashIntoType _i;		// slot; _keys.size() is the empty key.
+
+      void _skip() {
+	const HashIntoType n_slots = _map->_keys.size();
+	while (_i < n_slots && _map->_keys[_i] == TAGSET_EMPTY_KEY) {
+	  _i++;
+	}
+	if (_i == n_slots && !_map->_has_empty_key) {
+	  _i++;
+	}
+      }
+
+      const_iterator(const TagMap * map, HashIntoType i) : _map(map), _i(i) {
+	;
+      }
+
+    public:
+      HashIntoType key() const {
+	return _i == _map->_keys.size() ? TAGSET_EMPTY_KEY : _map->_keys[_i];
+      }
+      unsigned int value() const {
+	return _i == _map->_keys.size() ? _map->_empty_key_value :
+	  _map->_values[_i];
+      }
+
+      const_iterator& operator++() { _i++; _skip(); return *this; }
+
+      bool operator==(const const_iterator &o) const { return _i == o._i; }
+      bool operator!=(const const_iterator &o) const { return _i != o._i; }
+    };
+
+    TagMap() : _size(0), _has_empty_key(false), _empty_key_value(0) { ; }
+
+    HashIntoType size() const { return _size; }
+
+    const_iterator begin() const {
+      const_iterator it(this, 0);
+      it._skip();
+      return it;
+    }
+    const_iterator end() const { return const_iterator(this, _keys.size() + 1); }
+
+    // the value for this key, or 'missing'.
+    unsigned int get(HashIntoType key, unsigned int missing) const {
+      if (key == TAGSET_EMPTY_KEY) {
+	return _has_empty_key ? _empty_key_value : missing;
+      }
+      if (_keys.empty()) {
+	return missing;
+      }
+
+      HashIntoType i = _find_slot(key);
+      return _keys[i] == key ? _values[i] : missing;
+    }
+
+    void reserve(HashIntoType n) {
+      HashIntoType n_slots = _keys.empty() ? TAGSET_MIN_SLOTS : _keys.size();
+      while (n * 4 > n_slots * 3) {
+	n_slots *= 2;
+      }
+      if (n_slots != _keys.size()) {
+	_rehash(n_slots);
+      }
+    }
+
+    void set(HashIntoType key, unsigned int value) {
+      if (key == TAGSET_EMPTY_KEY) {
+	if (!_has_empty_key) {
+	  _has_empty_key = true;
+	  _size++;
+	}
+	_empty_key_value = value;
+	return;
+      }
+
+      reserve(_size + 1);
+
+      HashIntoType i = _find_slot(key);
+      if (_keys[i] != key) {
+	_keys[i] = key;
+	_size++;
+      }
+      _values[i] = value;
+    }
+
+    // set() for a key that is not there yet, from any number of threads
+    // at once; reserve() room for all of them first.
+    void set_new_concurrent(HashIntoType key, unsigned int value) {
+      if (key == TAGSET_EMPTY_KEY) {
+	_has_empty_key = true;
+	_empty_key_value = value;
+	__sync_fetch_and_add(&_size, 1);
+	return;
+      }
+
+      HashIntoType mask = _keys.size() - 1;
+      HashIntoType i = _mix_hash(key) & mask;
+      while (!__sync_bool_compare_and_swap(&_keys[i], TAGSET_EMPTY_KEY, key)) {
+	assert(_keys[i] != key);
+	i = (i + 1) & mask;
+      }
+      _values[i] = value;
+      __sync_fetch_and_add(&_size, 1);
+    }
+
+    void clear() {
+      std::vector<HashIntoType>().swap(_keys);
+      std::vector<unsigned int>().swap(_values);
+      _size = 0;
+      _has_empty_key = false;
+    }
+  };
+
+  //
+  // 7-bit varints, low bits first, for the packed file formats.
+  //
+
+  inline void _put_varint(std::vector<Byte> &out, HashIntoType x)
+  {
+    while (x >= 0x80) {
+      out.push_back((Byte) (x | 0x80));
+      x >>= 7;
+    }
+    out.push_back((Byte) x);
+  }
+
+  inline bool _get_varint(const Byte * &p, const Byte * end, HashIntoType &x)
+  {
+    x = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+      if (p >= end) {
+	return false;
+      }
+      Byte b = *p++;
+      x |= (HashIntoType) (b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  //
+  // Packed tag files (SAVED_PACKED_TAGS_VERSION).  The tags are sorted and
+  // cut into blocks of TAGFILE_BLOCK_TAGS; a block is stored as the gaps
+  // between its tags, as 7-bit varints, and an index after the header
+  // gives each block's first tag and where its gaps start.  n tags among
+  // 4^k hashes are about 4^k/n apart, so a billion 32-mer tags take 5
+  // bytes each rather than 8, and smaller k or denser tags take fewer.
+  //
+  //   version, ht_type (1 byte each), 2 bytes padding
+  //   ksize, tag_density, block_tags (unsigned int)
+  //   n_tags, n_blocks, n_data_bytes (unsigned long long)
+  //   n_blocks x (first tag, offset of its gaps) (unsigned long long)
+  //   the gaps
+  //
+
+  // mmap a whole file, read-only; NULL if it can't be.  munmap it after.
+  void * map_file(const std::string &filename, size_t &size);
+
+  void save_packed_tags(const std::string &filename,
+			unsigned char ht_type,
+			WordLength ksize,
+			unsigned int tag_density,
+			const TagSet &tags);
+
+  //
+  // TagFile: a packed tag file, mmapped.  contains() binary searches the
+  // index and decodes one block, so a few lookups cost a few page faults
+  // rather than loading the file; load_into() decodes the whole thing
+  // into a TagSet, sized for it up front.
+  //
+
+  class TagFile {
+  protected:
+    void * _map;
+    size_t _map_size;
+
+    unsigned char _ht_type;
+    unsigned int _ksize;
+    unsigned int _tag_density;
+    unsigned int _block_tags;
+    unsigned long long _n_tags;
+    unsigned long long _n_blocks;
+
+    const unsigned long long * _index;
+    const Byte * _data;
+    const Byte * _data_end;
+
+    bool _parse(const Byte * p, const Byte * end);
+
+  public:
+    TagFile(const std::string &filename);
+    ~TagFile();
+
+    // false if the file could not be mapped, or is not a packed tag file.
+    bool is_open() const { return _map != NULL; }
+
+    unsigned char ht_type() const { return _ht_type; }
+    WordLength ksize() const { return _ksize; }
+    unsigned int tag_density() const { return _tag_density; }
+    HashIntoType size() const { return _n_tags; }
+    HashIntoType n_blocks() const { return _n_blocks; }
+
+    // append the tags in block i to 'tags'; false if the block is corrupt.
+    bool get_block(HashIntoType i, std::vector<HashIntoType> &tags) const;
+
+    bool contains(HashIntoType tag) const;
+
+    // throws std::runtime_error if a block is corrupt; the tags decoded
+    // before it have been added by then.
+    void load_into(TagSet &tags) const;
+  };
+};
+
+#endif // TAGSET_HH
@@ -0,0 +1,145 @@
+#include "threads.hh"
+
+#include <assert.h>
+
+using namespace khmer;
+using namespace std;
+
+struct _thread_args {
+  ThreadFn fn;
+  unsigned int thread_id;
+  void * data;
+};
+
+static void * _thread_main(void * p)
+{
+  _thread_args * args = (_thread_args *) p;
+  args->fn(args->thread_id, args->data);
+  return NULL;
+}
+
+void khmer::run_threads(unsigned int n_threads, ThreadFn fn, void * data,
+			volatile bool * stop)
+{
+  if (n_threads <= 1) {
+    fn(0, data);
+    return;
+  }
+
+  std::vector<pthread_t> threads(n_threads);
+  std::vector<_thread_args> args(n_threads);
+
+  unsigned int n_started = 1;
+  for (; n_started < n_threads; n_started++) {
+    args[n_started].fn = fn;
+    args[n_started].thread_id = n_started;
+    args[n_started].data = data;
+
+    if (pthread_create(&threads[n_started], NULL, _thread_main,
+		       &args[n_started]) != 0) {
+      break;
+    }
+  }
+
+  // if the system won't start them all, the calling thread does the
+  // work of the ones that didn't start, after its own.
+  try {
+    fn(0, data);
+    for (unsigned int i = n_started; i < n_threads; i++) {
+      fn(i, data);
+    }
+  } catch (...) {
+    if (stop) { *stop = true; }
+    for (unsigned int i = 1; i < n_started; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    throw;
+  }
+
+  for (unsigned int i = 1; i < n_started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+//
+// ReadBatchSource
+//
+
+ReadBatchSource::ReadBatchSource(const std::string &filename,
+				 unsigned int batch_size) :
+  _batch_size(batch_size), _n_batches(0), _n_reads(0), _stop(false)
+{
+  assert(batch_size > 0);
+
+  _parser = IParser::get_parser(filename.c_str());
+  pthread_mutex_init(&_mutex, NULL);
+}
+
+ReadBatchSource::~ReadBatchSource()
+{
+  delete _parser;
+  _parser = NULL;
+  pthread_mutex_destroy(&_mutex);
+}
+
+bool ReadBatchSource::next_batch(ReadBatch &batch)
+{
+  batch.reads.clear();
+
+  pthread_mutex_lock(&_mutex);
+
+  if (_stop || _parser->is_complete()) {
+    pthread_mutex_unlock(&_mutex);
+    return false;
+  }
+
+  batch.batch_num = _n_batches++;
+  batch.first_read = _n_reads;
+
+  while (batch.reads.size() < _batch_size && !_parser->is_complete()) {
+    batch.reads.push_back(_parser->get_next_read());
+  }
+  _n_reads += batch.reads.size();
+
+  pthread_mutex_unlock(&_mutex);
+
+  return true;
+}
+
+//
+// OrderedWriter
+//
+
+OrderedWriter::OrderedWriter(std::ostream &out) : _out(out), _next_batch(0)
+{
+  pthread_mutex_init(&_mutex, NULL);
+}
+
+OrderedWriter::~OrderedWriter()
+{
+  pthread_mutex_destroy(&_mutex);
+}
+
+void OrderedWriter::write(unsigned long long batch_num,
+			  const std::string &chunk)
+{
+  pthread_mutex_lock(&_mutex);
+
+  if (batch_num != _next_batch) {
+    _pending[batch_num] = chunk;
+    pthread_mutex_unlock(&_mutex);
+    return;
+  }
+
+  _out << chunk;
+  _next_batch++;
+
+  std::map<unsigned long long, std::string>::iterator pi;
+  while ((pi = _pending.find(_next_batch)) != _pending.end()) {
+    _out << pi->second;
+    _pending.erase(pi);
+    _next_batch++;
+  }
+
+  pthread_mutex_unlock(&_mutex);
+}
@@ -0,0 +1,89 @@
+#ifndef THREADS_HH
+#define THREADS_HH
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+#include "khmer.hh"
+#include "parsers.hh"
+
+#define DEFAULT_READ_BATCH_SIZE 1000
+
+namespace khmer {
+  //
+  // Helpers for running a pass over a read file on several threads.
+  //
+  // Thread 0 is always the calling thread, and it is the only one that
+  // may run callbacks (which may call back into Python).  If thread 0
+  // throws, *stop is set so that the other threads can wind down, and the
+  // exception is rethrown once they have all been joined.  If a thread
+  // can't be started, the calling thread runs its share afterwards.
+  //
+
+  typedef void (*ThreadFn)(unsigned int thread_id, void * data);
+
+  void run_threads(unsigned int n_threads, ThreadFn fn, void * data,
+		   volatile bool * stop = NULL);
+
+  //
+  // ReadBatch/ReadBatchSource: hand out consecutive batches of reads from
+  // one parser to any number of threads.  Batches are numbered in file
+  // order, and so are the reads in them.
+  //
+
+  struct ReadBatch {
+    unsigned long long batch_num;
+    unsigned long long first_read;
+    std::vector<Read> reads;
+  };
+
+  class ReadBatchSource {
+  protected:
+    IParser * _parser;
+    unsigned int _batch_size;
+    unsigned long long _n_batches;
+    unsigned long long _n_reads;
+    volatile bool _stop;
+    pthread_mutex_t _mutex;
+
+  public:
+    ReadBatchSource(const std::string &filename,
+		    unsigned int batch_size = DEFAULT_READ_BATCH_SIZE);
+    ~ReadBatchSource();
+
+    // fill in the next batch; false once the file is done (or stopped).
+    bool next_batch(ReadBatch &batch);
+
+    void stop() { _stop = true; }
+    volatile bool * stop_flag() { return &_stop; }
+
+    // number of reads handed out so far.
+    unsigned long long n_reads() const { return _n_reads; }
+  };
+
+  //
+  // OrderedWriter: batches finish in any order, but their output has to
+  // go out in file order.  Chunks are held until all earlier batches have
+  // been written; every batch number must be written exactly once, even
+  // if its chunk is empty.
+  //
+
+  class OrderedWriter {
+  protected:
+    std::ostream &_out;
+    unsigned long long _next_batch;
+    std::map<unsigned long long, std::string> _pending;
+    pthread_mutex_t _mutex;
+
+  public:
+    OrderedWriter(std::ostream &out);
+    ~OrderedWriter();
+
+    void write(unsigned long long batch_num, const std::string &chunk);
+  };
+};
+
+#endif // THREADS_HH
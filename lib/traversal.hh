@@ -0,0 +1,158 @@
+#ifndef TRAVERSAL_HH
+#define TRAVERSAL_HH
+
+#include <vector>
+
+#include "khmer.hh"
+#include "ktable.hh"
+
+#define TRAVERSAL_MIN_SLOTS 1024
+#define TRAVERSAL_MIN_QUEUE 256
+
+namespace khmer {
+  struct TraversalNode {
+    HashIntoType kmer_f, kmer_r;
+    unsigned int breadth;
+  };
+
+  //
+  // TraversalWorkspace: the scratch space for a breadth-first search of
+  // the graph, kept from one search to the next so that a run of them
+  // (one per tag, in partitioning) allocates nothing once it has grown to
+  // size.  It holds
+  //
+  //   - the visited k-mers, in a flat open-addressed table whose slots are
+  //     stamped with the search they were filled in; start() forgets them
+  //     all by moving on to a new stamp.
+  //   - the search queue, as a ring buffer.
+  //   - 'tagged', for whatever the search wants to hand back.
+  //
+  // Nothing is allocated until the first start(), so a workspace that may
+  // not be used costs nothing.  A workspace is for one thread at a time.
+  //
+
+  class TraversalWorkspace {
+  protected:
+    std::vector<HashIntoType> _keys;
+    std::vector<unsigned int> _stamps;
+    unsigned int _epoch;
+    std::vector<HashIntoType> _visited; // this search's keys, in order
+
+    std::vector<TraversalNode> _queue;	// a power of two of them
+    HashIntoType _head, _tail;
+
+    void _grow_visited() {
+      HashIntoType n_slots = _keys.size() * 2;
+
+      _keys.assign(n_slots, 0);
+      _stamps.assign(n_slots, 0);
+      _epoch = 1;
+
+      for (HashIntoType i = 0; i < _visited.size(); i++) {
+	_insert(_visited[i]);
+      }
+    }
+
+    bool _insert(HashIntoType kmer) {
+      HashIntoType mask = _keys.size() - 1;
+      HashIntoType i = _mix_hash(kmer) & mask;
+
+      while (_stamps[i] == _epoch) {
+	if (_keys[i] == kmer) {
+	  return false;
+	}
+	i = (i + 1) & mask;
+      }
+      _keys[i] = kmer;
+      _stamps[i] = _epoch;
+      return true;
+    }
+
+    void _grow_queue() {
+      std::vector<TraversalNode> q(_queue.size() * 2);
+      HashIntoType mask = _queue.size() - 1;
+      HashIntoType n = _tail - _head;
+
+      for (HashIntoType i = 0; i < n; i++) {
+	q[i] = _queue[(_head + i) & mask];
+      }
+      _queue.swap(q);
+      _head = 0;
+      _tail = n;
+    }
+
+  public:
+    std::vector<HashIntoType> tagged;
+
+    TraversalWorkspace() : _epoch(1), _head(0), _tail(0) { ; }
+
+    // begin a new search: nothing visited, nothing queued or tagged.
+    void start() {
+      if (_keys.empty()) {
+	_keys.assign(TRAVERSAL_MIN_SLOTS, 0);
+	_stamps.assign(TRAVERSAL_MIN_SLOTS, 0);
+	_queue.resize(TRAVERSAL_MIN_QUEUE);
+      }
+
+      _epoch++;
+      if (_epoch == 0) {	// wrapped; old stamps could look current.
+	_stamps.assign(_stamps.size(), 0);
+	_epoch = 1;
+      }
+      _visited.clear();
+      _head = _tail = 0;
+      tagged.clear();
+    }
+
+    bool is_visited(HashIntoType kmer) const {
+      HashIntoType mask = _keys.size() - 1;
+      HashIntoType i = _mix_hash(kmer) & mask;
+
+      while (_stamps[i] == _epoch) {
+	if (_keys[i] == kmer) {
+	  return true;
+	}
+	i = (i + 1) & mask;
+      }
+      return false;
+    }
+
+    // mark the k-mer visited; false if it already was.
+    bool visit(HashIntoType kmer) {
+      if ((_visited.size() + 1) * 4 > _keys.size() * 3) {
+	_grow_visited();
+      }
+      if (!_insert(kmer)) {
+	return false;
+      }
+      _visited.push_back(kmer);
+      return true;
+    }
+
+    HashIntoType n_visited() const { return _visited.size(); }
+    const std::vector<HashIntoType>& visited() const { return _visited; }
+
+    // hand the visited k-mers over, taking v's storage in their place;
+    // that ends the search, so start() another before visiting again.
+    void swap_visited(std::vector<HashIntoType> &v) { _visited.swap(v); }
+
+    bool queue_empty() const { return _head == _tail; }
+
+    void push(HashIntoType kmer_f, HashIntoType kmer_r, unsigned int breadth) {
+      if (_tail - _head == _queue.size()) {
+	_grow_queue();
+      }
+      TraversalNode &node = _queue[_tail & (_queue.size() - 1)];
+      node.kmer_f = kmer_f;
+      node.kmer_r = kmer_r;
+      node.breadth = breadth;
+      _tail++;
+    }
+
+    TraversalNode pop() {
+      return _queue[_head++ & (_queue.size() - 1)];
+    }
+  };
+};
+
+#endif // TRAVERSAL_HH
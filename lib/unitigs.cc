@@ -0,0 +1,567 @@
+#include "hashbits.hh"
+#include "unitigs.hh"
+
+#include <queue>
+#include <algorithm>
+
+using namespace khmer;
+using namespace std;
+
+// the distinct neighbors of a k-mer, other than itself.
+
+unsigned int UnitigIndex::_neighbors(HashIntoType kmer_f,
+				     HashIntoType kmer_r,
+				     HashIntoType * f,
+				     HashIntoType * r) const
+{
+  HashIntoType nf[N_NEIGHBORS], nr[N_NEIGHBORS];
+  HashIntoType seen[N_NEIGHBORS];
+  const HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
+  unsigned int n = 0;
+
+  unsigned int present = _ht->get_neighbors(kmer_f, kmer_r, nf, nr);
+
+  for (unsigned int i = 0; i < N_NEIGHBORS; i++) {
+    if (!(present & (1 << i))) {
+      continue;
+    }
+
+    HashIntoType k = uniqify_rc(nf[i], nr[i]);
+    if (k == kmer) {
+      continue;
+    }
+
+    unsigned int j;
+    for (j = 0; j < n; j++) {
+      if (seen[j] == k) { break; }
+    }
+    if (j == n) {
+      seen[n] = k;
+      f[n] = nf[i];
+      r[n] = nr[i];
+      n++;
+    }
+  }
+
+  return n;
+}
+
+bool UnitigIndex::_is_linear(HashIntoType kmer_f, HashIntoType kmer_r) const
+{
+  HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+  const HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
+
+  if (set_contains(_ht->stop_tags, kmer) ||
+      set_contains(_cycle_breaks, kmer)) {
+    return false;
+  }
+  return _neighbors(kmer_f, kmer_r, f, r) == 2;
+}
+
+void UnitigIndex::_add_branch(HashIntoType kmer_f, HashIntoType kmer_r)
+{
+  const HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
+  const UnitigID id = _unitigs.size();
+
+  Unitig u;
+  u.branch = true;
+  u.length = 1;
+  u.left = u.right = kmer;
+  u.left_f = kmer_f;
+  u.left_r = kmer_r;
+  u.left_out = u.right_out = kmer;
+
+  if (set_contains(_ht->all_tags, kmer)) {
+    u.tag_positions.push_back(0);
+    u.tags.push_back(kmer);
+    _tags[kmer] = std::make_pair(id, 0U);
+  }
+
+  _unitigs.push_back(u);
+  _ends[kmer] = id;
+}
+
+// walk away from 'prev' through linear k-mers, appending them to 'path',
+// and stop at the first branch, which goes in out_f/out_r.  Returns false
+// if the walk comes back around to 'seed' instead.
+
+bool UnitigIndex::_walk(HashIntoType seed, HashIntoType prev,
+			HashIntoType cur_f, HashIntoType cur_r,
+			std::vector<std::pair<HashIntoType, HashIntoType> > &path,
+			HashIntoType &out_f, HashIntoType &out_r) const
+{
+  HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+
+  while (1) {
+    HashIntoType kmer = uniqify_rc(cur_f, cur_r);
+    if (kmer == seed) {
+      return false;
+    }
+
+    if (set_contains(_ht->stop_tags, kmer) ||
+	set_contains(_cycle_breaks, kmer) ||
+	_neighbors(cur_f, cur_r, f, r) != 2) {
+      out_f = cur_f;
+      out_r = cur_r;
+      return true;
+    }
+
+    path.push_back(std::make_pair(cur_f, cur_r));
+
+    // go on to whichever neighbor we didn't come from.
+    unsigned int next = uniqify_rc(f[0], r[0]) == prev ? 1 : 0;
+    prev = kmer;
+    cur_f = f[next];
+    cur_r = r[next];
+  }
+}
+
+// add the path through this linear k-mer; false if it is a cycle (or
+// not linear after all).
+
+bool UnitigIndex::_add_path(HashIntoType kmer_f, HashIntoType kmer_r)
+{
+  HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+  const HashIntoType seed = uniqify_rc(kmer_f, kmer_r);
+
+  if (_neighbors(kmer_f, kmer_r, f, r) != 2) {
+    return false;
+  }
+
+  std::vector<std::pair<HashIntoType, HashIntoType> > left_path, right_path;
+  HashIntoType left_out_f, left_out_r, right_out_f, right_out_r;
+
+  if (!_walk(seed, seed, f[0], r[0], left_path, left_out_f, left_out_r)) {
+    return false;
+  }
+  _walk(seed, seed, f[1], r[1], right_path, right_out_f, right_out_r);
+
+  // the path, left to right: left_path reversed, the seed, right_path.
+  std::vector<std::pair<HashIntoType, HashIntoType> > path;
+  path.insert(path.end(), left_path.rbegin(), left_path.rend());
+  path.push_back(std::make_pair(kmer_f, kmer_r));
+  path.insert(path.end(), right_path.begin(), right_path.end());
+
+  const UnitigID id = _unitigs.size();
+
+  Unitig u;
+  u.branch = false;
+  u.length = path.size();
+  u.left_f = path.front().first;
+  u.left_r = path.front().second;
+  u.left = uniqify_rc(u.left_f, u.left_r);
+  u.right = uniqify_rc(path.back().first, path.back().second);
+  u.left_out = uniqify_rc(left_out_f, left_out_r);
+  u.right_out = uniqify_rc(right_out_f, right_out_r);
+
+  for (unsigned int i = 0; i < path.size(); i++) {
+    HashIntoType kmer = uniqify_rc(path[i].first, path[i].second);
+    if (set_contains(_ht->all_tags, kmer)) {
+      u.tag_positions.push_back(i);
+      u.tags.push_back(kmer);
+      _tags[kmer] = std::make_pair(id, i);
+    }
+  }
+
+  _unitigs.push_back(u);
+  _ends[u.left] = id;
+  _ends[u.right] = id;
+
+  return true;
+}
+
+//
+// build: Dijkstra's algorithm out from the tags, adding unitigs as they
+// are reached.  Crossing a path to the branch at its far end costs the
+// length of the path, so everything within the radius of a tag gets in.
+//
+
+struct _UnitigBuildStep {
+  unsigned int dist;
+  HashIntoType kmer;
+
+  _UnitigBuildStep(unsigned int d, HashIntoType k) : dist(d), kmer(k) { ; }
+
+  bool operator>(const _UnitigBuildStep &o) const { return dist > o.dist; }
+};
+
+void UnitigIndex::build(unsigned int radius, unsigned int max_unitigs)
+{
+  _unitigs.clear();
+  _ends.clear();
+  _tags.clear();
+  _cycle_breaks.clear();
+  _radius = radius;
+  _complete = true;
+
+  std::priority_queue<_UnitigBuildStep, std::vector<_UnitigBuildStep>,
+		      std::greater<_UnitigBuildStep> > todo;
+  SeenSet expanded;		// branches whose neighbors are queued
+  const WordLength k = _ht->ksize();
+  HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+
+  for (TagSet::const_iterator ti = _ht->all_tags.begin();
+       ti != _ht->all_tags.end(); ti++) {
+    todo.push(_UnitigBuildStep(0, *ti));
+  }
+
+  while (!todo.empty()) {
+    if (max_unitigs && _unitigs.size() > max_unitigs) {
+      _complete = false;
+      break;
+    }
+
+    _UnitigBuildStep step = todo.top();
+    todo.pop();
+
+    UnitigID id;
+    unsigned int pos;
+
+    if (!find(step.kmer, id, pos)) {
+      HashIntoType kmer_f, kmer_r;
+      std::string kmer_s = _revhash(step.kmer, k);
+      _hash(kmer_s.c_str(), k, kmer_f, kmer_r);
+
+      if (!_is_linear(kmer_f, kmer_r) || !_add_path(kmer_f, kmer_r)) {
+	if (_is_linear(kmer_f, kmer_r)) {
+	  _cycle_breaks.insert(step.kmer); // a cycle: break it here.
+	}
+	_add_branch(kmer_f, kmer_r);
+      }
+
+      if (!find(step.kmer, id, pos)) {
+	continue;
+      }
+    }
+
+    const Unitig &u = _unitigs[id];
+
+    if (u.branch) {
+      if (step.dist < radius && expanded.insert(u.left).second) {
+	unsigned int n = _neighbors(u.left_f, u.left_r, f, r);
+	for (unsigned int i = 0; i < n; i++) {
+	  todo.push(_UnitigBuildStep(step.dist + 1, uniqify_rc(f[i], r[i])));
+	}
+      }
+    } else {
+      // on to the branches past either end.
+      unsigned int left_dist = step.dist + pos + 1;
+      unsigned int right_dist = step.dist + (u.length - 1 - pos) + 1;
+
+      if (left_dist <= radius) {
+	todo.push(_UnitigBuildStep(left_dist, u.left_out));
+      }
+      if (right_dist <= radius) {
+	todo.push(_UnitigBuildStep(right_dist, u.right_out));
+      }
+    }
+  }
+
+  _stamp_bins = _ht->_occupied_bins;
+  _stamp_tags = _ht->all_tags.generation();
+  _stamp_stop_tags = _ht->stop_tags.generation();
+}
+
+bool UnitigIndex::is_current() const
+{
+  return _stamp_bins == _ht->_occupied_bins &&
+    _stamp_tags == _ht->all_tags.generation() &&
+    _stamp_stop_tags == _ht->stop_tags.generation();
+}
+
+bool UnitigIndex::find(HashIntoType kmer, UnitigID &id,
+		       unsigned int &pos) const
+{
+  std::map<HashIntoType, UnitigID>::const_iterator ei = _ends.find(kmer);
+  if (ei != _ends.end()) {
+    id = ei->second;
+    pos = _unitigs[id].left == kmer ? 0 : _unitigs[id].length - 1;
+    return true;
+  }
+
+  std::map<HashIntoType, std::pair<UnitigID, unsigned int> >::const_iterator
+    ti = _tags.find(kmer);
+  if (ti != _tags.end()) {
+    id = ti->second.first;
+    pos = ti->second.second;
+    return true;
+  }
+
+  return false;
+}
+
+//
+// traverse: Dijkstra's algorithm over the unitigs, where crossing a path
+// of length n costs n, which gives the same breadths as the plain
+// breadth-first search over k-mers.
+//
+// Within a path, the start k-mer and (with stop_at_tags) any tags split
+// it into segments that can only be entered at their ends; k-mers in a
+// segment that was entered from both ends are only counted once.
+//
+
+// how a step enters its unitig.
+#define _STEP_BRANCH 0		// a branch, by unitig id
+#define _STEP_LEFT 1		// a path, at its left end
+#define _STEP_RIGHT 2		// a path, at its right end
+#define _STEP_BRANCH_KMER 3	// a branch, by k-mer
+
+struct _UnitigStep {
+  unsigned int dist;
+  HashIntoType target;
+  unsigned int how;
+
+  _UnitigStep(unsigned int d, HashIntoType t, unsigned int h) :
+    dist(d), target(t), how(h) { ; }
+
+  bool operator>(const _UnitigStep &o) const { return dist > o.dist; }
+};
+
+typedef std::priority_queue<_UnitigStep, std::vector<_UnitigStep>,
+			    std::greater<_UnitigStep> > _UnitigStepQueue;
+
+struct _UnitigTraversal {
+  const std::vector<Unitig> * unitigs;
+  unsigned int max_breadth;
+  bool stop_at_tags;
+  SeenSet * tagged_kmers;
+
+  UnitigID start_id;
+  long start_pos;		// -1 if the start is a branch
+
+  _UnitigStepQueue steps;
+  std::set<HashIntoType> entered;
+  // (unitig, first position of segment) -> k-mers seen from below/above
+  std::map<HashIntoType, std::pair<unsigned int, unsigned int> > covered;
+  unsigned long long n_visited;
+
+  // count the k-mers at positions lo..lo+seglen-1 reached from one end
+  // of their segment, the first of them at 'dist'.
+  void cover(UnitigID id, long lo, long seglen, unsigned int dist,
+	     bool from_below) {
+    if (seglen <= 0 || dist > max_breadth) {
+      return;
+    }
+
+    unsigned int n = std::min((unsigned long) seglen,
+			      (unsigned long) (max_breadth - dist + 1));
+
+    HashIntoType key = ((HashIntoType) id << 32) | (HashIntoType) lo;
+    std::pair<unsigned int, unsigned int> &c = covered[key];
+
+    unsigned int before = std::min((unsigned int) seglen, c.first + c.second);
+    if (from_below) {
+      c.first = std::max(c.first, n);
+    } else {
+      c.second = std::max(c.second, n);
+    }
+    unsigned int after = std::min((unsigned int) seglen, c.first + c.second);
+
+    n_visited += after - before;
+  }
+
+  void reach_tag(HashIntoType tag, unsigned int dist) {
+    if (dist <= max_breadth && tagged_kmers->insert(tag).second) {
+      n_visited++;
+    }
+  }
+
+  // walk up a path from position p, which is at 'dist', to the next
+  // barrier or the right end.
+  void walk_up(UnitigID id, long p, unsigned int dist) {
+    const Unitig &u = (*unitigs)[id];
+    long barrier = u.length;
+    long tag_i = -1;
+
+    if (stop_at_tags) {
+      std::vector<unsigned int>::const_iterator it =
+	std::lower_bound(u.tag_positions.begin(), u.tag_positions.end(),
+			 (unsigned int) p);
+      if (it != u.tag_positions.end()) {
+	barrier = *it;
+	tag_i = it - u.tag_positions.begin();
+      }
+    }
+    if (id == start_id && start_pos >= p && start_pos < barrier) {
+      barrier = start_pos;
+      tag_i = -1;
+    }
+
+    long seglen = barrier - p;
+    cover(id, p, seglen, dist, true);
+
+    if (barrier < (long) u.length) {
+      if (tag_i >= 0) {
+	reach_tag(u.tags[tag_i], dist + seglen);
+      }
+    } else if (dist + seglen <= max_breadth) {
+      steps.push(_UnitigStep(dist + seglen, u.right_out, _STEP_BRANCH_KMER));
+    }
+  }
+
+  // walk down a path from position p (maybe -1), which is at 'dist', to
+  // the next barrier or the left end.
+  void walk_down(UnitigID id, long p, unsigned int dist) {
+    const Unitig &u = (*unitigs)[id];
+    long barrier = -1;
+    long tag_i = -1;
+
+    if (stop_at_tags && p >= 0) {
+      std::vector<unsigned int>::const_iterator it =
+	std::upper_bound(u.tag_positions.begin(), u.tag_positions.end(),
+			 (unsigned int) p);
+      if (it != u.tag_positions.begin()) {
+	barrier = *(it - 1);
+	tag_i = it - u.tag_positions.begin() - 1;
+      }
+    }
+    if (id == start_id && start_pos <= p && start_pos > barrier) {
+      barrier = start_pos;
+      tag_i = -1;
+    }
+
+    long seglen = p - barrier;
+    cover(id, barrier + 1, seglen, dist, false);
+
+    if (barrier >= 0) {
+      if (tag_i >= 0) {
+	reach_tag(u.tags[tag_i], dist + seglen);
+      }
+    } else if (dist + seglen <= max_breadth) {
+      steps.push(_UnitigStep(dist + seglen, u.left_out, _STEP_BRANCH_KMER));
+    }
+  }
+};
+
+bool UnitigIndex::traverse(HashIntoType kmer_f, HashIntoType kmer_r,
+			   unsigned int max_breadth,
+			   bool stop_at_tags,
+			   bool break_on_stop_tags,
+			   SeenSet * tagged_kmers,
+			   unsigned long long max_visited,
+			   unsigned long long &n_visited) const
+{
+  UnitigID start_id;
+  unsigned int start_pos;
+
+  n_visited = 0;
+  if (!_complete || max_breadth > _radius) {
+    return false;
+  }
+
+  std::map<HashIntoType, std::pair<UnitigID, unsigned int> >::const_iterator
+    ti = _tags.find(uniqify_rc(kmer_f, kmer_r));
+  if (ti == _tags.end()) {
+    return false;
+  }
+  start_id = ti->second.first;
+  start_pos = ti->second.second;
+  assert(!stop_at_tags || tagged_kmers);
+
+  _UnitigTraversal t;
+  t.unitigs = &_unitigs;
+  t.max_breadth = max_breadth;
+  t.stop_at_tags = stop_at_tags;
+  t.tagged_kmers = tagged_kmers;
+  t.start_id = start_id;
+  t.start_pos = -1;
+  t.n_visited = 0;
+
+  if (_unitigs[start_id].branch) {
+    t.steps.push(_UnitigStep(0, start_id, _STEP_BRANCH));
+  } else {
+    t.start_pos = start_pos;
+    t.n_visited = 1;
+    if (max_breadth > 0) {
+      t.walk_up(start_id, (long) start_pos + 1, 1);
+      t.walk_down(start_id, (long) start_pos - 1, 1);
+    }
+  }
+
+  HashIntoType f[N_NEIGHBORS], r[N_NEIGHBORS];
+
+  while (!t.steps.empty()) {
+    if (max_visited && t.n_visited > max_visited) {
+      break;
+    }
+
+    _UnitigStep step = t.steps.top();
+    t.steps.pop();
+
+    UnitigID id = step.target;
+    unsigned int how = step.how;
+
+    if (how == _STEP_BRANCH_KMER) {
+      std::map<HashIntoType, UnitigID>::const_iterator ei =
+	_ends.find(step.target);
+      if (ei == _ends.end()) {
+	// as below: the graph has changed since the index was built.
+	n_visited = 0;
+	return false;
+      }
+      id = ei->second;
+      how = _STEP_BRANCH;
+    }
+
+    HashIntoType key = ((HashIntoType) id << 2) | how;
+    if (set_contains(t.entered, key)) {
+      continue;
+    }
+
+    const Unitig &u = _unitigs[id];
+
+    if (how == _STEP_LEFT) {
+      t.entered.insert(key);
+      t.walk_up(id, 0, step.dist);
+      continue;
+    } else if (how == _STEP_RIGHT) {
+      t.entered.insert(key);
+      t.walk_down(id, (long) u.length - 1, step.dist);
+      continue;
+    }
+
+    // a branch k-mer; stop tags are never entered.
+    if (break_on_stop_tags && set_contains(_ht->stop_tags, u.left)) {
+      continue;
+    }
+    t.entered.insert(key);
+    t.n_visited++;
+
+    if (stop_at_tags && id != start_id && u.tags.size()) {
+      tagged_kmers->insert(u.left);
+      continue;
+    }
+
+    if (step.dist >= max_breadth) {
+      continue;
+    }
+
+    unsigned int n = _neighbors(u.left_f, u.left_r, f, r);
+    for (unsigned int i = 0; i < n; i++) {
+      HashIntoType kmer = uniqify_rc(f[i], r[i]);
+
+      std::map<HashIntoType, UnitigID>::const_iterator ei = _ends.find(kmer);
+      if (ei == _ends.end()) {
+	// only if the graph has changed since the index was built.
+	n_visited = 0;
+	return false;
+      }
+
+      const UnitigID next_id = ei->second;
+      const Unitig &next = _unitigs[next_id];
+
+      if (next.branch) {
+	t.steps.push(_UnitigStep(step.dist + 1, next_id, _STEP_BRANCH));
+      } else {
+	// (a path of one k-mer has the same k-mer at both ends.)
+	bool from_left = next.length == 1 ? next.left_out == u.left :
+	  next.left == kmer;
+	t.steps.push(_UnitigStep(step.dist + 1, next_id,
+				 from_left ? _STEP_LEFT : _STEP_RIGHT));
+      }
+    }
+  }
+
+  n_visited = t.n_visited;
+  return true;
+}
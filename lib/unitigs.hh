@@ -0,0 +1,118 @@
+#ifndef UNITIGS_HH
+#define UNITIGS_HH
+
+#include <vector>
+#include <map>
+#include "hashtable.hh"
+
+
+namespace khmer {
+  class Hashbits;
+
+  typedef unsigned int UnitigID;
+
+  //
+  // UnitigIndex: the part of a Hashbits graph within some radius of the
+  // tags, compacted into unitigs.
+  //
+  // A k-mer is "linear" if it has exactly two distinct neighbors (other
+  // than itself) and is not a stop tag.  A unitig is either a maximal
+  // path of linear k-mers, or a single non-linear ("branch") k-mer; so
+  // the k-mer just outside either end of a path is always a branch.
+  // Paths are stored by their length, end k-mers and the tags in them,
+  // not k-mer by k-mer, and traverse() crosses a path in one step.
+  //
+  // The index describes the graph, tags and stop tags as they were when
+  // it was built; is_current() says whether that still holds, and the
+  // traversals fall back to walking k-mers when it doesn't, or when they
+  // start somewhere other than a tag or go further than the radius.
+  //
+
+  struct Unitig {
+    bool branch;
+    unsigned int length;
+
+    HashIntoType left, right;	// end k-mers, uniqify_rc'd
+    HashIntoType left_f, left_r; // the left end, as f/r
+
+    HashIntoType left_out, right_out; // branch k-mer beyond each end
+
+    std::vector<unsigned int> tag_positions; // sorted, 0 = left end
+    std::vector<HashIntoType> tags;
+  };
+
+  class UnitigIndex {
+  protected:
+    const Hashbits * _ht;
+    std::vector<Unitig> _unitigs;
+
+    // end k-mer -> unitig, for every unitig; tag -> (unitig, position).
+    std::map<HashIntoType, UnitigID> _ends;
+    std::map<HashIntoType, std::pair<UnitigID, unsigned int> > _tags;
+
+    // linear k-mers that close a cycle, and are treated as branches.
+    SeenSet _cycle_breaks;
+
+    unsigned int _radius;
+    bool _complete;		// false if max_unitigs was hit
+
+    HashIntoType _stamp_bins;
+    unsigned long long _stamp_tags;	// TagSet::generation()s
+    unsigned long long _stamp_stop_tags;
+
+    unsigned int _neighbors(HashIntoType kmer_f, HashIntoType kmer_r,
+			    HashIntoType * f, HashIntoType * r) const;
+    bool _is_linear(HashIntoType kmer_f, HashIntoType kmer_r) const;
+
+    bool _walk(HashIntoType seed, HashIntoType prev,
+	       HashIntoType cur_f, HashIntoType cur_r,
+	       std::vector<std::pair<HashIntoType, HashIntoType> > &path,
+	       HashIntoType &out_f, HashIntoType &out_r) const;
+
+    void _add_branch(HashIntoType kmer_f, HashIntoType kmer_r);
+    bool _add_path(HashIntoType kmer_f, HashIntoType kmer_r);
+
+  public:
+    UnitigIndex(const Hashbits * ht) : _ht(ht), _radius(0),
+      _complete(false) { ; }
+
+    // (re)build the index, out to 'radius' from the current tags.  In a
+    // badly overloaded table that can be a very large part of the graph,
+    // so the build gives up (and the index is not used) after max_unitigs
+    // unitigs, if that is not 0.
+    void build(unsigned int radius, unsigned int max_unitigs = 0);
+
+    bool is_current() const;
+    bool is_complete() const { return _complete; }
+    unsigned int radius() const { return _radius; }
+
+    unsigned int n_unitigs() const { return _unitigs.size(); }
+    const Unitig& get_unitig(UnitigID id) const { return _unitigs[id]; }
+
+    // the unitig holding this k-mer, if it is an end or a tag.
+    bool find(HashIntoType kmer, UnitigID &id, unsigned int &pos) const;
+
+    //
+    // Breadth-first search from a tag out to max_breadth, as in
+    // Hashbits::count_kmers_within_radius (and, with stop_at_tags, as in
+    // SubsetPartition::find_all_tags: other tags end the search in their
+    // direction and are put in tagged_kmers).  n_visited is the number of
+    // k-mers visited; the search stops once it passes max_visited, if
+    // that is not 0.
+    //
+    // Returns false if the start k-mer is not a tag, if max_breadth is
+    // past the radius, or if the graph turns out to have changed; then
+    // the caller has to walk the k-mers itself (and ignore anything put
+    // in tagged_kmers).
+    //
+    bool traverse(HashIntoType kmer_f, HashIntoType kmer_r,
+		  unsigned int max_breadth,
+		  bool stop_at_tags,
+		  bool break_on_stop_tags,
+		  SeenSet * tagged_kmers,
+		  unsigned long long max_visited,
+		  unsigned long long &n_visited) const;
+  };
+};
+
+#endif // UNITIGS_HH
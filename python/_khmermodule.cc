@@ -11,6 +11,7 @@
 #include "hashbits.hh"
 #include "counting.hh"
 #include "storage.hh"
+#include "hllcounter.hh"
 
 //
 // Function necessary for Python loading:
@@ -229,17 +230,19 @@ static PyObject * ktable_get(PyObject * self, PyObject * args)
     return NULL;
   }
 
-  unsigned long count = 0;
+  khmer::ExactCounterType count = 0;
 
-  if (PyInt_Check(arg)) {
-    long pos = PyInt_AsLong(arg);
-    count = ktable->get_count((unsigned int) pos);
+  if (PyInt_Check(arg) || PyLong_Check(arg)) {
+    khmer::HashIntoType pos = PyInt_Check(arg) ? PyInt_AsLong(arg) :
+      PyLong_AsUnsignedLongLong(arg);
+    if (PyErr_Occurred()) { return NULL; }
+    count = ktable->get_count(pos);
   } else if (PyString_Check(arg)) {
     std::string s = PyString_AsString(arg);
     count = ktable->get_count(s.c_str());
   }
 
-  return PyInt_FromLong(count);
+  return PyLong_FromUnsignedLongLong(count);
 }
 
 static PyObject * ktable__getitem__(PyObject * self, Py_ssize_t index)
@@ -275,9 +278,15 @@ static PyObject * ktable_set(PyObject * self, PyObject * args)
     return NULL;
   }
 
-  if (PyInt_Check(arg)) {
-    long pos = PyInt_AsLong(arg);
-    ktable->set_count((unsigned int) pos, count);
+  if (PyInt_Check(arg) || PyLong_Check(arg)) {
+    khmer::HashIntoType pos = PyInt_Check(arg) ? PyInt_AsLong(arg) :
+      PyLong_AsUnsignedLongLong(arg);
+    if (PyErr_Occurred()) { return NULL; }
+    if (pos > ktable->max_hash()) {
+      PyErr_SetString(PyExc_ValueError, "hash value out of range");
+      return NULL;
+    }
+    ktable->set_count(pos, count);
   } else if (PyString_Check(arg)) {
     std::string s = PyString_AsString(arg);
     ktable->set_count(s.c_str(), count);
@@ -296,7 +305,7 @@ static PyObject * ktable_max_hash(PyObject * self, PyObject * args)
     return NULL;
   }
 
-  return PyInt_FromLong(ktable->max_hash());
+  return PyLong_FromUnsignedLongLong(ktable->max_hash());
 }
 
 static PyObject * ktable_n_entries(PyObject * self, PyObject * args)
@@ -308,7 +317,31 @@ static PyObject * ktable_n_entries(PyObject * self, PyObject * args)
     return NULL;
   }
 
-  return PyInt_FromLong(ktable->n_entries());
+  return PyLong_FromUnsignedLongLong(ktable->n_entries());
+}
+
+static PyObject * ktable_n_occupied(PyObject * self, PyObject * args)
+{
+  khmer_KTableObject * me = (khmer_KTableObject *) self;
+  khmer::KTable * ktable = me->ktable;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyLong_FromUnsignedLongLong(ktable->n_occupied());
+}
+
+static PyObject * ktable_is_sparse(PyObject * self, PyObject * args)
+{
+  khmer_KTableObject * me = (khmer_KTableObject *) self;
+  khmer::KTable * ktable = me->ktable;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyBool_FromLong(ktable->is_sparse());
 }
 
 Py_ssize_t ktable__len__(PyObject * self)
@@ -350,6 +383,7 @@ static PyObject * ktable_clear(PyObject * self, PyObject * args)
 // fwd decl --> defined below
 static PyObject * ktable_update(PyObject * self, PyObject * args);
 static PyObject * ktable_intersect(PyObject * self, PyObject * args);
+static PyObject * ktable_consume_fasta(PyObject * self, PyObject * args);
 
 static PyMethodDef khmer_ktable_methods[] = {
   { "forward_hash", ktable_forward_hash, METH_VARARGS, "Convert string to int" },
@@ -357,9 +391,12 @@ static PyMethodDef khmer_ktable_methods[] = {
   { "reverse_hash", ktable_reverse_hash, METH_VARARGS, "Convert int to string" },
   { "count", ktable_count, METH_VARARGS, "Count the given kmer" },
   { "consume", ktable_consume, METH_VARARGS, "Count all k-mers in the given string" },
+  { "consume_fasta", ktable_consume_fasta, METH_VARARGS, "Count all k-mers in the given file, optionally on several threads" },
   { "get", ktable_get, METH_VARARGS, "Get the count for the given k-mer" },
   { "max_hash", ktable_max_hash, METH_VARARGS, "Get the maximum hash value"},
   { "n_entries", ktable_n_entries, METH_VARARGS, "Get the number of possible entries"},
+  { "n_occupied", ktable_n_occupied, METH_VARARGS, "Get the number of distinct k-mers counted"},
+  { "is_sparse", ktable_is_sparse, METH_VARARGS, "True if only the k-mers that occur are stored"},
   { "ksize", ktable_ksize, METH_VARARGS, "Get k"},
   { "set", ktable_set, METH_VARARGS, "Set counter to a value"},
   { "update", ktable_update, METH_VARARGS, "Combine another ktable with this one"},
@@ -423,15 +460,23 @@ static PyTypeObject khmer_KTableType = {
 static PyObject* new_ktable(PyObject * self, PyObject * args)
 {
   unsigned int size = 0;
+  PyObject * sparse_o = NULL;
 
-  if (!PyArg_ParseTuple(args, "I", &size)) {
+  if (!PyArg_ParseTuple(args, "I|O", &size, &sparse_o)) {
+    return NULL;
+  }
+
+  if (size > MAX_SPARSE_KTABLE_K) {
+    PyErr_SetString(PyExc_ValueError, "k is too large for a ktable");
     return NULL;
   }
 
+  bool sparse = sparse_o && PyObject_IsTrue(sparse_o);
+
   khmer_KTableObject * ktable_obj = (khmer_KTableObject *) \
     PyObject_New(khmer_KTableObject, &khmer_KTableType);
 
-  ktable_obj->ktable = new khmer::KTable(size);
+  ktable_obj->ktable = new khmer::KTable(size, sparse);
 
   return (PyObject *) ktable_obj;
 }
@@ -491,6 +536,33 @@ static PyObject * ktable_intersect(PyObject * self, PyObject * args)
   return (PyObject *) ktable_obj;
 }
 
+static PyObject * ktable_consume_fasta(PyObject * self, PyObject * args)
+{
+  khmer_KTableObject * me = (khmer_KTableObject *) self;
+  khmer::KTable * ktable = me->ktable;
+
+  char * filename;
+  unsigned int n_threads = 1;
+  PyObject * callback_obj = NULL;
+
+  if (!PyArg_ParseTuple(args, "s|IO", &filename, &n_threads,
+			&callback_obj)) {
+    return NULL;
+  }
+
+  unsigned int total_reads;
+  unsigned long long n_consumed;
+
+  try {
+    ktable->consume_fasta(filename, total_reads, n_consumed, n_threads,
+			  _report_fn, callback_obj);
+  } catch (_khmer_signal &e) {
+    return NULL;
+  }
+
+  return Py_BuildValue("IK", total_reads, n_consumed);
+}
+
 PyObject * consume_genome(PyObject * self, PyObject * args)
 {
   unsigned int size;
@@ -628,6 +700,40 @@ static PyTypeObject khmer_MinMaxType = {
     "minmax object",           /* tp_doc */
 };
 
+typedef struct {
+  PyObject_HEAD
+  khmer::HLLCounter * hll;
+} khmer_HLLCounterObject;
+
+#define is_hllcounter_obj(v)  ((v)->ob_type == &khmer_HLLCounterType)
+
+static void khmer_hllcounter_dealloc(PyObject* self);
+static PyObject * khmer_hllcounter_getattr(PyObject *, char *);
+
+static PyTypeObject khmer_HLLCounterType = {
+    PyObject_HEAD_INIT(NULL)
+    0,
+    "HLLCounter", sizeof(khmer_HLLCounterObject),
+    0,
+    khmer_hllcounter_dealloc,	/*tp_dealloc*/
+    0,				/*tp_print*/
+    khmer_hllcounter_getattr,	/*tp_getattr*/
+    0,				/*tp_setattr*/
+    0,				/*tp_compare*/
+    0,				/*tp_repr*/
+    0,				/*tp_as_number*/
+    0,				/*tp_as_sequence*/
+    0,				/*tp_as_mapping*/
+    0,				/*tp_hash */
+    0,				/*tp_call*/
+    0,				/*tp_str*/
+    0,				/*tp_getattro*/
+    0,				/*tp_setattro*/
+    0,				/*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,		/*tp_flags*/
+    "HyperLogLog distinct k-mer counter",           /* tp_doc */
+};
+
 
 
 static void khmer_counting_dealloc(PyObject *);
@@ -1387,11 +1493,165 @@ static PyObject * hash_fasta_count_kmers_by_position(PyObject * self, PyObject *
     PyList_SET_ITEM(x, i, PyInt_FromLong(counts[i]));
   }
 
-  delete counts;
+  delete[] counts;
 
   return x;
 }
 
+static PyObject * hash_scan_fasta(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  char * inputfile;
+  unsigned int stats;
+  unsigned int n_threads = 1;
+  PyObject * minmax_obj = NULL;
+  unsigned int max_read_len = 0;
+  unsigned int limit_by = 0;
+  char * pos_freq_file = NULL;
+  PyObject * readmask_obj = NULL;
+  PyObject * callback_obj = NULL;
+
+  if (!PyArg_ParseTuple(args, "sI|IOIIzOO", &inputfile, &stats, &n_threads,
+			&minmax_obj, &max_read_len, &limit_by,
+			&pos_freq_file, &readmask_obj, &callback_obj)) {
+    return NULL;
+  }
+
+  khmer::ReadStatsScanner scanner(*counting, stats);
+
+  if (stats & SCAN_MINMAX) {
+    if (!minmax_obj || !is_minmax_obj(minmax_obj)) {
+      PyErr_SetString(PyExc_TypeError,
+		      "SCAN_MINMAX needs a minmax object to fill in");
+      return NULL;
+    }
+    scanner.minmax = ((khmer_MinMaxObject *) minmax_obj)->mmt;
+  }
+  if (stats & SCAN_POSITION_FREQ) {
+    if (!pos_freq_file) {
+      PyErr_SetString(PyExc_ValueError,
+		      "SCAN_POSITION_FREQ needs an output filename");
+      return NULL;
+    }
+    scanner.pos_freq_filename = pos_freq_file;
+  }
+  if (readmask_obj && readmask_obj != Py_None) {
+    if (!is_readmask_obj(readmask_obj)) {
+      PyErr_SetString(PyExc_TypeError,
+		      "readmask must be None or a readmask object");
+      return NULL;
+    }
+    scanner.readmask = ((khmer_ReadMaskObject *) readmask_obj)->mask;
+  }
+  scanner.max_read_len = max_read_len;
+  scanner.limit_by_count = limit_by;
+
+  try {
+    scanner.scan(inputfile, n_threads, _report_fn, callback_obj);
+  } catch (_khmer_signal &e) {
+    return NULL;
+  }
+
+  PyObject * result = PyDict_New();
+  PyObject * val;
+
+  val = PyLong_FromUnsignedLongLong(scanner.n_reads);
+  PyDict_SetItemString(result, "n_reads", val);
+  Py_DECREF(val);
+
+  if (stats & SCAN_ABUNDANCE) {
+    val = PyLong_FromUnsignedLongLong(scanner.total_count());
+    PyDict_SetItemString(result, "total", val);
+    Py_DECREF(val);
+
+    val = PyLong_FromUnsignedLongLong(scanner.n_kmers());
+    PyDict_SetItemString(result, "count", val);
+    Py_DECREF(val);
+
+    float mean = scanner.n_kmers() ? scanner.mean() : 0.0;
+    val = PyFloat_FromDouble(mean);
+    PyDict_SetItemString(result, "mean", val);
+    Py_DECREF(val);
+
+    val = PyFloat_FromDouble(scanner.n_kmers() ?
+			     scanner.abs_deviation(mean) : 0.0);
+    PyDict_SetItemString(result, "abs_deviation", val);
+    Py_DECREF(val);
+  }
+
+  if (stats & SCAN_POSITION_COUNTS) {
+    val = PyList_New(max_read_len);
+    for (unsigned int i = 0; i < max_read_len; i++) {
+      PyList_SET_ITEM(val, i,
+		      PyLong_FromUnsignedLongLong(scanner.position_counts[i]));
+    }
+    PyDict_SetItemString(result, "position_counts", val);
+    Py_DECREF(val);
+  }
+
+  return result;
+}
+
+static PyObject * hash_filter_reads(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  char * inputfile;
+  char * outputfile = NULL;
+  unsigned int min_threshold, max_threshold;
+  unsigned int run_threshold, runlength;
+  unsigned int limit_threshold, limit_n;
+  unsigned int n_threads = 1;
+  PyObject * old_readmask_obj = NULL;
+  PyObject * readmask_obj = NULL;
+  PyObject * callback_obj = NULL;
+
+  if (!PyArg_ParseTuple(args, "szIIIIII|IOOO", &inputfile, &outputfile,
+			&min_threshold, &max_threshold,
+			&run_threshold, &runlength,
+			&limit_threshold, &limit_n, &n_threads,
+			&old_readmask_obj, &readmask_obj, &callback_obj)) {
+    return NULL;
+  }
+
+  khmer::ReadFilter filter(*counting);
+  filter.min_threshold = min_threshold;
+  filter.max_threshold = max_threshold;
+  filter.run_threshold = run_threshold;
+  filter.runlength = runlength;
+  filter.limit_threshold = limit_threshold;
+  filter.limit_n = limit_n;
+
+  if (old_readmask_obj && old_readmask_obj != Py_None) {
+    if (!is_readmask_obj(old_readmask_obj)) {
+      PyErr_SetString(PyExc_TypeError,
+		      "old readmask must be None or a readmask object");
+      return NULL;
+    }
+    filter.old_readmask = ((khmer_ReadMaskObject *) old_readmask_obj)->mask;
+  }
+  if (readmask_obj && readmask_obj != Py_None) {
+    if (!is_readmask_obj(readmask_obj)) {
+      PyErr_SetString(PyExc_TypeError,
+		      "readmask must be None or a readmask object");
+      return NULL;
+    }
+    filter.readmask = ((khmer_ReadMaskObject *) readmask_obj)->mask;
+  }
+
+  try {
+    filter.filter(inputfile, outputfile ? outputfile : "", n_threads,
+		  _report_fn, callback_obj);
+  } catch (_khmer_signal &e) {
+    return NULL;
+  }
+
+  return Py_BuildValue("KK", filter.n_reads, filter.n_kept);
+}
+
 static PyObject * hash_fasta_dump_kmers_by_abundance(PyObject * self, PyObject * args)
 {
   khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
@@ -1545,6 +1805,7 @@ static PyMethodDef khmer_counting_methods[] = {
   { "filter_fasta_file_any", hash_filter_fasta_file_any, METH_VARARGS, "" },
   { "filter_fasta_file_all", hash_filter_fasta_file_all, METH_VARARGS, "" },
   { "filter_fasta_file_run", hash_filter_fasta_file_run, METH_VARARGS, "" },
+  { "filter_reads", hash_filter_reads, METH_VARARGS, "Filter reads on their k-mer counts in one pass; returns (n_reads, n_kept)" },
   { "output_fasta_kmer_pos_freq", hash_output_fasta_kmer_pos_freq, METH_VARARGS, "" },
   { "get", hash_get, METH_VARARGS, "Get the count for the given k-mer" },
   { "max_hamming1_count", hash_max_hamming1_count, METH_VARARGS, "Get the count for the given k-mer" },
@@ -1556,6 +1817,7 @@ static PyMethodDef khmer_counting_methods[] = {
   { "trim_below_abundance", count_trim_below_abundance, METH_VARARGS, "Trim on >= abundance" },
   { "abundance_distribution", hash_abundance_distribution, METH_VARARGS, "" },
   { "fasta_count_kmers_by_position", hash_fasta_count_kmers_by_position, METH_VARARGS, "" },
+  { "scan_fasta", hash_scan_fasta, METH_VARARGS, "Compute any combination of SCAN_* k-mer abundance statistics in one pass over a file" },
   { "fasta_dump_kmers_by_abundance", hash_fasta_dump_kmers_by_abundance, METH_VARARGS, "" },
   { "load", hash_load, METH_VARARGS, "" },
   { "save", hash_save, METH_VARARGS, "" },
@@ -1628,11 +1890,31 @@ static PyObject* _new_counting_hash(PyObject * self, PyObject * args)
 {
   unsigned int k = 0;
   PyObject* sizes_list_o = NULL;
+  unsigned long long max_memory = 0;
+  double target_fp = DEFAULT_TARGET_FP;
 
-  if (!PyArg_ParseTuple(args, "IO", &k, &sizes_list_o)) {
+  if (!PyArg_ParseTuple(args, "IO|Ld", &k, &sizes_list_o, &max_memory,
+			&target_fp)) {
     return NULL;
   }
 
+  // "auto" sizing, from a cardinality estimate.
+  if (is_hllcounter_obj(sizes_list_o)) {
+    khmer::HLLCounter * hll = ((khmer_HLLCounterObject *) sizes_list_o)->hll;
+    if (target_fp <= 0 || target_fp >= 1) {
+      PyErr_SetString(PyExc_ValueError, "target_fp must be in (0, 1)");
+      return NULL;
+    }
+
+    khmer_KCountingHashObject * kcounting_obj = (khmer_KCountingHashObject *) \
+      PyObject_New(khmer_KCountingHashObject, &khmer_KCountingHashType);
+
+    kcounting_obj->counting = new khmer::CountingHash(k, *hll, max_memory,
+						      target_fp);
+
+    return (PyObject *) kcounting_obj;
+  }
+
   std::vector<khmer::HashIntoType> sizes;
   for (int i = 0; i < PyObject_Length(sizes_list_o); i++) {
     PyObject * size_o = PyList_GET_ITEM(sizes_list_o, i);
@@ -1651,6 +1933,92 @@ static PyObject* _new_counting_hash(PyObject * self, PyObject * args)
 // hashbits stuff
 //
 
+static PyObject * hashbits_estimated_fp_rate(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyFloat_FromDouble(hashbits->estimated_fp_rate());
+}
+
+static PyObject * hashbits_enable_adjacency_cache(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  khmer::HashIntoType max_bytes = DEFAULT_ADJACENCY_CACHE_BYTES;
+
+  if (!PyArg_ParseTuple(args, "|K", &max_bytes)) {
+    return NULL;
+  }
+
+  hashbits->enable_adjacency_cache(max_bytes);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hashbits_disable_adjacency_cache(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  hashbits->disable_adjacency_cache();
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hashbits_fill_adjacency_cache(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  unsigned int radius = hashbits->_get_tag_density();
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "|II", &radius, &n_threads)) {
+    return NULL;
+  }
+
+  unsigned long long n_visited;
+
+  Py_BEGIN_ALLOW_THREADS
+
+    n_visited = hashbits->fill_adjacency_cache(radius, n_threads);
+
+  Py_END_ALLOW_THREADS
+
+  return PyLong_FromUnsignedLongLong(n_visited);
+}
+
+static PyObject * hashbits_adjacency_cache_stats(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  const khmer::AdjacencyCache * cache = hashbits->adjacency_cache();
+  if (!cache) {
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+
+  return Py_BuildValue("KKKd", cache->n_slots(), cache->n_lookups(),
+		       cache->n_hits(), cache->hit_rate());
+}
+
 static PyObject * hashbits_n_unique_kmers(PyObject * self, PyObject * args)
 {
     khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
@@ -1742,42 +2110,283 @@ static PyObject * hashbits_count_overlap(PyObject * self, PyObject * args)
   return Py_BuildValue("LLO", n, n_overlap,x);
 }
 
-static PyObject * hashbits_n_occupied(PyObject * self, PyObject * args)
+static PyObject * hashbits_count_overlap_panel(PyObject * self, PyObject * args)
 {
   khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
   khmer::Hashbits * hashbits = me->hashbits;
 
-  khmer::HashIntoType start = 0, stop = 0;
+  char * filename;
+  PyObject * panel_o;
+  unsigned int n_points = 100;
+  unsigned int n_threads = 1;
+  PyObject * callback_obj = NULL;
 
-  if (!PyArg_ParseTuple(args, "|LL", &start, &stop)) {
+  if (!PyArg_ParseTuple(args, "sO|IIO", &filename, &panel_o, &n_points,
+			&n_threads, &callback_obj)) {
     return NULL;
   }
 
-  khmer::HashIntoType n = hashbits->n_occupied(start, stop);
-
-  return PyInt_FromLong(n);
-}
-
-static PyObject * hashbits_n_tags(PyObject * self, PyObject * args)
-{
-  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
-  khmer::Hashbits * hashbits = me->hashbits;
-
-  if (!PyArg_ParseTuple(args, "")) {
+  if (!PySequence_Check(panel_o)) {
+    PyErr_SetString(PyExc_TypeError, "panel must be a list of hashbits");
     return NULL;
   }
 
-  return PyInt_FromLong(hashbits->n_tags());
-}
+  std::vector<const khmer::Hashbits *> panel;
+  for (Py_ssize_t i = 0; i < PySequence_Length(panel_o); i++) {
+    PyObject * o = PySequence_GetItem(panel_o, i);
+    bool ok = is_hashbits_obj(o);
+    if (ok) {
+      panel.push_back(((khmer_KHashbitsObject *) o)->hashbits);
+    }
+    Py_DECREF(o);		// the list still holds it.
 
-static PyObject * hashbits_count(PyObject * self, PyObject * args)
-{
-  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
-  khmer::Hashbits * hashbits = me->hashbits;
+    if (!ok) {
+      PyErr_SetString(PyExc_TypeError, "panel must be a list of hashbits");
+      return NULL;
+    }
+    if (panel.back()->ksize() != hashbits->ksize()) {
+      PyErr_SetString(PyExc_ValueError, "panel tables must have the same k");
+      return NULL;
+    }
+  }
 
-  char * kmer;
+  // call the C++ function, and trap signals => Python
 
-  if (!PyArg_ParseTuple(args, "s", &kmer)) {
+  khmer::OverlapCurve curve;
+  unsigned long long n_consumed;
+  unsigned int total_reads;
+
+  try {
+    hashbits->consume_fasta_overlap(filename, panel, n_points, curve,
+				    total_reads, n_consumed, n_threads,
+				    _report_fn, callback_obj);
+  } catch (_khmer_signal &e) {
+    return NULL;
+  }
+
+  PyObject * points = PyList_New(curve.n_reads.size());
+  for (unsigned int i = 0; i < curve.n_reads.size(); i++) {
+    PyObject * overlap = PyList_New(panel.size());
+    for (unsigned int j = 0; j < panel.size(); j++) {
+      PyList_SET_ITEM(overlap, j,
+		      PyLong_FromUnsignedLongLong(curve.n_overlap[i][j]));
+    }
+    PyList_SET_ITEM(points, i, Py_BuildValue("KKN", curve.n_reads[i],
+					     curve.n_unique[i], overlap));
+  }
+
+  // the totals are the last point, if the file wasn't empty.
+  const bool empty = curve.n_reads.empty();
+  khmer::HashIntoType n_unique = empty ? 0 : curve.n_unique.back();
+
+  PyObject * totals = PyList_New(panel.size());
+  for (unsigned int j = 0; j < panel.size(); j++) {
+    khmer::HashIntoType n = empty ? 0 : curve.n_overlap.back()[j];
+    PyList_SET_ITEM(totals, j, PyLong_FromUnsignedLongLong(n));
+  }
+
+  return Py_BuildValue("KNN", n_unique, totals, points);
+}
+
+static PyObject * hashbits_n_occupied(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  khmer::HashIntoType start = 0, stop = 0;
+
+  if (!PyArg_ParseTuple(args, "|LL", &start, &stop)) {
+    return NULL;
+  }
+
+  khmer::HashIntoType n = hashbits->n_occupied(start, stop);
+
+  return PyInt_FromLong(n);
+}
+
+static PyObject * hashbits_table_occupancy(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "|I", &n_threads)) {
+    return NULL;
+  }
+
+  std::vector<khmer::HashIntoType> n_set;
+
+  Py_BEGIN_ALLOW_THREADS
+
+    hashbits->table_occupancy(n_set, n_threads);
+
+  Py_END_ALLOW_THREADS
+
+  PyObject * x = PyList_New(n_set.size());
+  for (unsigned int i = 0; i < n_set.size(); i++) {
+    PyList_SET_ITEM(x, i, PyLong_FromUnsignedLongLong(n_set[i]));
+  }
+  return x;
+}
+
+static PyObject * hashbits_recount_occupancy(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "|I", &n_threads)) {
+    return NULL;
+  }
+
+  khmer::HashIntoType n;
+
+  Py_BEGIN_ALLOW_THREADS
+
+    n = hashbits->recount_occupancy(n_threads);
+
+  Py_END_ALLOW_THREADS
+
+  return PyLong_FromUnsignedLongLong(n);
+}
+
+//
+// bitwise operations between tables.  Either side may be a hashbits
+// object or the name of a saved hashbits file, which is mmapped rather
+// than loaded; the caller deletes 'file' if it is set.
+//
+
+static bool _get_bit_arrays(PyObject * obj, khmer::BitArrays &bits,
+			    khmer::HashbitsFile * &file)
+{
+  file = NULL;
+
+  if (is_hashbits_obj(obj)) {
+    bits = ((khmer_KHashbitsObject *) obj)->hashbits->bit_arrays();
+    return true;
+  }
+
+  if (!PyString_Check(obj)) {
+    PyErr_SetString(PyExc_TypeError,
+		    "expected a hashbits object or a saved hashbits file");
+    return false;
+  }
+
+  file = new khmer::HashbitsFile(PyString_AsString(obj));
+  if (!file->is_open()) {
+    PyErr_SetString(PyExc_IOError, "cannot map saved hashbits file");
+    delete file;
+    file = NULL;
+    return false;
+  }
+
+  bits = file->bit_arrays();
+  return true;
+}
+
+static PyObject * _hashbits_combine(PyObject * self, PyObject * args,
+				    unsigned int op)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  PyObject * other_o = NULL;
+  unsigned int n_threads = 1;
+  PyObject * into_o = NULL;
+
+  if (!PyArg_ParseTuple(args, "O|IO", &other_o, &n_threads, &into_o)) {
+    return NULL;
+  }
+
+  khmer::Hashbits * into = hashbits;
+  if (into_o && into_o != Py_None) {
+    if (!is_hashbits_obj(into_o)) {
+      PyErr_SetString(PyExc_TypeError, "into must be a hashbits object");
+      return NULL;
+    }
+    into = ((khmer_KHashbitsObject *) into_o)->hashbits;
+  }
+
+  khmer::BitArrays other;
+  khmer::HashbitsFile * file;
+  if (!_get_bit_arrays(other_o, other, file)) {
+    return NULL;
+  }
+
+  khmer::BitArrays mine = hashbits->bit_arrays();
+  if (!mine.same_layout(other) || !mine.same_layout(into->bit_arrays())) {
+    delete file;
+    PyErr_SetString(PyExc_ValueError,
+		    "tables must have the same type, k and table sizes");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+
+    into->combine_tables(op, mine, other, n_threads);
+
+  Py_END_ALLOW_THREADS
+
+  delete file;
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hashbits_set_union(PyObject * self, PyObject * args)
+{
+  return _hashbits_combine(self, args, BITS_UNION);
+}
+
+static PyObject * hashbits_set_intersection(PyObject * self, PyObject * args)
+{
+  return _hashbits_combine(self, args, BITS_INTERSECTION);
+}
+
+static PyObject * hashbits_set_difference(PyObject * self, PyObject * args)
+{
+  return _hashbits_combine(self, args, BITS_DIFFERENCE);
+}
+
+static PyObject * hashbits_empty_copy(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  khmer_KHashbitsObject * khashbits_obj = (khmer_KHashbitsObject *) \
+    PyObject_New(khmer_KHashbitsObject, &khmer_KHashbitsType);
+
+  khashbits_obj->hashbits = hashbits->empty_copy();
+
+  return (PyObject *) khashbits_obj;
+}
+
+static PyObject * hashbits_n_tags(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyInt_FromLong(hashbits->n_tags());
+}
+
+static PyObject * hashbits_count(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  char * kmer;
+
+  if (!PyArg_ParseTuple(args, "s", &kmer)) {
     return NULL;
   }
 
@@ -1866,8 +2475,13 @@ static PyObject * hashbits_load_stop_tags(PyObject * self, PyObject * args)
   if (clear_tags_o && !PyObject_IsTrue(clear_tags_o)) {
     clear_tags = false;
   }
-  hashbits->load_stop_tags(filename, clear_tags);
-  
+  try {
+    hashbits->load_stop_tags(filename, clear_tags);
+  } catch (std::exception &e) {
+    PyErr_SetString(PyExc_IOError, e.what());
+    return NULL;
+  }
+
   Py_INCREF(Py_None);
   return Py_None;
 }
@@ -1878,12 +2492,14 @@ static PyObject * hashbits_save_stop_tags(PyObject * self, PyObject * args)
   khmer::Hashbits * hashbits = me->hashbits;
 
   char * filename = NULL;
+  PyObject * packed_o = NULL;
 
-  if (!PyArg_ParseTuple(args, "s", &filename)) {
+  if (!PyArg_ParseTuple(args, "s|O", &filename, &packed_o)) {
     return NULL;
   }
 
-  hashbits->save_stop_tags(filename);
+  bool packed = packed_o && PyObject_IsTrue(packed_o);
+  hashbits->save_stop_tags(filename, packed);
   
   Py_INCREF(Py_None);
   return Py_None;
@@ -1896,14 +2512,16 @@ static PyObject * hashbits_traverse_from_tags(PyObject * self, PyObject * args)
 
   PyObject * counting_o = NULL;
   unsigned int distance, threshold, frequency;
+  unsigned int n_threads = 1;
 
-  if (!PyArg_ParseTuple(args, "OIII", &counting_o, &distance, &threshold, &frequency)) {
+  if (!PyArg_ParseTuple(args, "OIII|I", &counting_o, &distance, &threshold, &frequency, &n_threads)) {
     return NULL;
   }
 
   khmer::CountingHash * counting = ((khmer_KCountingHashObject *) counting_o)->counting;
 
-  hashbits->traverse_from_tags(distance, threshold, frequency, *counting);
+  hashbits->traverse_from_tags(distance, threshold, frequency, *counting,
+			       n_threads);
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -1917,8 +2535,9 @@ static PyObject * hashbits_repartition_largest_partition(PyObject * self, PyObje
   PyObject * counting_o = NULL;
   PyObject * subset_o = NULL;
   unsigned int distance, threshold, frequency;
+  unsigned int n_threads = 1;
 
-  if (!PyArg_ParseTuple(args, "OOIII", &subset_o, &counting_o, &distance, &threshold, &frequency)) {
+  if (!PyArg_ParseTuple(args, "OOIII|I", &subset_o, &counting_o, &distance, &threshold, &frequency, &n_threads)) {
     return NULL;
   }
 
@@ -1931,7 +2550,7 @@ static PyObject * hashbits_repartition_largest_partition(PyObject * self, PyObje
 
   khmer::CountingHash * counting = ((khmer_KCountingHashObject *) counting_o)->counting;
 
-  unsigned int next_largest = subset_p->repartition_largest_partition(distance, threshold, frequency, *counting);
+  unsigned int next_largest = subset_p->repartition_largest_partition(distance, threshold, frequency, *counting, n_threads);
 
   return PyInt_FromLong(next_largest);
 }
@@ -2009,6 +2628,91 @@ static PyObject * hashbits_calc_connected_graph_size(PyObject * self, PyObject *
   return PyInt_FromLong(size);
 }
 
+static PyObject * hashbits_build_unitig_index(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  unsigned int radius = 0;
+  unsigned int max_unitigs = 0;
+
+  if (!PyArg_ParseTuple(args, "|II", &radius, &max_unitigs)) {
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+
+    hashbits->build_unitig_index(radius, max_unitigs);
+
+  Py_END_ALLOW_THREADS
+
+  if (!hashbits->unitig_index->is_complete()) {
+    PyErr_SetString(PyExc_RuntimeError, "too many unitigs; index not built");
+    hashbits->clear_unitig_index();
+    return NULL;
+  }
+
+  return PyInt_FromLong(hashbits->unitig_index->n_unitigs());
+}
+
+static PyObject * hashbits_clear_unitig_index(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  hashbits->clear_unitig_index();
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hashbits_get_unitig(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  char * kmer_s = NULL;
+
+  if (!PyArg_ParseTuple(args, "s", &kmer_s)) {
+    return NULL;
+  }
+
+  if (strlen(kmer_s) != hashbits->ksize()) {
+    PyErr_SetString(PyExc_ValueError, "k-mer length must be the same as the hashtable k-size");
+    return NULL;
+  }
+
+  const khmer::UnitigIndex * index = hashbits->unitig_index;
+  khmer::UnitigID id;
+  unsigned int pos;
+
+  if (!index || !index->find(khmer::_hash(kmer_s, hashbits->ksize()),
+			      id, pos)) {
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+
+  const khmer::Unitig &u = index->get_unitig(id);
+  const unsigned int k = hashbits->ksize();
+
+  PyObject * tags = PyList_New(u.tags.size());
+  for (unsigned int i = 0; i < u.tags.size(); i++) {
+    std::string s = khmer::_revhash(u.tags[i], k);
+    PyList_SET_ITEM(tags, i, PyString_FromString(s.c_str()));
+  }
+
+  PyObject * ret = Py_BuildValue("IIssO", id, u.length,
+				 khmer::_revhash(u.left, k).c_str(),
+				 khmer::_revhash(u.right, k).c_str(), tags);
+  Py_DECREF(tags);
+
+  return ret;
+}
+
 static PyObject * hashbits_kmer_degree(PyObject * self, PyObject * args)
 {
   khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
@@ -2175,6 +2879,86 @@ static PyObject * hashbits_do_subset_partition(PyObject * self, PyObject * args)
   return PyCObject_FromVoidPtr(subset_p, free_subset_partition_info);
 }
 
+static PyObject * hashbits_do_parallel_partition(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  PyObject * callback_obj = NULL;
+  unsigned int n_threads = 1;
+  PyObject * break_on_stop_tags_o = NULL;
+  PyObject * stop_big_traversals_o = NULL;
+
+  if (!PyArg_ParseTuple(args, "|IOOO", &n_threads,
+			&break_on_stop_tags_o,
+			&stop_big_traversals_o,
+			&callback_obj)) {
+    return NULL;
+  }
+
+  bool break_on_stop_tags = false;
+  if (break_on_stop_tags_o && PyObject_IsTrue(break_on_stop_tags_o)) {
+    break_on_stop_tags = true;
+  }
+  bool stop_big_traversals = false;
+  if (stop_big_traversals_o && PyObject_IsTrue(stop_big_traversals_o)) {
+    stop_big_traversals = true;
+  }
+
+  // the callback runs on this thread, so keep the GIL; the other
+  // threads don't touch Python.
+  try {
+    hashbits->partition->do_parallel_partition(n_threads, break_on_stop_tags,
+					       stop_big_traversals,
+					       _report_fn, callback_obj);
+  } catch (_khmer_signal &e) {
+    return NULL;
+  }
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hashbits_refine_streaming_partition(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  PyObject * callback_obj = NULL;
+  unsigned int n_threads = 1;
+  PyObject * break_on_stop_tags_o = NULL;
+  PyObject * stop_big_traversals_o = NULL;
+
+  if (!PyArg_ParseTuple(args, "|IOOO", &n_threads,
+			&break_on_stop_tags_o,
+			&stop_big_traversals_o,
+			&callback_obj)) {
+    return NULL;
+  }
+
+  bool break_on_stop_tags = false;
+  if (break_on_stop_tags_o && PyObject_IsTrue(break_on_stop_tags_o)) {
+    break_on_stop_tags = true;
+  }
+  bool stop_big_traversals = false;
+  if (stop_big_traversals_o && PyObject_IsTrue(stop_big_traversals_o)) {
+    stop_big_traversals = true;
+  }
+
+  // as in do_parallel_partition, keep the GIL for the callback.
+  unsigned int n_todo;
+  try {
+    n_todo = hashbits->partition->refine_streaming_partition(n_threads,
+						break_on_stop_tags,
+						stop_big_traversals,
+						_report_fn, callback_obj);
+  } catch (_khmer_signal &e) {
+    return NULL;
+  }
+
+  return PyInt_FromLong(n_todo);
+}
+
 static PyObject * hashbits_join_partitions_by_path(PyObject * self, PyObject *args)
 {
   khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
@@ -2224,7 +3008,65 @@ static PyObject * hashbits_merge_from_disk(PyObject * self, PyObject *args)
     return NULL;
   }
 
-  hashbits->partition->merge_from_disk(filename);
+  try {
+    hashbits->partition->merge_from_disk(filename);
+  } catch (std::exception &e) {
+    PyErr_SetString(PyExc_IOError, e.what());
+    return NULL;
+  }
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hashbits_merge_partitionmap_files(PyObject * self,
+						    PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  PyObject * filenames_o = NULL;
+  char * outfile = NULL;
+  PyObject * packed_o = NULL;
+  if (!PyArg_ParseTuple(args, "Os|O", &filenames_o, &outfile, &packed_o)) {
+    return NULL;
+  }
+
+  bool packed = packed_o && PyObject_IsTrue(packed_o);
+
+  if (!PySequence_Check(filenames_o)) {
+    PyErr_SetString(PyExc_TypeError, "expected a list of filenames");
+    return NULL;
+  }
+
+  std::vector<std::string> filenames;
+  for (Py_ssize_t i = 0; i < PySequence_Length(filenames_o); i++) {
+    PyObject * o = PySequence_GetItem(filenames_o, i);
+    const char * filename = o ? PyString_AsString(o) : NULL;
+    if (filename) {
+      filenames.push_back(filename);
+    }
+    Py_XDECREF(o);
+
+    if (!filename) {
+      return NULL;
+    }
+  }
+
+  std::string error;
+
+  Py_BEGIN_ALLOW_THREADS
+  try {
+    hashbits->partition->merge_partitionmap_files(filenames, outfile, packed);
+  } catch (std::exception &e) {
+    error = e.what();
+  }
+  Py_END_ALLOW_THREADS
+
+  if (!error.empty()) {	// raise it with the GIL back.
+    PyErr_SetString(PyExc_IOError, error.c_str());
+    return NULL;
+  }
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -2350,8 +3192,10 @@ static PyObject * hashbits_consume_fasta_and_tag(PyObject * self, PyObject * arg
 
   char * filename;
   PyObject * callback_obj = NULL;
+  unsigned int n_threads = 1;
 
-  if (!PyArg_ParseTuple(args, "s|O", &filename, &callback_obj)) {
+  if (!PyArg_ParseTuple(args, "s|OI", &filename, &callback_obj,
+			&n_threads)) {
     return NULL;
   }
 
@@ -2362,7 +3206,34 @@ static PyObject * hashbits_consume_fasta_and_tag(PyObject * self, PyObject * arg
 
   try {
     hashbits->consume_fasta_and_tag(filename, total_reads, n_consumed,
-				     _report_fn, callback_obj);
+				     n_threads, _report_fn, callback_obj);
+  } catch (_khmer_signal &e) {
+    return NULL;
+  }
+
+  return Py_BuildValue("iL", total_reads, n_consumed);
+}
+
+static PyObject * hashbits_consume_fasta_and_partition(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  char * filename;
+  PyObject * callback_obj = NULL;
+
+  if (!PyArg_ParseTuple(args, "s|O", &filename, &callback_obj)) {
+    return NULL;
+  }
+
+  // call the C++ function, and trap signals => Python
+
+  unsigned long long n_consumed;
+  unsigned int total_reads;
+
+  try {
+    hashbits->consume_fasta_and_partition(filename, total_reads, n_consumed,
+					  _report_fn, callback_obj);
   } catch (_khmer_signal &e) {
     return NULL;
   }
@@ -2531,16 +3402,13 @@ static PyObject * hashbits_get_stop_tags(PyObject * self, PyObject * args)
   }
 
   khmer::WordLength k = hashbits->ksize();
-  khmer::SeenSet::const_iterator si;
+  const std::vector<khmer::HashIntoType> &tags = hashbits->stop_tags.sorted();
 
-  PyObject * x = PyList_New(hashbits->stop_tags.size());
-  unsigned long long i = 0;
-  for (si = hashbits->stop_tags.begin(); si != hashbits->stop_tags.end(); si++)
-    {
-      std::string s = khmer::_revhash(*si, k);
-      PyList_SET_ITEM(x, i, Py_BuildValue("s", s.c_str()));
-      i++;
-    }
+  PyObject * x = PyList_New(tags.size());
+  for (unsigned long long i = 0; i < tags.size(); i++) {
+    std::string s = khmer::_revhash(tags[i], k);
+    PyList_SET_ITEM(x, i, Py_BuildValue("s", s.c_str()));
+  }
 
   return x;
 }
@@ -2555,14 +3423,12 @@ static PyObject * hashbits_get_tagset(PyObject * self, PyObject * args)
   }
 
   khmer::WordLength k = hashbits->ksize();
-  khmer::SeenSet::const_iterator si;
+  const std::vector<khmer::HashIntoType> &tags = hashbits->all_tags.sorted();
 
-  PyObject * x = PyList_New(hashbits->all_tags.size());
-  unsigned long long i = 0;
-  for (si = hashbits->all_tags.begin(); si != hashbits->all_tags.end(); si++) {
-    std::string s = khmer::_revhash(*si, k);
+  PyObject * x = PyList_New(tags.size());
+  for (unsigned long long i = 0; i < tags.size(); i++) {
+    std::string s = khmer::_revhash(tags[i], k);
     PyList_SET_ITEM(x, i, Py_BuildValue("s", s.c_str()));
-    i++;
   }
 
   return x;
@@ -2577,10 +3443,11 @@ static PyObject * hashbits_output_partitions(PyObject * self, PyObject * args)
   char * output = NULL;
   PyObject * callback_obj = NULL;
   PyObject * output_unassigned_o = NULL;
+  unsigned int n_threads = 1;
 
-  if (!PyArg_ParseTuple(args, "ss|OO", &filename, &output,
+  if (!PyArg_ParseTuple(args, "ss|OOI", &filename, &output,
 			&output_unassigned_o,
-			&callback_obj)) {
+			&callback_obj, &n_threads)) {
     return NULL;
   }
 
@@ -2597,7 +3464,55 @@ static PyObject * hashbits_output_partitions(PyObject * self, PyObject * args)
 						     output,
 						     output_unassigned,
 						     _report_fn,
-						     callback_obj);
+						     callback_obj,
+						     n_threads);
+  } catch (_khmer_signal &e) {
+    return NULL;
+  }
+
+  return PyInt_FromLong(n_partitions);
+}
+
+static PyObject * hashbits_output_partition_buckets(PyObject * self,
+						    PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  char * filename = NULL;
+  char * prefix = NULL;
+  unsigned int n_buckets = 0;
+  PyObject * callback_obj = NULL;
+  PyObject * output_unassigned_o = NULL;
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "ssI|OOI", &filename, &prefix, &n_buckets,
+			&output_unassigned_o,
+			&callback_obj, &n_threads)) {
+    return NULL;
+  }
+
+  if (n_buckets < 1) {
+    PyErr_SetString(PyExc_ValueError, "need at least one bucket");
+    return NULL;
+  }
+
+  bool output_unassigned = false;
+  if (output_unassigned_o != NULL && PyObject_IsTrue(output_unassigned_o)) {
+    output_unassigned = true;
+  }
+
+  unsigned int n_partitions = 0;
+
+  try {
+    khmer::SubsetPartition * subset_p = hashbits->partition;
+    n_partitions = subset_p->output_partition_buckets(filename,
+						      prefix,
+						      n_buckets,
+						      output_unassigned,
+						      _report_fn,
+						      callback_obj,
+						      n_threads);
   } catch (_khmer_signal &e) {
     return NULL;
   }
@@ -2668,12 +3583,17 @@ static PyObject * hashbits_save_partitionmap(PyObject * self, PyObject * args)
   khmer::Hashbits * hashbits = me->hashbits;
 
   char * filename = NULL;
+  PyObject * packed_o = NULL;
 
-  if (!PyArg_ParseTuple(args, "s", &filename)) {
+  if (!PyArg_ParseTuple(args, "s|O", &filename, &packed_o)) {
     return NULL;
   }
 
-  hashbits->partition->save_partitionmap(filename);
+  bool packed = packed_o && PyObject_IsTrue(packed_o);
+
+  Py_BEGIN_ALLOW_THREADS
+  hashbits->partition->save_partitionmap(filename, packed);
+  Py_END_ALLOW_THREADS
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -2685,12 +3605,26 @@ static PyObject * hashbits_load_partitionmap(PyObject * self, PyObject * args)
   khmer::Hashbits * hashbits = me->hashbits;
 
   char * filename = NULL;
+  unsigned int n_threads = 1;
 
-  if (!PyArg_ParseTuple(args, "s", &filename)) {
+  if (!PyArg_ParseTuple(args, "s|I", &filename, &n_threads)) {
     return NULL;
   }
 
-  hashbits->partition->load_partitionmap(filename);
+  std::string error;
+
+  Py_BEGIN_ALLOW_THREADS
+  try {
+    hashbits->partition->load_partitionmap(filename, n_threads);
+  } catch (std::exception &e) {
+    error = e.what();
+  }
+  Py_END_ALLOW_THREADS
+
+  if (!error.empty()) {
+    PyErr_SetString(PyExc_IOError, error.c_str());
+    return NULL;
+  }
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -2784,7 +3718,11 @@ static PyObject * hashbits_load(PyObject * self, PyObject * args)
     return NULL;
   }
 
-  hashbits->load(filename);
+  try {
+    hashbits->load(filename);
+  } catch (std::bad_alloc &e) {
+    return PyErr_NoMemory();
+  }
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -2823,7 +3761,12 @@ static PyObject * hashbits_load_tagset(PyObject * self, PyObject * args)
   if (clear_tags_o && !PyObject_IsTrue(clear_tags_o)) {
     clear_tags = false;
   }
-  hashbits->load_tagset(filename, clear_tags);
+  try {
+    hashbits->load_tagset(filename, clear_tags);
+  } catch (std::exception &e) {
+    PyErr_SetString(PyExc_IOError, e.what());
+    return NULL;
+  }
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -2835,12 +3778,14 @@ static PyObject * hashbits_save_tagset(PyObject * self, PyObject * args)
   khmer::Hashbits * hashbits = me->hashbits;
 
   char * filename = NULL;
+  PyObject * packed_o = NULL;
 
-  if (!PyArg_ParseTuple(args, "s", &filename)) {
+  if (!PyArg_ParseTuple(args, "s|O", &filename, &packed_o)) {
     return NULL;
   }
 
-  hashbits->save_tagset(filename);
+  bool packed = packed_o && PyObject_IsTrue(packed_o);
+  hashbits->save_tagset(filename, packed);
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -2882,12 +3827,24 @@ static PyObject * hashbits_load_subset_partitionmap(PyObject * self, PyObject *
   khmer::SubsetPartition * subset_p;
   subset_p = new khmer::SubsetPartition(hashbits);
 
+  std::string error;
+
   Py_BEGIN_ALLOW_THREADS
 
-  subset_p->load_partitionmap(filename);
+  try {
+    subset_p->load_partitionmap(filename);
+  } catch (std::exception &e) {
+    error = e.what();
+  }
 
   Py_END_ALLOW_THREADS
 
+  if (!error.empty()) {
+    delete subset_p;
+    PyErr_SetString(PyExc_IOError, error.c_str());
+    return NULL;
+  }
+
   return PyCObject_FromVoidPtr(subset_p, free_subset_partition_info);
 }
 
@@ -2962,12 +3919,23 @@ static PyObject * hashbits_merge2_from_disk(PyObject * self, PyObject * args)
   khmer::SubsetPartition * subset1_p;
   subset1_p = (khmer::SubsetPartition *) PyCObject_AsVoidPtr(subset1_obj);
 
+  std::string error;
+
   Py_BEGIN_ALLOW_THREADS
 
-    subset1_p->merge_from_disk(filename);
+    try {
+      subset1_p->merge_from_disk(filename);
+    } catch (std::exception &e) {
+      error = e.what();
+    }
 
   Py_END_ALLOW_THREADS
 
+    if (!error.empty()) {
+      PyErr_SetString(PyExc_IOError, error.c_str());
+      return NULL;
+    }
+
     Py_INCREF(Py_None);
     return Py_None;
 }
@@ -3281,9 +4249,21 @@ static PyMethodDef khmer_hashbits_methods[] = {
   { "ksize", hashbits_get_ksize, METH_VARARGS, "" },
   { "hashsizes", hashbits_get_hashsizes, METH_VARARGS, "" },
   { "n_occupied", hashbits_n_occupied, METH_VARARGS, "Count the number of occupied bins" },
+  { "table_occupancy", hashbits_table_occupancy, METH_VARARGS, "Count the bits set in each table, optionally on several threads" },
+  { "recount_occupancy", hashbits_recount_occupancy, METH_VARARGS, "Recount the occupied bins from the tables; returns the total over all tables" },
+  { "set_union", hashbits_set_union, METH_VARARGS, "OR another table (or saved file) into this one, or into a third table 'into'" },
+  { "set_intersection", hashbits_set_intersection, METH_VARARGS, "AND another table (or saved file) into this one, or into a third table 'into'" },
+  { "set_difference", hashbits_set_difference, METH_VARARGS, "Clear the bits set in another table (or saved file), here or in a third table 'into'" },
+  { "empty_copy", hashbits_empty_copy, METH_VARARGS, "Create an empty table with the same layout" },
   { "n_unique_kmers", hashbits_n_unique_kmers,  METH_VARARGS, "Count the number of unique kmers" },
+  { "estimated_fp_rate", hashbits_estimated_fp_rate, METH_VARARGS, "Estimate the false positive rate from how full the table is" },
+  { "enable_adjacency_cache", hashbits_enable_adjacency_cache, METH_VARARGS, "Cache the neighbors of each k-mer visited, in at most max_bytes of memory" },
+  { "disable_adjacency_cache", hashbits_disable_adjacency_cache, METH_VARARGS, "Drop the neighbor cache" },
+  { "fill_adjacency_cache", hashbits_fill_adjacency_cache, METH_VARARGS, "Fill the neighbor cache by traversing out to radius from every tag; returns the number of k-mers visited" },
+  { "adjacency_cache_stats", hashbits_adjacency_cache_stats, METH_VARARGS, "Return (n_slots, n_lookups, n_hits, hit_rate) for the neighbor cache, or None" },
   { "count", hashbits_count, METH_VARARGS, "Count the given kmer" },
   { "count_overlap", hashbits_count_overlap,METH_VARARGS,"Count overlap kmers in two datasets" },
+  { "count_overlap_panel", hashbits_count_overlap_panel, METH_VARARGS, "Consume a file, counting its new k-mers and how many are in each of a list of tables, in one pass; returns (n_unique, [n_overlap per table], [(n_reads, n_unique, [n_overlap per table]), ...])" },
   { "consume", hashbits_consume, METH_VARARGS, "Count all k-mers in the given string" },
   { "load_stop_tags", hashbits_load_stop_tags, METH_VARARGS, "" },
   { "save_stop_tags", hashbits_save_stop_tags, METH_VARARGS, "" },
@@ -3292,15 +4272,21 @@ static PyMethodDef khmer_hashbits_methods[] = {
   { "get", hashbits_get, METH_VARARGS, "Get the count for the given k-mer" },
   { "calc_connected_graph_size", hashbits_calc_connected_graph_size, METH_VARARGS, "" },
   { "kmer_degree", hashbits_kmer_degree, METH_VARARGS, "" },
+  { "build_unitig_index", hashbits_build_unitig_index, METH_VARARGS, "Compact the graph within radius of the tags into unitigs (optionally giving up after max_unitigs); returns the number of unitigs" },
+  { "clear_unitig_index", hashbits_clear_unitig_index, METH_VARARGS, "Drop the unitig index" },
+  { "get_unitig", hashbits_get_unitig, METH_VARARGS, "Return (id, length, left end, right end, [tags]) for the unitig with this k-mer as an end or a tag, or None" },
   { "trim_on_degree", hashbits_trim_on_degree, METH_VARARGS, "" },
   { "trim_on_sodd", hashbits_trim_on_sodd, METH_VARARGS, "" },
   { "trim_on_stoptags", hashbits_trim_on_stoptags, METH_VARARGS, "" },
   { "identify_stoptags_by_position", hashbits_identify_stoptags_by_position, METH_VARARGS, "" },
   { "trim_on_density_explosion", hashbits_trim_on_density_explosion, METH_VARARGS, "" },
   { "do_subset_partition", hashbits_do_subset_partition, METH_VARARGS, "" },
+  { "do_parallel_partition", hashbits_do_parallel_partition, METH_VARARGS, "Partition all the tags into this table's partition map, on n_threads threads" },
+  { "refine_streaming_partition", hashbits_refine_streaming_partition, METH_VARARGS, "Finish the partitions made by consume_fasta_and_partition, on n_threads threads; returns the number of tags searched from" },
   { "find_all_tags", hashbits_find_all_tags, METH_VARARGS, "" },
   { "assign_partition_id", hashbits_assign_partition_id, METH_VARARGS, "" },
   { "output_partitions", hashbits_output_partitions, METH_VARARGS, "" },
+  { "output_partition_buckets", hashbits_output_partition_buckets, METH_VARARGS, "Write the reads in a file into <prefix>.bucketN.part files, by partition ID mod n_buckets" },
   { "find_unpart", hashbits_find_unpart, METH_VARARGS, "" },
   { "filter_if_present", hashbits_filter_if_present, METH_VARARGS, "" },
   { "add_tag", hashbits_add_tag, METH_VARARGS, "" },
@@ -3320,6 +4306,7 @@ static PyMethodDef khmer_hashbits_methods[] = {
   { "_set_tag_density", hashbits__set_tag_density, METH_VARARGS, "" },
   { "consume_fasta", hashbits_consume_fasta, METH_VARARGS, "Count all k-mers in a given file" },
   { "consume_fasta_and_tag", hashbits_consume_fasta_and_tag, METH_VARARGS, "Count all k-mers in a given file" },
+  { "consume_fasta_and_partition", hashbits_consume_fasta_and_partition, METH_VARARGS, "Count and tag all k-mers in a given file, partitioning as it goes" },
   { "traverse_from_reads", hashbits_traverse_from_reads, METH_VARARGS, "" },
   { "consume_fasta_and_traverse", hashbits_consume_fasta_and_traverse, METH_VARARGS, "" },
   { "consume_fasta_and_tag_with_stoptags", hashbits_consume_fasta_and_tag_with_stoptags, METH_VARARGS, "Count all k-mers in a given file" },
@@ -3327,6 +4314,7 @@ static PyMethodDef khmer_hashbits_methods[] = {
   { "join_partitions_by_path", hashbits_join_partitions_by_path, METH_VARARGS, "" },
   { "merge_subset", hashbits_merge_subset, METH_VARARGS, "" },
   { "merge_subset_from_disk", hashbits_merge_from_disk, METH_VARARGS, "" },
+  { "merge_partitionmap_files", hashbits_merge_partitionmap_files, METH_VARARGS, "Merge saved partition maps into one new file, streaming them in tag order" },
   { "count_partitions", hashbits_count_partitions, METH_VARARGS, "" },
   { "subset_count_partitions", hashbits_subset_count_partitions, METH_VARARGS, "" },
   { "subset_partition_size_distribution", hashbits_subset_partition_size_distribution, METH_VARARGS, "" },
@@ -3344,7 +4332,7 @@ static PyMethodDef khmer_hashbits_methods[] = {
   { "find_radius_for_volume", hashbits_find_radius_for_volume, METH_VARARGS, "" },
   { "hitraverse_to_stoptags", hashbits_hitraverse_to_stoptags, METH_VARARGS, "" },
   { "traverse_from_tags", hashbits_traverse_from_tags, METH_VARARGS, "" },
-  { "repartition_largest_partition", hashbits_repartition_largest_partition, METH_VARARGS, "" },
+  { "repartition_largest_partition", hashbits_repartition_largest_partition, METH_VARARGS, "Find knots in the largest partition, traversing from its tags on n_threads threads, and repartition it" },
   { "get_median_count", hashbits_get_median_count, METH_VARARGS, "Get the median, average, and stddev of the k-mer counts in the string" },
 
   {NULL, NULL, 0, NULL}           /* sentinel */
@@ -3364,11 +4352,31 @@ static PyObject* _new_hashbits(PyObject * self, PyObject * args)
 {
   unsigned int k = 0;
   PyObject* sizes_list_o = NULL;
+  unsigned long long max_memory = 0;
+  double target_fp = DEFAULT_TARGET_FP;
 
-  if (!PyArg_ParseTuple(args, "IO", &k, &sizes_list_o)) {
+  if (!PyArg_ParseTuple(args, "IO|Ld", &k, &sizes_list_o, &max_memory,
+			&target_fp)) {
     return NULL;
   }
 
+  // "auto" sizing, from a cardinality estimate.
+  if (is_hllcounter_obj(sizes_list_o)) {
+    khmer::HLLCounter * hll = ((khmer_HLLCounterObject *) sizes_list_o)->hll;
+    if (target_fp <= 0 || target_fp >= 1) {
+      PyErr_SetString(PyExc_ValueError, "target_fp must be in (0, 1)");
+      return NULL;
+    }
+
+    khmer_KHashbitsObject * khashbits_obj = (khmer_KHashbitsObject *) \
+      PyObject_New(khmer_KHashbitsObject, &khmer_KHashbitsType);
+
+    khashbits_obj->hashbits = new khmer::Hashbits(k, *hll, max_memory,
+						  target_fp);
+
+    return (PyObject *) khashbits_obj;
+  }
+
   std::vector<khmer::HashIntoType> sizes;
   for (int i = 0; i < PyObject_Length(sizes_list_o); i++) {
     PyObject * size_o = PyList_GET_ITEM(sizes_list_o, i);
@@ -3383,6 +4391,36 @@ static PyObject* _new_hashbits(PyObject * self, PyObject * args)
   return (PyObject *) khashbits_obj;
 }
 
+static PyObject* _new_blocked_hashbits(PyObject * self, PyObject * args)
+{
+  unsigned int k = 0;
+  unsigned long long n_bits = 0;
+  unsigned int n_hashes = 0;
+
+  if (!PyArg_ParseTuple(args, "IKI", &k, &n_bits, &n_hashes)) {
+    return NULL;
+  }
+
+  if (n_hashes < 1 || n_hashes > MAX_BLOCK_HASHES) {
+    PyErr_SetString(PyExc_ValueError, "bad number of hashes");
+    return NULL;
+  }
+
+  khmer::BlockedHashbits * hashbits;
+  try {
+    hashbits = new khmer::BlockedHashbits(k, n_bits, n_hashes);
+  } catch (std::bad_alloc &e) {
+    return PyErr_NoMemory();
+  }
+
+  khmer_KHashbitsObject * khashbits_obj = (khmer_KHashbitsObject *) \
+    PyObject_New(khmer_KHashbitsObject, &khmer_KHashbitsType);
+
+  khashbits_obj->hashbits = hashbits;
+
+  return (PyObject *) khashbits_obj;
+}
+
 static PyObject * hash_collect_high_abundance_kmers(PyObject * self, PyObject * args)
 {
   khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
@@ -3408,7 +4446,8 @@ static PyObject * hash_collect_high_abundance_kmers(PyObject * self, PyObject *
 
   // ...and set the collected kmers as the stoptags.
   khashbits_obj->hashbits = new khmer::Hashbits(counting->ksize(), sizes);
-  khashbits_obj->hashbits->stop_tags.swap(found_kmers);
+  khashbits_obj->hashbits->stop_tags.insert(found_kmers.begin(),
+					     found_kmers.end());
 
   return (PyObject *) khashbits_obj;
 }
@@ -3566,7 +4605,12 @@ static PyObject * readmask_load(PyObject * self, PyObject * args)
     return NULL;
   }
 
-  mask->load(filename);
+  try {
+    mask->load(filename);
+  } catch (std::exception &e) {
+    PyErr_SetString(PyExc_IOError, e.what());
+    return NULL;
+  }
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -3881,9 +4925,241 @@ static void khmer_minmax_dealloc(PyObject* self)
 }
 
 
+//
+// HLLCounter object
+//
+
+static PyObject * hllcounter_add(PyObject * self, PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+  khmer::HLLCounter * hll = me->hll;
+
+  char * kmer;
+
+  if (!PyArg_ParseTuple(args, "s", &kmer)) {
+    return NULL;
+  }
+
+  if (strlen(kmer) != hll->ksize()) {
+    PyErr_SetString(PyExc_ValueError,
+		    "k-mer length must be the same as the counter k-size");
+    return NULL;
+  }
+
+  hll->add(khmer::_hash(kmer, hll->ksize()));
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hllcounter_consume(PyObject * self, PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+  khmer::HLLCounter * hll = me->hll;
+
+  char * seq;
+
+  if (!PyArg_ParseTuple(args, "s", &seq)) {
+    return NULL;
+  }
+
+  if (strlen(seq) < hll->ksize()) {
+    PyErr_SetString(PyExc_ValueError,
+		    "string length must >= the counter k-mer size");
+    return NULL;
+  }
+
+  unsigned int n_consumed = hll->consume_string(seq);
+
+  return PyInt_FromLong(n_consumed);
+}
+
+static PyObject * hllcounter_consume_fasta(PyObject * self, PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+  khmer::HLLCounter * hll = me->hll;
+
+  char * filename;
+  unsigned int max_reads = 0;
+  PyObject * callback_obj = NULL;
+
+  if (!PyArg_ParseTuple(args, "s|IO", &filename, &max_reads,
+			&callback_obj)) {
+    return NULL;
+  }
+
+  unsigned long long n_consumed;
+  unsigned int total_reads;
+
+  try {
+    hll->consume_fasta(filename, total_reads, n_consumed, max_reads,
+		       _report_fn, callback_obj);
+  } catch (_khmer_signal &e) {
+    return NULL;
+  }
+
+  return Py_BuildValue("iL", total_reads, n_consumed);
+}
+
+static PyObject * hllcounter_estimate_cardinality(PyObject * self,
+						  PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+  khmer::HLLCounter * hll = me->hll;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyLong_FromUnsignedLongLong(hll->estimate_cardinality());
+}
+
+static PyObject * hllcounter_error_rate(PyObject * self, PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+  khmer::HLLCounter * hll = me->hll;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyFloat_FromDouble(hll->error_rate());
+}
+
+static PyObject * hllcounter_merge(PyObject * self, PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+  khmer::HLLCounter * hll = me->hll;
+
+  PyObject * other_o;
+
+  if (!PyArg_ParseTuple(args, "O", &other_o)) {
+    return NULL;
+  }
+
+  if (!is_hllcounter_obj(other_o)) {
+    PyErr_SetString(PyExc_TypeError, "argument must be an HLLCounter");
+    return NULL;
+  }
+
+  khmer::HLLCounter * other = ((khmer_HLLCounterObject *) other_o)->hll;
+  if (other->ksize() != hll->ksize() ||
+      other->precision() != hll->precision()) {
+    PyErr_SetString(PyExc_ValueError,
+		    "can only merge counters with the same k and precision");
+    return NULL;
+  }
+
+  hll->merge(*other);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hllcounter_ksize(PyObject * self, PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+  khmer::HLLCounter * hll = me->hll;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyInt_FromLong(hll->ksize());
+}
+
+static PyMethodDef khmer_hllcounter_methods[] = {
+  { "add", hllcounter_add, METH_VARARGS, "Add a single k-mer" },
+  { "consume", hllcounter_consume, METH_VARARGS, "Add all k-mers in the given string" },
+  { "consume_fasta", hllcounter_consume_fasta, METH_VARARGS, "Add all k-mers in the given file, optionally stopping after max_reads reads" },
+  { "estimate_cardinality", hllcounter_estimate_cardinality, METH_VARARGS, "Estimate the number of distinct k-mers seen" },
+  { "error_rate", hllcounter_error_rate, METH_VARARGS, "Expected relative error of the estimate" },
+  { "merge", hllcounter_merge, METH_VARARGS, "Merge another counter into this one" },
+  { "ksize", hllcounter_ksize, METH_VARARGS, "" },
+  {NULL, NULL, 0, NULL}           /* sentinel */
+};
+
+static PyObject *
+khmer_hllcounter_getattr(PyObject * obj, char * name)
+{
+  return Py_FindMethod(khmer_hllcounter_methods, obj, name);
+}
+
+//
+// new_hllcounter
+//
+
+static PyObject* new_hllcounter(PyObject * self, PyObject * args)
+{
+  unsigned int k = 0;
+  unsigned int p = DEFAULT_HLL_PRECISION;
+
+  if (!PyArg_ParseTuple(args, "I|I", &k, &p)) {
+    return NULL;
+  }
+
+  if (p < 4 || p > 18) {
+    PyErr_SetString(PyExc_ValueError, "precision must be between 4 and 18");
+    return NULL;
+  }
+
+  khmer_HLLCounterObject * hll_obj = (khmer_HLLCounterObject *) \
+    PyObject_New(khmer_HLLCounterObject, &khmer_HLLCounterType);
+
+  hll_obj->hll = new khmer::HLLCounter(k, p);
+
+  return (PyObject *) hll_obj;
+}
+
+//
+// khmer_hllcounter_dealloc -- clean up an HLLCounter object.
+//
+
+static void khmer_hllcounter_dealloc(PyObject* self)
+{
+  khmer_HLLCounterObject * obj = (khmer_HLLCounterObject *) self;
+  delete obj->hll;
+  obj->hll = NULL;
+  
+  PyObject_Del((PyObject *) obj);
+}
+
 //////////////////////////////
 // standalone functions
 
+static PyObject * choose_table_sizes(PyObject * self, PyObject * args)
+{
+  unsigned long long n_unique_kmers;
+  unsigned long long max_memory = 0;
+  double target_fp = DEFAULT_TARGET_FP;
+  unsigned int bits_per_bin = 1;
+
+  if (!PyArg_ParseTuple(args, "L|LdI", &n_unique_kmers, &max_memory,
+			&target_fp, &bits_per_bin)) {
+    return NULL;
+  }
+
+  if (target_fp <= 0 || target_fp >= 1) {
+    PyErr_SetString(PyExc_ValueError, "target_fp must be in (0, 1)");
+    return NULL;
+  }
+  if (bits_per_bin == 0) {
+    PyErr_SetString(PyExc_ValueError, "bits_per_bin must be > 0");
+    return NULL;
+  }
+
+  std::vector<khmer::HashIntoType> sizes;
+  double fp = khmer::choose_table_sizes(n_unique_kmers, max_memory,
+					target_fp, bits_per_bin, sizes);
+
+  PyObject * sizes_o = PyList_New(sizes.size());
+  for (unsigned int i = 0; i < sizes.size(); i++) {
+    PyList_SET_ITEM(sizes_o, i, PyLong_FromUnsignedLongLong(sizes[i]));
+  }
+
+  return Py_BuildValue("Nd", sizes_o, fp);
+}
+
 static PyObject * forward_hash(PyObject * self, PyObject * args)
 {
   char * kmer;
@@ -3961,13 +5237,174 @@ static PyObject * set_reporting_callback(PyObject * self, PyObject * args)
 // Module machinery.
 //
 
+static PyObject * count_intersection(PyObject * self, PyObject * args)
+{
+  PyObject * a_o, * b_o;
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "OO|I", &a_o, &b_o, &n_threads)) {
+    return NULL;
+  }
+
+  khmer::BitArrays a, b;
+  khmer::HashbitsFile * a_file, * b_file;
+  if (!_get_bit_arrays(a_o, a, a_file)) {
+    return NULL;
+  }
+  if (!_get_bit_arrays(b_o, b, b_file)) {
+    delete a_file;
+    return NULL;
+  }
+
+  if (!a.same_layout(b)) {
+    delete a_file;
+    delete b_file;
+    PyErr_SetString(PyExc_ValueError,
+		    "tables must have the same type, k and table sizes");
+    return NULL;
+  }
+
+  std::vector<khmer::HashIntoType> n_set;
+  std::vector<khmer::Byte *> no_out;
+
+  Py_BEGIN_ALLOW_THREADS
+
+    khmer::sweep_bits(BITS_INTERSECTION, a, &b, no_out, n_set, n_threads);
+
+  Py_END_ALLOW_THREADS
+
+  PyObject * x = PyList_New(n_set.size());
+  for (unsigned int i = 0; i < n_set.size(); i++) {
+    PyList_SET_ITEM(x, i, Py_BuildValue("KIK", a.n_bits[i],
+					a.bits_per_kmer[i], n_set[i]));
+  }
+
+  delete a_file;
+  delete b_file;
+
+  return x;
+}
+
+static PyObject * tag_file_contains(PyObject * self, PyObject * args)
+{
+  char * filename = NULL;
+  PyObject * kmers_o = NULL;
+
+  if (!PyArg_ParseTuple(args, "sO", &filename, &kmers_o)) {
+    return NULL;
+  }
+
+  if (!PySequence_Check(kmers_o)) {
+    PyErr_SetString(PyExc_TypeError, "expected a list of k-mers");
+    return NULL;
+  }
+
+  khmer::TagFile tagfile(filename);
+  if (!tagfile.is_open()) {
+    PyErr_SetString(PyExc_IOError, "cannot map packed tag file");
+    return NULL;
+  }
+
+  Py_ssize_t n = PySequence_Size(kmers_o);
+  PyObject * x = PyList_New(n);
+  for (Py_ssize_t i = 0; i < n; i++) {
+    PyObject * kmer_o = PySequence_GetItem(kmers_o, i);
+    const char * kmer = kmer_o ? PyString_AsString(kmer_o) : NULL;
+
+    if (kmer && strlen(kmer) != tagfile.ksize()) {
+      PyErr_SetString(PyExc_ValueError,
+		      "k-mer length must be the same as the tag file k-size");
+      kmer = NULL;
+    }
+    if (!kmer) {
+      Py_XDECREF(kmer_o);
+      Py_DECREF(x);
+      return NULL;
+    }
+
+    bool found = tagfile.contains(khmer::_hash(kmer, tagfile.ksize()));
+    Py_DECREF(kmer_o);
+
+    PyList_SET_ITEM(x, i, PyBool_FromLong(found));
+  }
+
+  return x;
+}
+
+static PyObject * extract_partitions(PyObject * self, PyObject * args)
+{
+  char * prefix = NULL;
+  PyObject * filenames_o = NULL;
+  unsigned long long max_size = 0;
+  unsigned int min_part_size = 0;
+  PyObject * output_groups_o = NULL;
+  PyObject * output_unassigned_o = NULL;
+  PyObject * gzip_o = NULL;
+  PyObject * callback_obj = NULL;
+
+  if (!PyArg_ParseTuple(args, "sOKI|OOOO", &prefix, &filenames_o,
+			&max_size, &min_part_size, &output_groups_o,
+			&output_unassigned_o, &gzip_o, &callback_obj)) {
+    return NULL;
+  }
+
+  bool output_groups = !output_groups_o || PyObject_IsTrue(output_groups_o);
+  bool output_unassigned = output_unassigned_o &&
+    PyObject_IsTrue(output_unassigned_o);
+  bool gzip = gzip_o && PyObject_IsTrue(gzip_o);
+
+  if (!PySequence_Check(filenames_o)) {
+    PyErr_SetString(PyExc_TypeError, "expected a list of filenames");
+    return NULL;
+  }
+
+  std::vector<std::string> filenames;
+  for (Py_ssize_t i = 0; i < PySequence_Length(filenames_o); i++) {
+    PyObject * o = PySequence_GetItem(filenames_o, i);
+    const char * filename = o ? PyString_AsString(o) : NULL;
+    if (filename) {
+      filenames.push_back(filename);
+    }
+    Py_XDECREF(o);
+
+    if (!filename) {
+      return NULL;
+    }
+    if (!std::ifstream(filename).good()) {
+      PyErr_Format(PyExc_IOError, "cannot open '%s'", filename);
+      return NULL;
+    }
+  }
+
+  unsigned int n_groups = 0;
+  try {
+    n_groups = khmer::extract_partitions(filenames, prefix, max_size,
+					 min_part_size, output_groups,
+					 output_unassigned, gzip,
+					 _report_fn, callback_obj);
+  } catch (_khmer_signal &e) {
+    return NULL;
+  } catch (std::exception &e) {
+    PyErr_SetString(PyExc_IOError, e.what());
+    return NULL;
+  }
+
+  return PyInt_FromLong(n_groups);
+}
+
 static PyMethodDef KhmerMethods[] = {
-  { "new_ktable", new_ktable, METH_VARARGS, "Create an empty ktable" },
+  { "new_ktable", new_ktable, METH_VARARGS, "Create an empty ktable; new_ktable(k, True) only stores the k-mers that occur" },
   { "new_hashtable", new_hashtable, METH_VARARGS, "Create an empty single-table counting hash" },
   { "_new_counting_hash", _new_counting_hash, METH_VARARGS, "Create an empty counting hash" },
   { "_new_hashbits", _new_hashbits, METH_VARARGS, "Create an empty hashbits table" },
+  { "_new_blocked_hashbits", _new_blocked_hashbits, METH_VARARGS, "Create an empty blocked Bloom filter, with n_bits bits & n_hashes hashes" },
+  { "count_intersection", count_intersection, METH_VARARGS, "Count the bits set in both of two tables or saved files, without loading the files; returns (n_bits, bits_per_kmer, n_both) for each table" },
+  { "extract_partitions", extract_partitions, METH_VARARGS, "Group the reads in partition-annotated files into <prefix>.groupNNNN.fa files of at most max_size reads, by partition size; returns the number of groups" },
+  { "tag_file_contains", tag_file_contains, METH_VARARGS, "Look k-mers up in a packed tag or stop tag file (see save_tagset), without loading it; returns a list of bools" },
   { "new_readmask", new_readmask, METH_VARARGS, "Create a new read mask table" },
   { "new_minmax", new_minmax, METH_VARARGS, "Create a new min/max value table" },
+  { "new_hllcounter", new_hllcounter, METH_VARARGS, "Create a new HyperLogLog distinct k-mer counter" },
+  { "choose_table_sizes", choose_table_sizes, METH_VARARGS, "Pick table sizes for a target false positive rate & memory budget" },
   { "consume_genome", consume_genome, METH_VARARGS, "Create a new ktable from a genome" },
   { "forward_hash", forward_hash, METH_VARARGS, "", },
   { "forward_hash_no_rc", forward_hash_no_rc, METH_VARARGS, "", },
@@ -3988,4 +5425,11 @@ DL_EXPORT(void) init_khmer(void)
   Py_INCREF(KhmerError);
 
   PyModule_AddObject(m, "error", KhmerError);
+
+  PyModule_AddIntConstant(m, "SAVED_HASHBITS", SAVED_HASHBITS);
+  PyModule_AddIntConstant(m, "SAVED_BLOCKED_HASHBITS", SAVED_BLOCKED_HASHBITS);
+  PyModule_AddIntConstant(m, "SCAN_MINMAX", SCAN_MINMAX);
+  PyModule_AddIntConstant(m, "SCAN_ABUNDANCE", SCAN_ABUNDANCE);
+  PyModule_AddIntConstant(m, "SCAN_POSITION_COUNTS", SCAN_POSITION_COUNTS);
+  PyModule_AddIntConstant(m, "SCAN_POSITION_FREQ", SCAN_POSITION_FREQ);
 }
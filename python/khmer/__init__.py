@@ -1,32 +1,98 @@
 __version__ = "0.4"
 
 import _khmer
+import math
 from _khmer import new_ktable
 from _khmer import new_hashtable
 from _khmer import _new_counting_hash
-from _khmer import _new_hashbits
+from _khmer import _new_hashbits, _new_blocked_hashbits
+from _khmer import SAVED_HASHBITS, SAVED_BLOCKED_HASHBITS
 from _khmer import new_readmask
 from _khmer import new_minmax
+from _khmer import new_hllcounter
+from _khmer import choose_table_sizes
+from _khmer import SCAN_MINMAX, SCAN_ABUNDANCE, SCAN_POSITION_COUNTS, \
+     SCAN_POSITION_FREQ
 from _khmer import consume_genome
 from _khmer import forward_hash, forward_hash_no_rc, reverse_hash
 from _khmer import set_reporting_callback
+from _khmer import count_intersection
+from _khmer import tag_file_contains
+from _khmer import extract_partitions
 
-from filter_utils import filter_fasta_file_any, filter_fasta_file_all, filter_fasta_file_limit_n
+from filter_utils import filter_fasta_file_any, filter_fasta_file_all, \
+     filter_fasta_file_limit_n, filter_fasta_file_run
 
 ###
 
-def new_hashbits(k, starting_size, n_tables=2):
+DEFAULT_TARGET_FP = 0.01
+
+def new_hashbits(k, starting_size, n_tables=2, filenames=None,
+                 max_memory=0, target_fp=DEFAULT_TARGET_FP):
+    """
+    Create a Bloom filter.  If starting_size is 'auto', the number and
+    size of the tables are picked from a distinct k-mer estimate over
+    'filenames' to reach target_fp within max_memory bytes (0 => no
+    limit); n_tables is then ignored.  starting_size may also be an
+    HLLCounter that has already seen the data.
+    """
+    if starting_size == 'auto':
+        starting_size = estimate_kmer_cardinality(k, filenames)
+    if not isinstance(starting_size, (int, long, float)):
+        return _new_hashbits(k, starting_size, int(max_memory), target_fp)
+
     primes = get_n_primes_above_x(n_tables, starting_size)
     
     return _new_hashbits(k, primes)
 
-def new_counting_hash(k, starting_size, n_tables=2):
+def new_blocked_hashbits(k, starting_size, n_tables=2):
+    """
+    Create a blocked Bloom filter using the same memory as
+    new_hashbits(k, starting_size, n_tables), but with all n_tables bits
+    for a k-mer in one cache line.
+    """
+    return _new_blocked_hashbits(k, long(starting_size) * n_tables, n_tables)
+
+def new_counting_hash(k, starting_size, n_tables=2, filenames=None,
+                      max_memory=0, target_fp=DEFAULT_TARGET_FP):
+    """
+    Create a counting Bloom filter; see new_hashbits for 'auto' sizing.
+    """
+    if starting_size == 'auto':
+        starting_size = estimate_kmer_cardinality(k, filenames)
+    if not isinstance(starting_size, (int, long, float)):
+        return _new_counting_hash(k, starting_size, int(max_memory),
+                                  target_fp)
+
     primes = get_n_primes_above_x(n_tables, starting_size)
     
     return _new_counting_hash(k, primes)
 
+def estimate_kmer_cardinality(k, filenames, max_reads=0):
+    """
+    Run a HyperLogLog pre-pass over the given files & return the counter;
+    use counter.estimate_cardinality() for the number of distinct k-mers.
+    If max_reads is set, only that many reads from each file are used.
+    """
+    if not filenames:
+        raise ValueError("'auto' sizing needs the input filenames")
+
+    hll = new_hllcounter(k)
+    for filename in filenames:
+        hll.consume_fasta(filename, max_reads)
+
+    return hll
+
 def load_hashbits(filename):
-    ht = _new_hashbits(1, [1])
+    # the second byte of the file says which kind of table it is.
+    fp = open(filename, 'rb')
+    header = fp.read(2)
+    fp.close()
+
+    if len(header) == 2 and ord(header[1]) == SAVED_BLOCKED_HASHBITS:
+        ht = _new_blocked_hashbits(1, 1, 1)
+    else:
+        ht = _new_hashbits(1, [1])
     ht.load(filename)
 
     return ht
@@ -59,6 +125,34 @@ def calc_expected_collisions(ht):
 
     return fp_all
 
+def _kmers_from_bits(n_bits, bits_per_kmer, n_set):
+    # the number of k-mers that would leave n_set of n_bits bits set.
+    if n_set >= n_bits:
+        raise ValueError("table is full")
+    return math.log(1 - float(n_set) / n_bits) / \
+           (bits_per_kmer * math.log(1 - 1.0 / n_bits))
+
+def estimate_overlap(a, b, n_threads=1):
+    """
+    Estimate the number of k-mers in both a and b from the bits alone;
+    each may be a hashbits object or the name of a saved hashbits file.
+    Tables must have the same layout.  Uses the largest table.
+    """
+    a_bits = count_intersection(a, a, n_threads)
+    b_bits = count_intersection(b, b, n_threads)
+    ab_bits = count_intersection(a, b, n_threads)
+
+    i = max(range(len(ab_bits)), key=lambda i: ab_bits[i][0])
+    n_bits, bits_per_kmer, n_both = ab_bits[i]
+    n_a = a_bits[i][2]
+    n_b = b_bits[i][2]
+
+    in_a = _kmers_from_bits(n_bits, bits_per_kmer, n_a)
+    in_b = _kmers_from_bits(n_bits, bits_per_kmer, n_b)
+    in_either = _kmers_from_bits(n_bits, bits_per_kmer, n_a + n_b - n_both)
+
+    return max(in_a + in_b - in_either, 0)
+
 ###
 
 class KmerCount(object):
@@ -1,23 +1,15 @@
-def filter_fasta_file_any(ht, filename, total_reads, outname, threshold):
-    minmax = ht.fasta_file_to_minmax(filename, total_reads)
-    readmask = ht.filter_fasta_file_any(minmax, threshold)
-
-    n_kept = readmask.filter_fasta_file(filename, outname)
+# These all run as a single pass over the reads (see ht.filter_reads);
+# total_reads is no longer needed, but is kept for compatibility.
 
-    return total_reads, n_kept
+def filter_fasta_file_any(ht, filename, total_reads, outname, threshold):
+    return ht.filter_reads(filename, outname, 0, threshold, 0, 0, 0, 0)
 
 def filter_fasta_file_all(ht, filename, total_reads, outname, threshold):
-    minmax = ht.fasta_file_to_minmax(filename, total_reads)
-    readmask = ht.filter_fasta_file_all(minmax, threshold)
-
-    n_kept = readmask.filter_fasta_file(filename, outname)
-
-    return total_reads, n_kept
+    return ht.filter_reads(filename, outname, threshold, 0, 0, 0, 0, 0)
 
 def filter_fasta_file_limit_n(ht, filename, total_reads, outname, threshold, n):
-    minmax = ht.fasta_file_to_minmax(filename, total_reads)
-    readmask = ht.filter_fasta_file_limit_n(filename, minmax, threshold, n)
-
-    n_kept = readmask.filter_fasta_file(filename, outname)
+    return ht.filter_reads(filename, outname, 0, 0, 0, 0, threshold, n)
 
-    return total_reads, n_kept
+def filter_fasta_file_run(ht, filename, total_reads, outname, threshold,
+                          runlength):
+    return ht.filter_reads(filename, outname, 0, 0, threshold, runlength, 0, 0)
@@ -25,5 +25,10 @@ def build_construct_args():
     parser.add_argument('--hashsize', '-x', type=float, dest='min_hashsize',
                         default=env_hashsize,
                         help='lower bound on hashsize to use')
+    parser.add_argument('--max-memory-usage', '-M', type=float,
+                        dest='max_memory_usage', default=0,
+                        help='size the tables automatically (ignoring -N '
+                        'and -x) from a pre-pass over the input, using at '
+                        'most this many bytes')
 
     return parser
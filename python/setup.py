@@ -3,15 +3,20 @@ from distutils.core import setup, Extension
 # the c++ extension module (needs to be linked in with ktable.o ...)
 extension_mod = Extension("khmer._khmermodule",
                           ["_khmermodule.cc"],
-                          extra_compile_args=['-g'],
+                          extra_compile_args=['-g', '-pthread'],
+                          extra_link_args=['-pthread'],
                           include_dirs=['../lib',],
                           library_dirs=['../lib',],
                           extra_objects=['../lib/ktable.o',
                                          '../lib/hashtable.o',
+                                         '../lib/hllcounter.o',
                                          '../lib/parsers.o',
+                                         '../lib/threads.o',
                                          '../lib/hashbits.o',
                                          '../lib/counting.o',
                                          '../lib/subset.o',
+                                         '../lib/unitigs.o',
+                                         '../lib/tagset.o',
                                          '../lib/zlib-1.2.3/adler32.o',
                                          '../lib/zlib-1.2.3/compress.o',
                                          '../lib/zlib-1.2.3/crc32.o',
@@ -29,12 +34,21 @@ extension_mod = Extension("khmer._khmermodule",
                                    '../lib/ktable.hh',
                                    '../lib/hashtable.hh',
                                    '../lib/counting.hh',
+                                   '../lib/hllcounter.hh',
+                                   '../lib/threads.hh',
+                                   '../lib/tagset.hh',
+                                   '../lib/traversal.hh',
+                                   '../lib/unitigs.hh',
                                    '../lib/hashtable.o',
+                                   '../lib/hllcounter.o',
                                    '../lib/ktable.o',
                                    '../lib/parsers.o',
+                                   '../lib/threads.o',
                                    '../lib/hashbits.o',
                                    '../lib/counting.o',
                                    '../lib/subset.o',
+                                   '../lib/unitigs.o',
+                                   '../lib/tagset.o',
                                    '../lib/zlib-1.2.3/adler32.o',
                                    '../lib/zlib-1.2.3/compress.o',
                                    '../lib/zlib-1.2.3/crc32.o',
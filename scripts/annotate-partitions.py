@@ -4,7 +4,9 @@ Annotate sequences with partition numbers.
 
 % python scripts/annotate-partitions.py <pmap_file> <file1> [ <file2> ... ]
 
-Partition-annotated sequences will be in <fileN>.part.
+Partition-annotated sequences will be in <fileN>.part, or, with
+'--buckets N', in <fileN>.bucket0.part ... <fileN>.bucketN-1.part, each
+holding whole partitions.
 
 Use '-h' for parameter help.
 """
@@ -15,12 +17,19 @@ import argparse
 import khmer
 
 DEFAULT_K=32
+DEFAULT_N_THREADS=1
 
 def main():
     parser = argparse.ArgumentParser(description="Annotate seqs with partitions.")
 
     parser.add_argument('--ksize', '-k', type=int, default=DEFAULT_K,
                         help="k-mer size (default: %d)" % DEFAULT_K)
+    parser.add_argument('--threads', '-T', dest='n_threads', type=int,
+                        default=DEFAULT_N_THREADS,
+                        help='Number of threads to use')
+    parser.add_argument('--buckets', '-b', dest='n_buckets', type=int,
+                        default=0,
+                        help='Split the output into this many files')
     parser.add_argument('graphbase')
     parser.add_argument('input_filenames', nargs='+')
 
@@ -32,14 +41,22 @@ def main():
     partitionmap_file = args.graphbase + '.pmap.merged'
 
     print 'loading partition map from:', partitionmap_file
-    ht.load_partitionmap(partitionmap_file)
+    ht.load_partitionmap(partitionmap_file, args.n_threads)
 
     for infile in args.input_filenames:
         print 'outputting partitions for', infile
-        outfile = os.path.basename(infile) + '.part'
-        n = ht.output_partitions(infile, outfile)
-        print 'output %d partitions for %s' % (n, infile)
-        print 'partitions are in', outfile
+        if args.n_buckets:
+            prefix = os.path.basename(infile)
+            n = ht.output_partition_buckets(infile, prefix, args.n_buckets,
+                                            False, None, args.n_threads)
+            print 'output %d partitions for %s' % (n, infile)
+            print 'partitions are in %s.bucket*.part' % prefix
+        else:
+            outfile = os.path.basename(infile) + '.part'
+            n = ht.output_partitions(infile, outfile, False, None,
+                                     args.n_threads)
+            print 'output %d partitions for %s' % (n, infile)
+            print 'partitions are in', outfile
 
 if __name__ == '__main__':
     main()
@@ -4,7 +4,8 @@ Extract partitioned sequences into files grouped by partition size.
 
 % python scripts/extract-partitions.py <base> <file1.part> [ <file2.part> ... ]
 
-Grouped sequences will be <base>.groupN.fa files.
+Grouped sequences will be <base>.groupN.fa files, each holding at most
+--max-size sequences (unless a single partition is bigger than that).
 
 Use '-h' for parameter help.
 
@@ -13,21 +14,12 @@ by output_unassigned...
 """
 
 import sys
-import os.path
-import screed
 import argparse
+import khmer
 
 DEFAULT_MAX_SIZE=int(1e6)
 DEFAULT_THRESHOLD=5
 
-def read_partition_file(filename):
-    for n, record in enumerate(screed.open(filename, parse_description=False)):
-        name = record.name
-        name, partition_id = name.rsplit('\t', 1)
-        yield n, name, int(partition_id), record.sequence
-
-###
-
 def main():
     parser = argparse.ArgumentParser(description="Extract partitioned seqs.")
 
@@ -45,6 +37,9 @@ def main():
     parser.add_argument('--output-unassigned', '-U', dest='output_unass',
                         default=False, action='store_true',
                         help='Output unassigned sequences, too')
+    parser.add_argument('--gzip', '-z', dest='gzip',
+                        default=False, action='store_true',
+                        help='gzip the output files')
 
     args = parser.parse_args()
 
@@ -67,111 +62,25 @@ def main():
 
     if output_unassigned:
         print 'outputting unassigned reads to "%s.unassigned.fa"' % prefix
+    if args.gzip:
+        print '(gzipped, with ".gz" on the end)'
 
     print 'partition size distribution will go to %s' % distfilename
     print '---'
 
     ###
 
-    if output_unassigned:
-        unassigned_fp = open('%s.unassigned.fa' % prefix, 'w')
-
-    count = {}
-    for filename in args.part_filenames:
-        for n, name, pid, seq in read_partition_file(filename):
-            if n % 100000 == 0:
-                print '...', n
-
-            count[pid] = count.get(pid, 0) + 1
-
-            if pid == 0 and output_unassigned:
-                print >>unassigned_fp, '>%s\n%s' % (name, seq)
-
-    if output_unassigned:
-        unassigned_fp.close()
-
-    if 0 in count:                          # eliminate unpartitioned sequences
-       del count[0]
-
-    # develop histogram of partition sizes
-    dist = {}
-    for pid, size in count.items():
-        dist[size] = dist.get(size, 0) + 1
-
-    # output histogram
-    distfp = open(distfilename, 'w')
-
-    total = 0
-    wtotal = 0
-    for c, n in sorted(dist.items()):
-        total += n
-        wtotal += c*n
-        distfp.write('%d %d %d %d\n' % (c, n, total, wtotal))
-    distfp.close()
+    n_groups = khmer.extract_partitions(prefix, args.part_filenames,
+                                        MAX_SIZE, THRESHOLD, output_groups,
+                                        output_unassigned, args.gzip)
 
     if not output_groups:
         sys.exit(0)
 
-    # sort groups by size
-    divvy = sorted(count.items(), key=lambda y:y[1])
-    divvy = filter(lambda y:y[1] > THRESHOLD, divvy)
-
-    ## divvy up into different groups, based on having MAX_SIZE sequences
-    ## in each group.
-    total = 0
-    group = set()
-    group_n = 0
-    group_d = {}
-    for partition_id, n_reads in divvy:
-        group.add(partition_id)
-        total += n_reads
-
-        if total > MAX_SIZE:
-            for partition_id in group:
-                group_d[partition_id] = group_n
-                #print 'group_d', partition_id, group_n
-
-            group_n += 1
-            group = set()
-            total = 0
-
-    if group:
-        for partition_id in group:
-            group_d[partition_id] = group_n
-            #print 'group_d', partition_id, group_n
-        group_n += 1
-
-
-    print '%d groups' % group_n
-    if group_n == 0:
+    print '%d groups' % n_groups
+    if n_groups == 0:
         print 'nothing to output; exiting!'
         return
 
-    ## open a bunch of output files for the different groups
-    group_fps = {}
-    for n in range(group_n):
-        fp = open('%s.group%04d.fa' % (prefix, n), 'w')
-        group_fps[n] = fp
-
-    ## write 'em all out!
-
-    for filename in args.part_filenames:
-        for n, name, partition_id, seq in read_partition_file(filename):
-            if n % 100000 == 0:
-                print '...x2', n
-
-            if partition_id == 0:
-                continue
-
-            try:
-                group_n = group_d[partition_id]
-            except KeyError:
-                assert count[partition_id] <= THRESHOLD
-                continue
-
-            outfp = group_fps[group_n]
-
-            outfp.write('>%s\t%s\n%s\n' % (name, partition_id, seq))
-
 if __name__ == '__main__':
     main()
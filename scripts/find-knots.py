@@ -16,6 +16,7 @@ import khmer
 # counting hash parameters.
 DEFAULT_COUNTING_HT_SIZE=3e6                # number of bytes
 DEFAULT_COUNTING_HT_N=4                     # number of counting hash tables
+DEFAULT_N_THREADS=1
 
 # Lump removal parameters.  Probably shouldn't be changed, but who knows?
 #
@@ -44,6 +45,9 @@ def main():
     parser.add_argument('--hashsize', '-x', type=float, dest='min_hashsize',
                         default=DEFAULT_COUNTING_HT_SIZE,
                         help='lower bound on counting hashsize to use')
+    parser.add_argument('--threads', '-T', dest='n_threads', type=int,
+                        default=DEFAULT_N_THREADS,
+                        help='Number of threads to traverse from tags with')
     parser.add_argument('graphbase')
 
     args = parser.parse_args()
@@ -85,7 +89,8 @@ def main():
         ht.repartition_largest_partition(subset, counting,
                                          EXCURSION_DISTANCE,
                                          EXCURSION_KMER_THRESHOLD,
-                                         EXCURSION_KMER_COUNT_THRESHOLD)
+                                         EXCURSION_KMER_COUNT_THRESHOLD,
+                                         args.n_threads)
 
         print '** merging subset... %s' % subset_file
         ht.merge_subset(subset)
@@ -94,12 +99,13 @@ def main():
         size = ht.repartition_largest_partition(None, counting,
                                                 EXCURSION_DISTANCE,
                                                 EXCURSION_KMER_THRESHOLD,
-                                                EXCURSION_KMER_COUNT_THRESHOLD)
+                                                EXCURSION_KMER_COUNT_THRESHOLD,
+                                                args.n_threads)
 
         print '** repartitioned size:', size
 
         print 'saving stoptags binary'
-        ht.save_stop_tags(graphbase + '.stoptags')
+        ht.save_stop_tags(graphbase + '.stoptags', True)
         os.rename(subset_file, subset_file + '.processed')
         print '(%d of %d)\n' % (n, len(pmap_files))
 
@@ -22,21 +22,37 @@ def main():
     parser.add_argument('--no-build-tagset', '-n', default=False,
                         action='store_true', dest='no_build_tagset',
                         help='Do NOT construct tagset while loading sequences')
+    parser.add_argument('--threads', '-T', type=int, default=1,
+                        dest='n_threads',
+                        help='number of threads to load & tag with')
+    parser.add_argument('--partition', '-P', default=False,
+                        action='store_true', dest='partition',
+                        help='Partition while loading (on one thread), then '
+                        'finish on -T threads; saves <htname>.pmap.merged')
     parser.add_argument('output_filename')
     parser.add_argument('input_filenames', nargs='+')
 
     args = parser.parse_args()
 
+    if args.partition and args.no_build_tagset:
+        print>>sys.stderr, "** ERROR: can't partition without the tagset (-n)"
+        sys.exit(-1)
+
     if not args.quiet:
-        if args.min_hashsize == DEFAULT_MIN_HASHSIZE:
+        if args.min_hashsize == DEFAULT_MIN_HASHSIZE and \
+               not args.max_memory_usage:
             print>>sys.stderr, "** WARNING: hashsize is default!  You absodefly want to increase this!\n** Please read the docs!"
 
         print>>sys.stderr, '\nPARAMETERS:'
         print>>sys.stderr, ' - kmer size =    %d \t\t(-k)' % args.ksize
         print>>sys.stderr, ' - n hashes =     %d \t\t(-N)' % args.n_hashes
         print>>sys.stderr, ' - min hashsize = %-5.2g \t(-x)' % args.min_hashsize
+        print>>sys.stderr, ' - n threads =    %d \t\t(-T)' % args.n_threads
+        if args.max_memory_usage:
+            print>>sys.stderr, ' - max memory =   %-5.2g \t(-M; overrides -N/-x)' % args.max_memory_usage
         print>>sys.stderr, ''
-        print>>sys.stderr, 'Estimated memory usage is %.2g bytes (n_hashes x min_hashsize / 8)' % (args.n_hashes * args.min_hashsize / 8.)
+        if not args.max_memory_usage:
+            print>>sys.stderr, 'Estimated memory usage is %.2g bytes (n_hashes x min_hashsize / 8)' % (args.n_hashes * args.min_hashsize / 8.)
         print>>sys.stderr, '-'*8
 
     K=args.ksize
@@ -52,25 +68,43 @@ def main():
         print 'We WILL NOT build the tagset.'
     else:
         print 'We WILL build the tagset (for partitioning/traversal).'
+    if args.partition:
+        print 'We WILL partition while loading.'
 
     ###
     
+    if args.max_memory_usage:
+        print 'estimating number of distinct k-mers'
+        HT_SIZE = khmer.estimate_kmer_cardinality(K, filenames)
+        print '%d distinct k-mers (estimated)' % HT_SIZE.estimate_cardinality()
+
     print 'making hashtable'
-    ht = khmer.new_hashbits(K, HT_SIZE, N_HT)
+    ht = khmer.new_hashbits(K, HT_SIZE, N_HT,
+                            max_memory=args.max_memory_usage)
+    print 'using %d tables: %s' % (len(ht.hashsizes()), ht.hashsizes())
 
     for n, filename in enumerate(filenames):
        print 'consuming input', filename
        if args.no_build_tagset:
            ht.consume_fasta(filename)
+       elif args.partition:
+           ht.consume_fasta_and_partition(filename)
        else:
-           ht.consume_fasta_and_tag(filename)
+           ht.consume_fasta_and_tag(filename, None, args.n_threads)
 
     print 'saving hashtable in', base + '.ht'
     ht.save(base + '.ht')
 
     if not args.no_build_tagset:
         print 'saving tagset in', base + '.tagset'
-        ht.save_tagset(base + '.tagset')
+        ht.save_tagset(base + '.tagset', True)
+
+    if args.partition:
+        n_todo = ht.refine_streaming_partition(args.n_threads)
+        print 'finished partitioning from %d of %d tags' % (n_todo,
+                                                             ht.n_tags())
+        print 'saving partition map in', base + '.pmap.merged'
+        ht.save_partitionmap(base + '.pmap.merged', True)
 
     info_fp = open(base + '.info', 'w')
     info_fp.write('%d unique k-mers' % ht.n_unique_kmers())
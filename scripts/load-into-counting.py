@@ -23,15 +23,19 @@ def main():
     args = parser.parse_args()
 
     if not args.quiet:
-        if args.min_hashsize == DEFAULT_MIN_HASHSIZE:
+        if args.min_hashsize == DEFAULT_MIN_HASHSIZE and \
+               not args.max_memory_usage:
             print>>sys.stderr, "** WARNING: hashsize is default!  You absodefly want to increase this!\n** Please read the docs!"
 
         print>>sys.stderr, '\nPARAMETERS:'
         print>>sys.stderr, ' - kmer size =    %d \t\t(-k)' % args.ksize
         print>>sys.stderr, ' - n hashes =     %d \t\t(-N)' % args.n_hashes
         print>>sys.stderr, ' - min hashsize = %-5.2g \t(-x)' % args.min_hashsize
+        if args.max_memory_usage:
+            print>>sys.stderr, ' - max memory =   %-5.2g \t(-M; overrides -N/-x)' % args.max_memory_usage
         print>>sys.stderr, ''
-        print>>sys.stderr, 'Estimated memory usage is %.2g bytes (n_hashes x min_hashsize)' % (args.n_hashes * args.min_hashsize)
+        if not args.max_memory_usage:
+            print>>sys.stderr, 'Estimated memory usage is %.2g bytes (n_hashes x min_hashsize)' % (args.n_hashes * args.min_hashsize)
         print>>sys.stderr, '-'*8
 
 
@@ -47,8 +51,14 @@ def main():
 
     ###
     
+    if args.max_memory_usage:
+        print 'estimating number of distinct k-mers'
+        HT_SIZE = khmer.estimate_kmer_cardinality(K, filenames)
+        print '%d distinct k-mers (estimated)' % HT_SIZE.estimate_cardinality()
+
     print 'making hashtable'
-    ht = khmer.new_counting_hash(K, HT_SIZE, N_HT)
+    ht = khmer.new_counting_hash(K, HT_SIZE, N_HT,
+                                 max_memory=args.max_memory_usage)
     ht.set_use_bigcount(True)
 
     for n, filename in enumerate(filenames):
@@ -13,6 +13,7 @@ import khmer
 DEFAULT_SUBSET_SIZE=int(1e4)
 DEFAULT_COUNTING_HT_SIZE=3e6                # number of bytes
 DEFAULT_COUNTING_HT_N=4                     # number of counting hash tables
+DEFAULT_N_THREADS=1
 
 # Lump removal parameters.  Probably shouldn't be changed, but who knows?
 #
@@ -40,6 +41,9 @@ def main():
     parser.add_argument('--hashsize', '-x', type=float, dest='min_hashsize',
                         default=DEFAULT_COUNTING_HT_SIZE,
                         help='lower bound on counting hashsize to use')
+    parser.add_argument('--threads', '-T', dest='n_threads', type=int,
+                        default=DEFAULT_N_THREADS,
+                        help='Number of threads to traverse from tags with')
     parser.add_argument('--subset-size', '-s', default=DEFAULT_SUBSET_SIZE,
                         dest='subset_size', type=float,
                         help='Set subset size (default 1e4 is prob ok)')
@@ -83,10 +87,11 @@ def main():
     ht.repartition_largest_partition(subset, counting,
                                      EXCURSION_DISTANCE,
                                      EXCURSION_KMER_THRESHOLD,
-                                     EXCURSION_KMER_COUNT_THRESHOLD)
+                                     EXCURSION_KMER_COUNT_THRESHOLD,
+                                     args.n_threads)
 
     print 'saving stop tags'
-    ht.save_stop_tags(graphbase + '.stoptags')
+    ht.save_stop_tags(graphbase + '.stoptags', True)
 
 if __name__ == '__main__':
     main()
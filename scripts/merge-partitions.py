@@ -5,7 +5,8 @@ Merge multiple pmap files into a single one.
 % python scripts/merge-partitions.py <base>
 
 Load <base>.subset.*.pmap and merge into a single pmap file.  Final
-merged pmap file will be in <base>.pmap.merged.
+merged pmap file will be in <base>.pmap.merged, packed unless --unpacked
+is given.
 """
 
 import sys
@@ -25,6 +26,9 @@ def main():
     parser.add_argument('--keep-subsets', dest='remove_subsets',
                         default=True, action='store_false',
                         help='Keep individual subsets (default: False)')
+    parser.add_argument('--unpacked', dest='packed', default=True,
+                        action='store_false',
+                        help='Write the old, unpacked pmap format')
     parser.add_argument('graphbase')
     args = parser.parse_args()
 
@@ -37,12 +41,10 @@ def main():
     K = args.ksize
     ht = khmer.new_hashbits(K, 1, 1)
 
-    for pmap_file in pmap_files:
-        print 'merging', pmap_file
-        ht.merge_subset_from_disk(pmap_file)
-
-    print 'saving merged to', output_file
-    ht.save_partitionmap(output_file)
+    # the subsets are read side by side in tag order, so only their
+    # partitions are held in memory, not their tags.
+    print 'merging into', output_file
+    ht.merge_partitionmap_files(pmap_files, output_file, args.packed)
 
     if args.remove_subsets:
         print 'removing pmap files'
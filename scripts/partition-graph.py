@@ -4,7 +4,8 @@ Partition a graph.
 
 % python scripts/partition-graph.py <base>
 
-This will output many <base>.subset.N.pmap files.
+This will output many <base>.subset.N.pmap files; or, with --merged,
+partition on all the threads at once and output <base>.pmap.merged.
 
 Use '-h' for parameter help.
 """
@@ -65,6 +66,16 @@ def main():
                         default=DEFAULT_N_THREADS,
                         help='Number of simultaneous threads to execute')
 
+    parser.add_argument('--merged', dest='merged', action='store_true',
+                        default=False,
+                        help='Partition in one pass on all threads and write '
+                        '<base>.pmap.merged directly, with no subsets')
+
+    parser.add_argument('--adjacency-cache', dest='adjacency_cache',
+                        default=0, type=float,
+                        help='Cache k-mer neighbors in this many bytes '
+                        '(e.g. 1e9); off by default')
+
     args = parser.parse_args()
     basename = args.basename
 
@@ -87,6 +98,10 @@ def main():
         print 'loading stoptags from', args.stoptags
         ht.load_stop_tags(args.stoptags)
 
+    if args.adjacency_cache:
+        print 'caching neighbors in %d bytes' % args.adjacency_cache
+        ht.enable_adjacency_cache(int(args.adjacency_cache))
+
     # do we want to exhaustively traverse the graph?
     stop_big_traversals = args.no_big_traverse
     if stop_big_traversals:
@@ -98,6 +113,16 @@ def main():
     # now, partition!
     #
 
+    if args.merged:
+        output_file = basename + '.pmap.merged'
+        print 'partitioning on %d threads' % int(args.n_threads)
+        ht.do_parallel_partition(int(args.n_threads), True,
+                                 stop_big_traversals)
+
+        print 'saving merged to', output_file
+        ht.save_partitionmap(output_file, True)
+        return
+
     # divide the tags up into subsets
     divvy = ht.divide_tags_into_subsets(int(args.subset_size))
     n_subsets = len(divvy)
@@ -137,6 +162,10 @@ def main():
         t.join()
 
     print '---'
+    if args.adjacency_cache:
+        n_slots, n_lookups, n_hits, rate = ht.adjacency_cache_stats()
+        print 'neighbor cache: %d lookups, %.1f%% hits' % (n_lookups,
+                                                          rate * 100)
     print 'done making subsets! see %s.subset.*.pmap' % (basename,)
 
 if __name__ == '__main__':
@@ -0,0 +1,83 @@
+#! /usr/bin/env python
+"""
+Add new sequences to a graph that has already been partitioned.
+
+% python scripts/update-graph.py <base> <data1> [ <data2> <...> ]
+
+Load <base>.ht, <base>.tagset and <base>.pmap.merged (from load-graph.py
+-P, or merge-partitions.py), consume the new reads into them, and bring
+the partition map up to date by searching only from the tags on reads
+that touched the graph.  The graph, tagset and merged pmap are saved back
+under <base>.
+
+Use '-h' for parameter help.
+"""
+
+import sys
+import argparse
+import os.path
+
+import khmer
+
+def main():
+    parser = argparse.ArgumentParser(description=
+                                     'Add reads to a partitioned graph.')
+
+    parser.add_argument('--threads', '-T', type=int, default=1,
+                        dest='n_threads',
+                        help='number of threads to partition with')
+    parser.add_argument('graphbase')
+    parser.add_argument('input_filenames', nargs='+')
+
+    args = parser.parse_args()
+
+    base = args.graphbase
+    filenames = args.input_filenames
+
+    for suffix in ('.ht', '.tagset', '.pmap.merged'):
+        if not os.path.exists(base + suffix):
+            print >>sys.stderr, "** ERROR: no %s; build it with " \
+                  "load-graph.py -P" % (base + suffix)
+            sys.exit(-1)
+
+    print 'loading hashtable from', base + '.ht'
+    ht = khmer.load_hashbits(base + '.ht')
+    print 'loading tagset from', base + '.tagset'
+    ht.load_tagset(base + '.tagset')
+    print 'loading partition map from', base + '.pmap.merged'
+    ht.load_partitionmap(base + '.pmap.merged', args.n_threads)
+
+    n_tags = ht.n_tags()
+
+    for filename in filenames:
+        print 'consuming input', filename
+        ht.consume_fasta_and_partition(filename)
+
+    print '%d new tags' % (ht.n_tags() - n_tags)
+
+    n_todo = ht.refine_streaming_partition(args.n_threads)
+    print 'partitioned from %d tags' % n_todo
+
+    # don't overwrite a good graph with one that is too full to use.
+    fp_rate = khmer.calc_expected_collisions(ht)
+    print 'fp rate estimated to be %1.3f' % fp_rate
+    if fp_rate > 0.15:          # 0.18 is ACTUAL MAX. Do not change.
+        print >>sys.stderr, "**"
+        print >>sys.stderr, "** ERROR: the graph structure is too small for"
+        print >>sys.stderr, "** this data set; not saving.  Rebuild it with"
+        print >>sys.stderr, "** a larger hashsize/num ht."
+        print >>sys.stderr, "**"
+        sys.exit(-1)
+
+    print 'saving hashtable in', base + '.ht'
+    ht.save(base + '.ht')
+    print 'saving tagset in', base + '.tagset'
+    ht.save_tagset(base + '.tagset', True)
+    print 'saving partition map in', base + '.pmap.merged'
+    ht.save_partitionmap(base + '.pmap.merged', True)
+
+    info_fp = open(base + '.info', 'w')
+    info_fp.write('%d unique k-mers' % ht.n_unique_kmers())
+
+if __name__ == '__main__':
+    main()